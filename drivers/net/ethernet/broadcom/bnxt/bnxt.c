@@ -2283,6 +2283,8 @@ static int bnxt_alloc_rx_rings(struct bnxt *bp)
 		if (rc)
 			return rc;
 
+		xdp_rxq_info_init(&rxr->xdp_rxq, bp->dev, i);
+
 		if (agg_rings) {
 			u16 mem_size;
 
@@ -29,6 +29,7 @@
 
 #include <net/tcp.h>
 #include <net/udp.h>
+#include <net/xdp.h>
 #include <linux/types.h>
 #include <linux/errno.h>
 #include <linux/module.h>
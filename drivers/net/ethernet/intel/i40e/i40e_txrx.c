@@ -1284,6 +1284,8 @@ int i40e_setup_rx_descriptors(struct i40e_ring *rx_ring)
 	rx_ring->next_to_use = 0;
 
 	rx_ring->xdp_prog = rx_ring->vsi->xdp_prog;
+	xdp_rxq_info_init(&rx_ring->xdp_rxq, rx_ring->netdev,
+			  rx_ring->queue_index);
 
 	return 0;
 err:
@@ -2120,6 +2122,7 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 			xdp.data_hard_start = xdp.data -
 					      i40e_rx_offset(rx_ring);
 			xdp.data_end = xdp.data + size;
+			xdp.rxq = &rx_ring->xdp_rxq;
 
 			skb = i40e_run_xdp(rx_ring, &xdp);
 		}
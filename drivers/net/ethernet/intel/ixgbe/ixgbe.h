@@ -54,6 +54,7 @@
 #endif
 
 #include <net/busy_poll.h>
+#include <net/xdp.h>
 
 /* common prefix used by pr_<> macros */
 #undef pr_fmt
@@ -370,6 +371,7 @@ struct ixgbe_ring {
 		struct ixgbe_tx_queue_stats tx_stats;
 		struct ixgbe_rx_queue_stats rx_stats;
 	};
+	struct xdp_rxq_info xdp_rxq;
 } ____cacheline_internodealigned_in_smp;
 
 enum ixgbe_ring_f_enum {
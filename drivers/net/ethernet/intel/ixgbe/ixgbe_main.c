@@ -2338,6 +2338,7 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 			xdp.data_hard_start = xdp.data -
 					      ixgbe_rx_offset(rx_ring);
 			xdp.data_end = xdp.data + size;
+			xdp.rxq = &rx_ring->xdp_rxq;
 
 			skb = ixgbe_run_xdp(adapter, rx_ring, &xdp);
 		}
@@ -6330,6 +6331,8 @@ int ixgbe_setup_rx_resources(struct ixgbe_adapter *adapter,
 	rx_ring->next_to_use = 0;
 
 	rx_ring->xdp_prog = adapter->xdp_prog;
+	xdp_rxq_info_init(&rx_ring->xdp_rxq, rx_ring->netdev,
+			  rx_ring->queue_index);
 
 	return 0;
 err:
@@ -263,7 +263,7 @@ void mlx4_en_set_num_rx_rings(struct mlx4_en_dev *mdev)
 
 int mlx4_en_create_rx_ring(struct mlx4_en_priv *priv,
 			   struct mlx4_en_rx_ring **pring,
-			   u32 size, u16 stride, int node)
+			   u32 size, u16 stride, int node, int queue_index)
 {
 	struct mlx4_en_dev *mdev = priv->mdev;
 	struct mlx4_en_rx_ring *ring;
@@ -279,6 +279,8 @@ int mlx4_en_create_rx_ring(struct mlx4_en_priv *priv,
 		}
 	}
 
+	xdp_rxq_info_init(&ring->xdp_rxq, priv->dev, queue_index);
+
 	ring->prod = 0;
 	ring->cons = 0;
 	ring->size = size;
@@ -767,6 +769,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 			xdp.data_hard_start = va - frags[0].page_offset;
 			xdp.data = va;
 			xdp.data_end = xdp.data + length;
+			xdp.rxq = &ring->xdp_rxq;
 			orig_data = xdp.data;
 
 			act = bpf_prog_run_xdp(xdp_prog, &xdp);
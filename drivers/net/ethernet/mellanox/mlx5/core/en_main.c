@@ -581,6 +581,7 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 	rq->tstamp  = c->tstamp;
 	rq->channel = c;
 	rq->ix      = c->ix;
+	xdp_rxq_info_init(&rq->xdp_rxq, rq->netdev, rq->ix);
 	rq->mdev    = mdev;
 
 	rq->xdp_prog = params->xdp_prog ? bpf_prog_inc(params->xdp_prog) : NULL;
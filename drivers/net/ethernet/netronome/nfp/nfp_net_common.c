@@ -554,6 +554,8 @@ nfp_net_rx_ring_init(struct nfp_net_rx_ring *rx_ring,
 
 	rx_ring->fl_qcidx = rx_ring->idx * nn->stride_rx;
 	rx_ring->qcp_fl = nn->rx_bar + NFP_QCP_QUEUE_OFF(rx_ring->fl_qcidx);
+
+	xdp_rxq_info_init(&rx_ring->xdp_rxq, nn->dp.netdev, idx);
 }
 
 /**
@@ -1606,7 +1608,8 @@ nfp_net_tx_xdp_buf(struct nfp_net_dp *dp, struct nfp_net_rx_ring *rx_ring,
 }
 
 static int nfp_net_run_xdp(struct bpf_prog *prog, void *data, void *hard_start,
-			   unsigned int *off, unsigned int *len)
+			   unsigned int *off, unsigned int *len,
+			   struct xdp_rxq_info *rxq)
 {
 	struct xdp_buff xdp;
 	void *orig_data;
@@ -1615,6 +1618,7 @@ static int nfp_net_run_xdp(struct bpf_prog *prog, void *data, void *hard_start,
 	xdp.data_hard_start = hard_start;
 	xdp.data = data + *off;
 	xdp.data_end = data + *off + *len;
+	xdp.rxq = rxq;
 
 	orig_data = xdp.data;
 	ret = bpf_prog_run_xdp(prog, &xdp);
@@ -1745,7 +1749,8 @@ static int nfp_net_rx(struct nfp_net_rx_ring *rx_ring, int budget)
 			hard_start = rxbuf->frag + NFP_NET_RX_BUF_HEADROOM;
 
 			act = nfp_net_run_xdp(xdp_prog, rxbuf->frag, hard_start,
-					      &pkt_off, &pkt_len);
+					      &pkt_off, &pkt_len,
+					      &rx_ring->xdp_rxq);
 			switch (act) {
 			case XDP_PASS:
 				break;
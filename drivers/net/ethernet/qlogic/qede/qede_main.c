@@ -1502,6 +1502,8 @@ static void qede_init_fp(struct qede_dev *edev)
 			else
 				fp->rxq->data_direction = DMA_FROM_DEVICE;
 			fp->rxq->dev = &edev->pdev->dev;
+			xdp_rxq_info_init(&fp->rxq->xdp_rxq, edev->ndev,
+					  fp->rxq->rxq_id);
 		}
 
 		if (fp->type & QEDE_FASTPATH_TX) {
@@ -121,7 +121,7 @@ do {								\
 #define TUN_VNET_BE     0x40000000
 
 #define TUN_FEATURES (IFF_NO_PI | IFF_ONE_QUEUE | IFF_VNET_HDR | \
-		      IFF_MULTI_QUEUE)
+		      IFF_MULTI_QUEUE | IFF_NAPI | IFF_BATCH)
 #define GOODCOPY_LEN 128
 
 #define FLT_EXACT_COUNT 8
@@ -175,6 +175,9 @@ struct tun_file {
 	struct list_head next;
 	struct tun_struct *detached;
 	struct skb_array tx_array;
+	struct xdp_rxq_info xdp_rxq;
+	struct napi_struct napi;
+	bool napi_enabled;
 };
 
 struct tun_flow_entry {
@@ -523,6 +526,74 @@ static struct tun_struct *tun_enable_queue(struct tun_file *tfile)
 	return tun;
 }
 
+/* In NAPI mode, tun_get_user() queues packets on sk_write_queue and the
+ * poll routine feeds them to GRO.
+ */
+static int tun_napi_receive(struct napi_struct *napi, int budget)
+{
+	struct tun_file *tfile = container_of(napi, struct tun_file, napi);
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	struct sk_buff *skb;
+	int received = 0;
+
+	__skb_queue_head_init(&process_queue);
+
+	spin_lock(&queue->lock);
+	skb_queue_splice_tail_init(queue, &process_queue);
+	spin_unlock(&queue->lock);
+
+	while (received < budget && (skb = __skb_dequeue(&process_queue))) {
+		napi_gro_receive(napi, skb);
+		++received;
+	}
+
+	if (!skb_queue_empty(&process_queue)) {
+		spin_lock(&queue->lock);
+		skb_queue_splice(&process_queue, queue);
+		spin_unlock(&queue->lock);
+	}
+
+	return received;
+}
+
+static int tun_napi_poll(struct napi_struct *napi, int budget)
+{
+	unsigned int received;
+
+	received = tun_napi_receive(napi, budget);
+
+	if (received < budget)
+		napi_complete_done(napi, received);
+
+	return received;
+}
+
+static void tun_napi_init(struct tun_struct *tun, struct tun_file *tfile,
+			  bool napi_en)
+{
+	tfile->napi_enabled = napi_en;
+	if (napi_en) {
+		netif_napi_add(tun->dev, &tfile->napi, tun_napi_poll,
+			       NAPI_POLL_WEIGHT);
+		napi_enable(&tfile->napi);
+	}
+}
+
+static void tun_napi_disable(struct tun_file *tfile)
+{
+	if (tfile->napi_enabled)
+		napi_disable(&tfile->napi);
+}
+
+static void tun_napi_del(struct tun_file *tfile)
+{
+	if (tfile->napi_enabled) {
+		netif_napi_del(&tfile->napi);
+		tfile->napi_enabled = false;
+	}
+}
+
 static void tun_queue_purge(struct tun_file *tfile)
 {
 	struct sk_buff *skb;
@@ -541,6 +612,11 @@ static void __tun_detach(struct tun_file *tfile, bool clean)
 
 	tun = rtnl_dereference(tfile->tun);
 
+	if (tun && clean) {
+		tun_napi_disable(tfile);
+		tun_napi_del(tfile);
+	}
+
 	if (tun && !tfile->detached) {
 		u16 index = tfile->queue_index;
 		BUG_ON(index >= tun->numqueues);
@@ -549,6 +625,7 @@ static void __tun_detach(struct tun_file *tfile, bool clean)
 				   tun->tfiles[tun->numqueues - 1]);
 		ntfile = rtnl_dereference(tun->tfiles[index]);
 		ntfile->queue_index = index;
+		ntfile->xdp_rxq.queue_index = index;
 
 		--tun->numqueues;
 		if (clean) {
@@ -597,12 +674,14 @@ static void tun_detach_all(struct net_device *dev)
 	for (i = 0; i < n; i++) {
 		tfile = rtnl_dereference(tun->tfiles[i]);
 		BUG_ON(!tfile);
+		tun_napi_disable(tfile);
 		tfile->socket.sk->sk_shutdown = RCV_SHUTDOWN;
 		tfile->socket.sk->sk_data_ready(tfile->socket.sk);
 		RCU_INIT_POINTER(tfile->tun, NULL);
 		--tun->numqueues;
 	}
 	list_for_each_entry(tfile, &tun->disabled, next) {
+		tun_napi_disable(tfile);
 		tfile->socket.sk->sk_shutdown = RCV_SHUTDOWN;
 		tfile->socket.sk->sk_data_ready(tfile->socket.sk);
 		RCU_INIT_POINTER(tfile->tun, NULL);
@@ -612,12 +691,14 @@ static void tun_detach_all(struct net_device *dev)
 	synchronize_net();
 	for (i = 0; i < n; i++) {
 		tfile = rtnl_dereference(tun->tfiles[i]);
+		tun_napi_del(tfile);
 		/* Drop read queue */
 		tun_queue_purge(tfile);
 		sock_put(&tfile->sk);
 	}
 	list_for_each_entry_safe(tfile, tmp, &tun->disabled, next) {
 		tun_enable_queue(tfile);
+		tun_napi_del(tfile);
 		tun_queue_purge(tfile);
 		sock_put(&tfile->sk);
 	}
@@ -630,7 +711,8 @@ static void tun_detach_all(struct net_device *dev)
 		module_put(THIS_MODULE);
 }
 
-static int tun_attach(struct tun_struct *tun, struct file *file, bool skip_filter)
+static int tun_attach(struct tun_struct *tun, struct file *file,
+		      bool skip_filter, bool napi)
 {
 	struct tun_file *tfile = file->private_data;
 	struct net_device *dev = tun->dev;
@@ -671,15 +753,18 @@ static int tun_attach(struct tun_struct *tun, struct file *file, bool skip_filte
 	}
 
 	tfile->queue_index = tun->numqueues;
+	xdp_rxq_info_init(&tfile->xdp_rxq, tun->dev, tfile->queue_index);
 	tfile->socket.sk->sk_shutdown &= ~RCV_SHUTDOWN;
 	rcu_assign_pointer(tfile->tun, tun);
 	rcu_assign_pointer(tun->tfiles[tun->numqueues], tfile);
 	tun->numqueues++;
 
-	if (tfile->detached)
+	if (tfile->detached) {
 		tun_enable_queue(tfile);
-	else
+	} else {
 		sock_hold(&tfile->sk);
+		tun_napi_init(tun, tfile, napi);
+	}
 
 	tun_set_real_num_queues(tun);
 
@@ -1320,6 +1405,7 @@ static struct sk_buff *tun_build_skb(struct tun_struct *tun,
 		xdp.data_hard_start = buf;
 		xdp.data = buf + pad;
 		xdp.data_end = xdp.data + len;
+		xdp.rxq = &tfile->xdp_rxq;
 		orig_data = xdp.data;
 		act = bpf_prog_run_xdp(xdp_prog, &xdp);
 
@@ -1385,22 +1471,264 @@ static struct sk_buff *tun_build_skb(struct tun_struct *tun,
 	return NULL;
 }
 
+/* Hand a packet written by userspace to the stack, through NAPI when the
+ * queue was attached with IFF_NAPI, and account for it.
+ */
+static void tun_rx_deliver(struct tun_struct *tun, struct tun_file *tfile,
+			   struct sk_buff *skb, size_t len, bool more)
+{
+	struct tun_pcpu_stats *stats;
+	u32 rxhash;
+
+	rxhash = __skb_get_hash_symmetric(skb);
+	if (tfile->napi_enabled) {
+		struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+		int queue_len;
+
+		spin_lock_bh(&queue->lock);
+		__skb_queue_tail(queue, skb);
+		queue_len = skb_queue_len(queue);
+		spin_unlock(&queue->lock);
+
+		if (!more || queue_len > NAPI_POLL_WEIGHT)
+			napi_schedule(&tfile->napi);
+
+		local_bh_enable();
+	} else {
+#ifndef CONFIG_4KSTACKS
+		tun_rx_batched(tun, tfile, skb, more);
+#else
+		netif_rx_ni(skb);
+#endif
+	}
+
+	stats = get_cpu_ptr(tun->pcpu_stats);
+	u64_stats_update_begin(&stats->syncp);
+	stats->rx_packets++;
+	stats->rx_bytes += len;
+	u64_stats_update_end(&stats->syncp);
+	put_cpu_ptr(stats);
+
+	tun_flow_update(tun, rxhash, tfile);
+}
+
+/* Push out packets held back for a batch that ended early */
+static void tun_rx_flush(struct tun_struct *tun, struct tun_file *tfile)
+{
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	struct sk_buff *skb;
+
+	if (tfile->napi_enabled) {
+		local_bh_disable();
+		napi_schedule(&tfile->napi);
+		local_bh_enable();
+		return;
+	}
+
+	__skb_queue_head_init(&process_queue);
+	spin_lock(&queue->lock);
+	skb_queue_splice_tail_init(queue, &process_queue);
+	spin_unlock(&queue->lock);
+
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&process_queue))) {
+		skb_record_rx_queue(skb, tfile->queue_index);
+		netif_receive_skb(skb);
+	}
+	local_bh_enable();
+}
+
+#define TUN_XDP_BATCH 64
+
+/* Packets of an IFF_BATCH write copied out of userspace and waiting for
+ * the XDP program. Running the program over the whole batch lets us flush
+ * redirects once and send XDP_TX frames under a single queue lock.
+ */
+struct tun_xdp_batch {
+	int n;
+	struct {
+		struct xdp_buff xdp;
+		struct virtio_net_hdr gso;
+		struct sk_buff *skb;
+		unsigned int buflen;
+		int len;
+	} pkt[TUN_XDP_BATCH];
+};
+
+static void tun_xdp_tx_bulk(struct tun_struct *tun, struct tun_file *tfile,
+			    struct sk_buff_head *list,
+			    struct bpf_prog *xdp_prog)
+{
+	u16 queue_index = READ_ONCE(tfile->queue_index);
+	struct net_device *dev = tun->dev;
+	struct netdev_queue *txq;
+	struct sk_buff *skb;
+	int cpu, rc;
+
+	if (skb_queue_empty(list))
+		return;
+
+	/* Frames bounce back to the queue that wrote them */
+	txq = netdev_get_tx_queue(dev, queue_index);
+	cpu = smp_processor_id();
+	HARD_TX_LOCK(dev, txq, cpu);
+	while ((skb = __skb_dequeue(list))) {
+		skb_set_queue_mapping(skb, queue_index);
+		if (!netif_xmit_stopped(txq)) {
+			rc = netdev_start_xmit(skb, dev, txq,
+					       !skb_queue_empty(list));
+			if (dev_xmit_complete(rc))
+				continue;
+		}
+		trace_xdp_exception(dev, xdp_prog, XDP_TX);
+		kfree_skb(skb);
+	}
+	HARD_TX_UNLOCK(dev, txq);
+}
+
+static void tun_xdp_batch_run(struct tun_struct *tun, struct tun_file *tfile,
+			      struct tun_xdp_batch *batch, bool more)
+{
+	struct bpf_prog *xdp_prog;
+	struct sk_buff_head tx;
+	struct sk_buff *skb;
+	bool flush = false;
+	int i, last = -1;
+
+	__skb_queue_head_init(&tx);
+
+	local_bh_disable();
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(tun->xdp_prog);
+	for (i = 0; i < batch->n; i++) {
+		struct xdp_buff *xdp = &batch->pkt[i].xdp;
+		u32 act = XDP_PASS;
+
+		batch->pkt[i].skb = NULL;
+		if (xdp_prog)
+			act = bpf_prog_run_xdp(xdp_prog, xdp);
+
+		switch (act) {
+		case XDP_REDIRECT:
+			if (xdp_do_redirect(tun->dev, xdp, xdp_prog))
+				goto drop;
+			flush = true;
+			continue;
+		case XDP_TX:
+		case XDP_PASS:
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fall through */
+		case XDP_ABORTED:
+			trace_xdp_exception(tun->dev, xdp_prog, act);
+			/* fall through */
+		case XDP_DROP:
+			goto drop;
+		}
+
+		skb = build_skb(xdp->data_hard_start, batch->pkt[i].buflen);
+		if (!skb)
+			goto drop;
+		skb_reserve(skb, xdp->data - xdp->data_hard_start);
+		skb_put(skb, xdp->data_end - xdp->data);
+
+		if (act == XDP_TX) {
+			skb->dev = tun->dev;
+			__skb_queue_tail(&tx, skb);
+		} else {
+			batch->pkt[i].skb = skb;
+			last = i;
+		}
+		continue;
+drop:
+		put_page(virt_to_head_page(xdp->data_hard_start));
+		this_cpu_inc(tun->pcpu_stats->rx_dropped);
+	}
+	if (flush)
+		xdp_do_flush_map();
+	tun_xdp_tx_bulk(tun, tfile, &tx, xdp_prog);
+	rcu_read_unlock();
+	local_bh_enable();
+
+	for (i = 0; i <= last; i++) {
+		skb = batch->pkt[i].skb;
+		if (!skb)
+			continue;
+
+		if (virtio_net_hdr_to_skb(skb, &batch->pkt[i].gso,
+					  tun_is_little_endian(tun))) {
+			this_cpu_inc(tun->pcpu_stats->rx_frame_errors);
+			kfree_skb(skb);
+			continue;
+		}
+		skb->protocol = eth_type_trans(skb, tun->dev);
+		skb_reset_network_header(skb);
+		skb_probe_transport_header(skb, 0);
+
+		tun_rx_deliver(tun, tfile, skb, batch->pkt[i].len,
+			       more || i < last);
+	}
+	batch->n = 0;
+}
+
+/* Copy one packet of a batched write into the page frag, with the same
+ * layout tun_build_skb() uses, and queue it for tun_xdp_batch_run().
+ */
+static int tun_xdp_batch_add(struct tun_struct *tun, struct tun_file *tfile,
+			     struct tun_xdp_batch *batch, struct iov_iter *from,
+			     struct virtio_net_hdr *gso, int len)
+{
+	struct page_frag *alloc_frag = &current->task_frag;
+	int buflen = SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	int pad = TUN_RX_PAD + TUN_HEADROOM;
+	struct xdp_buff *xdp;
+	char *buf;
+
+	if (batch->n == TUN_XDP_BATCH)
+		tun_xdp_batch_run(tun, tfile, batch, true);
+
+	buflen += SKB_DATA_ALIGN(len + pad);
+	alloc_frag->offset = ALIGN((u64)alloc_frag->offset, SMP_CACHE_BYTES);
+	if (unlikely(!skb_page_frag_refill(buflen, alloc_frag, GFP_KERNEL)))
+		return -ENOMEM;
+
+	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
+	if (copy_page_from_iter(alloc_frag->page, alloc_frag->offset + pad,
+				len, from) != len)
+		return -EFAULT;
+	get_page(alloc_frag->page);
+	alloc_frag->offset += buflen;
+
+	xdp = &batch->pkt[batch->n].xdp;
+	xdp->data_hard_start = buf;
+	xdp->data = buf + pad;
+	xdp->data_end = xdp->data + len;
+	xdp->rxq = &tfile->xdp_rxq;
+	batch->pkt[batch->n].gso = *gso;
+	batch->pkt[batch->n].buflen = buflen;
+	batch->pkt[batch->n].len = len;
+	batch->n++;
+
+	return 0;
+}
+
 /* Get packet from user space buffer */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, struct iov_iter *from,
-			    int noblock, bool more)
+			    int noblock, bool more,
+			    struct tun_xdp_batch *batch)
 {
 	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
 	struct sk_buff *skb;
 	size_t total_len = iov_iter_count(from);
 	size_t len = total_len, align = tun->align, linear;
 	struct virtio_net_hdr gso = { 0 };
-	struct tun_pcpu_stats *stats;
 	int good_linear;
 	int copylen;
 	bool zerocopy = false;
 	int err;
-	u32 rxhash;
 	int skb_xdp = 1;
 
 	if (!(tun->dev->flags & IFF_UP))
@@ -1459,6 +1787,20 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			zerocopy = true;
 	}
 
+	if (batch && !gso.gso_type &&
+	    tun_can_build_skb(tun, tfile, len, noblock, zerocopy)) {
+		err = tun_xdp_batch_add(tun, tfile, batch, from, &gso, len);
+		if (err) {
+			this_cpu_inc(tun->pcpu_stats->rx_dropped);
+			return err;
+		}
+		return total_len;
+	}
+
+	/* Keep packets of a batch in order */
+	if (batch && batch->n)
+		tun_xdp_batch_run(tun, tfile, batch, true);
+
 	if (tun_can_build_skb(tun, tfile, len, noblock, zerocopy)) {
 		/* For the packet that is not easy to be processed
 		 * (e.g gso or jumbo packet), we will do it at after
@@ -1565,22 +1907,61 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 		local_bh_enable();
 	}
 
-	rxhash = __skb_get_hash_symmetric(skb);
-#ifndef CONFIG_4KSTACKS
-	tun_rx_batched(tun, tfile, skb, more);
-#else
-	netif_rx_ni(skb);
-#endif
+	tun_rx_deliver(tun, tfile, skb, len, more);
+	return total_len;
+}
 
-	stats = get_cpu_ptr(tun->pcpu_stats);
-	u64_stats_update_begin(&stats->syncp);
-	stats->rx_packets++;
-	stats->rx_bytes += len;
-	u64_stats_update_end(&stats->syncp);
-	put_cpu_ptr(stats);
+/* With IFF_BATCH a single write() carries several packets, each preceded
+ * by a struct tun_batch_hdr. All but the last packet are passed on with
+ * "more" set, so rx batching and NAPI are kicked once per write. Like
+ * sendmmsg(), the bytes of the packets accepted before an error are
+ * returned, or the error if the first packet failed.
+ */
+static ssize_t tun_get_user_batch(struct tun_struct *tun,
+				  struct tun_file *tfile,
+				  struct iov_iter *from, int noblock)
+{
+	struct tun_xdp_batch *batch = NULL;
+	ssize_t ret = 0, done = 0;
 
-	tun_flow_update(tun, rxhash, tfile);
-	return total_len;
+	if (rcu_access_pointer(tun->xdp_prog))
+		batch = kmalloc(sizeof(*batch), GFP_KERNEL);
+	if (batch)
+		batch->n = 0;
+
+	while (iov_iter_count(from)) {
+		struct tun_batch_hdr hdr;
+		size_t left;
+
+		if (!copy_from_iter_full(&hdr, sizeof(hdr), from)) {
+			ret = -EFAULT;
+			break;
+		}
+		left = iov_iter_count(from);
+		if (!hdr.len || hdr.len > left) {
+			ret = -EINVAL;
+			break;
+		}
+
+		iov_iter_truncate(from, hdr.len);
+		ret = tun_get_user(tun, tfile, NULL, from, noblock,
+				   left > hdr.len, batch);
+		iov_iter_advance(from, iov_iter_count(from));
+		iov_iter_reexpand(from, left - hdr.len);
+		if (ret < 0)
+			break;
+		done += sizeof(hdr) + hdr.len;
+	}
+
+	if (batch) {
+		if (batch->n)
+			tun_xdp_batch_run(tun, tfile, batch, false);
+		kfree(batch);
+	}
+	/* Earlier packets went out with "more" set */
+	if (ret < 0 && done)
+		tun_rx_flush(tun, tfile);
+	return done ? done : ret;
 }
 
 static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
@@ -1593,8 +1974,12 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from,
-			      file->f_flags & O_NONBLOCK, false);
+	if (tun->flags & IFF_BATCH)
+		result = tun_get_user_batch(tun, tfile, from,
+					    file->f_flags & O_NONBLOCK);
+	else
+		result = tun_get_user(tun, tfile, NULL, from,
+				      file->f_flags & O_NONBLOCK, false, NULL);
 
 	tun_put(tun);
 	return result;
@@ -1861,7 +2246,7 @@ static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 
 	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
 			   m->msg_flags & MSG_DONTWAIT,
-			   m->msg_flags & MSG_MORE);
+			   m->msg_flags & MSG_MORE, NULL);
 	tun_put(tun);
 	return ret;
 }
@@ -2012,7 +2397,8 @@ static int tun_set_iff(struct net *net, struct file *file, struct ifreq *ifr)
 		if (err < 0)
 			return err;
 
-		err = tun_attach(tun, file, ifr->ifr_flags & IFF_NOFILTER);
+		err = tun_attach(tun, file, ifr->ifr_flags & IFF_NOFILTER,
+				 ifr->ifr_flags & IFF_NAPI);
 		if (err < 0)
 			return err;
 
@@ -2101,7 +2487,7 @@ static int tun_set_iff(struct net *net, struct file *file, struct ifreq *ifr)
 				       NETIF_F_HW_VLAN_STAG_TX);
 
 		INIT_LIST_HEAD(&tun->disabled);
-		err = tun_attach(tun, file, false);
+		err = tun_attach(tun, file, false, ifr->ifr_flags & IFF_NAPI);
 		if (err < 0)
 			goto err_free_flow;
 
@@ -2253,7 +2639,7 @@ static int tun_set_queue(struct file *file, struct ifreq *ifr)
 		ret = security_tun_dev_attach_queue(tun->security);
 		if (ret < 0)
 			goto unlock;
-		ret = tun_attach(tun, file, false);
+		ret = tun_attach(tun, file, false, tun->flags & IFF_NAPI);
 	} else if (ifr->ifr_flags & IFF_DETACH_QUEUE) {
 		tun = rtnl_dereference(tfile->tun);
 		if (!tun || !(tun->flags & IFF_MULTI_QUEUE) || tfile->detached)
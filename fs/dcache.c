@@ -132,6 +132,13 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
+static DEFINE_PER_CPU(long, nr_dentry_negative);
+
+/*
+ * Number of unused negative dentries a superblock may keep before they
+ * are pruned in the background; 0 means no limit.
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
@@ -165,11 +172,21 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -324,6 +341,34 @@ void release_dentry_name_snapshot(struct name_snapshot *name)
 }
 EXPORT_SYMBOL(release_dentry_name_snapshot);
 
+/*
+ * Negative dentries are accounted while they sit on an LRU list (or on a
+ * shrink list), both globally and per superblock; the latter is what
+ * sysctl_negative_dentry_limit is checked against. d_lock must be held.
+ */
+static void d_negative_inc(struct dentry *dentry)
+{
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&dentry->d_sb->s_nr_negative);
+}
+
+static void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_negative);
+}
+
+static void d_negative_check(struct super_block *sb)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	if (!limit || percpu_counter_read_positive(&sb->s_nr_negative) <= limit)
+		return;
+	/* umount gets rid of them anyway */
+	if ((sb->s_flags & SB_ACTIVE) && !work_pending(&sb->s_negative_work))
+		queue_work(system_unbound_wq, &sb->s_negative_work);
+}
+
 static inline void __d_set_inode_and_type(struct dentry *dentry,
 					  struct inode *inode,
 					  unsigned type_flags)
@@ -335,6 +380,8 @@ static inline void __d_set_inode_and_type(struct dentry *dentry,
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	flags |= type_flags;
 	WRITE_ONCE(dentry->d_flags, flags);
+	if (flags & DCACHE_LRU_LIST)
+		d_negative_dec(dentry);
 }
 
 static inline void __d_clear_type_and_inode(struct dentry *dentry)
@@ -344,6 +391,8 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
+	if (flags & DCACHE_LRU_LIST)
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -396,7 +445,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * on the shrink list (ie not on the superblock LRU list).
  *
  * The per-cpu "nr_dentry_unused" counters are updated with
- * the DCACHE_LRU_LIST bit.
+ * the DCACHE_LRU_LIST bit, and so are the negative dentry counters
+ * for dentries that have no inode.
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -407,6 +457,10 @@ static void d_lru_add(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry)) {
+		d_negative_inc(dentry);
+		d_negative_check(dentry->d_sb);
+	}
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -415,6 +469,8 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -424,6 +480,8 @@ static void d_shrink_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 }
 
 static void d_shrink_add(struct dentry *dentry, struct list_head *list)
@@ -432,6 +490,8 @@ static void d_shrink_add(struct dentry *dentry, struct list_head *list)
 	list_add(&dentry->d_lru, list);
 	dentry->d_flags |= DCACHE_SHRINK_LIST | DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_inc(dentry);
 }
 
 /*
@@ -445,6 +505,8 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -1174,6 +1236,96 @@ static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 }
 
 
+struct negative_prune {
+	struct list_head dispose;
+	long nr_to_prune;
+};
+
+static enum lru_status dentry_negative_lru_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct negative_prune *prune = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (prune->nr_to_prune <= 0)
+		return LRU_SKIP;
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	/*
+	 * Positive dentries are left to the shrinker. They are rotated so
+	 * that the next batch starts past them, but DCACHE_REFERENCED is
+	 * left alone: the shrinker still gives them the same second chance.
+	 */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		prune->nr_to_prune--;
+		return LRU_REMOVED;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, &prune->dispose);
+	spin_unlock(&dentry->d_lock);
+	prune->nr_to_prune--;
+
+	return LRU_REMOVED;
+}
+
+/**
+ * prune_negative_dentries - trim negative dentries of a superblock
+ * @work: the superblock's s_negative_work
+ *
+ * Queued once a superblock keeps more unused negative dentries than
+ * sysctl_negative_dentry_limit. Prunes down to 7/8 of the limit so that
+ * a steady stream of failed lookups does not requeue it on every miss.
+ *
+ * The LRU is walked in batches, like shrink_dcache_sb() does, so that
+ * the list lock is not held across the whole list. Every entry a batch
+ * visits is either isolated or rotated, so the next batch starts on
+ * entries not seen yet, and a run visits each entry at most once.
+ */
+void prune_negative_dentries(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_negative_work);
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+	unsigned long nr_lru, walked = 0;
+	struct negative_prune prune;
+
+	/* an umount in progress frees them all */
+	if (!limit || !trylock_super(sb))
+		return;
+	if (!(sb->s_flags & SB_ACTIVE))
+		goto out;
+
+	limit -= limit >> 3;
+	prune.nr_to_prune = percpu_counter_sum_positive(&sb->s_nr_negative) -
+			    (long)limit;
+	nr_lru = list_lru_count(&sb->s_dentry_lru);
+	while (prune.nr_to_prune > 0 && walked < nr_lru) {
+		INIT_LIST_HEAD(&prune.dispose);
+		list_lru_walk(&sb->s_dentry_lru, dentry_negative_lru_isolate,
+			      &prune, 1024);
+		shrink_dentry_list(&prune.dispose);
+		walked += 1024;
+		cond_resched();
+	}
+out:
+	up_read(&sb->s_umount);
+}
+
 /**
  * shrink_dcache_sb - shrink dcache for a superblock
  * @sb: superblock
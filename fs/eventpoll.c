@@ -23,6 +23,7 @@
 #include <linux/poll.h>
 #include <linux/string.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/hash.h>
 #include <linux/spinlock.h>
 #include <linux/syscalls.h>
@@ -46,22 +47,26 @@
 
 /*
  * LOCKING:
- * There are three level of locking required by epoll :
+ * There are two level of locking required by epoll :
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
  *
- * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
- * user space) we could end up sleeping due a copy_to_user(), so
- * we need a lock that will allow us to sleep. This lock is a
- * mutex (ep->mtx). It is acquired during the event transfer loop,
- * during epoll_ctl(EPOLL_CTL_DEL) and during eventpoll_release_file().
+ * The acquire order is the one listed above, from 1 to 2.
+ * The poll callback might be triggered from a wake_up() that in
+ * turn might be called from IRQ context, on many CPUs at once, so
+ * it does not take any epoll lock: it pushes the item on the
+ * lock-less ep->rdllist_ll queue (an item is queued at most once,
+ * its ->rdllnode.next being EP_UNACTIVE_PTR while it is not) and
+ * wakes up the epoll_wait() callers through ep->wq, which is
+ * protected by its own lock. The queue is spliced onto ep->rdllist
+ * in batches by ep_splice_ready_llist(), under ep->mtx.
+ * During the event transfer loop (from kernel to user space) we
+ * could end up sleeping due a copy_to_user(), so we need a lock
+ * that will allow us to sleep. This lock is a mutex (ep->mtx),
+ * which protects ep->rdllist together with the RB tree. It is
+ * acquired during the event transfer loop, during epoll_ctl()
+ * and during eventpoll_release_file().
  * Then we also need a global mutex to serialize eventpoll_release_file()
  * and ep_free().
  * This mutex is acquired by ep_free() during the epoll file
@@ -85,7 +90,7 @@
  * of epoll file descriptors, we use the current recursion depth as
  * the lockdep subkey.
  * It is possible to drop the "ep->mtx" and to use the global
- * mutex "epmutex" (together with "ep->lock") to have it working,
+ * mutex "epmutex" to have it working,
  * but having "ep->mtx" will make the interface more scalable.
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->mtx" will guarantee
@@ -151,10 +156,10 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
+	 * Links this item to the lock-less "struct eventpoll"->rdllist_ll
+	 * queue. ->next is EP_UNACTIVE_PTR while the item is not queued.
 	 */
-	struct epitem *next;
+	struct llist_node rdllnode;
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -184,14 +189,11 @@ struct epitem {
  * interface.
  */
 struct eventpoll {
-	/* Protect the access to this structure */
-	spinlock_t lock;
-
 	/*
 	 * This mutex is used to ensure that files are not removed
 	 * while epoll is using them. This is held during the event
 	 * collection loop, the file cleanup path, the epoll file exit
-	 * code and the ctl operations.
+	 * code and the ctl operations. It also protects rdllist.
 	 */
 	struct mutex mtx;
 
@@ -204,15 +206,14 @@ struct eventpoll {
 	/* List of ready file descriptors */
 	struct list_head rdllist;
 
-	/* RB tree root used to store monitored fd structs */
-	struct rb_root_cached rbr;
-
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * Items queued by the poll callback, without holding any lock,
+	 * and not yet moved to rdllist.
 	 */
-	struct epitem *ovflist;
+	struct llist_head rdllist_ll;
+
+	/* RB tree root used to store monitored fd structs */
+	struct rb_root_cached rbr;
 
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
@@ -223,8 +224,7 @@ struct eventpoll {
 	struct file *file;
 
 	/* used to optimize loop detection check */
-	int visited;
-	struct list_head visited_list_link;
+	u64 gen;
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
@@ -288,8 +288,8 @@ static struct kmem_cache *epi_cache __read_mostly;
 /* Slab cache used to allocate "struct eppoll_entry" */
 static struct kmem_cache *pwq_cache __read_mostly;
 
-/* Visited nodes during ep_loop_check(), so we can unset them when we finish */
-static LIST_HEAD(visited_list);
+/* Generation of the current ep_loop_check() walk, protected by epmutex */
+static u64 loop_check_gen;
 
 /*
  * List of files with newly added links, where we may need to limit the number
@@ -387,7 +387,8 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty_careful(&ep->rdllist) ||
+	       !llist_empty(&ep->rdllist_ll);
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
@@ -663,6 +664,41 @@ static inline void ep_pm_stay_awake_rcu(struct epitem *epi)
 	rcu_read_unlock();
 }
 
+/*
+ * Moves the items queued by ep_poll_callback() onto ep->rdllist, in the
+ * order they were queued. Items already linked (either on ep->rdllist or
+ * on the private list of a running ep_scan_ready_list()) only get their
+ * queued marker cleared. Must be called with "mtx" held.
+ */
+static void ep_splice_ready_llist(struct eventpoll *ep)
+{
+	struct llist_node *batch;
+	struct epitem *epi, *nepi;
+
+	if (llist_empty(&ep->rdllist_ll))
+		return;
+
+	batch = llist_reverse_order(llist_del_all(&ep->rdllist_ll));
+	llist_for_each_entry_safe(epi, nepi, batch, rdllnode) {
+		/*
+		 * From now on ep_poll_callback() may queue the item again,
+		 * in which case the next splice will find it linked.
+		 */
+		WRITE_ONCE(epi->rdllnode.next, EP_UNACTIVE_PTR);
+		if (!ep_is_linked(&epi->rdllink)) {
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_pm_stay_awake(epi);
+		}
+	}
+
+	/*
+	 * Pairs with the barrier in ep_poll_callback(): either the callback
+	 * sees the cleared marker and queues the item again, or our next
+	 * f_op->poll() of the item sees the event it was signalling.
+	 */
+	smp_mb();
+}
+
 /**
  * ep_scan_ready_list - Scans the ready list in a way that makes possible for
  *                      the scan code, to call f_op->poll(). Also allows for
@@ -682,8 +718,6 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 			      void *priv, int depth, bool ep_locked)
 {
 	int error, pwake = 0;
-	unsigned long flags;
-	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
 	/*
@@ -695,48 +729,26 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		mutex_lock_nested(&ep->mtx, depth);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * Take in one batch whatever the poll callback queued so far, then
+	 * steal the ready list, and re-init the original one to the empty
+	 * list. The poll callback never touches ep->rdllist, so the "sproc"
+	 * callback can walk "txlist" and re-queue items without locks.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	ep_splice_ready_llist(ep);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
+	 * We move them to the main ready-list here; those already on
+	 * "txlist" are taken care of by the list_splice() below.
 	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-			ep_pm_stay_awake(epi);
-		}
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep_splice_ready_llist(ep);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
@@ -747,14 +759,13 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	if (!list_empty(&ep->rdllist)) {
 		/*
 		 * Wake up (if active) both the eventpoll wait list and
-		 * the ->poll() wait list (delayed after we release the lock).
+		 * the ->poll() wait list (delayed after we release the mutex).
 		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		if (wq_has_sleeper(&ep->wq))
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	if (!ep_locked)
 		mutex_unlock(&ep->mtx);
@@ -778,16 +789,11 @@ static void epi_rcu_free(struct rcu_head *head)
  */
 static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 {
-	unsigned long flags;
 	struct file *file = epi->ffd.file;
 
 	/*
-	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * Removes poll wait queue hooks. Once this is done the poll callback
+	 * cannot queue the item anymore.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -798,10 +804,11 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	/* The item cannot be unlinked from the lock-less queue in place */
+	if (epi->rdllnode.next != EP_UNACTIVE_PTR)
+		ep_splice_ready_llist(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 	/*
@@ -851,7 +858,7 @@ static void ep_free(struct eventpoll *ep)
 	 * Walks through the whole tree by freeing each "struct epitem". At this
 	 * point we are sure no poll callbacks will be lingering around, and also by
 	 * holding "epmutex" we can be sure that no file cleanup code will hit
-	 * us during this operation. So we can avoid the lock on "ep->lock".
+	 * us during this operation.
 	 * We do not need to lock ep->mtx, either, we only do it to prevent
 	 * a lockdep warning.
 	 */
@@ -1035,13 +1042,12 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
-	spin_lock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
+	init_llist_head(&ep->rdllist_ll);
 	ep->rbr = RB_ROOT_CACHED;
-	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
 
 	*pep = ep;
@@ -1126,21 +1132,38 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
 }
 #endif /* CONFIG_CHECKPOINT_RESTORE */
 
+/*
+ * Queues @epi on the lock-less ready queue, unless it is already there.
+ * Returns false if somebody else queued it first. Either way, the caller
+ * is ordered against ep_splice_ready_llist() by a full barrier.
+ */
+static bool ep_queue_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	if (cmpxchg(&epi->rdllnode.next, EP_UNACTIVE_PTR, NULL) !=
+	    EP_UNACTIVE_PTR) {
+		smp_mb();
+		return false;
+	}
+
+	/* llist_add() implies a full barrier */
+	llist_add(&epi->rdllnode, &ep->rdllist_ll);
+	return true;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
- * have events to report.
+ * have events to report. It runs without any epoll lock, so that
+ * wakeups coming from many CPUs at once do not serialize on the
+ * epoll instance.
  */
 static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
+	__u32 events = READ_ONCE(epi->event.events);
 	int ewake = 0;
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	ep_set_busy_poll_napi_id(epi);
 
 	/*
@@ -1149,8 +1172,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * EPOLLONESHOT bit that disables the descriptor when an event is received,
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
-	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+	if (!(events & ~EP_PRIVATE_BITS))
+		goto out;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -1158,51 +1181,31 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * callback. We need to be able to handle both cases here, hence the
 	 * test for "key" != NULL before the event match test.
 	 */
-	if (key && !((unsigned long) key & epi->event.events))
-		goto out_unlock;
+	if (key && !((unsigned long) key & events))
+		goto out;
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * The item is moved to ep->rdllist by the next ep->mtx holder. The
+	 * waiters are woken up even if it was already queued, exactly as
+	 * when the item was already on the ready list.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-			if (epi->ws) {
-				/*
-				 * Activate ep->ws since epi->ws may get
-				 * deactivated at any time.
-				 */
-				__pm_stay_awake(ep->ws);
-			}
-
-		}
-		goto out_unlock;
-	}
-
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (ep_queue_ready(ep, epi))
 		ep_pm_stay_awake_rcu(epi);
-	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq)) {
-		if ((epi->event.events & EPOLLEXCLUSIVE) &&
+		if ((events & EPOLLEXCLUSIVE) &&
 					!((unsigned long)key & POLLFREE)) {
 			switch ((unsigned long)key & EPOLLINOUT_BITS) {
 			case POLLIN:
-				if (epi->event.events & POLLIN)
+				if (events & POLLIN)
 					ewake = 1;
 				break;
 			case POLLOUT:
-				if (epi->event.events & POLLOUT)
+				if (events & POLLOUT)
 					ewake = 1;
 				break;
 			case 0:
@@ -1210,19 +1213,13 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				break;
 			}
 		}
-		wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 	}
 	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	if (!(epi->event.events & EPOLLEXCLUSIVE))
+out:
+	if (!(events & EPOLLEXCLUSIVE))
 		ewake = 1;
 
 	if ((unsigned long)key & POLLFREE) {
@@ -1433,7 +1430,6 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		     struct file *tfile, int fd, int full_check)
 {
 	int error, revents, pwake = 0;
-	unsigned long flags;
 	long user_watches;
 	struct epitem *epi;
 	struct ep_pqueue epq;
@@ -1452,7 +1448,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
-	epi->next = EP_UNACTIVE_PTR;
+	epi->rdllnode.next = EP_UNACTIVE_PTR;
 	if (epi->event.events & EPOLLWAKEUP) {
 		error = ep_create_wakeup_source(epi);
 		if (error)
@@ -1499,9 +1495,6 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	if (full_check && reverse_path_check())
 		goto error_remove_epi;
 
-	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/* record NAPI ID of new item if present */
 	ep_set_busy_poll_napi_id(epi);
 
@@ -1511,14 +1504,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		ep_pm_stay_awake(epi);
 
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		if (wq_has_sleeper(&ep->wq))
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	atomic_long_inc(&ep->user->epoll_watches);
 
 	/* We have to call this outside the lock */
@@ -1539,14 +1530,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, and queued the item on ep->rdllist_ll.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	if (epi->rdllnode.next != EP_UNACTIVE_PTR)
+		ep_splice_ready_llist(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 
@@ -1588,9 +1577,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * 1) Flush epi changes above to other CPUs.  This ensures
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
-	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    We need this because ep_poll_callback does not take
+	 *    any lock shared with us before reading epi.
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1612,19 +1600,15 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * If the item is "hot" and it is not registered inside the ready
 	 * list, push it inside.
 	 */
-	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-			ep_pm_stay_awake(epi);
+	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+		ep_pm_stay_awake(epi);
 
-			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
-			if (waitqueue_active(&ep->poll_wait))
-				pwake++;
-		}
-		spin_unlock_irq(&ep->lock);
+		/* Notify waiting tasks that events are available */
+		if (wq_has_sleeper(&ep->wq))
+			wake_up(&ep->wq);
+		if (waitqueue_active(&ep->poll_wait))
+			pwake++;
 	}
 
 	/* We have to call this outside the lock */
@@ -1703,7 +1687,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 * into ep->rdllist besides us. The epoll_ctl()
 				 * callers are locked out by
 				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
+				 * poll callback will queue them in ep->rdllist_ll.
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 				ep_pm_stay_awake(epi);
@@ -1757,7 +1741,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res = 0, eavail, timed_out = 0;
-	unsigned long flags;
 	u64 slack = 0;
 	wait_queue_entry_t wait;
 	ktime_t expires, *to = NULL;
@@ -1774,7 +1757,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
@@ -1783,8 +1765,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	if (!ep_events_available(ep))
 		ep_busy_loop(ep, timed_out);
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * Busy poll timed out.  Drop NAPI ID for now, we can add
@@ -1799,13 +1779,15 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * ep_poll_callback() when events will become available.
 		 */
 		init_waitqueue_entry(&wait, current);
-		__add_wait_queue_exclusive(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
 			 * We don't want to sleep if the ep_poll_callback() sends us
 			 * a wakeup in between. That's why we set the task state
-			 * to TASK_INTERRUPTIBLE before doing the checks.
+			 * to TASK_INTERRUPTIBLE before doing the checks. This
+			 * pairs with the barrier after queueing the item in
+			 * ep_poll_callback().
 			 */
 			set_current_state(TASK_INTERRUPTIBLE);
 			/*
@@ -1825,22 +1807,17 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
 
-		__remove_wait_queue(&ep->wq, &wait);
 		__set_current_state(TASK_RUNNING);
+		remove_wait_queue(&ep->wq, &wait);
 	}
 check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
@@ -1878,13 +1855,12 @@ static int ep_loop_check_proc(void *priv, void *cookie, int call_nests)
 	struct epitem *epi;
 
 	mutex_lock_nested(&ep->mtx, call_nests + 1);
-	ep->visited = 1;
-	list_add(&ep->visited_list_link, &visited_list);
+	ep->gen = loop_check_gen;
 	for (rbp = rb_first_cached(&ep->rbr); rbp; rbp = rb_next(rbp)) {
 		epi = rb_entry(rbp, struct epitem, rbn);
 		if (unlikely(is_file_epoll(epi->ffd.file))) {
 			ep_tovisit = epi->ffd.file->private_data;
-			if (ep_tovisit->visited)
+			if (ep_tovisit->gen == loop_check_gen)
 				continue;
 			error = ep_call_nested(&poll_loop_ncalls, EP_MAX_NESTS,
 					ep_loop_check_proc, epi->ffd.file,
@@ -1923,18 +1899,14 @@ static int ep_loop_check_proc(void *priv, void *cookie, int call_nests)
  */
 static int ep_loop_check(struct eventpoll *ep, struct file *file)
 {
-	int ret;
-	struct eventpoll *ep_cur, *ep_next;
+	/*
+	 * Start a new generation instead of clearing a visited mark on each
+	 * epoll file walked, so the check costs nothing after the walk.
+	 */
+	loop_check_gen++;
 
-	ret = ep_call_nested(&poll_loop_ncalls, EP_MAX_NESTS,
+	return ep_call_nested(&poll_loop_ncalls, EP_MAX_NESTS,
 			      ep_loop_check_proc, file, ep, current);
-	/* clear visited list */
-	list_for_each_entry_safe(ep_cur, ep_next, &visited_list,
-							visited_list_link) {
-		ep_cur->visited = 0;
-		list_del(&ep_cur->visited_list_link);
-	}
-	return ret;
 }
 
 static void clear_tfile_check_list(void)
@@ -12,7 +12,7 @@
 #ifdef CONFIG_HFSPLUS_FS_POSIX_ACL
 
 /* posix_acl.c */
-struct posix_acl *hfsplus_get_posix_acl(struct inode *inode, int type);
+struct posix_acl *hfsplus_get_posix_acl(struct inode *inode, int type, bool rcu);
 int hfsplus_set_posix_acl(struct inode *inode, struct posix_acl *acl,
 		int type);
 extern int hfsplus_init_posix_acl(struct inode *, struct inode *);
@@ -11,13 +11,16 @@
 #include "xattr.h"
 #include "acl.h"
 
-struct posix_acl *hfsplus_get_posix_acl(struct inode *inode, int type)
+struct posix_acl *hfsplus_get_posix_acl(struct inode *inode, int type, bool rcu)
 {
 	struct posix_acl *acl;
 	char *xattr_name;
 	char *value = NULL;
 	ssize_t size;
 
+	if (rcu)
+		return ERR_PTR(-ECHILD);
+
 	hfs_dbg(ACL_MOD, "[%s]: ino %lu\n", __func__, inode->i_ino);
 
 	switch (type) {
@@ -1699,6 +1699,13 @@ bool __atime_needs_update(const struct path *path, struct inode *inode,
 		return false;
 	if ((mnt->mnt_flags & MNT_NODIRATIME) && S_ISDIR(inode->i_mode))
 		return false;
+	/*
+	 * touch_atime() would fail to get write access anyway. Saying so
+	 * here keeps RCU-walk from dropping out on every symlink of a
+	 * read-only bind mount.
+	 */
+	if (mnt->mnt_flags & MNT_READONLY)
+		return false;
 
 	now = current_time(inode);
 
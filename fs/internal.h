@@ -56,6 +56,20 @@ extern int user_path_mountpoint_at(int, const char __user *, unsigned int, struc
 extern int vfs_path_lookup(struct dentry *, struct vfsmount *,
 			   const char *, unsigned int, struct path *);
 
+/* Why an RCU-walk had to fall back to ref-walk */
+enum rcu_walk_fail {
+	RCU_WALK_LOOKUP,	/* component not in the dcache */
+	RCU_WALK_REVALIDATE,	/* ->d_revalidate() or a managed dentry */
+	RCU_WALK_PERMISSION,	/* ->permission() or an uncached ACL */
+	RCU_WALK_SYMLINK,	/* ->get_link() or a symlink atime update */
+	RCU_WALK_RESTART,	/* lost a seqcount race, walk redone */
+	NR_RCU_WALK_FAIL
+};
+
+struct rcu_walk_stats {
+	unsigned long	fail[NR_RCU_WALK_FAIL];
+};
+
 /*
  * namespace.c
  */
@@ -142,6 +156,7 @@ extern int invalidate_inodes(struct super_block *, bool);
 extern struct dentry *__d_alloc(struct super_block *, const struct qstr *);
 extern int d_set_mounted(struct dentry *dentry);
 extern long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc);
+extern void prune_negative_dentries(struct work_struct *work);
 extern struct dentry *d_alloc_cursor(struct dentry *);
 
 /*
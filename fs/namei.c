@@ -39,6 +39,7 @@
 #include <linux/bitops.h>
 #include <linux/init_task.h>
 #include <linux/uaccess.h>
+#include <linux/seq_file.h>
 
 #include "internal.h"
 #include "mount.h"
@@ -268,7 +269,7 @@ static int check_acl(struct inode *inode, int mask)
 		acl = get_cached_acl_rcu(inode, ACL_TYPE_ACCESS);
 	        if (!acl)
 	                return -EAGAIN;
-		/* no ->get_acl() calls in RCU mode... */
+		/* only ACL_DONT_CACHE filesystems see ->get_acl() in RCU mode */
 		if (is_uncached_acl(acl))
 			return -ECHILD;
 	        return posix_acl_permission(inode, acl, mask & ~MAY_NOT_BLOCK);
@@ -671,6 +672,58 @@ static bool legitimize_links(struct nameidata *nd)
  * to restart the path walk from the beginning in ref-walk mode.
  */
 
+/*
+ * Each fallback is counted once, by whoever decides that the walk cannot
+ * go on in RCU mode: before calling unlazy_walk()/unlazy_child(), or when
+ * returning -ECHILD to have the walk redone. A failing unlazy is part of
+ * the same fallback and is not counted again.
+ */
+static inline void count_rcu_walk_fail(struct super_block *sb,
+				       enum rcu_walk_fail why)
+{
+	this_cpu_inc(sb->s_rcu_walk_stats->fail[why]);
+}
+
+/**
+ * show_rcu_walk_stats - report why path walks left RCU-walk on a superblock
+ * @m: seq_file to print to
+ * @sb: superblock walked
+ *
+ * Used for /proc/<pid>/mountstats; filesystems with their own ->show_stats
+ * call it from there. Prints an "rcuwalk:" line of its own, and nothing
+ * at all until a walk on @sb has fallen back, so that mountstats keeps its
+ * format for everybody else.
+ */
+void show_rcu_walk_stats(struct seq_file *m, struct super_block *sb)
+{
+	static const char * const names[NR_RCU_WALK_FAIL] = {
+		[RCU_WALK_LOOKUP]	= "lookup",
+		[RCU_WALK_REVALIDATE]	= "revalidate",
+		[RCU_WALK_PERMISSION]	= "permission",
+		[RCU_WALK_SYMLINK]	= "symlink",
+		[RCU_WALK_RESTART]	= "restart",
+	};
+	unsigned long fail[NR_RCU_WALK_FAIL] = { 0 };
+	unsigned long total = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_walk_stats *st = per_cpu_ptr(sb->s_rcu_walk_stats, cpu);
+
+		for (i = 0; i < NR_RCU_WALK_FAIL; i++) {
+			fail[i] += st->fail[i];
+			total += st->fail[i];
+		}
+	}
+	if (!total)
+		return;
+
+	seq_puts(m, "\n\trcuwalk:\t");
+	for (i = 0; i < NR_RCU_WALK_FAIL; i++)
+		seq_printf(m, "%s%s=%lu", i ? "," : "", names[i], fail[i]);
+}
+EXPORT_SYMBOL_GPL(show_rcu_walk_stats);
+
 /**
  * unlazy_walk - try to switch to ref-walk mode.
  * @nd: nameidata pathwalk data
@@ -1071,6 +1124,7 @@ const char *get_link(struct nameidata *nd)
 		touch_atime(&last->link);
 		cond_resched();
 	} else if (atime_needs_update_rcu(&last->link, inode)) {
+		count_rcu_walk_fail(inode->i_sb, RCU_WALK_SYMLINK);
 		if (unlikely(unlazy_walk(nd)))
 			return ERR_PTR(-ECHILD);
 		touch_atime(&last->link);
@@ -1090,6 +1144,8 @@ const char *get_link(struct nameidata *nd)
 		if (nd->flags & LOOKUP_RCU) {
 			res = get(NULL, inode, &last->done);
 			if (res == ERR_PTR(-ECHILD)) {
+				count_rcu_walk_fail(inode->i_sb,
+						    RCU_WALK_SYMLINK);
 				if (unlikely(unlazy_walk(nd)))
 					return ERR_PTR(-ECHILD);
 				res = get(dentry, inode, &last->done);
@@ -1593,6 +1649,7 @@ static int lookup_fast(struct nameidata *nd,
 		bool negative;
 		dentry = __d_lookup_rcu(parent, &nd->last, &seq);
 		if (unlikely(!dentry)) {
+			count_rcu_walk_fail(parent->d_sb, RCU_WALK_LOOKUP);
 			if (unlazy_walk(nd))
 				return -ECHILD;
 			return 0;
@@ -1604,8 +1661,10 @@ static int lookup_fast(struct nameidata *nd,
 		 */
 		*inode = d_backing_inode(dentry);
 		negative = d_is_negative(dentry);
-		if (unlikely(read_seqcount_retry(&dentry->d_seq, seq)))
+		if (unlikely(read_seqcount_retry(&dentry->d_seq, seq))) {
+			count_rcu_walk_fail(parent->d_sb, RCU_WALK_RESTART);
 			return -ECHILD;
+		}
 
 		/*
 		 * This sequence count validates that the parent had no
@@ -1614,8 +1673,10 @@ static int lookup_fast(struct nameidata *nd,
 		 * The memory barrier in read_seqcount_begin of child is
 		 *  enough, we can use __read_seqcount_retry here.
 		 */
-		if (unlikely(__read_seqcount_retry(&parent->d_seq, nd->seq)))
+		if (unlikely(__read_seqcount_retry(&parent->d_seq, nd->seq))) {
+			count_rcu_walk_fail(parent->d_sb, RCU_WALK_RESTART);
 			return -ECHILD;
+		}
 
 		*seqp = seq;
 		status = d_revalidate(dentry, nd->flags);
@@ -1631,6 +1692,7 @@ static int lookup_fast(struct nameidata *nd,
 			if (likely(__follow_mount_rcu(nd, path, inode, seqp)))
 				return 1;
 		}
+		count_rcu_walk_fail(parent->d_sb, RCU_WALK_REVALIDATE);
 		if (unlazy_child(nd, dentry, seq))
 			return -ECHILD;
 		if (unlikely(status == -ECHILD))
@@ -1710,6 +1772,7 @@ static inline int may_lookup(struct nameidata *nd)
 		int err = inode_permission(nd->inode, MAY_EXEC|MAY_NOT_BLOCK);
 		if (err != -ECHILD)
 			return err;
+		count_rcu_walk_fail(nd->inode->i_sb, RCU_WALK_PERMISSION);
 		if (unlazy_walk(nd))
 			return -ECHILD;
 	}
@@ -168,6 +168,7 @@ struct nfs_client *nfs_alloc_client(const struct nfs_client_initdata *cl_init)
 
 	memcpy(&clp->cl_addr, cl_init->addr, cl_init->addrlen);
 	clp->cl_addrlen = cl_init->addrlen;
+	clp->cl_nconnect = cl_init->nconnect;
 
 	if (cl_init->hostname) {
 		err = -ENOMEM;
@@ -506,6 +507,7 @@ int nfs_create_rpc_client(struct nfs_client *clp,
 		.program	= &nfs_program,
 		.version	= clp->rpc_ops->version,
 		.authflavor	= flavor,
+		.nconnect	= clp->cl_nconnect,
 	};
 
 	if (test_bit(NFS_CS_DISCRTRY, &clp->cl_flags))
@@ -665,6 +667,8 @@ static int nfs_init_server(struct nfs_server *server,
 			data->timeo, data->retrans);
 	if (data->flags & NFS_MOUNT_NORESVPORT)
 		set_bit(NFS_CS_NORESVPORT, &cl_init.init_flags);
+	if (data->nfs_server.protocol == XPRT_TRANSPORT_TCP)
+		cl_init.nconnect = data->nfs_server.nconnect;
 
 	/* Allocate or find a client reference we can use */
 	clp = nfs_get_client(&cl_init);
@@ -888,6 +892,8 @@ struct nfs_server *nfs_alloc_server(void)
 	INIT_LIST_HEAD(&server->state_owners_lru);
 
 	atomic_set(&server->active, 0);
+	spin_lock_init(&server->rsize_ctl.lock);
+	spin_lock_init(&server->wsize_ctl.lock);
 
 	server->io_stats = nfs_alloc_iostats();
 	if (!server->io_stats) {
@@ -57,6 +57,9 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_SECFLAVORS	(12)
 
+/* Maximum number of connections nconnect= may open to one server */
+#define NFS_MAX_CONNECTIONS	(16)
+
 /*
  * Value used if the user did not specify a port value.
  */
@@ -81,6 +84,7 @@ struct nfs_client_initdata {
 	struct nfs_subversion *nfs_mod;
 	int proto;
 	u32 minorversion;
+	unsigned int nconnect;
 	struct net *net;
 	const struct rpc_timeout *timeparms;
 };
@@ -121,6 +125,7 @@ struct nfs_parsed_mount_data {
 		char			*export_path;
 		int			port;
 		unsigned short		protocol;
+		unsigned short		nconnect;
 	} nfs_server;
 
 	struct security_mnt_opts lsm_opts;
@@ -257,6 +262,7 @@ int nfs_initiate_pgio(struct rpc_clnt *clnt, struct nfs_pgio_header *hdr,
 		      struct rpc_cred *cred, const struct nfs_rpc_ops *rpc_ops,
 		      const struct rpc_call_ops *call_ops, int how, int flags);
 void nfs_free_request(struct nfs_page *req);
+unsigned int nfs_iosize_get(struct nfs_iosize *ctl, unsigned int max);
 struct nfs_pgio_mirror *
 nfs_pgio_current_mirror(struct nfs_pageio_descriptor *desc);
 
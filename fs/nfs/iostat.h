@@ -15,12 +15,24 @@
 #include <linux/cache.h>
 #include <linux/nfs_iostat.h>
 
+/*
+ * READ/WRITE histograms. Size bucket 0 counts RPCs below 1KB, bucket n
+ * those of [2^(n-1), 2^n) KB; latency buckets work the same way in
+ * microseconds. The last bucket of each collects everything larger.
+ */
+#define NFSIOS_HIST_READ	0
+#define NFSIOS_HIST_WRITE	1
+#define NFSIOS_SIZE_BUCKETS	12
+#define NFSIOS_LAT_BUCKETS	20
+
 struct nfs_iostats {
 	unsigned long long	bytes[__NFSIOS_BYTESMAX];
 #ifdef CONFIG_NFS_FSCACHE
 	unsigned long long	fscache[__NFSIOS_FSCACHEMAX];
 #endif
 	unsigned long		events[__NFSIOS_COUNTSMAX];
+	unsigned long		rpcsize[2][NFSIOS_SIZE_BUCKETS];
+	unsigned long		rpclat[2][NFSIOS_LAT_BUCKETS];
 } ____cacheline_aligned;
 
 static inline void nfs_inc_server_stats(const struct nfs_server *server,
@@ -49,6 +61,21 @@ static inline void nfs_add_stats(const struct inode *inode,
 	nfs_add_server_stats(NFS_SERVER(inode), stat, addend);
 }
 
+static inline void nfs_add_server_iohist(const struct nfs_server *server,
+					 int dir, unsigned int bytes,
+					 s64 usecs)
+{
+	unsigned int size = min_t(unsigned int, fls(bytes >> 10),
+				  NFSIOS_SIZE_BUCKETS - 1);
+	unsigned int lat = 0;
+
+	if (usecs > 0)
+		lat = min_t(unsigned int, fls64(usecs), NFSIOS_LAT_BUCKETS - 1);
+
+	this_cpu_inc(server->io_stats->rpcsize[dir][size]);
+	this_cpu_inc(server->io_stats->rpclat[dir][lat]);
+}
+
 #ifdef CONFIG_NFS_FSCACHE
 static inline void nfs_add_fscache_stats(struct inode *inode,
 					 enum nfs_stat_fscachecounters stat,
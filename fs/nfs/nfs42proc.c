@@ -252,7 +252,9 @@ ssize_t nfs42_proc_copy(struct file *src, loff_t pos_src,
 			continue;
 		}
 
-		err2 = nfs4_handle_exception(server, err, &src_exception);
+		/* the source may be on another mount of the same server */
+		err2 = nfs4_handle_exception(NFS_SERVER(file_inode(src)), err,
+					     &src_exception);
 		err  = nfs4_handle_exception(server, err, &dst_exception);
 		if (!err)
 			err = err2;
@@ -22,6 +22,7 @@
 #include <linux/export.h>
 
 #include "internal.h"
+#include "iostat.h"
 #include "pnfs.h"
 
 #define NFSDBG_FACILITY		NFSDBG_PAGECACHE
@@ -702,6 +703,109 @@ void nfs_pageio_init(struct nfs_pageio_descriptor *desc,
 	nfs_pageio_mirror_init(&desc->pg_mirrors[0], bsize);
 }
 
+static bool nfs_adaptive_iosize;
+module_param_named(adaptive_iosize, nfs_adaptive_iosize, bool, 0644);
+MODULE_PARM_DESC(adaptive_iosize, "Grow READ/WRITE sizes from observed "
+		 "throughput instead of always using rsize/wsize");
+
+/* Initial adaptive size, RPCs per measurement window, windows to back off */
+#define NFS_IOSIZE_START	(64 * 1024)
+#define NFS_IOSIZE_SAMPLES	16
+#define NFS_IOSIZE_HOLD		64
+
+/**
+ * nfs_iosize_get - transfer size to use for a new I/O descriptor
+ * @ctl: adaptive state of the mount for this direction
+ * @max: negotiated rsize or wsize
+ */
+unsigned int nfs_iosize_get(struct nfs_iosize *ctl, unsigned int max)
+{
+	unsigned int cur;
+
+	if (!nfs_adaptive_iosize)
+		return max;
+
+	cur = READ_ONCE(ctl->cur);
+	if (!cur) {
+		cur = min_t(unsigned int, NFS_IOSIZE_START, max);
+		cmpxchg(&ctl->cur, 0, cur);
+	}
+	return min(cur, max);
+}
+
+/*
+ * Feed one completed READ or WRITE into the adaptive size. Throughput
+ * is measured per window of NFS_IOSIZE_SAMPLES full sized RPCs. Outside
+ * of a back off period the size is doubled, and the doubling is kept
+ * only if it improved throughput by at least an eighth. A window that
+ * halves throughput means the server is saturated, so step down.
+ */
+static void nfs_iosize_sample(struct nfs_iosize *ctl, unsigned int max,
+			      unsigned int bytes, s64 usecs)
+{
+	unsigned long tput;
+
+	if (!nfs_adaptive_iosize || usecs <= 0)
+		return;
+
+	spin_lock(&ctl->lock);
+	/* short RPCs (file tails, sparse writes) say nothing about cur */
+	if (!ctl->cur || bytes < ctl->cur / 2)
+		goto out;
+
+	ctl->bytes += bytes;
+	ctl->usecs += usecs;
+	if (++ctl->samples < NFS_IOSIZE_SAMPLES)
+		goto out;
+
+	tput = div64_u64(ctl->bytes * USEC_PER_MSEC, ctl->usecs);
+	ctl->samples = 0;
+	ctl->bytes = 0;
+	ctl->usecs = 0;
+
+	if (ctl->probing) {
+		ctl->probing = false;
+		if (tput < ctl->base_tput + ctl->base_tput / 8) {
+			ctl->cur = max_t(unsigned int, ctl->cur / 2, PAGE_SIZE);
+			ctl->hold = NFS_IOSIZE_HOLD;
+			goto out;
+		}
+	} else if (ctl->base_tput && tput < ctl->base_tput / 2 &&
+		   ctl->cur > NFS_IOSIZE_START) {
+		ctl->cur /= 2;
+		ctl->hold = NFS_IOSIZE_HOLD;
+	} else if (ctl->hold) {
+		ctl->hold--;
+	} else if (ctl->cur < max) {
+		ctl->base_tput = tput;
+		ctl->cur = min(ctl->cur * 2, max);
+		ctl->probing = true;
+		goto out;
+	}
+	ctl->base_tput = tput;
+out:
+	spin_unlock(&ctl->lock);
+}
+
+static void nfs_pgio_account(struct rpc_task *task,
+			     struct nfs_pgio_header *hdr)
+{
+	struct nfs_server *server = NFS_SERVER(hdr->inode);
+	s64 usecs = ktime_us_delta(ktime_get(), task->tk_start);
+
+	if (hdr->rw_mode == FMODE_WRITE) {
+		nfs_add_server_iohist(server, NFSIOS_HIST_WRITE,
+				      hdr->args.count, usecs);
+		nfs_iosize_sample(&server->wsize_ctl, server->wsize,
+				  hdr->args.count, usecs);
+	} else {
+		nfs_add_server_iohist(server, NFSIOS_HIST_READ,
+				      hdr->args.count, usecs);
+		nfs_iosize_sample(&server->rsize_ctl, server->rsize,
+				  hdr->args.count, usecs);
+	}
+}
+
 /**
  * nfs_pgio_result - Basic pageio error handling
  * @task: The task that ran
@@ -717,10 +821,12 @@ static void nfs_pgio_result(struct rpc_task *task, void *calldata)
 
 	if (hdr->rw_ops->rw_done(task, hdr, inode) != 0)
 		return;
-	if (task->tk_status < 0)
+	if (task->tk_status < 0) {
 		nfs_set_pgio_error(hdr, task->tk_status, hdr->args.offset);
-	else
+	} else {
+		nfs_pgio_account(task, hdr);
 		hdr->rw_ops->rw_result(task, hdr);
+	}
 }
 
 /*
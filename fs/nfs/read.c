@@ -69,7 +69,7 @@ void nfs_pageio_init_read(struct nfs_pageio_descriptor *pgio,
 		pg_ops = server->pnfs_curr_ld->pg_read_ops;
 #endif
 	nfs_pageio_init(pgio, inode, pg_ops, compl_ops, &nfs_rw_read_ops,
-			server->rsize, 0);
+			nfs_iosize_get(&server->rsize_ctl, server->rsize), 0);
 }
 EXPORT_SYMBOL_GPL(nfs_pageio_init_read);
 
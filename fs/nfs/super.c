@@ -102,6 +102,7 @@ enum {
 	Opt_mountport,
 	Opt_mountvers,
 	Opt_minorversion,
+	Opt_nconnect,
 
 	/* Mount options that take string arguments */
 	Opt_nfsvers,
@@ -167,6 +168,7 @@ static const match_table_t nfs_mount_option_tokens = {
 	{ Opt_mountport, "mountport=%s" },
 	{ Opt_mountvers, "mountvers=%s" },
 	{ Opt_minorversion, "minorversion=%s" },
+	{ Opt_nconnect, "nconnect=%s" },
 
 	{ Opt_nfsvers, "nfsvers=%s" },
 	{ Opt_nfsvers, "vers=%s" },
@@ -675,6 +677,8 @@ static void nfs_show_mount_options(struct seq_file *m, struct nfs_server *nfss,
 		if (nfss->port)
 			seq_printf(m, ",port=%u", nfss->port);
 
+	if (nfss->nfs_client && nfss->nfs_client->cl_nconnect > 0)
+		seq_printf(m, ",nconnect=%u", nfss->nfs_client->cl_nconnect);
 	seq_printf(m, ",timeo=%lu", 10U * nfss->client->cl_timeout->to_initval / HZ);
 	seq_printf(m, ",retrans=%u", nfss->client->cl_timeout->to_retries);
 	seq_printf(m, ",sec=%s", nfs_pseudoflavour_to_name(nfss->client->cl_auth->au_flavor));
@@ -799,6 +803,27 @@ EXPORT_SYMBOL_GPL(nfs_show_path);
 /*
  * Present statistical information for this VFS mountpoint
  */
+static void show_iohist(struct seq_file *m, struct nfs_server *nfss,
+			const char *name, int dir, bool lat)
+{
+	int nr = lat ? NFSIOS_LAT_BUCKETS : NFSIOS_SIZE_BUCKETS;
+	int i, cpu;
+
+	seq_printf(m, "\n\t%s:\t", name);
+	for (i = 0; i < nr; i++) {
+		unsigned long sum = 0;
+
+		for_each_possible_cpu(cpu) {
+			struct nfs_iostats *stats;
+
+			stats = per_cpu_ptr(nfss->io_stats, cpu);
+			sum += lat ? stats->rpclat[dir][i] :
+				     stats->rpcsize[dir][i];
+		}
+		seq_printf(m, "%lu ", sum);
+	}
+}
+
 int nfs_show_stats(struct seq_file *m, struct dentry *root)
 {
 	int i, cpu;
@@ -882,6 +907,19 @@ int nfs_show_stats(struct seq_file *m, struct dentry *root)
 			seq_printf(m, "%Lu ", totals.fscache[i]);
 	}
 #endif
+
+	/*
+	 * READ/WRITE size (log2 KB) and latency (log2 usec) histograms,
+	 * and the transfer sizes currently in use
+	 */
+	show_iohist(m, nfss, "rdsize", NFSIOS_HIST_READ, false);
+	show_iohist(m, nfss, "wrsize", NFSIOS_HIST_WRITE, false);
+	show_iohist(m, nfss, "rdlat", NFSIOS_HIST_READ, true);
+	show_iohist(m, nfss, "wrlat", NFSIOS_HIST_WRITE, true);
+	seq_printf(m, "\n\tiosize:\trsize=%u,wsize=%u",
+		   nfs_iosize_get(&nfss->rsize_ctl, nfss->rsize),
+		   nfs_iosize_get(&nfss->wsize_ctl, nfss->wsize));
+	show_rcu_walk_stats(m, root->d_sb);
 	seq_printf(m, "\n");
 
 	rpc_print_iostats(m, nfss->client);
@@ -1420,6 +1458,12 @@ static int nfs_parse_mount_options(char *raw,
 				goto out_invalid_value;
 			mnt->minorversion = option;
 			break;
+		case Opt_nconnect:
+			if (nfs_get_option_ul_bound(args, &option,
+						    1, NFS_MAX_CONNECTIONS))
+				goto out_invalid_value;
+			mnt->nfs_server.nconnect = option;
+			break;
 
 		/*
 		 * options that take text values
@@ -710,6 +710,7 @@ int nfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
 	struct inode *inode = mapping->host;
 	struct nfs_pageio_descriptor pgio;
 	struct nfs_io_completion *ioc = nfs_io_completion_alloc(GFP_NOFS);
+	long extra = 0;
 	int err;
 
 	nfs_inc_stats(inode, NFSIOS_VFSWRITEPAGES);
@@ -720,7 +721,22 @@ int nfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
 	nfs_pageio_init_write(&pgio, inode, wb_priority(wbc), false,
 				&nfs_async_write_completion_ops);
 	pgio.pg_io_completion = ioc;
+
+	/*
+	 * Background writeback hands us the dirty pages in chunks. Round
+	 * the chunk up to whole WRITEs so that its end does not leave a
+	 * short RPC behind that the next chunk could have filled.
+	 */
+	if (wbc->sync_mode == WB_SYNC_NONE && wbc->nr_to_write > 0 &&
+	    wbc->nr_to_write != LONG_MAX) {
+		long wpages = max_t(long, pgio.pg_bsize >> PAGE_SHIFT, 1);
+
+		extra = roundup(wbc->nr_to_write, wpages) - wbc->nr_to_write;
+		wbc->nr_to_write += extra;
+	}
+
 	err = write_cache_pages(mapping, wbc, nfs_writepages_callback, &pgio);
+	wbc->nr_to_write -= extra;
 	nfs_pageio_complete(&pgio);
 	nfs_io_completion_put(ioc);
 
@@ -1431,7 +1447,8 @@ void nfs_pageio_init_write(struct nfs_pageio_descriptor *pgio,
 		pg_ops = server->pnfs_curr_ld->pg_write_ops;
 #endif
 	nfs_pageio_init(pgio, inode, pg_ops, compl_ops, &nfs_rw_write_ops,
-			server->wsize, ioflags);
+			nfs_iosize_get(&server->wsize_ctl, server->wsize),
+			ioflags);
 }
 EXPORT_SYMBOL_GPL(nfs_pageio_init_write);
 
@@ -133,7 +133,7 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page && !PageCompound(page))
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -144,7 +144,8 @@ static int anon_pipe_buf_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) == 1) {
+	/* subpages of a higher-order page cannot go to the page cache */
+	if (page_count(page) == 1 && !PageCompound(page)) {
 		if (memcg_kmem_enabled())
 			memcg_kmem_uncharge(page, 0);
 		__SetPageLocked(page);
@@ -349,6 +350,52 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 	return ret;
 }
 
+/*
+ * Large writes take their pages from higher-order allocations, one
+ * subpage per pipe_buffer. Every subpage handed out carries its own
+ * reference on the compound page, so the buffers need no special
+ * release and the allocator is only entered once per
+ * PIPE_FRAG_ORDER worth of data.
+ *
+ * A higher-order page is only taken when the write fills all of it and
+ * there are enough free slots to hold it, so that no subpage sits
+ * unused while the writer waits. Whatever is left when the write ends
+ * early is given back by pipe_put_frags().
+ */
+#define PIPE_FRAG_ORDER		3
+
+static struct page *pipe_alloc_page(struct pipe_inode_info *pipe, size_t len)
+{
+	struct page *page;
+
+	if (!pipe->frag_left && len >= PAGE_SIZE << PIPE_FRAG_ORDER &&
+	    pipe->buffers - pipe->nrbufs >= 1 << PIPE_FRAG_ORDER) {
+		page = alloc_pages(GFP_HIGHUSER | __GFP_ACCOUNT | __GFP_COMP |
+				   __GFP_NOWARN | __GFP_NORETRY,
+				   PIPE_FRAG_ORDER);
+		if (page) {
+			page_ref_add(page, (1 << PIPE_FRAG_ORDER) - 1);
+			pipe->frag_page = page;
+			pipe->frag_left = 1 << PIPE_FRAG_ORDER;
+		}
+	}
+
+	if (pipe->frag_left) {
+		pipe->frag_left--;
+		return pipe->frag_page++;
+	}
+
+	return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+}
+
+static void pipe_put_frags(struct pipe_inode_info *pipe)
+{
+	while (pipe->frag_left) {
+		pipe->frag_left--;
+		put_page(pipe->frag_page++);
+	}
+}
+
 static inline int is_packetized(struct file *file)
 {
 	return (file->f_flags & O_DIRECT) != 0;
@@ -418,7 +465,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			int copied;
 
 			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+				page = pipe_alloc_page(pipe, iov_iter_count(from));
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
 					break;
@@ -477,6 +524,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		pipe->waiting_writers--;
 	}
 out:
+	pipe_put_frags(pipe);
 	__pipe_unlock(pipe);
 	if (do_wakeup) {
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
@@ -679,7 +727,8 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 			pipe_buf_release(pipe, buf);
 	}
 	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+		put_page(pipe->tmp_page);
+	pipe_put_frags(pipe);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1043,7 +1092,7 @@ static inline unsigned int round_pipe_size(unsigned int size)
  * Allocate a new array of pipe buffers and copy the info over. Returns the
  * pipe size if successful, or return -ERROR on error.
  */
-static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
+long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 {
 	struct pipe_buffer *bufs;
 	unsigned int size, nr_pages;
@@ -53,9 +53,25 @@ struct posix_acl *get_cached_acl(struct inode *inode, int type)
 }
 EXPORT_SYMBOL(get_cached_acl);
 
+/*
+ * Returns the cached ACL without taking a reference, for RCU-walk. A
+ * filesystem that does not cache its ACLs (ACL_DONT_CACHE) is asked for
+ * it through ->get_acl() in RCU mode, and may still answer with the
+ * uncached marker by returning -ECHILD.
+ */
 struct posix_acl *get_cached_acl_rcu(struct inode *inode, int type)
 {
-	return rcu_dereference(*acl_by_type(inode, type));
+	struct posix_acl *acl = rcu_dereference(*acl_by_type(inode, type));
+
+	if (acl == ACL_DONT_CACHE && inode->i_op->get_acl) {
+		struct posix_acl *ret;
+
+		ret = inode->i_op->get_acl(inode, type, true);
+		if (!IS_ERR(ret))
+			acl = ret;
+	}
+
+	return acl;
 }
 EXPORT_SYMBOL(get_cached_acl_rcu);
 
@@ -137,7 +153,7 @@ struct posix_acl *get_acl(struct inode *inode, int type)
 		set_cached_acl(inode, type, NULL);
 		return NULL;
 	}
-	acl = inode->i_op->get_acl(inode, type);
+	acl = inode->i_op->get_acl(inode, type, false);
 
 	if (IS_ERR(acl)) {
 		/*
@@ -228,6 +228,8 @@ static int show_vfsstat(struct seq_file *m, struct vfsmount *mnt)
 	if (sb->s_op->show_stats) {
 		seq_putc(m, ' ');
 		err = sb->s_op->show_stats(m, mnt_path.dentry);
+	} else {
+		show_rcu_walk_stats(m, sb);
 	}
 
 	seq_putc(m, '\n');
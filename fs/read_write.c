@@ -22,6 +22,9 @@
 #include <linux/fs.h>
 #include "internal.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/copy_file_range.h>
+
 #include <linux/uaccess.h>
 #include <asm/unistd.h>
 
@@ -1546,6 +1549,9 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 {
 	struct inode *inode_in = file_inode(file_in);
 	struct inode *inode_out = file_inode(file_out);
+	loff_t start_in = pos_in, start_out = pos_out;
+	int method;
+	u64 start;
 	ssize_t ret;
 
 	if (flags != 0)
@@ -1569,20 +1575,28 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 	    (file_out->f_flags & O_APPEND))
 		return -EBADF;
 
-	/* this could be relaxed once a method supports cross-fs copies */
-	if (inode_in->i_sb != inode_out->i_sb)
+	/*
+	 * Copies between superblocks are only done within one filesystem
+	 * type: the splice fallback would give short or empty copies from
+	 * the likes of procfs or sysfs into anything else.
+	 */
+	if (inode_in->i_sb->s_type != inode_out->i_sb->s_type)
 		return -EXDEV;
 
 	if (len == 0)
 		return 0;
 
 	file_start_write(file_out);
+	start = ktime_get_ns();
 
 	/*
 	 * Try cloning first, this is supported by more file systems, and
 	 * more efficient if both clone and copy are supported (e.g. NFS).
+	 * Shared extents only exist within a superblock.
 	 */
-	if (file_in->f_op->clone_file_range) {
+	method = COPY_FILE_RANGE_CLONE;
+	if (inode_in->i_sb == inode_out->i_sb &&
+	    file_in->f_op->clone_file_range) {
 		ret = file_in->f_op->clone_file_range(file_in, pos_in,
 				file_out, pos_out, len);
 		if (ret == 0) {
@@ -1591,17 +1605,31 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 		}
 	}
 
-	if (file_out->f_op->copy_file_range) {
+	/*
+	 * ->copy_file_range() may also be asked to copy between two
+	 * superblocks of the same filesystem, e.g. two NFS mounts of one
+	 * server. It returns -EXDEV if it cannot.
+	 */
+	method = COPY_FILE_RANGE_OFFLOAD;
+	if (file_out->f_op->copy_file_range &&
+	    file_out->f_op->copy_file_range == file_in->f_op->copy_file_range) {
 		ret = file_out->f_op->copy_file_range(file_in, pos_in, file_out,
 						      pos_out, len, flags);
-		if (ret != -EOPNOTSUPP)
+		if (ret != -EOPNOTSUPP && ret != -EXDEV)
 			goto done;
 	}
 
+	/*
+	 * Anything else is copied through the page cache by the internal
+	 * splice loop.
+	 */
+	method = COPY_FILE_RANGE_SPLICE;
 	ret = do_splice_direct(file_in, &pos_in, file_out, &pos_out,
 			len > MAX_RW_COUNT ? MAX_RW_COUNT : len, 0);
 
 done:
+	trace_vfs_copy_file_range(file_in, start_in, file_out, start_out, len,
+				  method, ret, ktime_get_ns() - start);
 	if (ret > 0) {
 		fsnotify_access(file_in);
 		add_rchar(current, ret);
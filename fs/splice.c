@@ -939,6 +939,18 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 	len = sd->total_len;
 	flags = sd->flags;
 
+	/*
+	 * Every round trip through the internal pipe moves at most what it
+	 * can hold, so grow it for large transfers, up to what any user
+	 * may ask for with F_SETPIPE_SZ. Staying small is not an error.
+	 * The pipe is charged to the user like any other, so it goes back
+	 * to the default size once done rather than stay cached that large
+	 * in current->splice_pipe.
+	 */
+	if (len > (size_t)pipe->buffers * PAGE_SIZE &&
+	    (size_t)pipe->buffers * PAGE_SIZE < pipe_max_size)
+		pipe_set_size(pipe, min_t(size_t, len, pipe_max_size));
+
 	/*
 	 * Don't block on output, we have to drain the direct pipe.
 	 */
@@ -988,6 +1000,8 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 
 done:
 	pipe->nrbufs = pipe->curbuf = 0;
+	if (pipe->buffers > PIPE_DEF_BUFFERS)
+		pipe_set_size(pipe, PIPE_DEF_BUFFERS * PAGE_SIZE);
 	file_accessed(in);
 	return bytes;
 
@@ -1215,6 +1229,14 @@ static int iter_to_pipe(struct iov_iter *from,
 				buf.page = pages[n];
 				buf.offset = start;
 				buf.len = size;
+				/*
+				 * Only whole pages can be handed over, the
+				 * rest of a partial one is not the caller's
+				 * to give.
+				 */
+				buf.flags = flags;
+				if (start || size != PAGE_SIZE)
+					buf.flags &= ~PIPE_BUF_FLAG_GIFT;
 				ret = add_to_pipe(pipe, &buf);
 				if (unlikely(ret < 0)) {
 					failed = true;
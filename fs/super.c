@@ -155,6 +155,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	free_percpu(s->s_rcu_walk_stats);
 	kfree(s);
 }
 
@@ -175,6 +176,7 @@ static void destroy_super(struct super_block *s)
 {
 	list_lru_destroy(&s->s_dentry_lru);
 	list_lru_destroy(&s->s_inode_lru);
+	percpu_counter_destroy(&s->s_nr_negative);
 	security_sb_free(s);
 	WARN_ON(!list_empty(&s->s_mounts));
 	put_user_ns(s->s_user_ns);
@@ -207,6 +209,14 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 	if (security_sb_alloc(s))
 		goto fail;
 
+	s->s_rcu_walk_stats = alloc_percpu(struct rcu_walk_stats);
+	if (!s->s_rcu_walk_stats)
+		goto fail;
+
+	if (percpu_counter_init(&s->s_nr_negative, 0, GFP_USER))
+		goto fail;
+	INIT_WORK(&s->s_negative_work, prune_negative_dentries);
+
 	for (i = 0; i < SB_FREEZE_LEVELS; i++) {
 		if (__percpu_init_rwsem(&s->s_writers.rw_sem[i],
 					sb_writers_name[i],
@@ -317,6 +327,8 @@ void deactivate_locked_super(struct super_block *s)
 		cleancache_invalidate_fs(s);
 		unregister_shrinker(&s->s_shrink);
 		fs->kill_sb(s);
+		/* SB_ACTIVE is gone, so it cannot be queued again */
+		cancel_work_sync(&s->s_negative_work);
 
 		/*
 		 * Since list_lru_destroy() may sleep, we cannot call it from
@@ -21,7 +21,9 @@
  */
 #define BPF_MAX_VAR_SIZ	(1 << 29)
 
-/* Liveness marks, used for registers and spilled-regs (in stack slots).
+/* Liveness marks, used for registers and stack slots.  For a stack slot the
+ * marks live in the slot's spilled_regs[] entry whether it holds a spilled
+ * register or misc data; only a full BPF_REG_SIZE write counts as a write.
  * Read marks propagate upwards until they find a write mark; they record that
  * "one of this state's descendants read this reg" (and therefore the reg is
  * relevant for states_equal() checks).
@@ -51,6 +53,9 @@ struct bpf_reg_state {
 		 */
 		struct bpf_map *map_ptr;
 
+		/* valid when type == PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
+		u32 mem_size;
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -60,6 +65,8 @@ struct bpf_reg_state {
 	 * offset, so they can share range knowledge.
 	 * For PTR_TO_MAP_VALUE_OR_NULL this is used to share which map value we
 	 * came from, when one is tested for != NULL.
+	 * For PTR_TO_MEM[_OR_NULL] this is the reference the pointer holds,
+	 * all copies are invalidated when it is released.
 	 */
 	u32 id;
 	/* Ordering of fields matters.  See states_equal() */
@@ -91,6 +98,16 @@ enum bpf_stack_slot_type {
 
 #define BPF_REG_SIZE 8	/* size of eBPF register in bytes */
 
+/* Memory handed out by helpers that must be given back before the program
+ * exits, e.g. bpf_ringbuf_reserve()/bpf_ringbuf_submit().
+ */
+struct bpf_reference_state {
+	u32 id;		/* id of the PTR_TO_MEM[_OR_NULL] registers holding it */
+	int insn_idx;	/* allocation insn, for error reporting */
+};
+
+#define BPF_MAX_ACQUIRED_REFS 8
+
 /* state of the program:
  * type of all registers and stack info
  */
@@ -98,6 +115,8 @@ struct bpf_verifier_state {
 	struct bpf_reg_state regs[MAX_BPF_REG];
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct bpf_reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
+	int acquired_refs;
+	struct bpf_reference_state refs[BPF_MAX_ACQUIRED_REFS];
 	struct bpf_verifier_state *parent;
 };
 
@@ -105,6 +124,7 @@ struct bpf_verifier_state {
 struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
+	u32 miss_cnt, hit_cnt;	/* failed/successful states_equal() checks */
 };
 
 struct bpf_insn_aux_data {
@@ -119,6 +139,23 @@ struct bpf_insn_aux_data {
 
 #define MAX_USED_MAPS 64 /* max number of maps accessed by one eBPF program */
 
+/* Maximum number of register states that can exist at once */
+#define BPF_ID_MAP_SIZE	(MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE + \
+			 BPF_MAX_ACQUIRED_REFS)
+struct bpf_id_pair {
+	u32 old;
+	u32 cur;
+};
+
+/* log_level bits: LEVEL1 traces the walked instructions, LEVEL2 also dumps
+ * the state at every one of them, STATS adds the verification cost summary
+ */
+#define BPF_LOG_LEVEL1	1
+#define BPF_LOG_LEVEL2	2
+#define BPF_LOG_STATS	4
+#define BPF_LOG_LEVEL	(BPF_LOG_LEVEL1 | BPF_LOG_LEVEL2)
+#define BPF_LOG_MASK	(BPF_LOG_LEVEL | BPF_LOG_STATS)
+
 struct bpf_verifier_env;
 struct bpf_ext_analyzer_ops {
 	int (*insn_hook)(struct bpf_verifier_env *env,
@@ -143,6 +180,20 @@ struct bpf_verifier_env {
 	bool allow_ptr_leaks;
 	bool seen_direct_write;
 	struct bpf_insn_aux_data *insn_aux_data; /* array of per-insn state */
+	struct bpf_verifier_state_list *free_list; /* evicted from explored_states */
+	struct bpf_id_pair idmap_scratch[BPF_ID_MAP_SIZE];
+	/* verification cost, reported with BPF_LOG_STATS */
+	u64 verification_time;		/* ns spent in check_cfg() + do_check() */
+	u32 insn_processed;		/* insns walked, incl. re-walks */
+	u32 prev_insn_processed;	/* insn_processed at the last new state */
+	u32 jmps_processed;		/* jumps walked */
+	u32 prev_jmps_processed;	/* jmps_processed at the last new state */
+	u32 total_states;		/* states ever added to explored_states */
+	u32 cur_states;			/* states on explored_states right now */
+	u32 peak_states;		/* high-water mark of cur_states */
+	u32 pruned_states;		/* paths cut short by an equivalent state */
+	u32 evicted_states;		/* states dropped from explored_states */
+	u32 max_states_per_insn;	/* longest explored_states[] list walked */
 };
 
 int bpf_analyzer(struct bpf_prog *prog, const struct bpf_ext_analyzer_ops *ops,
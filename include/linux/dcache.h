@@ -66,7 +66,8 @@ struct dentry_stat_t {
 	long nr_unused;
 	long age_limit;          /* age in seconds */
 	long want_pages;         /* pages requested by system */
-	long dummy[2];
+	long nr_negative;        /* unused negative dentries */
+	long dummy;
 };
 extern struct dentry_stat_t dentry_stat;
 
@@ -502,6 +503,7 @@ static inline bool d_is_fallthru(const struct dentry *dentry)
 
 
 extern int sysctl_vfs_cache_pressure;
+extern unsigned long sysctl_negative_dentry_limit;
 
 static inline unsigned long vfs_pressure_ratio(unsigned long val)
 {
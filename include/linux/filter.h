@@ -18,8 +18,10 @@
 #include <linux/capability.h>
 #include <linux/cryptohash.h>
 #include <linux/set_memory.h>
+#include <linux/scatterlist.h>
 
 #include <net/sch_generic.h>
+#include <net/xdp.h>
 
 #include <uapi/linux/filter.h>
 #include <uapi/linux/bpf.h>
@@ -493,6 +495,28 @@ struct xdp_buff {
 	void *data;
 	void *data_end;
 	void *data_hard_start;
+	struct xdp_rxq_info *rxq;
+};
+
+/* Message handed to BPF_PROG_TYPE_SK_MSG programs. The data lives in the
+ * scatterlist entries [sg_start, sg_end) and [data, data_end) covers the
+ * first of them. When skb is set the pages belong to it, otherwise each
+ * entry holds a page reference.
+ */
+struct sk_msg_buff {
+	void *data;
+	void *data_end;
+	__u32 apply_bytes;
+	__u32 cork_bytes;
+	int sg_start;
+	int sg_end;
+	struct scatterlist sg_data[MAX_SKB_FRAGS];
+	__u32 flags;
+	__u32 key;
+	struct bpf_map *map;
+	struct sock *sk;
+	struct sk_buff *skb;
+	struct list_head list;
 };
 
 /* compute the linear packet data range [data, data_end) which
@@ -707,6 +731,7 @@ u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
 struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog);
 void bpf_jit_compile(struct bpf_prog *prog);
 bool bpf_helper_changes_pkt_data(void *func);
+const struct bpf_func_proto *bpf_base_func_proto(enum bpf_func_id func_id);
 
 struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
 				       const struct bpf_insn *patch, u32 len);
@@ -728,6 +753,7 @@ void bpf_warn_invalid_xdp_action(u32 act);
 void bpf_warn_invalid_xdp_redirect(u32 ifindex);
 
 struct sock *do_sk_redirect_map(struct sk_buff *skb);
+struct sock *do_msg_redirect_map(struct sk_msg_buff *md);
 
 #ifdef CONFIG_BPF_JIT
 extern int bpf_jit_enable;
@@ -56,6 +56,7 @@ struct cred;
 struct swap_info_struct;
 struct seq_file;
 struct workqueue_struct;
+struct rcu_walk_stats;
 struct iov_iter;
 struct fscrypt_info;
 struct fscrypt_operations;
@@ -1408,6 +1409,13 @@ struct super_block {
 	/* Number of inodes with nlink == 0 but still referenced */
 	atomic_long_t s_remove_count;
 
+	/* RCU-walk fallbacks, by reason */
+	struct rcu_walk_stats __percpu *s_rcu_walk_stats;
+
+	/* Unused negative dentries, trimmed by s_negative_work */
+	struct percpu_counter s_nr_negative;
+	struct work_struct s_negative_work;
+
 	/* Being remounted read-only */
 	int s_readonly_remount;
 
@@ -1736,7 +1744,7 @@ struct inode_operations {
 	struct dentry * (*lookup) (struct inode *,struct dentry *, unsigned int);
 	const char * (*get_link) (struct dentry *, struct inode *, struct delayed_call *);
 	int (*permission) (struct inode *, int);
-	struct posix_acl * (*get_acl)(struct inode *, int);
+	struct posix_acl * (*get_acl)(struct inode *, int, bool);
 
 	int (*readlink) (struct dentry *, char __user *,int);
 
@@ -2685,6 +2693,7 @@ extern void emergency_remount(void);
 extern sector_t bmap(struct inode *, sector_t);
 #endif
 extern int notify_change(struct dentry *, struct iattr *, struct inode **);
+extern void show_rcu_walk_stats(struct seq_file *, struct super_block *);
 extern int inode_permission(struct inode *, int);
 extern int __inode_permission(struct inode *, int);
 extern int generic_permission(struct inode *, int);
@@ -17,6 +17,11 @@ struct ip_conntrack_stat {
 	unsigned int expect_create;
 	unsigned int expect_delete;
 	unsigned int search_restart;
+	unsigned int insert_lat;	/* ns, moving average */
+	unsigned int gc_scanned;
+	unsigned int gc_expired;
+	unsigned int gc_early_drop;
+	unsigned int early_drop_hint;
 };
 
 /* call to create an explicit dependency on nf_conntrack. */
@@ -54,6 +54,7 @@ struct nfs_client {
 	struct rpc_clnt *	cl_rpcclient;
 	const struct nfs_rpc_ops *rpc_ops;	/* NFS protocol vector */
 	int			cl_proto;	/* Network transport protocol */
+	unsigned int		cl_nconnect;	/* Number of connections */
 	struct nfs_subversion *	cl_nfs_mod;	/* pointer to nfs version module */
 
 	u32			cl_minorversion;/* NFSv4 minorversion */
@@ -125,6 +126,22 @@ struct nfs_client {
 /*
  * NFS client parameters stored in the superblock.
  */
+/*
+ * Adaptive transfer size state for one direction of a mount. Starts
+ * small and doubles towards rsize/wsize for as long as each step buys
+ * per-RPC throughput; see nfs_iosize_sample().
+ */
+struct nfs_iosize {
+	spinlock_t		lock;
+	unsigned int		cur;		/* size for new requests, 0 until used */
+	unsigned int		samples;	/* RPCs in the current window */
+	unsigned int		hold;		/* windows to wait before probing */
+	bool			probing;	/* cur was just doubled */
+	u64			bytes;		/* bytes in the current window */
+	u64			usecs;		/* summed RTT of the window */
+	unsigned long		base_tput;	/* bytes/ms before the last step */
+};
+
 struct nfs_server {
 	struct nfs_client *	nfs_client;	/* shared client and NFS4 state */
 	struct list_head	client_link;	/* List of other nfs_server structs
@@ -142,6 +159,8 @@ struct nfs_server {
 	unsigned int		rpages;		/* read size (in pages) */
 	unsigned int		wsize;		/* write size */
 	unsigned int		wpages;		/* write size (in pages) */
+	struct nfs_iosize	rsize_ctl;	/* adaptive read size */
+	struct nfs_iosize	wsize_ctl;	/* adaptive write size */
 	unsigned int		wtmult;		/* server disk block size */
 	unsigned int		dtsize;		/* readdir size */
 	unsigned short		port;		/* "port=" setting */
@@ -19,13 +19,22 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/llist.h>
+
+/*
+ * Queueing latency histogram, from svc_xprt_enqueue until a thread picks
+ * the transport up. Bucket 0 counts waits below 1us, bucket n counts
+ * waits of [2^(n-1), 2^n) us, the last bucket everything longer.
+ */
+#define SVC_POOL_QLAT_BUCKETS	16
 
 /* statistics for svc_pool structures */
 struct svc_pool_stats {
 	atomic_long_t	packets;
-	unsigned long	sockets_queued;
+	atomic_long_t	sockets_queued;
 	atomic_long_t	threads_woken;
 	atomic_long_t	threads_timedout;
+	atomic_long_t	qlat[SVC_POOL_QLAT_BUCKETS];
 };
 
 /*
@@ -40,6 +49,8 @@ struct svc_pool_stats {
  */
 struct svc_pool {
 	unsigned int		sp_id;	    	/* pool id; also node id on NUMA */
+	struct llist_head	sp_xprts;	/* newly queued transports,
+						 * added without sp_lock */
 	spinlock_t		sp_lock;	/* protects all fields */
 	struct list_head	sp_sockets;	/* pending sockets */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
@@ -54,6 +54,8 @@ struct svc_xprt {
 	struct kref		xpt_ref;
 	struct list_head	xpt_list;
 	struct list_head	xpt_ready;
+	struct llist_node	xpt_qnode;	/* on svc_pool->sp_xprts */
+	ktime_t			xpt_qtime;	/* when last enqueued */
 	unsigned long		xpt_flags;
 #define	XPT_BUSY	0		/* enqueued/receiving */
 #define	XPT_CONN	1		/* conn pending */
@@ -184,6 +184,7 @@ struct rpc_xprt {
 
 	unsigned long		cong;		/* current congestion */
 	unsigned long		cwnd;		/* congestion window */
+	atomic_long_t		queuelen;	/* tasks bound to this xprt */
 
 	size_t			max_payload;	/* largest RPC payload size,
 						   in bytes */
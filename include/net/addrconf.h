@@ -230,6 +230,16 @@ struct ipv6_stub {
 			      const struct in6_addr *solicited_addr,
 			      bool router, bool solicited, bool override, bool inc_opt);
 	struct neigh_table *nd_tbl;
+
+	/* Route lookups without the caching of the forwarding path, for
+	 * BPF programs.  Only valid once the device has an inet6_dev.
+	 */
+	struct fib6_table *(*fib6_get_table)(struct net *net, u32 id);
+	struct rt6_info *(*fib6_table_lookup)(struct net *net,
+					      struct fib6_table *table,
+					      struct flowi6 *fl6, int flags);
+	struct dst_entry *(*ip6_route_lookup)(struct net *net,
+					      struct flowi6 *fl6, int flags);
 };
 extern const struct ipv6_stub *ipv6_stub __read_mostly;
 
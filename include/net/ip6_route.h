@@ -85,6 +85,9 @@ struct dst_entry *ip6_route_lookup(struct net *net, struct flowi6 *fl6,
 				   int flags);
 struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table,
 			       int ifindex, struct flowi6 *fl6, int flags);
+struct rt6_info *ip6_pol_route_lookup(struct net *net,
+				      struct fib6_table *table,
+				      struct flowi6 *fl6, int flags);
 
 void ip6_route_init_special_entries(void);
 int ip6_route_init(void);
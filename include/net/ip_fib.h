@@ -238,6 +238,47 @@ struct fib_table *fib_trie_unmerge(struct fib_table *main_tb);
 void fib_table_flush_external(struct fib_table *table);
 void fib_free_table(struct fib_table *tb);
 
+#ifdef CONFIG_IP_FIB_LOOKUP_CACHE
+int fib_table_lookup_cached(struct net *net, struct fib_table *tb,
+			    const struct flowi4 *flp, struct fib_result *res,
+			    int fib_flags);
+int fib_lookup_cache_sysctl(struct net *net, int enable);
+int __net_init fib_lookup_cache_net_init(struct net *net);
+void __net_exit fib_lookup_cache_net_exit(struct net *net);
+
+/* Called under RTNL after aliases are unlinked or linked into a table, and
+ * before anything unlinked is handed to RCU for freeing.
+ */
+static inline void fib_lookup_cache_invalidate(struct net *net)
+{
+	smp_wmb();
+	atomic_inc(&net->ipv4.fib_cache_genid);
+	smp_mb__after_atomic();
+}
+#else
+static inline int fib_table_lookup_cached(struct net *net,
+					  struct fib_table *tb,
+					  const struct flowi4 *flp,
+					  struct fib_result *res,
+					  int fib_flags)
+{
+	return fib_table_lookup(tb, flp, res, fib_flags);
+}
+
+static inline int fib_lookup_cache_net_init(struct net *net)
+{
+	return 0;
+}
+
+static inline void fib_lookup_cache_net_exit(struct net *net)
+{
+}
+
+static inline void fib_lookup_cache_invalidate(struct net *net)
+{
+}
+#endif
+
 #ifndef CONFIG_IP_MULTIPLE_TABLES
 
 #define TABLE_LOCAL_INDEX	(RT_TABLE_LOCAL & (FIB_TABLE_HASHSZ - 1))
@@ -272,7 +313,8 @@ static inline int fib_lookup(struct net *net, const struct flowi4 *flp,
 
 	tb = fib_get_table(net, RT_TABLE_MAIN);
 	if (tb)
-		err = fib_table_lookup(tb, flp, res, flags | FIB_LOOKUP_NOREF);
+		err = fib_table_lookup_cached(net, tb, flp, res,
+					      flags | FIB_LOOKUP_NOREF);
 
 	if (err == -EAGAIN)
 		err = -ENETUNREACH;
@@ -323,14 +365,14 @@ static inline int fib_lookup(struct net *net, struct flowi4 *flp,
 
 	tb = rcu_dereference_rtnl(net->ipv4.fib_main);
 	if (tb)
-		err = fib_table_lookup(tb, flp, res, flags);
+		err = fib_table_lookup_cached(net, tb, flp, res, flags);
 
 	if (!err)
 		goto out;
 
 	tb = rcu_dereference_rtnl(net->ipv4.fib_default);
 	if (tb)
-		err = fib_table_lookup(tb, flp, res, flags);
+		err = fib_table_lookup_cached(net, tb, flp, res, flags);
 
 out:
 	if (err == -EAGAIN)
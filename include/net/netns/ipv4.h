@@ -16,6 +16,8 @@ struct ipv4_devconf;
 struct fib_rules_ops;
 struct hlist_head;
 struct fib_table;
+struct fib_lookup_cache;
+struct fib_lookup_cache_stat;
 struct sock;
 struct local_ports {
 	seqlock_t	lock;
@@ -58,6 +60,12 @@ struct netns_ipv4 {
 #endif
 	struct hlist_head	*fib_table_hash;
 	bool			fib_offload_disabled;
+#ifdef CONFIG_IP_FIB_LOOKUP_CACHE
+	int			sysctl_fib_lookup_cache;
+	atomic_t		fib_cache_genid;
+	struct fib_lookup_cache __percpu __rcu *fib_cache;
+	struct fib_lookup_cache_stat __percpu *fib_cache_stat;
+#endif
 	struct sock		*fibnl;
 
 	struct sock  * __percpu	*icmp_sk;
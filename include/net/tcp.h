@@ -960,6 +960,8 @@ enum tcp_ca_ack_event_flags {
 #define TCP_CONG_NON_RESTRICTED 0x1
 /* Requires ECN/ECT set on all packets */
 #define TCP_CONG_NEEDS_ECN	0x2
+/* Implemented by a BPF program, see net/ipv4/bpf_tcp_ca.c */
+#define TCP_CONG_BPF		0x4
 
 union tcp_cc_info;
 
@@ -1033,6 +1035,38 @@ struct tcp_congestion_ops {
 int tcp_register_congestion_control(struct tcp_congestion_ops *type);
 void tcp_unregister_congestion_control(struct tcp_congestion_ops *type);
 
+#ifdef CONFIG_BPF_SYSCALL
+bool bpf_tcp_ca_get(const struct tcp_congestion_ops *ca);
+void bpf_tcp_ca_put(const struct tcp_congestion_ops *ca);
+#else
+static inline bool bpf_tcp_ca_get(const struct tcp_congestion_ops *ca)
+{
+	return false;
+}
+
+static inline void bpf_tcp_ca_put(const struct tcp_congestion_ops *ca)
+{
+}
+#endif
+
+/* Sockets pin the module of their congestion control, or the
+ * algorithm itself when it is a BPF program.
+ */
+static inline bool tcp_ca_get(const struct tcp_congestion_ops *ca)
+{
+	if (unlikely(ca->flags & TCP_CONG_BPF))
+		return bpf_tcp_ca_get(ca);
+	return try_module_get(ca->owner);
+}
+
+static inline void tcp_ca_put(const struct tcp_congestion_ops *ca)
+{
+	if (unlikely(ca->flags & TCP_CONG_BPF))
+		bpf_tcp_ca_put(ca);
+	else
+		module_put(ca->owner);
+}
+
 void tcp_assign_congestion_control(struct sock *sk);
 void tcp_init_congestion_control(struct sock *sk);
 void tcp_cleanup_congestion_control(struct sock *sk);
@@ -1798,6 +1832,17 @@ static inline bool inet_sk_transparent(const struct sock *sk)
 	return inet_sk(sk)->transparent;
 }
 
+/* Data queued outside of the receive queue, e.g. by sockmap, counts as
+ * readable too.
+ */
+static inline bool tcp_stream_is_readable(const struct tcp_sock *tp,
+					  int target, struct sock *sk)
+{
+	return (tp->rcv_nxt - tp->copied_seq >= target) ||
+		(sk->sk_prot->stream_memory_read ?
+		sk->sk_prot->stream_memory_read(sk) : false);
+}
+
 /* Determines whether this is a thin stream (which may suffer from
  * increased latency). Used to trigger latency-reducing mechanisms.
  */
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* include/net/xdp.h
+ *
+ * Receive side context of XDP buffers.
+ */
+#ifndef __LINUX_NET_XDP_H__
+#define __LINUX_NET_XDP_H__
+
+#include <linux/types.h>
+
+struct net_device;
+
+/**
+ * struct xdp_rxq_info - receive queue an XDP buffer was received on
+ * @dev: receiving device
+ * @queue_index: index of the queue on @dev
+ *
+ * Drivers keep one per RX ring, set it up together with the ring and
+ * point xdp_buff.rxq to it before running the program.  Helpers use it
+ * to find the ingress device and its namespace.  It is only written at
+ * setup, so it can share a cacheline with the hot ring fields.
+ */
+struct xdp_rxq_info {
+	struct net_device	*dev;
+	u32			queue_index;
+};
+
+static inline void xdp_rxq_info_init(struct xdp_rxq_info *rxq,
+				     struct net_device *dev, u32 queue_index)
+{
+	rxq->dev = dev;
+	rxq->queue_index = queue_index;
+}
+
+#endif /* __LINUX_NET_XDP_H__ */
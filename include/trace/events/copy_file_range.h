@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM copy_file_range
+
+#if !defined(_TRACE_COPY_FILE_RANGE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_COPY_FILE_RANGE_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+#include <linux/kdev_t.h>
+#include <linux/math64.h>
+
+#ifndef _TRACE_COPY_FILE_RANGE_DEF
+#define _TRACE_COPY_FILE_RANGE_DEF
+/* How vfs_copy_file_range() ended up moving the data */
+enum copy_file_range_method {
+	COPY_FILE_RANGE_CLONE,		/* ->clone_file_range(), shared extents */
+	COPY_FILE_RANGE_OFFLOAD,	/* ->copy_file_range(), e.g. server side */
+	COPY_FILE_RANGE_SPLICE,		/* in-kernel splice through page cache */
+};
+#endif
+
+TRACE_DEFINE_ENUM(COPY_FILE_RANGE_CLONE);
+TRACE_DEFINE_ENUM(COPY_FILE_RANGE_OFFLOAD);
+TRACE_DEFINE_ENUM(COPY_FILE_RANGE_SPLICE);
+
+#define show_copy_file_range_method(m)				\
+	__print_symbolic(m,					\
+		{ COPY_FILE_RANGE_CLONE,	"clone" },	\
+		{ COPY_FILE_RANGE_OFFLOAD,	"offload" },	\
+		{ COPY_FILE_RANGE_SPLICE,	"splice" })
+
+TRACE_EVENT(vfs_copy_file_range,
+
+	TP_PROTO(struct file *file_in, loff_t pos_in,
+		 struct file *file_out, loff_t pos_out,
+		 size_t len, int method, ssize_t ret, u64 duration_ns),
+
+	TP_ARGS(file_in, pos_in, file_out, pos_out, len, method, ret,
+		duration_ns),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev_in)
+		__field(unsigned long, ino_in)
+		__field(loff_t, pos_in)
+		__field(dev_t, dev_out)
+		__field(unsigned long, ino_out)
+		__field(loff_t, pos_out)
+		__field(size_t, len)
+		__field(int, method)
+		__field(ssize_t, ret)
+		__field(u64, duration_ns)
+		__field(u64, mbps)
+	),
+
+	TP_fast_assign(
+		__entry->dev_in = file_inode(file_in)->i_sb->s_dev;
+		__entry->ino_in = file_inode(file_in)->i_ino;
+		__entry->pos_in = pos_in;
+		__entry->dev_out = file_inode(file_out)->i_sb->s_dev;
+		__entry->ino_out = file_inode(file_out)->i_ino;
+		__entry->pos_out = pos_out;
+		__entry->len = len;
+		__entry->method = method;
+		__entry->ret = ret;
+		__entry->duration_ns = duration_ns;
+		/* bytes per nanosecond * 1000 is MB/s */
+		__entry->mbps = ret > 0 && duration_ns ?
+			div64_u64((u64)ret * 1000, duration_ns) : 0;
+	),
+
+	TP_printk("in %d:%d ino %lx pos %lld out %d:%d ino %lx pos %lld len %zu method %s ret %zd duration_ns %llu MB/s %llu",
+		MAJOR(__entry->dev_in), MINOR(__entry->dev_in),
+		__entry->ino_in, __entry->pos_in,
+		MAJOR(__entry->dev_out), MINOR(__entry->dev_out),
+		__entry->ino_out, __entry->pos_out,
+		__entry->len,
+		show_copy_file_range_method(__entry->method),
+		__entry->ret, __entry->duration_ns, __entry->mbps)
+);
+
+#endif /* _TRACE_COPY_FILE_RANGE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -93,6 +93,10 @@ enum bpf_cmd {
 	BPF_PROG_GET_FD_BY_ID,
 	BPF_MAP_GET_FD_BY_ID,
 	BPF_OBJ_GET_INFO_BY_FD,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
 };
 
 enum bpf_map_type {
@@ -112,6 +116,8 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_HASH_OF_MAPS,
 	BPF_MAP_TYPE_DEVMAP,
 	BPF_MAP_TYPE_SOCKMAP,
+	BPF_MAP_TYPE_CPUMAP,
+	BPF_MAP_TYPE_RINGBUF,
 };
 
 enum bpf_prog_type {
@@ -130,6 +136,8 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_LWT_XMIT,
 	BPF_PROG_TYPE_SOCK_OPS,
 	BPF_PROG_TYPE_SK_SKB,
+	BPF_PROG_TYPE_SK_MSG,
+	BPF_PROG_TYPE_TCP_CC,
 };
 
 enum bpf_attach_type {
@@ -139,6 +147,8 @@ enum bpf_attach_type {
 	BPF_CGROUP_SOCK_OPS,
 	BPF_SK_SKB_STREAM_PARSER,
 	BPF_SK_SKB_STREAM_VERDICT,
+	BPF_SK_MSG_VERDICT,
+	BPF_TCP_CONGESTION,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -150,6 +160,11 @@ enum bpf_attach_type {
  */
 #define BPF_F_ALLOW_OVERRIDE	(1U << 0)
 
+/* Flags for BPF_PROG_ATTACH with BPF_TCP_CONGESTION: the algorithm
+ * requires ECN/ECT set on all packets.
+ */
+#define BPF_F_TCP_CC_NEEDS_ECN	(1U << 0)
+
 /* If BPF_F_STRICT_ALIGNMENT is used in BPF_PROG_LOAD command, the
  * verifier will perform strict alignment checking as if the kernel
  * has been built with CONFIG_EFFICIENT_UNALIGNED_ACCESS not set,
@@ -201,6 +216,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -223,6 +255,7 @@ union bpf_attr {
 		__u32		attach_bpf_fd;	/* eBPF program to attach */
 		__u32		attach_type;
 		__u32		attach_flags;
+		__aligned_u64	tcp_cc_name;	/* BPF_TCP_CONGESTION: algorithm name */
 	};
 
 	struct { /* anonymous struct used by BPF_PROG_TEST_RUN command */
@@ -373,7 +406,7 @@ union bpf_attr {
  *	       xdp_bfp: XDP_REDIRECT on success or XDP_ABORT on error
  * int bpf_redirect_map(map, key, flags)
  *     redirect to endpoint in map
- *     @map: pointer to dev map
+ *     @map: pointer to dev map or cpu map
  *     @key: index in map to lookup
  *     @flags: --
  *     Return: XDP_REDIRECT on success or XDP_ABORT on error
@@ -575,7 +608,8 @@ union bpf_attr {
  *     sock in map.
  *     @map: pointer to sockmap
  *     @key: key to lookup sock in map
- *     @flags: reserved for future use
+ *     @flags: BPF_F_INGRESS to queue the skb on the receive side of the
+ *     target sock instead of transmitting it
  *     Return: SK_PASS
  *
  * int bpf_sock_map_update(skops, map, key, flags)
@@ -583,6 +617,92 @@ union bpf_attr {
  *	@map: pointer to sockmap to update
  *	@key: key to insert/update sock in map
  *	@flags: same flags as map update elem
+ *
+ * int bpf_fib_lookup(ctx, params, plen, flags)
+ *     Do a FIB lookup in the kernel tables using the parameters in
+ *     params.  If the lookup succeeds and the packet is to be forwarded,
+ *     the neighbour tables are searched for the nexthop.  On success the
+ *     egress device is returned in ifindex, the nexthop address in
+ *     ipv4_dst or ipv6_dst, the MAC of the egress device in smac, the
+ *     MAC of the nexthop in dmac and the route metric in rt_metric.
+ *     @ctx: pointer to xdp_md or __sk_buff
+ *     @params: pointer to struct bpf_fib_lookup
+ *     @plen: size of params
+ *     @flags: BPF_FIB_LOOKUP_DIRECT, BPF_FIB_LOOKUP_OUTPUT
+ *     Return: one of BPF_FIB_LKUP_RET_*, or negative error if the input
+ *     is invalid
+ *
+ * int bpf_ringbuf_output(ringbuf, data, size, flags)
+ *     Copy size bytes from data into a ring buffer map, as one record.
+ *     @ringbuf: pointer to BPF_MAP_TYPE_RINGBUF map
+ *     @data: pointer to the data
+ *     @size: size of the data, multiple of 8 is best
+ *     @flags: BPF_RB_NO_WAKEUP or BPF_RB_FORCE_WAKEUP, 0 to let the
+ *     kernel wake up the consumer only if it caught up with the producer
+ *     Return: 0 on success or negative error
+ *
+ * void *bpf_ringbuf_reserve(ringbuf, size, flags)
+ *     Reserve size bytes in a ring buffer map, the program fills them in
+ *     place and must pass the pointer to bpf_ringbuf_submit() or
+ *     bpf_ringbuf_discard() before it exits.
+ *     @ringbuf: pointer to BPF_MAP_TYPE_RINGBUF map
+ *     @size: size of the record, a known constant
+ *     @flags: reserved for future use, must be 0
+ *     Return: pointer to the record or NULL if the ring is full
+ *
+ * void bpf_ringbuf_submit(data, flags)
+ *     Make a record obtained with bpf_ringbuf_reserve() visible to the
+ *     consumer.
+ *     @data: pointer returned by bpf_ringbuf_reserve()
+ *     @flags: as for bpf_ringbuf_output()
+ *
+ * void bpf_ringbuf_discard(data, flags)
+ *     Drop a record obtained with bpf_ringbuf_reserve(), the consumer
+ *     skips it.
+ *     @data: pointer returned by bpf_ringbuf_reserve()
+ *     @flags: as for bpf_ringbuf_output()
+ *
+ * u64 bpf_ringbuf_query(ringbuf, flags)
+ *     Sample the state of a ring buffer map, for the program to decide
+ *     on its own wakeups.  The values are racy by nature.
+ *     @ringbuf: pointer to BPF_MAP_TYPE_RINGBUF map
+ *     @flags: BPF_RB_AVAIL_DATA, BPF_RB_RING_SIZE, BPF_RB_CONS_POS or
+ *     BPF_RB_PROD_POS
+ *     Return: the requested value, 0 for unknown flags
+ *
+ * int bpf_msg_redirect_map(msg, map, key, flags)
+ *     Redirect the message to a sock in map using key as a lookup key
+ *     for the sock in map.
+ *     @msg: pointer to sk_msg_md
+ *     @map: pointer to sockmap
+ *     @key: key to lookup sock in map
+ *     @flags: BPF_F_INGRESS to queue the message on the receive side of
+ *     the target sock instead of transmitting it
+ *     Return: SK_PASS
+ *
+ * int bpf_msg_apply_bytes(msg, bytes)
+ *     Apply the verdict of this run to the next bytes of the stream only,
+ *     the program runs again for the data that follows.
+ *     @msg: pointer to sk_msg_md
+ *     @bytes: number of bytes the verdict covers, 0 for the whole message
+ *     Return: 0
+ *
+ * int bpf_msg_cork_bytes(msg, bytes)
+ *     Hold back the message until bytes of data are queued and only then
+ *     run the program again, on all of it.
+ *     @msg: pointer to sk_msg_md
+ *     @bytes: number of bytes to accumulate
+ *     Return: 0
+ *
+ * int bpf_msg_pull_data(msg, start, end, flags)
+ *     Make the bytes in [start, end) of the message contiguous so that
+ *     they are reachable through data and data_end. The bytes are copied
+ *     when they span several buffers.
+ *     @msg: pointer to sk_msg_md
+ *     @start: offset of the first byte
+ *     @end: offset past the last byte
+ *     @flags: reserved for future use, must be 0
+ *     Return: 0 on success or negative error
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -639,6 +759,16 @@ union bpf_attr {
 	FN(redirect_map),		\
 	FN(sk_redirect_map),		\
 	FN(sock_map_update),		\
+	FN(fib_lookup),			\
+	FN(ringbuf_output),		\
+	FN(ringbuf_reserve),		\
+	FN(ringbuf_submit),		\
+	FN(ringbuf_discard),		\
+	FN(ringbuf_query),		\
+	FN(msg_redirect_map),		\
+	FN(msg_apply_bytes),		\
+	FN(msg_cork_bytes),		\
+	FN(msg_pull_data),		\
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -666,7 +796,9 @@ enum bpf_func_id {
 #define BPF_F_MARK_MANGLED_0		(1ULL << 5)
 #define BPF_F_MARK_ENFORCE		(1ULL << 6)
 
-/* BPF_FUNC_clone_redirect and BPF_FUNC_redirect flags. */
+/* BPF_FUNC_clone_redirect, BPF_FUNC_redirect, BPF_FUNC_sk_redirect_map and
+ * BPF_FUNC_msg_redirect_map flags.
+ */
 #define BPF_F_INGRESS			(1ULL << 0)
 
 /* BPF_FUNC_skb_set_tunnel_key and BPF_FUNC_skb_get_tunnel_key flags. */
@@ -693,6 +825,35 @@ enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET,
 };
 
+/* BPF_FUNC_fib_lookup flags. */
+#define BPF_FIB_LOOKUP_DIRECT		(1U << 0)	/* skip FIB rules */
+#define BPF_FIB_LOOKUP_OUTPUT		(1U << 1)	/* lookup as egress */
+
+/* BPF_FUNC_ringbuf_output, BPF_FUNC_ringbuf_submit and
+ * BPF_FUNC_ringbuf_discard flags.
+ */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags. */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* BPF ring buffer record header, followed by the data padded to 8 bytes.
+ * len holds the data length and the flags below, the consumer must read it
+ * with acquire semantics and skip the record if BPF_RINGBUF_DISCARD_BIT is
+ * set.  The ring is mmap()ed as a consumer position page (read-write),
+ * a producer position page and twice the data pages (read-only), so that
+ * a record wrapping around the end can be read in one go.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)	/* not committed yet */
+#define BPF_RINGBUF_DISCARD_BIT		(1U << 30)	/* dropped, skip */
+#define BPF_RINGBUF_HDR_SZ		8
+
 /* user accessible mirror of in-kernel sk_buff.
  * new fields can only be added to the end of this structure
  */
@@ -784,6 +945,9 @@ enum xdp_action {
 struct xdp_md {
 	__u32 data;
 	__u32 data_end;
+	/* Below access go through struct xdp_rxq_info */
+	__u32 ingress_ifindex; /* rxq->dev->ifindex */
+	__u32 rx_queue_index;  /* rxq->queue_index  */
 };
 
 enum sk_action {
@@ -791,6 +955,14 @@ enum sk_action {
 	SK_PASS,
 };
 
+/* user accessible metadata for SK_MSG packet hook, new fields must
+ * be added to the end of this structure
+ */
+struct sk_msg_md {
+	void *data;
+	void *data_end;
+};
+
 #define BPF_TAG_SIZE	8
 
 struct bpf_prog_info {
@@ -801,6 +973,7 @@ struct bpf_prog_info {
 	__u32 xlated_prog_len;
 	__aligned_u64 jited_prog_insns;
 	__aligned_u64 xlated_prog_insns;
+	__u32 verified_insns;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -864,4 +1037,113 @@ enum {
 #define TCP_BPF_IW		1001	/* Set TCP initial congestion window */
 #define TCP_BPF_SNDCWND_CLAMP	1002	/* Set sndcwnd_clamp */
 
+#define BPF_TCP_CC_PRIV_U32S	16
+
+/* User bpf_tcp_cc struct, the context of BPF_PROG_TYPE_TCP_CC programs.
+ * One program implements a whole congestion control algorithm, the
+ * callback being run is given in op with its arguments in args[].
+ * Only snd_cwnd, snd_cwnd_cnt and priv[] can be written; priv[] is
+ * per-connection storage, zeroed when the algorithm is assigned.
+ * New fields can only be added at the end of this structure
+ */
+struct bpf_tcp_cc {
+	__u32 op;
+	__u32 args[3];
+	__u64 now_us;		/* timestamp of the most recent packet */
+	__u32 snd_cwnd;
+	__u32 snd_cwnd_cnt;
+	__u32 snd_cwnd_clamp;
+	__u32 snd_ssthresh;
+	__u32 prior_cwnd;	/* cwnd before loss recovery */
+	__u32 ca_state;		/* TCP_CA_Open, TCP_CA_Recovery, ... */
+	__u32 is_cwnd_limited;	/* tcp_is_cwnd_limited() */
+	__u32 mss_cache;
+	__u32 srtt_us;		/* smoothed RTT << 3 */
+	__u32 packets_out;
+	__u32 delivered;
+	__u32 idle_us;		/* time since data was last sent */
+	__u32 priv[BPF_TCP_CC_PRIV_U32S];
+};
+
+/* List of BPF_PROG_TYPE_TCP_CC operators, one per tcp_congestion_ops
+ * callback. New entries can only be added at the end
+ */
+enum {
+	BPF_TCP_CC_INIT,
+	BPF_TCP_CC_SSTHRESH,		/* Should return the new ssthresh,
+					 * 0 for the Reno one
+					 */
+	BPF_TCP_CC_CONG_AVOID,		/* args: ack, acked */
+	BPF_TCP_CC_SET_STATE,		/* args: new ca_state */
+	BPF_TCP_CC_CWND_EVENT,		/* args: event (CA_EVENT_*) */
+	BPF_TCP_CC_IN_ACK_EVENT,	/* args: flags (CA_ACK_*) */
+	BPF_TCP_CC_PKTS_ACKED,		/* args: pkts_acked, rtt_us or -1,
+					 * in_flight
+					 */
+	BPF_TCP_CC_UNDO_CWND,		/* Should return the cwnd to restore,
+					 * 0 for max(snd_cwnd, prior_cwnd)
+					 */
+};
+
+/* Return values of bpf_fib_lookup() */
+enum {
+	BPF_FIB_LKUP_RET_SUCCESS,      /* lookup successful, forward */
+	BPF_FIB_LKUP_RET_BLACKHOLE,    /* dest is blackholed; can be dropped */
+	BPF_FIB_LKUP_RET_UNREACHABLE,  /* dest is unreachable; can be dropped */
+	BPF_FIB_LKUP_RET_PROHIBIT,     /* dest not allowed; can be dropped */
+	BPF_FIB_LKUP_RET_NOT_FWDED,    /* packet is not forwarded */
+	BPF_FIB_LKUP_RET_FWD_DISABLED, /* forwarding is not enabled on ingress */
+	BPF_FIB_LKUP_RET_UNSUPP_LWT,   /* fwd requires encapsulation */
+	BPF_FIB_LKUP_RET_NO_NEIGH,     /* no neighbor entry for nexthop */
+	BPF_FIB_LKUP_RET_FRAG_NEEDED,  /* fragmentation required to fwd */
+};
+
+struct bpf_fib_lookup {
+	/* input: network family for lookup (AF_INET, AF_INET6) */
+	__u8	family;
+
+	/* set if lookup is to consider L4 data - e.g., FIB rules */
+	__u8	l4_protocol;
+	__be16	sport;
+	__be16	dport;
+
+	/* total length of packet from network header, used for the MTU
+	 * check of XDP lookups
+	 */
+	__u16	tot_len;
+
+	/* input: L3 device index for lookup
+	 * output: egress device index
+	 */
+	__u32	ifindex;
+
+	union {
+		/* inputs to lookup */
+		__u8	tos;		/* AF_INET  */
+		__be32	flowinfo;	/* AF_INET6, flow_label + priority */
+
+		/* output: metric of fib result */
+		__u32	rt_metric;
+	};
+
+	union {
+		__be32	ipv4_src;
+		__u32	ipv6_src[4];	/* in6_addr; network order */
+	};
+
+	/* input: destination address of the network header
+	 * output: gateway address if the route has one
+	 */
+	union {
+		__be32	ipv4_dst;
+		__u32	ipv6_dst[4];	/* in6_addr; network order */
+	};
+
+	/* output */
+	__be16	h_vlan_proto;
+	__be16	h_vlan_TCI;
+	__u8	smac[6];	/* ETH_ALEN */
+	__u8	dmac[6];	/* ETH_ALEN */
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
@@ -61,6 +61,8 @@
 /* TUNSETIFF ifr flags */
 #define IFF_TUN		0x0001
 #define IFF_TAP		0x0002
+#define IFF_NAPI	0x0010
+#define IFF_BATCH	0x0040
 #define IFF_NO_PI	0x1000
 /* This flag has no real effect */
 #define IFF_ONE_QUEUE	0x2000
@@ -90,6 +92,13 @@ struct tun_pi {
 	__be16 proto;
 };
 
+/* With IFF_BATCH, each packet in a write() is preceded by this header.
+ * len covers the tun_pi and virtio_net_hdr of the packet, if any.
+ */
+struct tun_batch_hdr {
+	__u32 len;
+};
+
 /*
  * Filter spec (used for SETXXFILTER ioctls)
  * This stuff is applicable only to the TAP (Ethernet) devices.
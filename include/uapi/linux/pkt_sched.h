@@ -821,6 +821,7 @@ struct tc_fq_qd_stats {
 	__u32	inactive_flows;
 	__u32	throttled_flows;
 	__u32	unthrottle_latency_ns;
+	__u64	horizon_caps;	/* departure times ignored, beyond horizon */
 };
 
 /* Heavy-Hitter Filter */
@@ -33,7 +33,7 @@ static inline void __pcpu_freelist_push(struct pcpu_freelist_head *head,
 {
 	raw_spin_lock(&head->lock);
 	node->next = head->first;
-	head->first = node;
+	WRITE_ONCE(head->first, node);
 	raw_spin_unlock(&head->lock);
 }
 
@@ -74,31 +74,41 @@ void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
 	local_irq_restore(flags);
 }
 
-struct pcpu_freelist_node *pcpu_freelist_pop(struct pcpu_freelist *s)
+/* Must be called with irqs disabled, e.g. under a bucket lock */
+struct pcpu_freelist_node *__pcpu_freelist_pop(struct pcpu_freelist *s)
 {
 	struct pcpu_freelist_head *head;
 	struct pcpu_freelist_node *node;
-	unsigned long flags;
-	int orig_cpu, cpu;
+	int cpu;
 
-	local_irq_save(flags);
-	orig_cpu = cpu = raw_smp_processor_id();
-	while (1) {
+	for_each_cpu_wrap(cpu, cpu_possible_mask, raw_smp_processor_id()) {
 		head = per_cpu_ptr(s->freelist, cpu);
+		/* Peek before locking, so that once the local list runs dry
+		 * the remaining empty lists are skipped without touching
+		 * their locks, and non-empty remote ones are only locked
+		 * when there is something to take.
+		 */
+		if (!READ_ONCE(head->first))
+			continue;
 		raw_spin_lock(&head->lock);
 		node = head->first;
 		if (node) {
-			head->first = node->next;
-			raw_spin_unlock_irqrestore(&head->lock, flags);
+			WRITE_ONCE(head->first, node->next);
+			raw_spin_unlock(&head->lock);
 			return node;
 		}
 		raw_spin_unlock(&head->lock);
-		cpu = cpumask_next(cpu, cpu_possible_mask);
-		if (cpu >= nr_cpu_ids)
-			cpu = 0;
-		if (cpu == orig_cpu) {
-			local_irq_restore(flags);
-			return NULL;
-		}
 	}
+	return NULL;
+}
+
+struct pcpu_freelist_node *pcpu_freelist_pop(struct pcpu_freelist *s)
+{
+	struct pcpu_freelist_node *node;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	node = __pcpu_freelist_pop(s);
+	local_irq_restore(flags);
+	return node;
 }
@@ -15,11 +15,15 @@
  *
  * A sock map may have BPF programs attached to it, currently a program
  * used to parse packets and a program to provide a verdict and redirect
- * decision on the packet are supported. Any programs attached to a sock
+ * decision on the packet are supported, as well as a program giving a
+ * verdict on the messages the sock sends. Any programs attached to a sock
  * map are inherited by sock objects when they are added to the map. If
  * no BPF programs are attached the sock object may only be used for sock
  * redirect.
  *
+ * Redirects either transmit on the target sock or, with BPF_F_INGRESS,
+ * queue the data on its receive side where it is read like TCP data.
+ *
  * A sock object may be in multiple maps, but can only inherit a single
  * parse or verdict program. If adding a sock object to a map would result
  * in having multiple parsing programs the update will return an EBUSY error.
@@ -38,14 +42,17 @@
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
 #include <linux/list.h>
+#include <linux/sched/signal.h>
 #include <net/strparser.h>
 #include <net/tcp.h>
+#include <net/inet_common.h>
 
 struct bpf_stab {
 	struct bpf_map map;
 	struct sock **sock_map;
 	struct bpf_prog *bpf_parse;
 	struct bpf_prog *bpf_verdict;
+	struct bpf_prog *bpf_tx_msg;
 };
 
 enum smap_psock_state {
@@ -59,8 +66,8 @@ struct smap_psock_map_entry {
 
 struct smap_psock {
 	struct rcu_head	rcu;
-	/* refcnt is used inside sk_callback_lock */
-	u32 refcnt;
+	/* refcnt is dropped to zero inside sk_callback_lock */
+	refcount_t refcnt;
 
 	/* datapath variables */
 	struct sk_buff_head rxqueue;
@@ -71,9 +78,19 @@ struct smap_psock {
 	int save_off;
 	struct sk_buff *save_skb;
 
+	/* datapath variables for the msg verdict, used under lock_sock */
+	struct sock *sk_redir;
+	bool redir_ingress;
+	int apply_bytes;
+	int cork_bytes;
+	int eval;
+	struct sk_msg_buff *cork;
+	struct list_head ingress;
+
 	struct strparser strp;
 	struct bpf_prog *bpf_parse;
 	struct bpf_prog *bpf_verdict;
+	struct bpf_prog *bpf_tx_msg;
 	struct list_head maps;
 
 	/* Back reference used when sock callback trigger sockmap operations */
@@ -86,6 +103,8 @@ struct smap_psock {
 	void (*save_data_ready)(struct sock *sk);
 	void (*save_write_space)(struct sock *sk);
 	void (*save_state_change)(struct sock *sk);
+	void (*save_close)(struct sock *sk, long timeout);
+	struct proto *sk_proto;
 };
 
 static inline struct smap_psock *smap_psock_sk(const struct sock *sk)
@@ -105,6 +124,7 @@ enum __sk_action {
 	__SK_DROP = 0,
 	__SK_PASS,
 	__SK_REDIRECT,
+	__SK_NONE,
 };
 
 static int smap_verdict_func(struct smap_psock *psock, struct sk_buff *skb)
@@ -173,6 +193,974 @@ static void smap_report_sk_error(struct smap_psock *psock, int err)
 
 static void smap_release_sock(struct smap_psock *psock, struct sock *sock);
 
+/* Sockets in a sockmap run with a copy of their proto that hooks close,
+ * recvmsg and poll so that messages queued on psock->ingress are seen, and
+ * sendmsg/sendpage once a msg verdict program is attached. Listeners are
+ * never accepted into a map: sk_clone_lock() copies sk_prot and
+ * sk_user_data verbatim, so their children would end up running on the
+ * listener's psock.
+ */
+enum {
+	SOCKMAP_IPV4,
+	SOCKMAP_IPV6,
+	SOCKMAP_NUM_PROTS,
+};
+
+enum {
+	SOCKMAP_BASE,
+	SOCKMAP_TX,
+	SOCKMAP_NUM_CONFIGS,
+};
+
+static struct proto *saved_tcpv6_prot __read_mostly;
+static DEFINE_SPINLOCK(tcpv6_prot_lock);
+static struct proto bpf_tcp_prots[SOCKMAP_NUM_PROTS][SOCKMAP_NUM_CONFIGS];
+
+static void bpf_tcp_close(struct sock *sk, long timeout);
+static int bpf_tcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t size);
+static int bpf_tcp_sendpage(struct sock *sk, struct page *page,
+			    int offset, size_t size, int flags);
+static int bpf_tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			   int nonblock, int flags, int *addr_len);
+static bool bpf_tcp_stream_read(const struct sock *sk);
+
+static void build_protos(struct proto prot[SOCKMAP_NUM_CONFIGS],
+			 struct proto *base)
+{
+	prot[SOCKMAP_BASE]			= *base;
+	prot[SOCKMAP_BASE].close		= bpf_tcp_close;
+	prot[SOCKMAP_BASE].recvmsg		= bpf_tcp_recvmsg;
+	prot[SOCKMAP_BASE].stream_memory_read	= bpf_tcp_stream_read;
+
+	prot[SOCKMAP_TX]			= prot[SOCKMAP_BASE];
+	prot[SOCKMAP_TX].sendmsg		= bpf_tcp_sendmsg;
+	prot[SOCKMAP_TX].sendpage		= bpf_tcp_sendpage;
+}
+
+static void update_sk_prot(struct sock *sk, struct smap_psock *psock)
+{
+	int family = sk->sk_family == AF_INET6 ? SOCKMAP_IPV6 : SOCKMAP_IPV4;
+	int conf = psock->bpf_tx_msg ? SOCKMAP_TX : SOCKMAP_BASE;
+
+	sk->sk_prot = &bpf_tcp_prots[family][conf];
+}
+
+/* Called with sk_callback_lock held on a new psock */
+static int bpf_tcp_init(struct sock *sk, struct smap_psock *psock)
+{
+	/* A ULP such as kTLS owns the proto already */
+	if (inet_csk(sk)->icsk_ulp_ops)
+		return -EBUSY;
+
+	if (sk->sk_family == AF_INET6) {
+		if (unlikely(sk->sk_prot != smp_load_acquire(&saved_tcpv6_prot))) {
+			spin_lock_bh(&tcpv6_prot_lock);
+			if (likely(sk->sk_prot != saved_tcpv6_prot)) {
+				build_protos(bpf_tcp_prots[SOCKMAP_IPV6],
+					     sk->sk_prot);
+				smp_store_release(&saved_tcpv6_prot,
+						  sk->sk_prot);
+			}
+			spin_unlock_bh(&tcpv6_prot_lock);
+		}
+	} else if (sk->sk_prot != &tcp_prot) {
+		return -EOPNOTSUPP;
+	}
+
+	psock->save_close = sk->sk_prot->close;
+	psock->sk_proto = sk->sk_prot;
+	update_sk_prot(sk, psock);
+	return 0;
+}
+
+static void bpf_tcp_release(struct sock *sk, struct smap_psock *psock)
+{
+	if (psock->sk_proto) {
+		sk->sk_prot = psock->sk_proto;
+		psock->sk_proto = NULL;
+	}
+}
+
+/* Called with sk_callback_lock held */
+static void bpf_tcp_msg_add(struct smap_psock *psock,
+			    struct sock *sk,
+			    struct bpf_prog *tx_msg)
+{
+	struct bpf_prog *orig_tx_msg;
+
+	orig_tx_msg = xchg(&psock->bpf_tx_msg, tx_msg);
+	if (orig_tx_msg)
+		bpf_prog_put(orig_tx_msg);
+	if (psock->sk_proto)
+		update_sk_prot(sk, psock);
+}
+
+/* Drop a reference taken by the data path. The last one detaches the psock
+ * and must be dropped under sk_callback_lock like the map side does.
+ */
+static void smap_psock_put(struct smap_psock *psock, struct sock *sk)
+{
+	if (refcount_dec_not_one(&psock->refcnt))
+		return;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	smap_release_sock(psock, sk);
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+static int smap_msg_size(const struct sk_msg_buff *md)
+{
+	int i, size = 0;
+
+	for (i = md->sg_start; i < md->sg_end; i++)
+		size += md->sg_data[i].length;
+	return size;
+}
+
+/* Move the live entries to the front to make room at the end */
+static void smap_msg_compact(struct sk_msg_buff *md)
+{
+	int i, n = md->sg_end - md->sg_start;
+
+	if (!md->sg_start)
+		return;
+	for (i = 0; i < n; i++)
+		md->sg_data[i] = md->sg_data[md->sg_start + i];
+	md->sg_start = 0;
+	md->sg_end = n;
+}
+
+/* Release up to bytes from the head of a tx message, uncharging them from
+ * sk unless sk is NULL. Returns the number of bytes released.
+ */
+static int free_bytes_sg(struct sock *sk, int bytes, struct sk_msg_buff *md)
+{
+	int freed = 0;
+
+	while (bytes && md->sg_start < md->sg_end) {
+		struct scatterlist *sg = &md->sg_data[md->sg_start];
+		int n = min_t(int, bytes, sg->length);
+
+		sg->length -= n;
+		sg->offset += n;
+		bytes -= n;
+		freed += n;
+		if (sk)
+			sk_mem_uncharge(sk, n);
+		if (!sg->length) {
+			put_page(sg_page(sg));
+			md->sg_start++;
+		}
+	}
+	if (md->sg_start == md->sg_end)
+		md->sg_start = md->sg_end = 0;
+
+	return freed;
+}
+
+static int free_start_sg(struct sock *sk, struct sk_msg_buff *md)
+{
+	return free_bytes_sg(sk, INT_MAX, md);
+}
+
+static void return_mem_sg(struct sock *sk, int bytes, struct sk_msg_buff *md)
+{
+	int i;
+
+	for (i = md->sg_start; bytes > 0 && i < md->sg_end; i++) {
+		int n = min_t(int, bytes, md->sg_data[i].length);
+
+		sk_mem_uncharge(sk, n);
+		bytes -= n;
+	}
+}
+
+static void free_ingress_md(struct sock *sk, struct sk_msg_buff *md)
+{
+	int i;
+
+	for (i = md->sg_start; i < md->sg_end; i++) {
+		sk_mem_uncharge(sk, md->sg_data[i].length);
+		if (!md->skb)
+			put_page(sg_page(&md->sg_data[i]));
+	}
+	if (md->skb)
+		consume_skb(md->skb);
+	kfree(md);
+}
+
+/* Called with lock_sock(sk) held */
+static void smap_free_queued(struct sock *sk, struct smap_psock *psock)
+{
+	struct sk_msg_buff *md, *tmp;
+
+	if (psock->cork) {
+		free_start_sg(sk, psock->cork);
+		kfree(psock->cork);
+		psock->cork = NULL;
+	}
+
+	list_for_each_entry_safe(md, tmp, &psock->ingress, list) {
+		list_del(&md->list);
+		free_ingress_md(sk, md);
+	}
+}
+
+/* Same wakeup as sock_def_readable(), the strparser hook in sk_data_ready
+ * only looks at the receive queue.
+ */
+static void smap_ingress_wake(struct sock *sk)
+{
+	struct socket_wq *wq;
+
+	rcu_read_lock();
+	wq = rcu_dereference(sk->sk_wq);
+	if (skwq_has_sleeper(wq))
+		wake_up_interruptible_sync_poll(&wq->wait, POLLIN |
+						POLLRDNORM | POLLRDBAND);
+	sk_wake_async(sk, SOCK_WAKE_WAITD, POLL_IN);
+	rcu_read_unlock();
+}
+
+static void bpf_compute_data_pointers_sg(struct sk_msg_buff *md)
+{
+	struct scatterlist *sg = md->sg_data + md->sg_start;
+
+	if (md->sg_start < md->sg_end) {
+		md->data = sg_virt(sg);
+		md->data_end = md->data + sg->length;
+	} else {
+		md->data = NULL;
+		md->data_end = NULL;
+	}
+}
+
+static int smap_do_tx_msg(struct sock *sk,
+			  struct smap_psock *psock,
+			  struct sk_msg_buff *md)
+{
+	struct bpf_prog *prog;
+	unsigned int rc, _rc;
+
+	preempt_disable();
+	rcu_read_lock();
+
+	/* If the policy was removed mid-send then default to 'accept' */
+	prog = READ_ONCE(psock->bpf_tx_msg);
+	if (unlikely(!prog)) {
+		_rc = __SK_PASS;
+		goto verdict;
+	}
+
+	bpf_compute_data_pointers_sg(md);
+	md->sk = sk;
+	md->map = NULL;
+	md->flags = 0;
+	md->apply_bytes = 0;
+	md->cork_bytes = 0;
+	rc = (*prog->bpf_func)(md, prog->insnsi);
+	psock->apply_bytes = md->apply_bytes;
+
+	/* Moving return codes from UAPI namespace into internal namespace */
+	_rc = rc == SK_PASS ? (md->map ? __SK_REDIRECT : __SK_PASS) :
+			      __SK_DROP;
+
+	/* The psock holds a reference on the sock but not on the map, look
+	 * the target up now as the map may be gone by the time the verdict
+	 * is applied.
+	 */
+	if (_rc == __SK_REDIRECT) {
+		if (psock->sk_redir)
+			sock_put(psock->sk_redir);
+		psock->redir_ingress = md->flags & BPF_F_INGRESS;
+		psock->sk_redir = do_msg_redirect_map(md);
+		if (!psock->sk_redir) {
+			_rc = __SK_DROP;
+			goto verdict;
+		}
+		sock_hold(psock->sk_redir);
+	}
+verdict:
+	rcu_read_unlock();
+	preempt_enable();
+
+	return _rc;
+}
+
+/* Queue bytes from the head of md on the receive side of sk */
+static int bpf_tcp_ingress(struct sock *sk, int apply_bytes,
+			   struct smap_psock *psock,
+			   struct sk_msg_buff *md)
+{
+	bool apply = apply_bytes;
+	struct sk_msg_buff *r;
+	int copied = 0, err = 0;
+
+	r = kzalloc(sizeof(struct sk_msg_buff), __GFP_NOWARN | GFP_KERNEL);
+	if (unlikely(!r))
+		return -ENOMEM;
+	sg_init_table(r->sg_data, MAX_SKB_FRAGS);
+
+	lock_sock(sk);
+	if (unlikely(sk->sk_shutdown & RCV_SHUTDOWN)) {
+		err = -EPIPE;
+		goto out;
+	}
+
+	while (md->sg_start < md->sg_end) {
+		struct scatterlist *sg = &md->sg_data[md->sg_start];
+		int size = (apply && apply_bytes < sg->length) ?
+			   apply_bytes : sg->length;
+
+		if (!sk_wmem_schedule(sk, size)) {
+			if (!copied)
+				err = -ENOMEM;
+			break;
+		}
+
+		sk_mem_charge(sk, size);
+		r->sg_data[r->sg_end] = *sg;
+		r->sg_data[r->sg_end].length = size;
+		r->sg_end++;
+		sg->length -= size;
+		sg->offset += size;
+		copied += size;
+
+		/* A split entry is referenced by both messages */
+		if (sg->length)
+			get_page(sg_page(sg));
+		else
+			md->sg_start++;
+
+		if (apply) {
+			apply_bytes -= size;
+			if (!apply_bytes)
+				break;
+		}
+	}
+	if (md->sg_start == md->sg_end)
+		md->sg_start = md->sg_end = 0;
+
+	if (copied) {
+		list_add_tail(&r->list, &psock->ingress);
+		smap_ingress_wake(sk);
+		r = NULL;
+	}
+out:
+	release_sock(sk);
+	kfree(r);
+	return err;
+}
+
+/* Transmit bytes from the head of md on sk, called with lock_sock(sk) */
+static int bpf_tcp_push(struct sock *sk, int apply_bytes,
+			struct sk_msg_buff *md,
+			int flags, bool uncharge)
+{
+	bool apply = apply_bytes;
+	struct scatterlist *sg;
+	struct page *p;
+	int ret, size;
+
+	while (md->sg_start < md->sg_end) {
+		sg = md->sg_data + md->sg_start;
+		size = (apply && apply_bytes < sg->length) ?
+			apply_bytes : sg->length;
+		p = sg_page(sg);
+
+		tcp_rate_check_app_limited(sk);
+		ret = do_tcp_sendpages(sk, p, sg->offset, size, flags);
+		if (unlikely(ret <= 0))
+			return ret ? ret : -EPIPE;
+
+		if (apply)
+			apply_bytes -= ret;
+		sg->offset += ret;
+		sg->length -= ret;
+		if (uncharge)
+			sk_mem_uncharge(sk, ret);
+
+		if (!sg->length) {
+			put_page(p);
+			md->sg_start++;
+		}
+
+		if (apply && !apply_bytes)
+			break;
+	}
+	if (md->sg_start == md->sg_end)
+		md->sg_start = md->sg_end = 0;
+
+	return 0;
+}
+
+/* Hand send bytes from the head of md, already uncharged from the sender,
+ * to sk. Whatever could not be delivered is dropped.
+ */
+static int bpf_tcp_sendmsg_do_redirect(struct sock *sk, int send,
+				       struct sk_msg_buff *md,
+				       bool ingress, int flags)
+{
+	int left = smap_msg_size(md) - send;
+	struct smap_psock *psock;
+	int err = -EPIPE;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock || !refcount_inc_not_zero(&psock->refcnt))) {
+		rcu_read_unlock();
+		goto out;
+	}
+	rcu_read_unlock();
+
+	if (ingress) {
+		err = bpf_tcp_ingress(sk, send, psock, md);
+	} else {
+		lock_sock(sk);
+		err = bpf_tcp_push(sk, send, md, flags, false);
+		release_sock(sk);
+	}
+	smap_psock_put(psock, sk);
+out:
+	free_bytes_sg(NULL, smap_msg_size(md) - left, md);
+	return err;
+}
+
+static void apply_bytes_dec(struct smap_psock *psock, int i)
+{
+	if (psock->apply_bytes) {
+		if (psock->apply_bytes < i)
+			psock->apply_bytes = 0;
+		else
+			psock->apply_bytes -= i;
+	}
+}
+
+static void bpf_md_init(struct smap_psock *psock)
+{
+	if (!psock->apply_bytes) {
+		psock->eval =  __SK_NONE;
+		if (psock->sk_redir) {
+			sock_put(psock->sk_redir);
+			psock->sk_redir = NULL;
+		}
+	}
+}
+
+/* Run the verdict on m, or reuse the one still covering apply_bytes, and
+ * act on it until m is empty or corked. Called with lock_sock(sk) held,
+ * *copied is reduced by the bytes that were accepted but then dropped.
+ */
+static int bpf_exec_tx_verdict(struct smap_psock *psock,
+			       struct sk_msg_buff *m,
+			       struct sock *sk,
+			       int *copied, int flags)
+{
+	bool cork = false, enospc;
+	struct sock *redir;
+	int err = 0, size, send;
+
+more_data:
+	enospc = m->sg_end == MAX_SKB_FRAGS;
+	if (psock->eval == __SK_NONE)
+		psock->eval = smap_do_tx_msg(sk, psock, m);
+	size = smap_msg_size(m);
+
+	if (m->cork_bytes && m->cork_bytes > size && !enospc) {
+		psock->cork_bytes = m->cork_bytes - size;
+		psock->apply_bytes = 0;
+		bpf_md_init(psock);
+		if (m == psock->cork)
+			goto out;
+		if (!psock->cork) {
+			psock->cork = kzalloc(sizeof(struct sk_msg_buff),
+					      GFP_ATOMIC | __GFP_NOWARN);
+			if (!psock->cork) {
+				psock->cork_bytes = 0;
+				*copied -= free_start_sg(sk, m);
+				err = -ENOMEM;
+				goto out;
+			}
+		}
+		memcpy(psock->cork, m, sizeof(*m));
+		m->sg_start = m->sg_end = 0;
+		goto out;
+	}
+
+	send = size;
+	if (psock->apply_bytes && psock->apply_bytes < send)
+		send = psock->apply_bytes;
+
+	switch (psock->eval) {
+	case __SK_PASS:
+		err = bpf_tcp_push(sk, send, m, flags, true);
+		if (unlikely(err)) {
+			*copied -= free_start_sg(sk, m);
+			break;
+		}
+		apply_bytes_dec(psock, send);
+		break;
+	case __SK_REDIRECT:
+		redir = psock->sk_redir;
+		sock_hold(redir);
+		apply_bytes_dec(psock, send);
+
+		/* The cork may be replaced while the sock is unlocked */
+		if (m == psock->cork) {
+			cork = true;
+			psock->cork = NULL;
+		}
+
+		return_mem_sg(sk, send, m);
+		release_sock(sk);
+		err = bpf_tcp_sendmsg_do_redirect(redir, send, m,
+						  psock->redir_ingress, flags);
+		lock_sock(sk);
+		sock_put(redir);
+
+		if (unlikely(err < 0)) {
+			*copied -= send;
+			*copied -= free_start_sg(sk, m);
+		}
+		break;
+	case __SK_DROP:
+	default:
+		free_bytes_sg(sk, send, m);
+		apply_bytes_dec(psock, send);
+		*copied -= send;
+		err = -EACCES;
+		break;
+	}
+
+	if (likely(!err)) {
+		bpf_md_init(psock);
+		if (m->sg_start < m->sg_end)
+			goto more_data;
+	}
+out:
+	if (cork) {
+		if (!psock->cork && m->sg_start == m->sg_end) {
+			psock->cork = m;
+		} else {
+			*copied -= free_start_sg(sk, m);
+			kfree(m);
+		}
+	}
+	return err;
+}
+
+/* Copy len bytes from the iterator into page frags appended to md and
+ * charged to sk. The copy is short when md runs out of entries or sk out
+ * of memory.
+ */
+static int bpf_tcp_copy_sg(struct sock *sk, struct sk_msg_buff *md,
+			   struct iov_iter *from, int len)
+{
+	struct page_frag *pfrag = sk_page_frag(sk);
+	int copied = 0, err = -ENOSPC;
+
+	smap_msg_compact(md);
+	while (len > 0) {
+		struct scatterlist *sg = NULL;
+		int use;
+
+		if (!sk_page_frag_refill(sk, pfrag)) {
+			err = -ENOMEM;
+			break;
+		}
+		use = min_t(int, len, pfrag->size - pfrag->offset);
+		if (!sk_wmem_schedule(sk, use)) {
+			err = -ENOMEM;
+			break;
+		}
+
+		if (md->sg_end > md->sg_start) {
+			sg = &md->sg_data[md->sg_end - 1];
+			if (sg_page(sg) != pfrag->page ||
+			    sg->offset + sg->length != pfrag->offset)
+				sg = NULL;
+		}
+		if (!sg) {
+			if (md->sg_end == MAX_SKB_FRAGS)
+				break;
+			sg = &md->sg_data[md->sg_end];
+			if (!copy_from_iter_full(page_address(pfrag->page) +
+						 pfrag->offset, use, from)) {
+				err = -EFAULT;
+				break;
+			}
+			sg_set_page(sg, pfrag->page, 0, pfrag->offset);
+			get_page(pfrag->page);
+			md->sg_end++;
+		} else if (!copy_from_iter_full(page_address(pfrag->page) +
+						pfrag->offset, use, from)) {
+			err = -EFAULT;
+			break;
+		}
+
+		sg->length += use;
+		sk_mem_charge(sk, use);
+		pfrag->offset += use;
+		copied += use;
+		len -= use;
+	}
+
+	return copied ? copied : err;
+}
+
+static int bpf_tcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
+{
+	int flags = msg->msg_flags;
+	struct sk_msg_buff md = {0};
+	struct smap_psock *psock;
+	int copied = 0, err = 0;
+	long timeo;
+
+	/* The psock may have been removed before the proto was restored, in
+	 * that case this is a plain TCP socket again.
+	 */
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock || !refcount_inc_not_zero(&psock->refcnt))) {
+		rcu_read_unlock();
+		return tcp_sendmsg(sk, msg, size);
+	}
+	rcu_read_unlock();
+
+	sg_init_table(md.sg_data, MAX_SKB_FRAGS);
+	lock_sock(sk);
+	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
+
+	while (msg_data_left(msg)) {
+		bool enospc = false;
+		struct sk_msg_buff *m;
+		int copy;
+
+		if (sk->sk_err) {
+			err = -sk->sk_err;
+			goto out_err;
+		}
+
+		if (!sk_stream_memory_free(sk))
+			goto wait_for_sndbuf;
+
+		m = psock->cork_bytes ? psock->cork : &md;
+		copy = bpf_tcp_copy_sg(sk, m, &msg->msg_iter,
+				       msg_data_left(msg));
+		if (copy == -ENOMEM)
+			goto wait_for_memory;
+		if (copy == -ENOSPC)
+			copy = 0;
+		else if (copy < 0) {
+			err = copy;
+			goto out_err;
+		}
+		copied += copy;
+		enospc = m->sg_end == MAX_SKB_FRAGS;
+
+		/* While corking only account the bytes, unless the message
+		 * is full. Programs must cope with cork requests that are
+		 * not honored, checking the data length tells them apart.
+		 */
+		if (psock->cork_bytes) {
+			if (copy > psock->cork_bytes)
+				psock->cork_bytes = 0;
+			else
+				psock->cork_bytes -= copy;
+
+			if (psock->cork_bytes && !enospc)
+				continue;
+
+			/* All cork bytes accounted for re-run filter */
+			psock->eval = __SK_NONE;
+			psock->cork_bytes = 0;
+		}
+
+		err = bpf_exec_tx_verdict(psock, m, sk, &copied, flags);
+		if (unlikely(err < 0))
+			goto out_err;
+		continue;
+wait_for_sndbuf:
+		set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+wait_for_memory:
+		err = sk_stream_wait_memory(sk, &timeo);
+		if (err)
+			goto out_err;
+	}
+out_err:
+	/* Bytes copied in but not yet given a verdict are dropped */
+	if (md.sg_start < md.sg_end)
+		copied -= free_start_sg(sk, &md);
+	if (err < 0)
+		err = sk_stream_error(sk, msg->msg_flags, err);
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+	return copied > 0 ? copied : err;
+}
+
+static int bpf_tcp_sendpage(struct sock *sk, struct page *page,
+			    int offset, size_t size, int flags)
+{
+	struct sk_msg_buff md = {0}, *m;
+	struct smap_psock *psock;
+	int err = 0, copied = 0;
+	bool enospc;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock || !refcount_inc_not_zero(&psock->refcnt))) {
+		rcu_read_unlock();
+		return tcp_sendpage(sk, page, offset, size, flags);
+	}
+	rcu_read_unlock();
+
+	lock_sock(sk);
+	if (psock->cork_bytes) {
+		m = psock->cork;
+		smap_msg_compact(m);
+	} else {
+		m = &md;
+		sg_init_table(m->sg_data, MAX_SKB_FRAGS);
+	}
+
+	if (unlikely(m->sg_end == MAX_SKB_FRAGS)) {
+		err = -EAGAIN;
+		goto out_err;
+	}
+	if (!sk_wmem_schedule(sk, size)) {
+		err = -ENOMEM;
+		goto out_err;
+	}
+
+	sg_set_page(&m->sg_data[m->sg_end++], page, size, offset);
+	get_page(page);
+	sk_mem_charge(sk, size);
+	copied = size;
+	enospc = m->sg_end == MAX_SKB_FRAGS;
+
+	if (psock->cork_bytes) {
+		if (size > psock->cork_bytes)
+			psock->cork_bytes = 0;
+		else
+			psock->cork_bytes -= size;
+
+		if (psock->cork_bytes && !enospc)
+			goto out_err;
+
+		/* All cork bytes accounted for re-run filter */
+		psock->eval = __SK_NONE;
+		psock->cork_bytes = 0;
+	}
+
+	err = bpf_exec_tx_verdict(psock, m, sk, &copied, flags);
+out_err:
+	if (md.sg_start < md.sg_end)
+		copied -= free_start_sg(sk, &md);
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+	return copied > 0 ? copied : err;
+}
+
+/* Copy from psock->ingress, called with lock_sock(sk) held */
+static int bpf_tcp_recv_ingress(struct sock *sk, struct smap_psock *psock,
+				struct msghdr *msg, int len, int flags)
+{
+	struct iov_iter *iter = &msg->msg_iter;
+	bool peek = flags & MSG_PEEK;
+	struct sk_msg_buff *md, *tmp;
+	int copied = 0;
+
+	list_for_each_entry_safe(md, tmp, &psock->ingress, list) {
+		int i;
+
+		for (i = md->sg_start; i < md->sg_end && copied < len; i++) {
+			struct scatterlist *sg = &md->sg_data[i];
+			int copy = min_t(int, sg->length, len - copied);
+
+			if (copy_page_to_iter(sg_page(sg), sg->offset,
+					      copy, iter) != copy)
+				return copied ? copied : -EFAULT;
+			copied += copy;
+			if (peek)
+				continue;
+
+			sg->offset += copy;
+			sg->length -= copy;
+			sk_mem_uncharge(sk, copy);
+			if (sg->length)
+				break;
+			if (!md->skb)
+				put_page(sg_page(sg));
+			md->sg_start++;
+		}
+
+		if (!peek && md->sg_start == md->sg_end) {
+			list_del(&md->list);
+			if (md->skb)
+				consume_skb(md->skb);
+			kfree(md);
+		}
+		if (copied == len)
+			break;
+	}
+
+	return copied;
+}
+
+static int bpf_tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			   int nonblock, int flags, int *addr_len)
+{
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+	struct smap_psock *psock;
+	int copied;
+	long timeo;
+
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return inet_recv_error(sk, msg, len, addr_len);
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock || !refcount_inc_not_zero(&psock->refcnt))) {
+		rcu_read_unlock();
+		return tcp_recvmsg(sk, msg, len, nonblock, flags, addr_len);
+	}
+	rcu_read_unlock();
+
+	timeo = sock_rcvtimeo(sk, nonblock);
+	lock_sock(sk);
+	for (;;) {
+		copied = bpf_tcp_recv_ingress(sk, psock, msg,
+					      min_t(size_t, len, INT_MAX),
+					      flags);
+		if (copied)
+			break;
+
+		/* TCP data, errors, shutdown, timeouts and signals are all
+		 * left to tcp_recvmsg().
+		 */
+		if (!skb_queue_empty(&sk->sk_receive_queue) || sk->sk_err ||
+		    (sk->sk_shutdown & RCV_SHUTDOWN) ||
+		    sock_flag(sk, SOCK_DONE) || !timeo ||
+		    signal_pending(current))
+			break;
+
+		add_wait_queue(sk_sleep(sk), &wait);
+		sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+		sk_wait_event(sk, &timeo,
+			      !list_empty(&psock->ingress) ||
+			      !skb_queue_empty(&sk->sk_receive_queue) ||
+			      sk->sk_err || (sk->sk_shutdown & RCV_SHUTDOWN),
+			      &wait);
+		sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+		remove_wait_queue(sk_sleep(sk), &wait);
+	}
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+
+	if (copied)
+		return copied;
+	return tcp_recvmsg(sk, msg, len, !timeo, flags, addr_len);
+}
+
+static bool bpf_tcp_stream_read(const struct sock *sk)
+{
+	struct smap_psock *psock;
+	bool empty = true;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock))
+		empty = list_empty(&psock->ingress);
+	rcu_read_unlock();
+	return !empty;
+}
+
+static void bpf_tcp_close(struct sock *sk, long timeout)
+{
+	void (*close_fun)(struct sock *sk, long timeout);
+	struct smap_psock_map_entry *e, *tmp;
+	struct smap_psock *psock;
+	struct sock *osk;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock)) {
+		rcu_read_unlock();
+		return tcp_close(sk, timeout);
+	}
+
+	/* The psock may be destroyed once the last reference is dropped, the
+	 * close hook of the original proto stays valid.
+	 */
+	close_fun = psock->save_close;
+	if (unlikely(!refcount_inc_not_zero(&psock->refcnt))) {
+		rcu_read_unlock();
+		return close_fun(sk, timeout);
+	}
+	rcu_read_unlock();
+
+	/* Queued data is charged to sk and must go before TCP tears it down */
+	lock_sock(sk);
+	smap_free_queued(sk, psock);
+	release_sock(sk);
+
+	write_lock_bh(&sk->sk_callback_lock);
+	list_for_each_entry_safe(e, tmp, &psock->maps, list) {
+		osk = cmpxchg(e->entry, sk, NULL);
+		if (osk == sk) {
+			list_del(&e->list);
+			kfree(e);
+			smap_release_sock(psock, sk);
+		}
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	smap_psock_put(psock, sk);
+	close_fun(sk, timeout);
+}
+
+/* Queue a redirected skb on the receive side of psock->sock, the pages stay
+ * with the skb until they are read.
+ */
+static int smap_do_ingress(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct sock *sk = psock->sock;
+	struct sk_msg_buff *r;
+	int num_sg;
+
+	if (unlikely(sk->sk_shutdown & RCV_SHUTDOWN))
+		return -EPIPE;
+
+	if (skb_has_frag_list(skb) ||
+	    skb_shinfo(skb)->nr_frags >= MAX_SKB_FRAGS) {
+		if (skb_linearize(skb))
+			return -ENOMEM;
+	}
+
+	r = kzalloc(sizeof(struct sk_msg_buff), __GFP_NOWARN | GFP_ATOMIC);
+	if (unlikely(!r))
+		return -EAGAIN;
+
+	if (!sk_rmem_schedule(sk, skb, skb->len)) {
+		kfree(r);
+		return -EAGAIN;
+	}
+
+	sg_init_table(r->sg_data, MAX_SKB_FRAGS);
+	num_sg = skb_to_sgvec(skb, r->sg_data, 0, skb->len);
+	if (unlikely(num_sg < 0)) {
+		kfree(r);
+		return num_sg;
+	}
+
+	sk_mem_charge(sk, skb->len);
+	r->sg_end = num_sg;
+	r->skb = skb;
+	list_add_tail(&r->list, &psock->ingress);
+	smap_ingress_wake(sk);
+	return skb->len;
+}
+
 /* Called with lock_sock(sk) held */
 static void smap_state_change(struct sock *sk)
 {
@@ -264,6 +1252,7 @@ static void smap_tx_work(struct work_struct *w)
 	struct smap_psock *psock;
 	struct sk_buff *skb;
 	int rem, off, n;
+	bool ingress;
 
 	psock = container_of(w, struct smap_psock, tx_work);
 
@@ -281,12 +1270,17 @@ static void smap_tx_work(struct work_struct *w)
 		rem = skb->len;
 		off = 0;
 start:
+		ingress = TCP_SKB_CB(skb)->bpf.flags & BPF_F_INGRESS;
 		do {
-			if (likely(psock->sock->sk_socket))
-				n = skb_send_sock_locked(psock->sock,
-							 skb, off, rem);
-			else
+			if (likely(psock->sock->sk_socket)) {
+				if (ingress)
+					n = smap_do_ingress(psock, skb);
+				else
+					n = skb_send_sock_locked(psock->sock,
+								 skb, off, rem);
+			} else {
 				n = -EINVAL;
+			}
 			if (n <= 0) {
 				if (n == -EAGAIN) {
 					/* Retry when space is available */
@@ -304,7 +1298,10 @@ static void smap_tx_work(struct work_struct *w)
 			rem -= n;
 			off += n;
 		} while (rem);
-		kfree_skb(skb);
+
+		/* An skb queued on ingress is freed once read */
+		if (!ingress)
+			kfree_skb(skb);
 	}
 out:
 	release_sock(psock->sock);
@@ -354,10 +1351,10 @@ static void smap_destroy_psock(struct rcu_head *rcu)
 
 static void smap_release_sock(struct smap_psock *psock, struct sock *sock)
 {
-	psock->refcnt--;
-	if (psock->refcnt)
+	if (!refcount_dec_and_test(&psock->refcnt))
 		return;
 
+	bpf_tcp_release(sock, psock);
 	smap_stop_sock(psock, sock);
 	clear_bit(SMAP_TX_RUNNING, &psock->state);
 	rcu_assign_sk_user_data(sock, NULL);
@@ -462,11 +1459,20 @@ static void smap_gc_work(struct work_struct *w)
 	cancel_work_sync(&psock->tx_work);
 	__skb_queue_purge(&psock->rxqueue);
 
+	lock_sock(psock->sock);
+	smap_free_queued(psock->sock, psock);
+	release_sock(psock->sock);
+
+	if (psock->sk_redir)
+		sock_put(psock->sk_redir);
+
 	/* At this point all strparser and xmit work must be complete */
 	if (psock->bpf_parse)
 		bpf_prog_put(psock->bpf_parse);
 	if (psock->bpf_verdict)
 		bpf_prog_put(psock->bpf_verdict);
+	if (psock->bpf_tx_msg)
+		bpf_prog_put(psock->bpf_tx_msg);
 
 	list_for_each_entry_safe(e, tmp, &psock->maps, list) {
 		list_del(&e->list);
@@ -493,7 +1499,9 @@ static struct smap_psock *smap_init_psock(struct sock *sock,
 	INIT_WORK(&psock->tx_work, smap_tx_work);
 	INIT_WORK(&psock->gc_work, smap_gc_work);
 	INIT_LIST_HEAD(&psock->maps);
-	psock->refcnt = 1;
+	INIT_LIST_HEAD(&psock->ingress);
+	psock->eval = __SK_NONE;
+	refcount_set(&psock->refcnt, 1);
 
 	rcu_assign_sk_user_data(sock, psock);
 	sock_hold(sock);
@@ -697,7 +1705,7 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 {
 	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
 	struct smap_psock_map_entry *e = NULL;
-	struct bpf_prog *verdict, *parse;
+	struct bpf_prog *verdict, *parse, *tx_msg;
 	struct sock *osock, *sock;
 	struct smap_psock *psock;
 	u32 i = *(u32 *)key;
@@ -717,12 +1725,21 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 
 	sock = skops->sk;
 
+	/* A listener's sk_prot and psock would leak into every accepted
+	 * child. Passive children are still in SYN_RECV when
+	 * BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB runs, both for regular and
+	 * fast open connections.
+	 */
+	if (!((1 << sock->sk_state) & (TCPF_ESTABLISHED | TCPF_SYN_RECV)))
+		return -EOPNOTSUPP;
+
 	/* 1. If sock map has BPF programs those will be inherited by the
 	 * sock being added. If the sock is already attached to BPF programs
 	 * this results in an error.
 	 */
 	verdict = READ_ONCE(stab->bpf_verdict);
 	parse = READ_ONCE(stab->bpf_parse);
+	tx_msg = READ_ONCE(stab->bpf_tx_msg);
 
 	if (parse && verdict) {
 		/* bpf prog refcnt may be zero if a concurrent attach operation
@@ -741,6 +1758,17 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		}
 	}
 
+	if (tx_msg) {
+		tx_msg = bpf_prog_inc_not_zero(stab->bpf_tx_msg);
+		if (IS_ERR(tx_msg)) {
+			if (verdict)
+				bpf_prog_put(verdict);
+			if (parse)
+				bpf_prog_put(parse);
+			return PTR_ERR(tx_msg);
+		}
+	}
+
 	write_lock_bh(&sock->sk_callback_lock);
 	psock = smap_psock_sk(sock);
 
@@ -755,7 +1783,11 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 			err = -EBUSY;
 			goto out_progs;
 		}
-		psock->refcnt++;
+		if (READ_ONCE(psock->bpf_tx_msg) && tx_msg) {
+			err = -EBUSY;
+			goto out_progs;
+		}
+		refcount_inc(&psock->refcnt);
 	} else {
 		psock = smap_init_psock(sock, stab);
 		if (IS_ERR(psock)) {
@@ -764,12 +1796,16 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		}
 
 		set_bit(SMAP_TX_RUNNING, &psock->state);
+
+		err = bpf_tcp_init(sock, psock);
+		if (err)
+			goto out_free;
 	}
 
 	e = kzalloc(sizeof(*e), GFP_ATOMIC | __GFP_NOWARN);
 	if (!e) {
 		err = -ENOMEM;
-		goto out_progs;
+		goto out_free;
 	}
 	e->entry = &stab->sock_map[i];
 
@@ -784,6 +1820,9 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		smap_start_sock(psock, sock);
 	}
 
+	if (tx_msg)
+		bpf_tcp_msg_add(psock, sock, tx_msg);
+
 	/* 4. Place psock in sockmap for use and stop any programs on
 	 * the old sock assuming its not the same sock we are replacing
 	 * it with. Because we can only have a single set of programs if
@@ -811,6 +1850,8 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		bpf_prog_put(verdict);
 	if (parse)
 		bpf_prog_put(parse);
+	if (tx_msg)
+		bpf_prog_put(tx_msg);
 	write_unlock_bh(&sock->sk_callback_lock);
 	kfree(e);
 	return err;
@@ -831,6 +1872,9 @@ int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
 	case BPF_SK_SKB_STREAM_VERDICT:
 		orig = xchg(&stab->bpf_verdict, prog);
 		break;
+	case BPF_SK_MSG_VERDICT:
+		orig = xchg(&stab->bpf_tx_msg, prog);
+		break;
 	default:
 		return -EOPNOTSUPP;
 	}
@@ -886,6 +1930,9 @@ static void sock_map_release(struct bpf_map *map)
 	orig = xchg(&stab->bpf_verdict, NULL);
 	if (orig)
 		bpf_prog_put(orig);
+	orig = xchg(&stab->bpf_tx_msg, NULL);
+	if (orig)
+		bpf_prog_put(orig);
 }
 
 const struct bpf_map_ops sock_map_ops = {
@@ -915,3 +1962,10 @@ const struct bpf_func_proto bpf_sock_map_update_proto = {
 	.arg3_type	= ARG_PTR_TO_MAP_KEY,
 	.arg4_type	= ARG_ANYTHING,
 };
+
+static int __init bpf_sock_map_init(void)
+{
+	build_protos(bpf_tcp_prots[SOCKMAP_IPV4], &tcp_prot);
+	return 0;
+}
+core_initcall(bpf_sock_map_init);
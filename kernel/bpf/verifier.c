@@ -151,6 +151,8 @@ struct bpf_call_arg_meta {
 	bool pkt_access;
 	int regno;
 	int access_size;
+	u32 mem_size;
+	u32 release_id;
 };
 
 /* verbose verifier prints what it's seeing
@@ -188,6 +190,8 @@ static const char * const reg_type_str[] = {
 	[PTR_TO_STACK]		= "fp",
 	[PTR_TO_PACKET]		= "pkt",
 	[PTR_TO_PACKET_END]	= "pkt_end",
+	[PTR_TO_MEM]		= "mem",
+	[PTR_TO_MEM_OR_NULL]	= "mem_or_null",
 };
 
 #define __BPF_FUNC_STR_FN(x) [BPF_FUNC_ ## x] = __stringify(bpf_ ## x)
@@ -234,6 +238,9 @@ static void print_verifier_state(struct bpf_verifier_state *state)
 				verbose(",ks=%d,vs=%d",
 					reg->map_ptr->key_size,
 					reg->map_ptr->value_size);
+			else if (t == PTR_TO_MEM ||
+				 t == PTR_TO_MEM_OR_NULL)
+				verbose(",sz=%u", reg->mem_size);
 			if (tnum_is_const(reg->var_off)) {
 				/* Typically an immediate SCALAR_VALUE, but
 				 * could be a pointer whose offset is too big
@@ -270,9 +277,47 @@ static void print_verifier_state(struct bpf_verifier_state *state)
 			verbose(" fp%d=%s", -MAX_BPF_STACK + i,
 				reg_type_str[state->spilled_regs[i / BPF_REG_SIZE].type]);
 	}
+	for (i = 0; i < state->acquired_refs; i++)
+		verbose(" ref%d=%d", state->refs[i].id, state->refs[i].insn_idx);
 	verbose("\n");
 }
 
+/* Record memory handed out by a helper at insn_idx, the program has to give
+ * it back before it exits.  Returns the id the pointers to it carry.
+ */
+static int acquire_reference_state(struct bpf_verifier_env *env, int insn_idx)
+{
+	struct bpf_verifier_state *state = &env->cur_state;
+	int n = state->acquired_refs;
+
+	if (n >= BPF_MAX_ACQUIRED_REFS) {
+		verbose("more than %d references held\n", BPF_MAX_ACQUIRED_REFS);
+		return -E2BIG;
+	}
+	state->refs[n].id = ++env->id_gen;
+	state->refs[n].insn_idx = insn_idx;
+	state->acquired_refs++;
+	return state->refs[n].id;
+}
+
+/* Order is kept, states_equal() compares the refs pairwise */
+static int release_reference_state(struct bpf_verifier_state *state, u32 id)
+{
+	int i;
+
+	for (i = 0; i < state->acquired_refs; i++) {
+		if (state->refs[i].id != id)
+			continue;
+		state->acquired_refs--;
+		memmove(&state->refs[i], &state->refs[i + 1],
+			(state->acquired_refs - i) * sizeof(state->refs[0]));
+		memset(&state->refs[state->acquired_refs], 0,
+		       sizeof(state->refs[0]));
+		return 0;
+	}
+	return -EINVAL;
+}
+
 static const char *const bpf_class_string[] = {
 	[BPF_LD]    = "ld",
 	[BPF_LDX]   = "ldx",
@@ -708,6 +753,8 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 	case PTR_TO_PACKET:
 	case PTR_TO_PACKET_END:
 	case CONST_PTR_TO_MAP:
+	case PTR_TO_MEM:
+	case PTR_TO_MEM_OR_NULL:
 		return true;
 	default:
 		return false;
@@ -766,8 +813,15 @@ static int check_stack_write(struct bpf_verifier_env *env,
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
 		}
 	} else {
-		/* regular write of data into stack */
+		enum bpf_reg_liveness live = state->spilled_regs[spi].live;
+
+		/* regular write of data into stack, only overwriting the
+		 * whole slot screens off reads of it from the parent
+		 */
 		state->spilled_regs[spi] = (struct bpf_reg_state) {};
+		if (size == BPF_REG_SIZE)
+			live |= REG_LIVE_WRITTEN;
+		state->spilled_regs[spi].live = live;
 
 		for (i = 0; i < size; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_MISC;
@@ -826,6 +880,7 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 				return -EACCES;
 			}
 		}
+		mark_stack_slot_read(state, (MAX_BPF_STACK + off) / BPF_REG_SIZE);
 		if (value_regno >= 0)
 			/* have read misc data from the stack */
 			mark_reg_unknown(state->regs, value_regno);
@@ -833,11 +888,23 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 	}
 }
 
-/* check read/write into map element returned by bpf_map_lookup_elem() */
+/* check read/write into map element returned by bpf_map_lookup_elem(), or
+ * into memory returned by a RET_PTR_TO_ALLOC_MEM_OR_NULL helper
+ */
 static int __check_map_access(struct bpf_verifier_env *env, u32 regno, int off,
 			    int size)
 {
-	struct bpf_map *map = env->cur_state.regs[regno].map_ptr;
+	struct bpf_reg_state *reg = &env->cur_state.regs[regno];
+	struct bpf_map *map = reg->map_ptr;
+
+	if (reg->type == PTR_TO_MEM) {
+		if (off < 0 || size <= 0 || off + size > reg->mem_size) {
+			verbose("invalid access to memory, mem_size=%u off=%d size=%d\n",
+				reg->mem_size, off, size);
+			return -EACCES;
+		}
+		return 0;
+	}
 
 	if (off < 0 || size <= 0 || off + size > map->value_size) {
 		verbose("invalid access to map value, value_size=%d off=%d size=%d\n",
@@ -859,7 +926,7 @@ static int check_map_access(struct bpf_verifier_env *env, u32 regno,
 	 * need to try adding each of min_value and max_value to off
 	 * to make sure our theoretical access will be safe.
 	 */
-	if (log_level)
+	if (log_level & BPF_LOG_LEVEL)
 		print_verifier_state(state);
 	/* The minimum value is only important with signed
 	 * comparisons where we can't assume the floor of a
@@ -902,7 +969,10 @@ static bool may_access_direct_pkt_data(struct bpf_verifier_env *env,
 	switch (env->prog->type) {
 	case BPF_PROG_TYPE_LWT_IN:
 	case BPF_PROG_TYPE_LWT_OUT:
-		/* dst_input() and dst_output() can't write for now */
+	case BPF_PROG_TYPE_SK_MSG:
+		/* dst_input() and dst_output() can't write for now, sk_msg
+		 * pages may be shared with the sender
+		 */
 		if (t == BPF_WRITE)
 			return false;
 		/* fallthrough */
@@ -1172,6 +1242,17 @@ static int check_mem_access(struct bpf_verifier_env *env, int insn_idx, u32 regn
 		if (!err && t == BPF_READ && value_regno >= 0)
 			mark_reg_unknown(state->regs, value_regno);
 
+	} else if (reg->type == PTR_TO_MEM) {
+		if (t == BPF_WRITE && value_regno >= 0 &&
+		    is_pointer_value(env, value_regno)) {
+			verbose("R%d leaks addr into mem\n", value_regno);
+			return -EACCES;
+		}
+
+		err = check_map_access(env, regno, off, size);
+		if (!err && t == BPF_READ && value_regno >= 0)
+			mark_reg_unknown(state->regs, value_regno);
+
 	} else if (reg->type == PTR_TO_CTX) {
 		enum bpf_reg_type reg_type = SCALAR_VALUE;
 
@@ -1382,6 +1463,9 @@ static int check_stack_boundary(struct bpf_verifier_env *env, int regno,
 			return -EACCES;
 		}
 	}
+	for (i = (MAX_BPF_STACK + off) / BPF_REG_SIZE;
+	     i <= (MAX_BPF_STACK + off + access_size - 1) / BPF_REG_SIZE; i++)
+		mark_stack_slot_read(state, i);
 	return 0;
 }
 
@@ -1395,6 +1479,7 @@ static int check_helper_mem_access(struct bpf_verifier_env *env, int regno,
 	case PTR_TO_PACKET:
 		return check_packet_access(env, regno, reg->off, access_size);
 	case PTR_TO_MAP_VALUE:
+	case PTR_TO_MEM:
 		return check_map_access(env, regno, reg->off, access_size);
 	default: /* scalar_value|ptr_to_stack or invalid ptr */
 		return check_stack_boundary(env, regno, access_size,
@@ -1437,7 +1522,8 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		if (type != PTR_TO_PACKET && type != expected_type)
 			goto err_type;
 	} else if (arg_type == ARG_CONST_SIZE ||
-		   arg_type == ARG_CONST_SIZE_OR_ZERO) {
+		   arg_type == ARG_CONST_SIZE_OR_ZERO ||
+		   arg_type == ARG_CONST_ALLOC_SIZE_OR_ZERO) {
 		expected_type = SCALAR_VALUE;
 		if (type != expected_type)
 			goto err_type;
@@ -1459,9 +1545,20 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		if (register_is_null(*reg))
 			/* final test in check_stack_boundary() */;
 		else if (type != PTR_TO_PACKET && type != PTR_TO_MAP_VALUE &&
-			 type != expected_type)
+			 type != PTR_TO_MEM && type != expected_type)
 			goto err_type;
 		meta->raw_mode = arg_type == ARG_PTR_TO_UNINIT_MEM;
+	} else if (arg_type == ARG_PTR_TO_ALLOC_MEM) {
+		expected_type = PTR_TO_MEM;
+		if (type != expected_type)
+			goto err_type;
+		/* The helper gets the memory back, not a pointer into it */
+		if (reg->off || !tnum_equals_const(reg->var_off, 0)) {
+			verbose("R%d must point to the start of the allocated memory\n",
+				regno);
+			return -EACCES;
+		}
+		meta->release_id = reg->id;
 	} else {
 		verbose("unsupported arg_type %d\n", arg_type);
 		return -EFAULT;
@@ -1555,6 +1652,15 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		err = check_helper_mem_access(env, regno - 1,
 					      reg->umax_value,
 					      zero_size_allowed, meta);
+	} else if (arg_type == ARG_CONST_ALLOC_SIZE_OR_ZERO) {
+		/* The size of the returned memory must be known, the
+		 * helper checks it against what it can hand out.
+		 */
+		if (!tnum_is_const(reg->var_off)) {
+			verbose("R%d is not a known constant\n", regno);
+			return -EACCES;
+		}
+		meta->mem_size = reg->var_off.value;
 	}
 
 	return err;
@@ -1597,6 +1703,11 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (func_id != BPF_FUNC_redirect_map)
 			goto error;
 		break;
+	/* Restrict bpf side of cpumap, open when use-cases appear */
+	case BPF_MAP_TYPE_CPUMAP:
+		if (func_id != BPF_FUNC_redirect_map)
+			goto error;
+		break;
 	case BPF_MAP_TYPE_ARRAY_OF_MAPS:
 	case BPF_MAP_TYPE_HASH_OF_MAPS:
 		if (func_id != BPF_FUNC_map_lookup_elem)
@@ -1608,6 +1719,12 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		    func_id != BPF_FUNC_map_delete_elem)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output &&
+		    func_id != BPF_FUNC_ringbuf_reserve &&
+		    func_id != BPF_FUNC_ringbuf_query)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1633,7 +1750,8 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 			goto error;
 		break;
 	case BPF_FUNC_redirect_map:
-		if (map->map_type != BPF_MAP_TYPE_DEVMAP)
+		if (map->map_type != BPF_MAP_TYPE_DEVMAP &&
+		    map->map_type != BPF_MAP_TYPE_CPUMAP)
 			goto error;
 		break;
 	case BPF_FUNC_sk_redirect_map:
@@ -1644,6 +1762,12 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_reserve:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1673,6 +1797,33 @@ static int check_raw_mode(const struct bpf_func_proto *fn)
 	return count > 1 ? -EINVAL : 0;
 }
 
+/* Memory given back to a helper can't be used anymore, turn all the pointers
+ * to it into unknown SCALAR_VALUE.
+ */
+static int release_reference(struct bpf_verifier_env *env, u32 id)
+{
+	struct bpf_verifier_state *state = &env->cur_state;
+	struct bpf_reg_state *regs = state->regs, *reg;
+	int i;
+
+	if (release_reference_state(state, id))
+		return -EINVAL;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if (regs[i].type == PTR_TO_MEM && regs[i].id == id)
+			mark_reg_unknown(regs, i);
+
+	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
+		if (state->stack_slot_type[i] != STACK_SPILL)
+			continue;
+		reg = &state->spilled_regs[i / BPF_REG_SIZE];
+		if (reg->type != PTR_TO_MEM || reg->id != id)
+			continue;
+		__mark_reg_unknown(reg);
+	}
+	return 0;
+}
+
 /* Packet data might have moved, any old PTR_TO_PACKET[_END] are now invalid,
  * so turn them into unknown SCALAR_VALUE.
  */
@@ -1754,6 +1905,10 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 			verbose("verifier bug\n");
 			return -EINVAL;
 		}
+		if (state->acquired_refs) {
+			verbose("tail_call would lead to reference leak\n");
+			return -EINVAL;
+		}
 		env->insn_aux_data[insn_idx].map_ptr = meta.map_ptr;
 	}
 	err = check_func_arg(env, BPF_REG_3, fn->arg3_type, &meta);
@@ -1776,6 +1931,15 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 			return err;
 	}
 
+	if (meta.release_id) {
+		err = release_reference(env, meta.release_id);
+		if (err) {
+			verbose("func %s#%d reference has not been acquired before\n",
+				func_id_name(func_id), func_id);
+			return err;
+		}
+	}
+
 	/* reset caller saved regs */
 	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		mark_reg_not_init(regs, caller_saved[i]);
@@ -1810,6 +1974,16 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 			insn_aux->map_ptr = meta.map_ptr;
 		else if (insn_aux->map_ptr != meta.map_ptr)
 			insn_aux->map_ptr = BPF_MAP_PTR_POISON;
+	} else if (fn->ret_type == RET_PTR_TO_ALLOC_MEM_OR_NULL) {
+		int id = acquire_reference_state(env, insn_idx);
+
+		if (id < 0)
+			return id;
+		mark_reg_known_zero(regs, BPF_REG_0);
+		regs[BPF_REG_0].type = PTR_TO_MEM_OR_NULL;
+		regs[BPF_REG_0].raw = 0;
+		regs[BPF_REG_0].mem_size = meta.mem_size;
+		regs[BPF_REG_0].id = id;
 	} else {
 		verbose("unknown return type %d of func %s#%d\n",
 			fn->ret_type, func_id_name(func_id), func_id);
@@ -1924,6 +2098,12 @@ static int adjust_ptr_min_max_vals(struct bpf_verifier_env *env,
 				dst);
 		return -EACCES;
 	}
+	if (ptr_reg->type == PTR_TO_MEM_OR_NULL) {
+		if (!env->allow_ptr_leaks)
+			verbose("R%d pointer arithmetic on PTR_TO_MEM_OR_NULL prohibited, null-check it first\n",
+				dst);
+		return -EACCES;
+	}
 	if (ptr_reg->type == CONST_PTR_TO_MAP) {
 		if (!env->allow_ptr_leaks)
 			verbose("R%d pointer arithmetic on CONST_PTR_TO_MAP prohibited\n",
@@ -2874,6 +3054,23 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 {
 	struct bpf_reg_state *reg = &regs[regno];
 
+	if (reg->type == PTR_TO_MEM_OR_NULL && reg->id == id) {
+		if (WARN_ON_ONCE(reg->smin_value || reg->smax_value ||
+				 !tnum_equals_const(reg->var_off, 0) ||
+				 reg->off)) {
+			__mark_reg_known_zero(reg);
+			reg->off = 0;
+		}
+		/* The id stays, it names the reference until released */
+		if (is_null) {
+			reg->type = SCALAR_VALUE;
+			reg->id = 0;
+		} else {
+			reg->type = PTR_TO_MEM;
+		}
+		return;
+	}
+
 	if (reg->type == PTR_TO_MAP_VALUE_OR_NULL && reg->id == id) {
 		/* Old offset (both fixed and variable parts) should
 		 * have been known-zero, because we don't allow pointer
@@ -2911,6 +3108,10 @@ static void mark_map_regs(struct bpf_verifier_state *state, u32 regno,
 	u32 id = regs[regno].id;
 	int i;
 
+	/* Nothing was allocated, there is nothing to give back */
+	if (is_null && regs[regno].type == PTR_TO_MEM_OR_NULL)
+		WARN_ON_ONCE(release_reference_state(state, id));
+
 	for (i = 0; i < MAX_BPF_REG; i++)
 		mark_map_reg(regs, i, id, is_null);
 
@@ -2921,13 +3122,92 @@ static void mark_map_regs(struct bpf_verifier_state *state, u32 regno,
 	}
 }
 
+/* compute branch direction of the expression "if (reg opcode val) goto target;"
+ * and return:
+ *  1 - branch will be taken and "goto target" will be executed
+ *  0 - branch will not be taken and fall-through to next insn
+ * -1 - unknown. Example: "if (reg < 5)" is unknown when register value range [0,10]
+ */
+static int is_branch_taken(struct bpf_reg_state *reg, u64 val, u8 opcode)
+{
+	if (reg->type != SCALAR_VALUE)
+		return -1;
+
+	switch (opcode) {
+	case BPF_JEQ:
+		if (tnum_is_const(reg->var_off))
+			return !!tnum_equals_const(reg->var_off, val);
+		break;
+	case BPF_JNE:
+		if (tnum_is_const(reg->var_off))
+			return !tnum_equals_const(reg->var_off, val);
+		break;
+	case BPF_JSET:
+		if ((~reg->var_off.mask & reg->var_off.value) & val)
+			return 1;
+		if (!((reg->var_off.mask | reg->var_off.value) & val))
+			return 0;
+		break;
+	case BPF_JGT:
+		if (reg->umin_value > val)
+			return 1;
+		else if (reg->umax_value <= val)
+			return 0;
+		break;
+	case BPF_JSGT:
+		if (reg->smin_value > (s64)val)
+			return 1;
+		else if (reg->smax_value <= (s64)val)
+			return 0;
+		break;
+	case BPF_JLT:
+		if (reg->umax_value < val)
+			return 1;
+		else if (reg->umin_value >= val)
+			return 0;
+		break;
+	case BPF_JSLT:
+		if (reg->smax_value < (s64)val)
+			return 1;
+		else if (reg->smin_value >= (s64)val)
+			return 0;
+		break;
+	case BPF_JGE:
+		if (reg->umin_value >= val)
+			return 1;
+		else if (reg->umax_value < val)
+			return 0;
+		break;
+	case BPF_JSGE:
+		if (reg->smin_value >= (s64)val)
+			return 1;
+		else if (reg->smax_value < (s64)val)
+			return 0;
+		break;
+	case BPF_JLE:
+		if (reg->umax_value <= val)
+			return 1;
+		else if (reg->umin_value > val)
+			return 0;
+		break;
+	case BPF_JSLE:
+		if (reg->smax_value <= (s64)val)
+			return 1;
+		else if (reg->smin_value > (s64)val)
+			return 0;
+		break;
+	}
+
+	return -1;
+}
+
 static int check_cond_jmp_op(struct bpf_verifier_env *env,
 			     struct bpf_insn *insn, int *insn_idx)
 {
 	struct bpf_verifier_state *other_branch, *this_branch = &env->cur_state;
 	struct bpf_reg_state *regs = this_branch->regs, *dst_reg;
 	u8 opcode = BPF_OP(insn->code);
-	int err;
+	int pred, err;
 
 	if (opcode > BPF_JSLE) {
 		verbose("invalid BPF_JMP opcode %x\n", opcode);
@@ -2964,24 +3244,33 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 
 	dst_reg = &regs[insn->dst_reg];
 
-	/* detect if R == 0 where R was initialized to zero earlier */
-	if (BPF_SRC(insn->code) == BPF_K &&
-	    (opcode == BPF_JEQ || opcode == BPF_JNE) &&
-	    dst_reg->type == SCALAR_VALUE &&
-	    tnum_equals_const(dst_reg->var_off, insn->imm)) {
-		if (opcode == BPF_JEQ) {
-			/* if (imm == imm) goto pc+off;
-			 * only follow the goto, ignore fall-through
-			 */
-			*insn_idx += insn->off;
-			return 0;
-		} else {
-			/* if (imm != imm) goto pc+off;
-			 * only follow fall-through branch, since
-			 * that's where the program will go
-			 */
-			return 0;
-		}
+	/* Don't walk a branch that the known bounds of the scalar rule out.
+	 * Unprivileged programs only get this for an exact match of a
+	 * constant, the dead side of any other comparison is still walked
+	 * as it may run speculatively.
+	 */
+	pred = -1;
+	if (BPF_SRC(insn->code) == BPF_K)
+		pred = is_branch_taken(dst_reg, insn->imm, opcode);
+	else if (regs[insn->src_reg].type == SCALAR_VALUE &&
+		 tnum_is_const(regs[insn->src_reg].var_off))
+		pred = is_branch_taken(dst_reg,
+				       regs[insn->src_reg].var_off.value,
+				       opcode);
+	if (pred >= 0 && !env->allow_ptr_leaks &&
+	    !(BPF_SRC(insn->code) == BPF_K &&
+	      (opcode == BPF_JEQ || opcode == BPF_JNE) &&
+	      tnum_equals_const(dst_reg->var_off, insn->imm)))
+		pred = -1;
+	if (pred == 1) {
+		/* only follow the goto, ignore fall-through */
+		*insn_idx += insn->off;
+		return 0;
+	} else if (pred == 0) {
+		/* only follow fall-through branch, since
+		 * that's where the program will go
+		 */
+		return 0;
 	}
 
 	other_branch = push_stack(env, *insn_idx + insn->off + 1, *insn_idx);
@@ -3021,7 +3310,8 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 	/* detect if R == 0 where R is returned from bpf_map_lookup_elem() */
 	if (BPF_SRC(insn->code) == BPF_K &&
 	    insn->imm == 0 && (opcode == BPF_JEQ || opcode == BPF_JNE) &&
-	    dst_reg->type == PTR_TO_MAP_VALUE_OR_NULL) {
+	    (dst_reg->type == PTR_TO_MAP_VALUE_OR_NULL ||
+	     dst_reg->type == PTR_TO_MEM_OR_NULL)) {
 		/* Mark all identical map registers in each branch as either
 		 * safe or unknown depending R == 0 or R != 0 conditional.
 		 */
@@ -3071,7 +3361,7 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 		verbose("R%d pointer comparison prohibited\n", insn->dst_reg);
 		return -EACCES;
 	}
-	if (log_level)
+	if (log_level & BPF_LOG_LEVEL)
 		print_verifier_state(this_branch);
 	return 0;
 }
@@ -3157,6 +3447,14 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
+	/* LD_ABS/IND can terminate the program without going through
+	 * BPF_EXIT, held references would leak.
+	 */
+	if (env->cur_state.acquired_refs) {
+		verbose("BPF_LD_[ABS|IND] cannot be mixed with unreleased references\n");
+		return -EINVAL;
+	}
+
 	if (insn->dst_reg != BPF_REG_0 || insn->off != 0 ||
 	    BPF_SIZE(insn->code) == BPF_DW ||
 	    (mode == BPF_ABS && insn->src_reg != BPF_REG_0)) {
@@ -3404,13 +3702,6 @@ static bool range_within(struct bpf_reg_state *old,
 	       old->smax_value >= cur->smax_value;
 }
 
-/* Maximum number of register states that can exist at once */
-#define ID_MAP_SIZE	(MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE)
-struct idpair {
-	u32 old;
-	u32 cur;
-};
-
 /* If in the old state two registers had the same id, then they need to have
  * the same id in the new state as well.  But that id could be different from
  * the old state, so we need to track the mapping from old to new ids.
@@ -3421,11 +3712,11 @@ struct idpair {
  * So we look through our idmap to see if this old id has been seen before.  If
  * so, we require the new id to match; otherwise, we add the id pair to the map.
  */
-static bool check_ids(u32 old_id, u32 cur_id, struct idpair *idmap)
+static bool check_ids(u32 old_id, u32 cur_id, struct bpf_id_pair *idmap)
 {
 	unsigned int i;
 
-	for (i = 0; i < ID_MAP_SIZE; i++) {
+	for (i = 0; i < BPF_ID_MAP_SIZE; i++) {
 		if (!idmap[i].old) {
 			/* Reached an empty slot; haven't seen this id before */
 			idmap[i].old = old_id;
@@ -3442,7 +3733,7 @@ static bool check_ids(u32 old_id, u32 cur_id, struct idpair *idmap)
 
 /* Returns true if (rold safe implies rcur safe) */
 static bool regsafe(struct bpf_reg_state *rold, struct bpf_reg_state *rcur,
-		    struct idpair *idmap)
+		    struct bpf_id_pair *idmap)
 {
 	if (!(rold->live & REG_LIVE_READ))
 		/* explored state didn't use this */
@@ -3495,6 +3786,18 @@ static bool regsafe(struct bpf_reg_state *rold, struct bpf_reg_state *rcur,
 			return false;
 		/* Check our ids match any regs they're supposed to */
 		return check_ids(rold->id, rcur->id, idmap);
+	case PTR_TO_MEM:
+	case PTR_TO_MEM_OR_NULL:
+		/* Same size and fixed offset, a reference that plays the
+		 * same role, and a variable offset within the old one.
+		 */
+		if (rcur->type != rold->type ||
+		    rold->mem_size != rcur->mem_size || rold->off != rcur->off)
+			return false;
+		if (!check_ids(rold->id, rcur->id, idmap))
+			return false;
+		return range_within(rold, rcur) &&
+		       tnum_in(rold->var_off, rcur->var_off);
 	case PTR_TO_PACKET:
 		if (rcur->type != PTR_TO_PACKET)
 			return false;
@@ -3564,21 +3867,35 @@ static bool states_equal(struct bpf_verifier_env *env,
 			 struct bpf_verifier_state *old,
 			 struct bpf_verifier_state *cur)
 {
-	struct idpair *idmap;
-	bool ret = false;
+	struct bpf_id_pair *idmap = env->idmap_scratch;
 	int i;
 
-	idmap = kcalloc(ID_MAP_SIZE, sizeof(struct idpair), GFP_KERNEL);
-	/* If we failed to allocate the idmap, just say it's not safe */
-	if (!idmap)
-		return false;
+	memset(idmap, 0, sizeof(env->idmap_scratch));
 
 	for (i = 0; i < MAX_BPF_REG; i++) {
 		if (!regsafe(&old->regs[i], &cur->regs[i], idmap))
-			goto out_free;
+			return false;
+	}
+
+	/* Same outstanding references, allocated in the same order */
+	if (old->acquired_refs != cur->acquired_refs)
+		return false;
+	for (i = 0; i < old->acquired_refs; i++) {
+		if (!check_ids(old->refs[i].id, cur->refs[i].id, idmap))
+			return false;
 	}
 
 	for (i = 0; i < MAX_BPF_STACK; i++) {
+		/* A slot that no path from the explored state read can hold
+		 * anything.  Unprivileged programs keep comparing it: whether
+		 * a spill overwrites misc data decides the sanitize_stack_off
+		 * patching of that spill insn.
+		 */
+		if (env->allow_ptr_leaks && !(i % BPF_REG_SIZE) &&
+		    !(old->spilled_regs[i / BPF_REG_SIZE].live & REG_LIVE_READ)) {
+			i += BPF_REG_SIZE - 1;
+			continue;
+		}
 		if (old->stack_slot_type[i] == STACK_INVALID)
 			continue;
 		if (old->stack_slot_type[i] != cur->stack_slot_type[i])
@@ -3587,7 +3904,7 @@ static bool states_equal(struct bpf_verifier_env *env,
 			 * this verifier states are not equivalent,
 			 * return false to continue verification of this path
 			 */
-			goto out_free;
+			return false;
 		if (i % BPF_REG_SIZE)
 			continue;
 		if (old->stack_slot_type[i] != STACK_SPILL)
@@ -3605,14 +3922,11 @@ static bool states_equal(struct bpf_verifier_env *env,
 			 * such verifier states are not equivalent.
 			 * return false to continue verification of this path
 			 */
-			goto out_free;
+			return false;
 		else
 			continue;
 	}
-	ret = true;
-out_free:
-	kfree(idmap);
-	return ret;
+	return true;
 }
 
 /* A write screens off any subsequent reads; but write marks come from the
@@ -3645,10 +3959,6 @@ static bool do_propagate_liveness(const struct bpf_verifier_state *state,
 	}
 	/* ... and stack slots */
 	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++) {
-		if (parent->stack_slot_type[i * BPF_REG_SIZE] != STACK_SPILL)
-			continue;
-		if (state->stack_slot_type[i * BPF_REG_SIZE] != STACK_SPILL)
-			continue;
 		if (parent->spilled_regs[i].live & REG_LIVE_READ)
 			continue;
 		if (writes && (state->spilled_regs[i].live & REG_LIVE_WRITTEN))
@@ -3683,10 +3993,12 @@ static void propagate_liveness(const struct bpf_verifier_state *state,
 static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
 	struct bpf_verifier_state_list *new_sl;
-	struct bpf_verifier_state_list *sl;
+	struct bpf_verifier_state_list *sl, **pprev;
+	u32 states_cnt = 0;
 	int i;
 
-	sl = env->explored_states[insn_idx];
+	pprev = &env->explored_states[insn_idx];
+	sl = *pprev;
 	if (!sl)
 		/* this 'insn_idx' instruction wasn't marked, so we will not
 		 * be doing state search here
@@ -3695,6 +4007,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 
 	while (sl != STATE_LIST_MARK) {
 		if (states_equal(env, &sl->state, &env->cur_state)) {
+			sl->hit_cnt++;
 			/* reached equivalent register/stack state,
 			 * prune the search.
 			 * Registers read by the continuation are read by us.
@@ -3708,9 +4021,39 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			propagate_liveness(&sl->state, &env->cur_state);
 			return 1;
 		}
-		sl = sl->next;
+		states_cnt++;
+		sl->miss_cnt++;
+		/* A state that keeps failing to match only makes every later
+		 * visit of this insn slower, stop checking against it.  It
+		 * can't be freed yet: it may be on the parentage chain of a
+		 * state still being explored, which propagates read marks
+		 * into it.
+		 */
+		if (sl->miss_cnt > sl->hit_cnt * 3 + 3) {
+			*pprev = sl->next;
+			sl->next = env->free_list;
+			env->free_list = sl;
+			env->cur_states--;
+			env->evicted_states++;
+			sl = *pprev;
+			continue;
+		}
+		pprev = &sl->next;
+		sl = *pprev;
 	}
 
+	if (env->max_states_per_insn < states_cnt)
+		env->max_states_per_insn = states_cnt;
+
+	/* Most insns are a pruning point, but a checkpoint only pays for
+	 * itself when there is some straight-line code and branching to
+	 * skip on a match.  Keep looking for matches, but only remember a
+	 * new state after at least 2 jumps and 8 insns since the last one.
+	 */
+	if (env->jmps_processed - env->prev_jmps_processed < 2 ||
+	    env->insn_processed - env->prev_insn_processed < 8)
+		return 0;
+
 	/* there were no equivalent states, remember current one.
 	 * technically the current state is not proven to be safe yet,
 	 * but it will either reach bpf_exit (which means it's safe) or
@@ -3720,9 +4063,17 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	new_sl = kmalloc(sizeof(struct bpf_verifier_state_list), GFP_USER);
 	if (!new_sl)
 		return -ENOMEM;
+	env->total_states++;
+	env->cur_states++;
+	if (env->peak_states < env->cur_states)
+		env->peak_states = env->cur_states;
+	env->prev_jmps_processed = env->jmps_processed;
+	env->prev_insn_processed = env->insn_processed;
 
 	/* add new state to the head of linked list */
 	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
+	new_sl->miss_cnt = 0;
+	new_sl->hit_cnt = 0;
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
 	/* connect new state to parentage chain */
@@ -3736,8 +4087,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	for (i = 0; i < BPF_REG_FP; i++)
 		env->cur_state.regs[i].live = REG_LIVE_NONE;
 	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
-		if (env->cur_state.stack_slot_type[i * BPF_REG_SIZE] == STACK_SPILL)
-			env->cur_state.spilled_regs[i].live = REG_LIVE_NONE;
+		env->cur_state.spilled_regs[i].live = REG_LIVE_NONE;
 	return 0;
 }
 
@@ -3757,7 +4107,6 @@ static int do_check(struct bpf_verifier_env *env)
 	struct bpf_reg_state *regs = state->regs;
 	int insn_cnt = env->prog->len;
 	int insn_idx, prev_insn_idx = 0;
-	int insn_processed = 0;
 	bool do_print_state = false;
 
 	init_reg_state(regs);
@@ -3777,9 +4126,9 @@ static int do_check(struct bpf_verifier_env *env)
 		insn = &insns[insn_idx];
 		class = BPF_CLASS(insn->code);
 
-		if (++insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
+		if (++env->insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
 			verbose("BPF program is too large. Processed %d insn\n",
-				insn_processed);
+				env->insn_processed);
 			return -E2BIG;
 		}
 
@@ -3788,7 +4137,8 @@ static int do_check(struct bpf_verifier_env *env)
 			return err;
 		if (err == 1) {
 			/* found equivalent state, can prune the search */
-			if (log_level) {
+			env->pruned_states++;
+			if (log_level & BPF_LOG_LEVEL) {
 				if (do_print_state)
 					verbose("\nfrom %d to %d: safe\n",
 						prev_insn_idx, insn_idx);
@@ -3801,8 +4151,9 @@ static int do_check(struct bpf_verifier_env *env)
 		if (need_resched())
 			cond_resched();
 
-		if (log_level > 1 || (log_level && do_print_state)) {
-			if (log_level > 1)
+		if ((log_level & BPF_LOG_LEVEL2) ||
+		    ((log_level & BPF_LOG_LEVEL) && do_print_state)) {
+			if (log_level & BPF_LOG_LEVEL2)
 				verbose("%d:", insn_idx);
 			else
 				verbose("\nfrom %d to %d:",
@@ -3811,7 +4162,7 @@ static int do_check(struct bpf_verifier_env *env)
 			do_print_state = false;
 		}
 
-		if (log_level) {
+		if (log_level & BPF_LOG_LEVEL) {
 			verbose("%d: ", insn_idx);
 			print_bpf_insn(env, insn);
 		}
@@ -3941,6 +4292,7 @@ static int do_check(struct bpf_verifier_env *env)
 		} else if (class == BPF_JMP) {
 			u8 opcode = BPF_OP(insn->code);
 
+			env->jmps_processed++;
 			if (opcode == BPF_CALL) {
 				if (BPF_SRC(insn->code) != BPF_K ||
 				    insn->off != 0 ||
@@ -3990,6 +4342,13 @@ static int do_check(struct bpf_verifier_env *env)
 					return -EACCES;
 				}
 
+				if (env->cur_state.acquired_refs) {
+					verbose("Unreleased reference id=%d alloc_insn=%d\n",
+						env->cur_state.refs[0].id,
+						env->cur_state.refs[0].insn_idx);
+					return -EINVAL;
+				}
+
 process_bpf_exit:
 				insn_idx = pop_stack(env, &prev_insn_idx);
 				if (insn_idx < 0) {
@@ -4030,8 +4389,6 @@ static int do_check(struct bpf_verifier_env *env)
 		insn_idx++;
 	}
 
-	verbose("processed %d insns, stack depth %d\n",
-		insn_processed, env->prog->aux->stack_depth);
 	return 0;
 }
 
@@ -4548,6 +4905,13 @@ static void free_states(struct bpf_verifier_env *env)
 	struct bpf_verifier_state_list *sl, *sln;
 	int i;
 
+	sl = env->free_list;
+	while (sl) {
+		sln = sl->next;
+		kfree(sl);
+		sl = sln;
+	}
+
 	if (!env->explored_states)
 		return;
 
@@ -4565,10 +4929,26 @@ static void free_states(struct bpf_verifier_env *env)
 	kfree(env->explored_states);
 }
 
+static void print_verification_stats(struct bpf_verifier_env *env)
+{
+	if (log_level & BPF_LOG_STATS)
+		verbose("verification time %llu usec\n",
+			div_u64(env->verification_time, 1000));
+	verbose("processed %u insns (limit %u), stack depth %u\n",
+		env->insn_processed, BPF_COMPLEXITY_LIMIT_INSNS,
+		env->prog->aux->stack_depth);
+	if (log_level & BPF_LOG_STATS)
+		verbose("total_states %u peak_states %u pruned_states %u evicted_states %u max_states_per_insn %u\n",
+			env->total_states, env->peak_states,
+			env->pruned_states, env->evicted_states,
+			env->max_states_per_insn);
+}
+
 int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 {
 	char __user *log_ubuf = NULL;
 	struct bpf_verifier_env *env;
+	u64 start_time;
 	int ret = -EINVAL;
 
 	/* 'struct bpf_verifier_env' can be global, but since it's not small,
@@ -4600,7 +4980,8 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 		ret = -EINVAL;
 		/* log_* values have to be sane */
 		if (log_size < 128 || log_size > UINT_MAX >> 8 ||
-		    log_level == 0 || log_ubuf == NULL)
+		    log_level == 0 || log_level & ~BPF_LOG_MASK ||
+		    log_ubuf == NULL)
 			goto err_unlock;
 
 		ret = -ENOMEM;
@@ -4626,6 +5007,8 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	if (!env->explored_states)
 		goto skip_full_check;
 
+	start_time = ktime_get_ns();
+
 	ret = check_cfg(env);
 	if (ret < 0)
 		goto skip_full_check;
@@ -4634,6 +5017,10 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 
 	ret = do_check(env);
 
+	env->verification_time = ktime_get_ns() - start_time;
+	print_verification_stats(env);
+	env->prog->aux->verified_insns = env->insn_processed;
+
 skip_full_check:
 	while (pop_stack(env, NULL) >= 0);
 	free_states(env);
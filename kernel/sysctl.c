@@ -1698,6 +1698,13 @@ static struct ctl_table fs_table[] = {
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "negative-dentry-limit",
+		.data		= &sysctl_negative_dentry_limit,
+		.maxlen		= sizeof(sysctl_negative_dentry_limit),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 	{
 		.procname	= "overflowuid",
 		.data		= &fs_overflowuid,
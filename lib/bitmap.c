@@ -152,6 +152,43 @@ void __bitmap_shift_left(unsigned long *dst, const unsigned long *src,
 }
 EXPORT_SYMBOL(__bitmap_shift_left);
 
+/**
+ * bitmap_cut() - remove bit region from bitmap and right shift remaining bits
+ * @dst: destination bitmap, might overlap with src
+ * @src: source bitmap
+ * @first: start bit of region to be removed
+ * @cut: number of bits to remove
+ * @nbits: bitmap size, in bits
+ *
+ * Bits below @first are kept as they are, the @cut bits starting at @first
+ * are dropped and the bits above them are shifted down to @first. Zeros are
+ * fed into the vacated MS positions. @first + @cut must not exceed @nbits.
+ *
+ * Example for bitmap_cut(dst, src, 2, 3, 8), removing bits 2 to 4:
+ *   src: 0b11011010
+ *   dst: 0b00011010
+ */
+void bitmap_cut(unsigned long *dst, const unsigned long *src,
+		unsigned int first, unsigned int cut, unsigned int nbits)
+{
+	unsigned int w = first / BITS_PER_LONG;
+	unsigned long keep = 0;
+
+	if (first % BITS_PER_LONG)
+		keep = src[w] & BITMAP_LAST_WORD_MASK(first);
+
+	if (dst != src)
+		memmove(dst, src, w * sizeof(*dst));
+
+	__bitmap_shift_right(dst + w, src + w, cut, nbits - w * BITS_PER_LONG);
+
+	if (first % BITS_PER_LONG) {
+		dst[w] &= ~BITMAP_LAST_WORD_MASK(first);
+		dst[w] |= keep;
+	}
+}
+EXPORT_SYMBOL(bitmap_cut);
+
 int __bitmap_and(unsigned long *dst, const unsigned long *bitmap1,
 				const unsigned long *bitmap2, unsigned int bits)
 {
@@ -496,6 +496,74 @@ static int bpf_fill_stxdw(struct bpf_test *self)
 	return __bpf_fill_stxdw(self, BPF_DW);
 }
 
+/* ALU ops with immediates that cancel out, R0 stays 1 */
+static int bpf_fill_alu_imm(struct bpf_test *self)
+{
+	unsigned int len = BPF_MAXINSNS;
+	struct bpf_insn *insn;
+	int i, k;
+
+	insn = kmalloc_array(len, sizeof(*insn), GFP_KERNEL);
+	if (!insn)
+		return -ENOMEM;
+
+	insn[0] = BPF_ALU32_IMM(BPF_MOV, R0, 1);
+
+	for (i = 1; i + 8 < len; i += 8) {
+		k = i % 4096;
+		insn[i + 0] = BPF_ALU64_IMM(BPF_ADD, R0, k);
+		insn[i + 1] = BPF_ALU64_IMM(BPF_SUB, R0, k);
+		insn[i + 2] = BPF_ALU32_IMM(BPF_ADD, R0, -k);
+		insn[i + 3] = BPF_ALU32_IMM(BPF_SUB, R0, -k);
+		insn[i + 4] = BPF_ALU64_IMM(BPF_MUL, R0, 8);
+		insn[i + 5] = BPF_ALU64_IMM(BPF_DIV, R0, 8);
+		insn[i + 6] = BPF_ALU64_IMM(BPF_AND, R0, 0xffff);
+		insn[i + 7] = BPF_ALU32_IMM(BPF_MOD, R0, 0x10000);
+	}
+
+	for (; i < len - 1; i++)
+		insn[i] = BPF_ALU64_IMM(BPF_ADD, R0, 0);
+
+	insn[len - 1] = BPF_EXIT_INSN();
+
+	self->u.ptr.insns = insn;
+	self->u.ptr.len = len;
+
+	return 0;
+}
+
+/* Store, reload and sum across the stack, R0 counts the groups */
+static int bpf_fill_stack_ldst(struct bpf_test *self)
+{
+	unsigned int len = BPF_MAXINSNS;
+	struct bpf_insn *insn;
+	int i, off;
+
+	insn = kmalloc_array(len, sizeof(*insn), GFP_KERNEL);
+	if (!insn)
+		return -ENOMEM;
+
+	insn[0] = BPF_ALU32_IMM(BPF_MOV, R0, 0);
+
+	for (i = 1; i + 3 < len; i += 3) {
+		off = -8 * (1 + (i / 3) % 32);
+		insn[i + 0] = BPF_ST_MEM(BPF_DW, R10, off, 1);
+		insn[i + 1] = BPF_LDX_MEM(BPF_DW, R1, R10, off);
+		insn[i + 2] = BPF_ALU64_REG(BPF_ADD, R0, R1);
+	}
+
+	for (; i < len - 1; i++)
+		insn[i] = BPF_ALU64_IMM(BPF_ADD, R0, 0);
+
+	insn[len - 1] = BPF_EXIT_INSN();
+
+	self->u.ptr.insns = insn;
+	self->u.ptr.len = len;
+	self->stack_depth = 256;
+
+	return 0;
+}
+
 static struct bpf_test tests[] = {
 	{
 		"TAX",
@@ -5461,6 +5529,170 @@ static struct bpf_test tests[] = {
 		{ { 2, 10 } },
 		.fill_helper = bpf_fill_jump_around_ld_abs,
 	},
+	/*
+	 * Immediate and offset encodings, as picked by JITs
+	 */
+	{
+		"ALU_ADD_K/ALU_SUB_K: 32-bit wrap with negative imm",
+		.u.insns_int = {
+			BPF_ALU32_IMM(BPF_MOV, R0, 0),
+			BPF_ALU32_IMM(BPF_SUB, R0, 1),
+			BPF_ALU32_IMM(BPF_ADD, R0, -2),
+			BPF_LD_IMM64(R1, 0xfffffffdULL),
+			BPF_JMP_REG(BPF_JEQ, R0, R1, 2),
+			BPF_ALU32_IMM(BPF_MOV, R0, 2),
+			BPF_EXIT_INSN(),
+			BPF_ALU32_IMM(BPF_MOV, R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 1 } },
+	},
+	{
+		"ALU64_ADD_K/ALU64_SUB_K: imm12 boundaries",
+		.u.insns_int = {
+			BPF_ALU64_IMM(BPF_MOV, R0, 0),
+			BPF_ALU64_IMM(BPF_ADD, R0, -4095),
+			BPF_LD_IMM64(R1, 0xfffffffffffff001ULL),
+			BPF_JMP_REG(BPF_JNE, R0, R1, 6),
+			BPF_ALU64_IMM(BPF_SUB, R0, -4096),
+			BPF_ALU64_IMM(BPF_ADD, R0, 4095),
+			BPF_ALU64_IMM(BPF_SUB, R0, 4096),
+			BPF_LD_IMM64(R1, 0),
+			BPF_JMP_REG(BPF_JEQ, R0, R1, 2),
+			BPF_ALU32_IMM(BPF_MOV, R0, 2),
+			BPF_EXIT_INSN(),
+			BPF_ALU32_IMM(BPF_MOV, R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 1 } },
+	},
+	{
+		"ALU64_AND_K: low bit masks",
+		.u.insns_int = {
+			BPF_LD_IMM64(R0, 0x123456789abcdef0ULL),
+			BPF_ALU64_IMM(BPF_AND, R0, 0xfff),
+			BPF_ALU64_IMM(BPF_MOV, R1, -1),
+			BPF_ALU64_IMM(BPF_AND, R1, 0x7fffffff),
+			BPF_ALU64_IMM(BPF_RSH, R1, 16),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0xef0 + 0x7fff } },
+	},
+	{
+		"ALU64_MUL_K/DIV_K/MOD_K: powers of two",
+		.u.insns_int = {
+			BPF_LD_IMM64(R0, 0x8000000000000123ULL),
+			BPF_ALU64_IMM(BPF_MUL, R0, 16),
+			BPF_ALU64_IMM(BPF_DIV, R0, 8),
+			BPF_ALU64_IMM(BPF_MOD, R0, 0x40),
+			BPF_ALU64_IMM(BPF_MUL, R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 6 } },
+	},
+	{
+		"ALU_MUL_K/DIV_K/MOD_K: powers of two",
+		.u.insns_int = {
+			BPF_ALU32_IMM(BPF_MOV, R0, -1),
+			BPF_ALU32_IMM(BPF_DIV, R0, 0x10000),
+			BPF_ALU32_IMM(BPF_MUL, R0, 0x10000),
+			BPF_ALU32_IMM(BPF_MOD, R0, 0x20000),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x10000 } },
+	},
+	{
+		"JMP_JSGT_K/JGT_K/JGE_K: negative imm",
+		.u.insns_int = {
+			BPF_ALU32_IMM(BPF_MOV, R0, 0),
+			BPF_LD_IMM64(R1, -5),
+			BPF_JMP_IMM(BPF_JSGT, R1, -6, 1),
+			BPF_EXIT_INSN(),
+			BPF_JMP_IMM(BPF_JGT, R1, -4, 3),
+			BPF_JMP_IMM(BPF_JGE, R1, -5, 1),
+			BPF_EXIT_INSN(),
+			BPF_ALU32_IMM(BPF_MOV, R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 1 } },
+	},
+	{
+		"LD_IMM64: sparse and inverted 16-bit chunks",
+		.u.insns_int = {
+			BPF_ALU32_IMM(BPF_MOV, R0, 0),
+			BPF_LD_IMM64(R1, 0x0000ffff00000000ULL),
+			BPF_ALU32_IMM(BPF_MOV, R3, 0xffff),
+			BPF_ALU64_IMM(BPF_LSH, R3, 32),
+			BPF_JMP_REG(BPF_JNE, R1, R3, 11),
+			BPF_LD_IMM64(R1, 0xffff0000ffffffffULL),
+			BPF_ALU64_IMM(BPF_XOR, R3, -1),
+			BPF_JMP_REG(BPF_JNE, R1, R3, 7),
+			BPF_LD_IMM64(R1, 0xffffffff00001234ULL),
+			BPF_ALU64_IMM(BPF_MOV, R3, -1),
+			BPF_ALU64_IMM(BPF_LSH, R3, 32),
+			BPF_ALU64_IMM(BPF_OR, R3, 0x1234),
+			BPF_JMP_REG(BPF_JNE, R1, R3, 1),
+			BPF_ALU32_IMM(BPF_MOV, R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 1 } },
+	},
+	{
+		"ST_MEM/STX_MEM/LDX_MEM: aligned and unaligned stack offsets",
+		.u.insns_int = {
+			BPF_ST_MEM(BPF_B, R10, -1, 0x5a),
+			BPF_ST_MEM(BPF_W, R10, -8, 0x12345678),
+			BPF_ST_MEM(BPF_DW, R10, -16, 0),
+			BPF_ST_MEM(BPF_DW, R10, -64, -1),
+			BPF_ALU32_IMM(BPF_MOV, R2, 0xabcd),
+			BPF_STX_MEM(BPF_H, R10, R2, -3),
+			BPF_LDX_MEM(BPF_B, R0, R10, -1),
+			BPF_LDX_MEM(BPF_W, R1, R10, -8),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_LDX_MEM(BPF_DW, R1, R10, -16),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_LDX_MEM(BPF_DW, R1, R10, -64),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_LDX_MEM(BPF_H, R1, R10, -3),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x1235029e } },
+		.stack_depth = 64,
+	},
+	{
+		"JIT throughput: ALU immediates",
+		{ },
+		INTERNAL,
+		{ },
+		{ { 0, 1 } },
+		.fill_helper = bpf_fill_alu_imm,
+	},
+	{
+		"JIT throughput: stack store/load",
+		{ },
+		INTERNAL,
+		{ },
+		{ { 0, (BPF_MAXINSNS - 2) / 3 } },
+		.fill_helper = bpf_fill_stack_ldst,
+	},
 	/*
 	 * LD_IND / LD_ABS on fragmented SKBs
 	 */
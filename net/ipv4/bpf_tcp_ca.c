@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * TCP congestion control implemented by BPF programs.
+ *
+ * A BPF_PROG_TYPE_TCP_CC program attached with BPF_TCP_CONGESTION is
+ * registered under the given name as a regular tcp_congestion_ops, so
+ * it can be selected through the tcp_congestion_control sysctl, the
+ * TCP_CONGESTION socket option or a route congctl metric, exactly like
+ * an algorithm built as a module.
+ *
+ * Every callback runs the program on a struct bpf_tcp_cc describing the
+ * connection. snd_cwnd, snd_cwnd_cnt and the per-connection priv[] area
+ * (kept in icsk_ca_priv) are copied back once the program returns.
+ *
+ * Sockets using the algorithm hold a reference on it in place of the
+ * module reference, so it only goes away once detached and no longer
+ * in use.
+ */
+
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/jhash.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <net/tcp.h>
+
+struct bpf_tcp_ca {
+	struct tcp_congestion_ops	ops;
+	struct bpf_prog			*prog;
+	refcount_t			refcnt;
+};
+
+/* Serializes detach against itself */
+static DEFINE_MUTEX(bpf_tcp_ca_mutex);
+
+static struct bpf_tcp_ca *to_bpf_tcp_ca(const struct tcp_congestion_ops *ca)
+{
+	return container_of((struct tcp_congestion_ops *)ca,
+			    struct bpf_tcp_ca, ops);
+}
+
+static u32 bpf_tcp_ca_run(struct sock *sk, u32 op, u32 arg0, u32 arg1,
+			  u32 arg2)
+{
+	const struct bpf_tcp_ca *bca = to_bpf_tcp_ca(inet_csk(sk)->icsk_ca_ops);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bpf_tcp_cc ctx;
+	u32 ret;
+
+	BUILD_BUG_ON(sizeof(ctx.priv) > ICSK_CA_PRIV_SIZE);
+
+	ctx.op = op;
+	ctx.args[0] = arg0;
+	ctx.args[1] = arg1;
+	ctx.args[2] = arg2;
+	ctx.now_us = tp->tcp_mstamp;
+	ctx.snd_cwnd = tp->snd_cwnd;
+	ctx.snd_cwnd_cnt = tp->snd_cwnd_cnt;
+	ctx.snd_cwnd_clamp = tp->snd_cwnd_clamp;
+	ctx.snd_ssthresh = tp->snd_ssthresh;
+	ctx.prior_cwnd = tp->prior_cwnd;
+	ctx.ca_state = inet_csk(sk)->icsk_ca_state;
+	ctx.is_cwnd_limited = tcp_is_cwnd_limited(sk);
+	ctx.mss_cache = tp->mss_cache;
+	ctx.srtt_us = tp->srtt_us;
+	ctx.packets_out = tp->packets_out;
+	ctx.delivered = tp->delivered;
+	ctx.idle_us = jiffies_to_usecs(tcp_jiffies32 - tp->lsndtime);
+	memcpy(ctx.priv, inet_csk_ca(sk), sizeof(ctx.priv));
+
+	preempt_disable();
+	ret = BPF_PROG_RUN(bca->prog, &ctx);
+	preempt_enable();
+
+	/* The stack relies on a non zero, clamped cwnd */
+	tp->snd_cwnd = clamp(ctx.snd_cwnd, 1U, tp->snd_cwnd_clamp);
+	tp->snd_cwnd_cnt = ctx.snd_cwnd_cnt;
+	memcpy(inet_csk_ca(sk), ctx.priv, sizeof(ctx.priv));
+
+	return ret;
+}
+
+static void bpf_tcp_ca_init(struct sock *sk)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_INIT, 0, 0, 0);
+}
+
+static u32 bpf_tcp_ca_ssthresh(struct sock *sk)
+{
+	u32 ssthresh = bpf_tcp_ca_run(sk, BPF_TCP_CC_SSTHRESH, 0, 0, 0);
+
+	return ssthresh ? max(ssthresh, 2U) : tcp_reno_ssthresh(sk);
+}
+
+static void bpf_tcp_ca_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_CONG_AVOID, ack, acked, 0);
+}
+
+static void bpf_tcp_ca_set_state(struct sock *sk, u8 new_state)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_SET_STATE, new_state, 0, 0);
+}
+
+static void bpf_tcp_ca_cwnd_event(struct sock *sk, enum tcp_ca_event ev)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_CWND_EVENT, ev, 0, 0);
+}
+
+static void bpf_tcp_ca_in_ack_event(struct sock *sk, u32 flags)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_IN_ACK_EVENT, flags, 0, 0);
+}
+
+static void bpf_tcp_ca_pkts_acked(struct sock *sk,
+				  const struct ack_sample *sample)
+{
+	bpf_tcp_ca_run(sk, BPF_TCP_CC_PKTS_ACKED, sample->pkts_acked,
+		       sample->rtt_us, sample->in_flight);
+}
+
+static u32 bpf_tcp_ca_undo_cwnd(struct sock *sk)
+{
+	u32 cwnd = bpf_tcp_ca_run(sk, BPF_TCP_CC_UNDO_CWND, 0, 0, 0);
+
+	return cwnd ? cwnd : tcp_reno_undo_cwnd(sk);
+}
+
+bool bpf_tcp_ca_get(const struct tcp_congestion_ops *ca)
+{
+	return refcount_inc_not_zero(&to_bpf_tcp_ca(ca)->refcnt);
+}
+
+void bpf_tcp_ca_put(const struct tcp_congestion_ops *ca)
+{
+	struct bpf_tcp_ca *bca = to_bpf_tcp_ca(ca);
+
+	if (refcount_dec_and_test(&bca->refcnt)) {
+		bpf_prog_put(bca->prog);
+		kfree(bca);
+	}
+}
+
+static int bpf_tcp_ca_get_name(const union bpf_attr *attr, char *name)
+{
+	long len;
+
+	len = strncpy_from_user(name, u64_to_user_ptr(attr->tcp_cc_name),
+				TCP_CA_NAME_MAX);
+	if (len < 0)
+		return len;
+	if (!len || len == TCP_CA_NAME_MAX)
+		return -EINVAL;
+	return 0;
+}
+
+int bpf_tcp_ca_attach(const union bpf_attr *attr)
+{
+	struct bpf_tcp_ca *bca;
+	struct bpf_prog *prog;
+	int err;
+
+	if (attr->target_fd || attr->attach_flags & ~BPF_F_TCP_CC_NEEDS_ECN)
+		return -EINVAL;
+
+	bca = kzalloc(sizeof(*bca), GFP_USER);
+	if (!bca)
+		return -ENOMEM;
+
+	/* tcp_register_congestion_control() hashes the whole name buffer */
+	err = bpf_tcp_ca_get_name(attr, bca->ops.name);
+	if (err)
+		goto out_free;
+
+	prog = bpf_prog_get_type(attr->attach_bpf_fd, BPF_PROG_TYPE_TCP_CC);
+	if (IS_ERR(prog)) {
+		err = PTR_ERR(prog);
+		goto out_free;
+	}
+
+	bca->ops.flags = TCP_CONG_BPF;
+	if (attr->attach_flags & BPF_F_TCP_CC_NEEDS_ECN)
+		bca->ops.flags |= TCP_CONG_NEEDS_ECN;
+	bca->ops.init = bpf_tcp_ca_init;
+	bca->ops.ssthresh = bpf_tcp_ca_ssthresh;
+	bca->ops.cong_avoid = bpf_tcp_ca_cong_avoid;
+	bca->ops.set_state = bpf_tcp_ca_set_state;
+	bca->ops.cwnd_event = bpf_tcp_ca_cwnd_event;
+	bca->ops.in_ack_event = bpf_tcp_ca_in_ack_event;
+	bca->ops.pkts_acked = bpf_tcp_ca_pkts_acked;
+	bca->ops.undo_cwnd = bpf_tcp_ca_undo_cwnd;
+	bca->prog = prog;
+	refcount_set(&bca->refcnt, 1);
+
+	err = tcp_register_congestion_control(&bca->ops);
+	if (err) {
+		bpf_prog_put(prog);
+		goto out_free;
+	}
+	return 0;
+
+out_free:
+	kfree(bca);
+	return err;
+}
+
+int bpf_tcp_ca_detach(const union bpf_attr *attr)
+{
+	char name[TCP_CA_NAME_MAX] = {};
+	struct tcp_congestion_ops *ca;
+	int err;
+
+	if (attr->target_fd)
+		return -EINVAL;
+
+	err = bpf_tcp_ca_get_name(attr, name);
+	if (err)
+		return err;
+
+	mutex_lock(&bpf_tcp_ca_mutex);
+	rcu_read_lock();
+	ca = tcp_ca_find_key(jhash(name, sizeof(name), strlen(name)));
+	rcu_read_unlock();
+
+	/* Still registered, so our reference keeps it alive */
+	if (!ca || !(ca->flags & TCP_CONG_BPF) || strcmp(ca->name, name)) {
+		err = -ENOENT;
+	} else {
+		tcp_unregister_congestion_control(ca);
+		bpf_tcp_ca_put(ca);
+	}
+	mutex_unlock(&bpf_tcp_ca_mutex);
+
+	return err;
+}
+
+static bool bpf_tcp_ca_is_valid_access(int off, int size,
+				       enum bpf_access_type type,
+				       struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off + size > offsetofend(struct bpf_tcp_cc, priv))
+		return false;
+	if (off % size != 0)
+		return false;
+
+	switch (off) {
+	case bpf_ctx_range(struct bpf_tcp_cc, now_us):
+		return type == BPF_READ && off == offsetof(struct bpf_tcp_cc,
+							   now_us) &&
+		       size == sizeof(__u64);
+	case offsetof(struct bpf_tcp_cc, snd_cwnd):
+	case offsetof(struct bpf_tcp_cc, snd_cwnd_cnt):
+	case bpf_ctx_range(struct bpf_tcp_cc, priv):
+		break;
+	default:
+		if (type == BPF_WRITE)
+			return false;
+	}
+
+	return size == sizeof(__u32);
+}
+
+const struct bpf_verifier_ops tcp_cc_prog_ops = {
+	.get_func_proto		= bpf_base_func_proto,
+	.is_valid_access	= bpf_tcp_ca_is_valid_access,
+};
@@ -2140,6 +2140,8 @@ static int devinet_conf_proc(struct ctl_table *ctl, int write,
 		}
 		if (i == IPV4_DEVCONF_IGNORE_ROUTES_WITH_LINKDOWN - 1 &&
 		    new_value != old_value) {
+			/* Lookups remembered by the fib cache may change */
+			rt_cache_flush(net);
 			ifindex = devinet_conf_ifindex(net, cnf);
 			inet_netconf_notify_devconf(net, RTM_NEWNETCONF,
 						    NETCONFA_IGNORE_ROUTES_WITH_LINKDOWN,
@@ -169,6 +169,7 @@ int fib_unmerge(struct net *net)
 
 	/* replace merged table with clean table */
 	fib_replace_table(net, old, new);
+	fib_lookup_cache_invalidate(net);
 	fib_free_table(old);
 
 	/* attempt to fetch main table if it has been allocated */
@@ -1328,9 +1329,14 @@ static int __net_init fib_net_init(struct net *net)
 	error = fib_proc_init(net);
 	if (error < 0)
 		goto out_proc;
+	error = fib_lookup_cache_net_init(net);
+	if (error < 0)
+		goto out_cache;
 out:
 	return error;
 
+out_cache:
+	fib_proc_exit(net);
 out_proc:
 	nl_fib_lookup_exit(net);
 out_nlfl:
@@ -1340,6 +1346,7 @@ static int __net_init fib_net_init(struct net *net)
 
 static void __net_exit fib_net_exit(struct net *net)
 {
+	fib_lookup_cache_net_exit(net);
 	fib_proc_exit(net);
 	nl_fib_lookup_exit(net);
 	ip_fib_net_exit(net);
@@ -0,0 +1,299 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: per-cpu cache of table lookup results.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Forwarded packets have no socket dst to reuse, every one of them goes
+ * through fib_table_lookup().  With large tables the trie walk is mostly
+ * cache misses, so remember the last results per cpu in a small direct
+ * mapped array indexed by a hash of the lookup key.
+ *
+ * Entries are tagged with a generation made of net->ipv4.fib_cache_genid,
+ * bumped by the trie whenever aliases are unlinked or added, and rt_genid,
+ * bumped by rt_cache_flush() on nexthop, device and rule changes.  A
+ * stale entry is never used, and since the generation is bumped before
+ * the unlinked aliases and fib_info are handed to RCU for freeing, the
+ * pointers of an entry that matches stay valid for the read side section.
+ *
+ * The cache is only used from softirq context (or with BHs disabled),
+ * which makes the per-cpu array exclusive to the current user, and for
+ * FIB_LOOKUP_NOREF lookups.
+ */
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/rtnetlink.h>
+#include <net/net_namespace.h>
+#include <net/ip_fib.h>
+
+#define FIB_LOOKUP_CACHE_BITS	8
+#define FIB_LOOKUP_CACHE_SIZE	(1U << FIB_LOOKUP_CACHE_BITS)
+
+struct fib_lookup_cache_entry {
+	unsigned int		genid;
+	const struct fib_table	*tb;
+	__be32			daddr;
+	int			oif;
+	u32			flags;
+	int			err;
+	struct fib_result	res;
+};
+
+struct fib_lookup_cache {
+	struct fib_lookup_cache_entry	ent[FIB_LOOKUP_CACHE_SIZE];
+};
+
+struct fib_lookup_cache_stat {
+	unsigned int	hit;
+	unsigned int	miss;
+	unsigned int	stale;
+	unsigned int	bypass;
+};
+
+static unsigned int fib_lookup_cache_genid(struct net *net)
+{
+	unsigned int genid;
+
+	genid = atomic_read(&net->ipv4.fib_cache_genid) + rt_genid_ipv4(net);
+	/* Pairs with fib_lookup_cache_invalidate(): a trie walk done after
+	 * reading the new generation doesn't find what was unlinked.
+	 */
+	smp_rmb();
+
+	return genid;
+}
+
+/* Everything in the flow that fib_table_lookup() looks at but the address */
+static u32 fib_lookup_cache_flags(const struct flowi4 *flp, int fib_flags)
+{
+	return flp->flowi4_tos | flp->flowi4_scope << 8 |
+	       (flp->flowi4_flags & FLOWI_FLAG_SKIP_NH_OIF) << 16 |
+	       (fib_flags & FIB_LOOKUP_IGNORE_LINKSTATE) << 24;
+}
+
+static struct fib_lookup_cache_entry *
+fib_lookup_cache_slot(struct fib_lookup_cache *c, const struct fib_table *tb,
+		      const struct flowi4 *flp, u32 flags)
+{
+	u32 hash = jhash_3words((__force u32)flp->daddr, flp->flowi4_oif,
+				flags, tb->tb_id);
+
+	return &c->ent[hash & (FIB_LOOKUP_CACHE_SIZE - 1)];
+}
+
+/* fib_table_lookup() fills these only, tclassid belongs to the rules */
+static void fib_result_copy(struct fib_result *dst,
+			    const struct fib_result *src)
+{
+	dst->prefix = src->prefix;
+	dst->prefixlen = src->prefixlen;
+	dst->nh_sel = src->nh_sel;
+	dst->type = src->type;
+	dst->scope = src->scope;
+	dst->fi = src->fi;
+	dst->table = src->table;
+	dst->fa_head = src->fa_head;
+}
+
+int fib_table_lookup_cached(struct net *net, struct fib_table *tb,
+			    const struct flowi4 *flp, struct fib_result *res,
+			    int fib_flags)
+{
+	struct fib_lookup_cache_stat __percpu *stat = net->ipv4.fib_cache_stat;
+	struct fib_lookup_cache __percpu *pc;
+	struct fib_lookup_cache_entry *e;
+	struct fib_lookup_cache *c;
+	unsigned int genid;
+	u32 flags;
+	int err;
+
+	pc = rcu_dereference(net->ipv4.fib_cache);
+	if (!pc)
+		return fib_table_lookup(tb, flp, res, fib_flags);
+
+	if (!in_softirq() || !(fib_flags & FIB_LOOKUP_NOREF)) {
+		this_cpu_inc(stat->bypass);
+		return fib_table_lookup(tb, flp, res, fib_flags);
+	}
+
+	c = this_cpu_ptr(pc);
+	genid = fib_lookup_cache_genid(net);
+	flags = fib_lookup_cache_flags(flp, fib_flags);
+	e = fib_lookup_cache_slot(c, tb, flp, flags);
+
+	if (e->tb == tb && e->daddr == flp->daddr &&
+	    e->oif == flp->flowi4_oif && e->flags == flags) {
+		if (likely(e->genid == genid)) {
+			__this_cpu_inc(stat->hit);
+			if (!e->err)
+				fib_result_copy(res, &e->res);
+			return e->err;
+		}
+		__this_cpu_inc(stat->stale);
+	} else {
+		__this_cpu_inc(stat->miss);
+	}
+
+	err = fib_table_lookup(tb, flp, res, fib_flags);
+
+	e->genid = genid;
+	e->tb = tb;
+	e->daddr = flp->daddr;
+	e->oif = flp->flowi4_oif;
+	e->flags = flags;
+	e->err = err;
+	if (!err)
+		fib_result_copy(&e->res, res);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(fib_table_lookup_cached);
+
+static int fib_lookup_cache_set(struct net *net, bool enable)
+{
+	struct fib_lookup_cache __percpu *c;
+
+	ASSERT_RTNL();
+
+	c = rtnl_dereference(net->ipv4.fib_cache);
+	if (enable == !!c)
+		return 0;
+
+	if (enable) {
+		/* Zeroed entries have no table, they never match */
+		c = alloc_percpu(struct fib_lookup_cache);
+		if (!c)
+			return -ENOMEM;
+		rcu_assign_pointer(net->ipv4.fib_cache, c);
+	} else {
+		RCU_INIT_POINTER(net->ipv4.fib_cache, NULL);
+		synchronize_net();
+		free_percpu(c);
+	}
+
+	return 0;
+}
+
+int fib_lookup_cache_sysctl(struct net *net, int enable)
+{
+	int err;
+
+	rtnl_lock();
+	err = fib_lookup_cache_set(net, enable);
+	rtnl_unlock();
+
+	return err;
+}
+
+#ifdef CONFIG_PROC_FS
+static void *fib_lookup_cache_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct net *net = seq_file_net(seq);
+	int cpu;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+
+	for (cpu = *pos - 1; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return per_cpu_ptr(net->ipv4.fib_cache_stat, cpu);
+	}
+	return NULL;
+}
+
+static void *fib_lookup_cache_seq_next(struct seq_file *seq, void *v,
+				       loff_t *pos)
+{
+	struct net *net = seq_file_net(seq);
+	int cpu;
+
+	for (cpu = *pos; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return per_cpu_ptr(net->ipv4.fib_cache_stat, cpu);
+	}
+	return NULL;
+}
+
+static void fib_lookup_cache_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
+static int fib_lookup_cache_seq_show(struct seq_file *seq, void *v)
+{
+	const struct fib_lookup_cache_stat *st = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(seq, "hit      miss     stale    bypass\n");
+		return 0;
+	}
+
+	seq_printf(seq, "%08x %08x %08x %08x\n",
+		   st->hit, st->miss, st->stale, st->bypass);
+	return 0;
+}
+
+static const struct seq_operations fib_lookup_cache_seq_ops = {
+	.start	= fib_lookup_cache_seq_start,
+	.next	= fib_lookup_cache_seq_next,
+	.stop	= fib_lookup_cache_seq_stop,
+	.show	= fib_lookup_cache_seq_show,
+};
+
+static int fib_lookup_cache_seq_open(struct inode *inode, struct file *file)
+{
+	return seq_open_net(inode, file, &fib_lookup_cache_seq_ops,
+			    sizeof(struct seq_net_private));
+}
+
+static const struct file_operations fib_lookup_cache_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = fib_lookup_cache_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = seq_release_net,
+};
+#endif /* CONFIG_PROC_FS */
+
+int __net_init fib_lookup_cache_net_init(struct net *net)
+{
+	atomic_set(&net->ipv4.fib_cache_genid, 0);
+	RCU_INIT_POINTER(net->ipv4.fib_cache, NULL);
+
+	net->ipv4.fib_cache_stat = alloc_percpu(struct fib_lookup_cache_stat);
+	if (!net->ipv4.fib_cache_stat)
+		return -ENOMEM;
+
+#ifdef CONFIG_PROC_FS
+	if (!proc_create("fib_lookup_cache", 0444, net->proc_net_stat,
+			 &fib_lookup_cache_seq_fops)) {
+		free_percpu(net->ipv4.fib_cache_stat);
+		return -ENOMEM;
+	}
+#endif
+	return 0;
+}
+
+void __net_exit fib_lookup_cache_net_exit(struct net *net)
+{
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("fib_lookup_cache", net->proc_net_stat);
+#endif
+	/* No more lookups, see fib_net_exit() */
+	free_percpu(rcu_dereference_protected(net->ipv4.fib_cache, 1));
+	free_percpu(net->ipv4.fib_cache_stat);
+}
@@ -132,9 +132,9 @@ static int fib4_rule_action(struct fib_rule *rule, struct flowi *flp,
 	tb_id = fib_rule_get_table(rule, arg);
 	tbl = fib_get_table(rule->fr_net, tb_id);
 	if (tbl)
-		err = fib_table_lookup(tbl, &flp->u.ip4,
-				       (struct fib_result *)arg->result,
-				       arg->flags);
+		err = fib_table_lookup_cached(rule->fr_net, tbl, &flp->u.ip4,
+					      (struct fib_result *)arg->result,
+					      arg->flags);
 
 	rcu_read_unlock();
 	return err;
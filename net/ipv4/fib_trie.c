@@ -1223,6 +1223,7 @@ int fib_table_insert(struct net *net, struct fib_table *tb,
 				  tb->tb_id, &cfg->fc_nlinfo, nlflags);
 
 			hlist_replace_rcu(&fa->fa_list, &new_fa->fa_list);
+			fib_lookup_cache_invalidate(net);
 
 			alias_free_mem_rcu(fa);
 
@@ -1272,6 +1273,7 @@ int fib_table_insert(struct net *net, struct fib_table *tb,
 	if (!plen)
 		tb->tb_num_default++;
 
+	fib_lookup_cache_invalidate(net);
 	rt_cache_flush(cfg->fc_nlinfo.nl_net);
 	call_fib_entry_notifiers(net, event, key, plen, fi, tos, cfg->fc_type,
 				 tb->tb_id);
@@ -1583,6 +1585,7 @@ int fib_table_delete(struct net *net, struct fib_table *tb,
 		tb->tb_num_default--;
 
 	fib_remove_alias(t, tp, l, fa_to_delete);
+	fib_lookup_cache_invalidate(net);
 
 	if (fa_to_delete->fa_state & FA_S_ACCESSED)
 		rt_cache_flush(cfg->fc_nlinfo.nl_net);
@@ -1905,6 +1908,7 @@ int fib_table_flush(struct net *net, struct fib_table *tb, bool flush_all)
 						 fi, fa->fa_tos, fa->fa_type,
 						 tb->tb_id);
 			hlist_del_rcu(&fa->fa_list);
+			fib_lookup_cache_invalidate(net);
 			fib_release_info(fa->fa_info);
 			alias_free_mem_rcu(fa);
 			found++;
@@ -377,6 +377,28 @@ static int proc_tfo_blackhole_detect_timeout(struct ctl_table *table,
 	return ret;
 }
 
+#ifdef CONFIG_IP_FIB_LOOKUP_CACHE
+static int proc_fib_lookup_cache(struct ctl_table *table, int write,
+				 void __user *buffer, size_t *lenp,
+				 loff_t *ppos)
+{
+	struct net *net = container_of(table->data, struct net,
+				       ipv4.sysctl_fib_lookup_cache);
+	int *valp = table->data;
+	int old = *valp;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (write && !ret && *valp != old) {
+		ret = fib_lookup_cache_sysctl(net, *valp);
+		if (ret)
+			*valp = old;
+	}
+
+	return ret;
+}
+#endif
+
 static int proc_tcp_available_ulp(struct ctl_table *ctl,
 				  int write,
 				  void __user *buffer, size_t *lenp,
@@ -1114,6 +1136,17 @@ static struct ctl_table ipv4_net_table[] = {
 		.extra1		= &zero,
 		.extra2		= &one,
 	},
+#endif
+#ifdef CONFIG_IP_FIB_LOOKUP_CACHE
+	{
+		.procname	= "fib_lookup_cache",
+		.data		= &init_net.ipv4.sysctl_fib_lookup_cache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_fib_lookup_cache,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 #endif
 	{
 		.procname	= "ip_unprivileged_port_start",
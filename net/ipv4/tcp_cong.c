@@ -158,7 +158,7 @@ void tcp_assign_congestion_control(struct sock *sk)
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(ca, &tcp_cong_list, list) {
-		if (likely(try_module_get(ca->owner))) {
+		if (likely(tcp_ca_get(ca))) {
 			icsk->icsk_ca_ops = ca;
 			goto out;
 		}
@@ -210,7 +210,7 @@ void tcp_cleanup_congestion_control(struct sock *sk)
 
 	if (icsk->icsk_ca_ops->release)
 		icsk->icsk_ca_ops->release(sk);
-	module_put(icsk->icsk_ca_ops->owner);
+	tcp_ca_put(icsk->icsk_ca_ops);
 }
 
 /* Used by sysctl to change default congestion control */
@@ -362,12 +362,12 @@ int tcp_set_congestion_control(struct sock *sk, const char *name, bool load, boo
 	} else if (!load) {
 		const struct tcp_congestion_ops *old_ca = icsk->icsk_ca_ops;
 
-		if (try_module_get(ca->owner)) {
+		if (tcp_ca_get(ca)) {
 			if (reinit) {
 				tcp_reinit_congestion_control(sk, ca);
 			} else {
 				icsk->icsk_ca_ops = ca;
-				module_put(old_ca->owner);
+				tcp_ca_put(old_ca);
 			}
 		} else {
 			err = -EBUSY;
@@ -375,7 +375,7 @@ int tcp_set_congestion_control(struct sock *sk, const char *name, bool load, boo
 	} else if (!((ca->flags & TCP_CONG_NON_RESTRICTED) ||
 		     ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))) {
 		err = -EPERM;
-	} else if (!try_module_get(ca->owner)) {
+	} else if (!tcp_ca_get(ca)) {
 		err = -EBUSY;
 	} else {
 		tcp_reinit_congestion_control(sk, ca);
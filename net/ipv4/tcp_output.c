@@ -957,25 +957,43 @@ static bool tcp_needs_internal_pacing(const struct sock *sk)
 	return smp_load_acquire(&sk->sk_pacing_status) == SK_PACING_NEEDED;
 }
 
-static void tcp_internal_pacing(struct sock *sk, const struct sk_buff *skb)
+/* Earliest Departure Time (EDT) model : a paced data packet carries in
+ * skb->tstamp the CLOCK_MONOTONIC time it is allowed to leave, and
+ * tp->tcp_wstamp_ns then moves forward by the packet serialization time
+ * at sk_pacing_rate. sch_fq simply holds packets until their departure
+ * time. Without it, tcp_pacing_check() holds back the next transmit.
+ * Returns the departure time of @skb, or 0 if it is not paced.
+ */
+static u64 tcp_update_wstamp(struct sock *sk, const struct sk_buff *skb)
 {
-	u64 len_ns;
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 prior_wstamp, edt, len_ns;
 	u32 rate;
 
-	if (!tcp_needs_internal_pacing(sk))
-		return;
+	if (smp_load_acquire(&sk->sk_pacing_status) == SK_PACING_NONE)
+		return 0;
 	rate = sk->sk_pacing_rate;
 	if (!rate || rate == ~0U)
-		return;
+		return 0;
 
-	/* Should account for header sizes as sch_fq does,
-	 * but lets make things simple.
-	 */
-	len_ns = (u64)skb->len * NSEC_PER_SEC;
-	do_div(len_ns, rate);
-	hrtimer_start(&tcp_sk(sk)->pacing_timer,
-		      ktime_add_ns(ktime_get(), len_ns),
-		      HRTIMER_MODE_ABS_PINNED);
+	prior_wstamp = tp->tcp_wstamp_ns;
+	edt = max(prior_wstamp, ktime_get_ns());
+	tp->tcp_wstamp_ns = edt;
+
+	/* Do not pace the very first packets of a flow */
+	if (tp->data_segs_out >= 10) {
+		/* Should account for header sizes as sch_fq does,
+		 * but lets make things simple.
+		 */
+		len_ns = (u64)skb->len * NSEC_PER_SEC;
+		do_div(len_ns, rate);
+		/* Account for schedule/timers drifts : if we are late,
+		 * give back up to half of the serialization time.
+		 */
+		len_ns -= min(len_ns / 2, edt - prior_wstamp);
+		tp->tcp_wstamp_ns += len_ns;
+	}
+	return edt;
 }
 
 /* This routine actually transmits TCP packets queued in by
@@ -1001,6 +1019,7 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 	struct sk_buff *oskb = NULL;
 	struct tcp_md5sig_key *md5;
 	struct tcphdr *th;
+	u64 edt = 0;
 	int err;
 
 	BUG_ON(!skb || !tcp_skb_pcount(skb));
@@ -1107,8 +1126,8 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 
 	if (skb->len != tcp_header_size) {
 		tcp_event_data_sent(tp, sk);
+		edt = tcp_update_wstamp(sk, skb);
 		tp->data_segs_out += tcp_skb_pcount(skb);
-		tcp_internal_pacing(sk, skb);
 	}
 
 	if (after(tcb->end_seq, tp->snd_nxt) || tcb->seq == tcb->end_seq)
@@ -1120,8 +1139,10 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 	skb_shinfo(skb)->gso_segs = tcp_skb_pcount(skb);
 	skb_shinfo(skb)->gso_size = tcp_skb_mss(skb);
 
-	/* Our usage of tstamp should remain private */
-	skb->tstamp = 0;
+	/* Paced data carries its departure time for sch_fq,
+	 * otherwise our usage of tstamp should remain private.
+	 */
+	skb->tstamp = ns_to_ktime(edt);
 
 	/* Cleanup our debris for IP stacks */
 	memset(skb->cb, 0, max(sizeof(struct inet_skb_parm),
@@ -2178,10 +2199,22 @@ static int tcp_mtu_probe(struct sock *sk)
 	return -1;
 }
 
-static bool tcp_pacing_check(const struct sock *sk)
+/* Without sch_fq, hold back transmits until the departure time of the
+ * next packet, and arm the pacing timer to resume then.
+ */
+static bool tcp_pacing_check(struct sock *sk)
 {
-	return tcp_needs_internal_pacing(sk) &&
-	       hrtimer_active(&tcp_sk(sk)->pacing_timer);
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tcp_needs_internal_pacing(sk))
+		return false;
+	if (tp->tcp_wstamp_ns <= ktime_get_ns())
+		return false;
+	if (!hrtimer_is_queued(&tp->pacing_timer))
+		hrtimer_start(&tp->pacing_timer,
+			      ns_to_ktime(tp->tcp_wstamp_ns),
+			      HRTIMER_MODE_ABS_PINNED);
+	return true;
 }
 
 /* TCP Small Queues :
@@ -3279,8 +3312,8 @@ static void tcp_ca_dst_init(struct sock *sk, const struct dst_entry *dst)
 
 	rcu_read_lock();
 	ca = tcp_ca_find_key(ca_key);
-	if (likely(ca && try_module_get(ca->owner))) {
-		module_put(icsk->icsk_ca_ops->owner);
+	if (likely(ca && tcp_ca_get(ca))) {
+		tcp_ca_put(icsk->icsk_ca_ops);
 		icsk->icsk_ca_dst_locked = tcp_ca_dst_locked(dst);
 		icsk->icsk_ca_ops = ca;
 	}
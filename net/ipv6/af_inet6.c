@@ -878,6 +878,9 @@ static const struct ipv6_stub ipv6_stub_impl = {
 	.udpv6_encap_enable = udpv6_encap_enable,
 	.ndisc_send_na = ndisc_send_na,
 	.nd_tbl	= &nd_tbl,
+	.fib6_get_table = fib6_get_table,
+	.fib6_table_lookup = ip6_pol_route_lookup,
+	.ip6_route_lookup = ip6_route_lookup,
 };
 
 static int __init inet6_init(void)
@@ -378,6 +378,8 @@ static inline int ip6_forward_finish(struct net *net, struct sock *sk,
 	__IP6_INC_STATS(net, ip6_dst_idev(dst), IPSTATS_MIB_OUTFORWDATAGRAMS);
 	__IP6_ADD_STATS(net, ip6_dst_idev(dst), IPSTATS_MIB_OUTOCTETS, skb->len);
 
+	/* receive timestamp must not be taken as a departure time */
+	skb->tstamp = 0;
 	return dst_output(net, sk, skb);
 }
 
@@ -864,9 +864,9 @@ static struct fib6_node* fib6_backtrack(struct fib6_node *fn,
 	}
 }
 
-static struct rt6_info *ip6_pol_route_lookup(struct net *net,
-					     struct fib6_table *table,
-					     struct flowi6 *fl6, int flags)
+struct rt6_info *ip6_pol_route_lookup(struct net *net,
+				      struct fib6_table *table,
+				      struct flowi6 *fl6, int flags)
 {
 	struct fib6_node *fn;
 	struct rt6_info *rt;
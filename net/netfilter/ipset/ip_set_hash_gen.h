@@ -27,9 +27,12 @@
  * Readers and resizing
  *
  * Resizing can be triggered by userspace command only, and those
- * are serialized by the nfnl mutex. During resizing the set is
- * read-locked, so the only possible concurrent operations are
- * the kernel side readers. Those must be protected by proper RCU locking.
+ * are serialized by the nfnl mutex. Readers are never blocked: they must be
+ * protected by proper RCU locking and keep seeing the original table until
+ * the new one is fully populated. The set lock is taken for a chunk of
+ * buckets at a time only, kernel side adds/deletes and the garbage
+ * collector can run in between, marking the buckets they modify so that
+ * those are copied again.
  */
 
 /* Number of elements to store in an initial array block */
@@ -38,6 +41,8 @@
 #define AHASH_MAX_SIZE			(3 * AHASH_INIT_SIZE)
 /* Max muber of elements in the array block when tuned */
 #define AHASH_MAX_TUNED			64
+/* Number of buckets rehashed at once with the set lock held */
+#define AHASH_RESIZE_CHUNK		1024
 
 /* Max number of elements can be tuned */
 #ifdef IP_SET_HASH_WITH_MULTI
@@ -210,6 +215,9 @@ htable_bits(u32 hashsize)
 #undef mtype_test
 #undef mtype_uref
 #undef mtype_expire
+#undef mtype_resize_mark
+#undef mtype_resize_copy
+#undef mtype_resize_clear
 #undef mtype_resize
 #undef mtype_head
 #undef mtype_list
@@ -252,6 +260,9 @@ htable_bits(u32 hashsize)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_uref		IPSET_TOKEN(MTYPE, _uref)
 #define mtype_expire		IPSET_TOKEN(MTYPE, _expire)
+#define mtype_resize_mark	IPSET_TOKEN(MTYPE, _resize_mark)
+#define mtype_resize_copy	IPSET_TOKEN(MTYPE, _resize_copy)
+#define mtype_resize_clear	IPSET_TOKEN(MTYPE, _resize_clear)
 #define mtype_resize		IPSET_TOKEN(MTYPE, _resize)
 #define mtype_head		IPSET_TOKEN(MTYPE, _head)
 #define mtype_list		IPSET_TOKEN(MTYPE, _list)
@@ -292,11 +303,23 @@ struct htype {
 	u8 netmask;		/* netmask value for subnets to store */
 #endif
 	struct mtype_elem next; /* temporary storage for uadd */
+	unsigned long *resize_dirty; /* buckets modified during resizing */
+	u32 resize_pos;		/* buckets below are rehashed already */
 #ifdef IP_SET_HASH_WITH_NETS
 	struct net_prefixes nets[NLEN]; /* book-keeping of prefixes */
 #endif
 };
 
+/* Record that a bucket of the table being resized has been modified after
+ * it was rehashed. Must be called with the set lock held.
+ */
+static inline void
+mtype_resize_mark(struct htype *h, u32 key)
+{
+	if (unlikely(h->resize_dirty) && key < h->resize_pos)
+		__set_bit(key, h->resize_dirty);
+}
+
 #ifdef IP_SET_HASH_WITH_NETS
 /* Network cidr size book keeping when the hash stores different
  * sized networks. cidr == real cidr + 1 to support /0.
@@ -484,6 +507,7 @@ mtype_expire(struct ip_set *set, struct htype *h)
 			if (!ip_set_timeout_expired(ext_timeout(data, set)))
 				continue;
 			pr_debug("expired %u/%u\n", i, j);
+			mtype_resize_mark(h, i);
 			clear_bit(j, n->used);
 			smp_mb__after_atomic();
 #ifdef IP_SET_HASH_WITH_NETS
@@ -540,29 +564,127 @@ mtype_gc(unsigned long ul_set)
 	add_timer(&h->gc);
 }
 
+/* Copy the elements of bucket i of the original table into the new one */
+static int
+mtype_resize_copy(struct ip_set *set, struct htable *orig, struct htable *t,
+		  u32 i, struct mtype_elem *tmp, size_t *extsize)
+{
+	struct htype *h = set->data;
+	size_t dsize = set->dsize;
+#ifdef IP_SET_HASH_WITH_NETS
+	u8 flags;
+#endif
+	struct mtype_elem *data;
+	struct mtype_elem *d;
+	struct hbucket *n, *m;
+	u32 j, key;
+
+	n = __ipset_dereference_protected(hbucket(orig, i), 1);
+	if (!n)
+		return 0;
+	for (j = 0; j < n->pos; j++) {
+		if (!test_bit(j, n->used))
+			continue;
+		data = ahash_data(n, j, dsize);
+#ifdef IP_SET_HASH_WITH_NETS
+		/* We have readers running parallel with us,
+		 * so the live data cannot be modified.
+		 */
+		flags = 0;
+		memcpy(tmp, data, dsize);
+		data = tmp;
+		mtype_data_reset_flags(data, &flags);
+#endif
+		key = HKEY(data, h->initval, t->htable_bits);
+		m = __ipset_dereference_protected(hbucket(t, key), 1);
+		if (!m) {
+			m = kzalloc(sizeof(*m) +
+				    AHASH_INIT_SIZE * dsize,
+				    GFP_ATOMIC);
+			if (!m)
+				return -ENOMEM;
+			m->size = AHASH_INIT_SIZE;
+			*extsize += ext_size(AHASH_INIT_SIZE, dsize);
+			RCU_INIT_POINTER(hbucket(t, key), m);
+		} else if (m->pos >= m->size) {
+			struct hbucket *ht;
+
+			if (m->size >= AHASH_MAX(h))
+				return -EAGAIN;
+			ht = kzalloc(sizeof(*ht) +
+				     (m->size + AHASH_INIT_SIZE) * dsize,
+				     GFP_ATOMIC);
+			if (!ht)
+				return -ENOMEM;
+			memcpy(ht, m, sizeof(struct hbucket) +
+				      m->size * dsize);
+			ht->size = m->size + AHASH_INIT_SIZE;
+			*extsize += ext_size(AHASH_INIT_SIZE, dsize);
+			kfree(m);
+			m = ht;
+			RCU_INIT_POINTER(hbucket(t, key), ht);
+		}
+		d = ahash_data(m, m->pos, dsize);
+		memcpy(d, data, dsize);
+		set_bit(m->pos++, m->used);
+#ifdef IP_SET_HASH_WITH_NETS
+		mtype_data_reset_flags(d, &flags);
+#endif
+	}
+
+	return 0;
+}
+
+/* Drop the copies of bucket i of the original table from the new one.
+ * The new table is not visible to readers yet and the extensions are still
+ * owned by the original elements, so the buckets can simply be freed.
+ */
+static void
+mtype_resize_clear(struct ip_set *set, struct htable *orig, struct htable *t,
+		   u32 i, size_t *extsize)
+{
+	struct hbucket *m;
+	u32 k, key;
+
+	/* The hash key is masked by the table size: the elements of bucket i
+	 * can only land in the buckets having i in their low bits.
+	 */
+	for (k = 0; k < jhash_size(t->htable_bits - orig->htable_bits); k++) {
+		key = i | (k << orig->htable_bits);
+		m = __ipset_dereference_protected(hbucket(t, key), 1);
+		if (!m)
+			continue;
+		*extsize -= ext_size(m->size, set->dsize);
+		RCU_INIT_POINTER(hbucket(t, key), NULL);
+		kfree(m);
+	}
+}
+
 /* Resize a hash: create a new hash table with doubling the hashsize
  * and inserting the elements to it. Repeat until we succeed or
  * fail due to memory pressures.
+ *
+ * The buckets are copied in chunks of AHASH_RESIZE_CHUNK, releasing the set
+ * lock in between, so that kernel side adds, deletes and the garbage
+ * collector are not held off for the whole rehashing. The buckets of the
+ * original table which are modified after they have been copied are
+ * recorded in h->resize_dirty and copied again before the new table is
+ * published.
  */
 static int
 mtype_resize(struct ip_set *set, bool retried)
 {
 	struct htype *h = set->data;
 	struct htable *t, *orig;
+	unsigned long *dirty;
 	u8 htable_bits;
-	size_t extsize, dsize = set->dsize;
-#ifdef IP_SET_HASH_WITH_NETS
-	u8 flags;
-	struct mtype_elem *tmp;
-#endif
-	struct mtype_elem *data;
-	struct mtype_elem *d;
-	struct hbucket *n, *m;
-	u32 i, j, key;
+	size_t extsize;
+	struct mtype_elem *tmp = NULL;
+	u32 i, n, hsize;
 	int ret;
 
 #ifdef IP_SET_HASH_WITH_NETS
-	tmp = kmalloc(dsize, GFP_KERNEL);
+	tmp = kmalloc(set->dsize, GFP_KERNEL);
 	if (!tmp)
 		return -ENOMEM;
 #endif
@@ -570,6 +692,14 @@ mtype_resize(struct ip_set *set, bool retried)
 	orig = rcu_dereference_bh_nfnl(h->table);
 	htable_bits = orig->htable_bits;
 	rcu_read_unlock_bh();
+	hsize = jhash_size(htable_bits);
+
+	dirty = kvzalloc(BITS_TO_LONGS(hsize) * sizeof(unsigned long),
+			 GFP_KERNEL);
+	if (!dirty) {
+		ret = -ENOMEM;
+		goto out;
+	}
 
 retry:
 	ret = 0;
@@ -587,76 +717,52 @@ mtype_resize(struct ip_set *set, bool retried)
 		goto out;
 	}
 	t->htable_bits = htable_bits;
+	extsize = 0;
 
 	spin_lock_bh(&set->lock);
 	orig = __ipset_dereference_protected(h->table, 1);
 	/* There can't be another parallel resizing, but dumping is possible */
 	atomic_set(&orig->ref, 1);
 	atomic_inc(&orig->uref);
-	extsize = 0;
+	h->resize_dirty = dirty;
+	h->resize_pos = 0;
 	pr_debug("attempt to resize set %s from %u to %u, t %p\n",
 		 set->name, orig->htable_bits, htable_bits, orig);
-	for (i = 0; i < jhash_size(orig->htable_bits); i++) {
-		n = __ipset_dereference_protected(hbucket(orig, i), 1);
-		if (!n)
-			continue;
-		for (j = 0; j < n->pos; j++) {
-			if (!test_bit(j, n->used))
-				continue;
-			data = ahash_data(n, j, dsize);
-#ifdef IP_SET_HASH_WITH_NETS
-			/* We have readers running parallel with us,
-			 * so the live data cannot be modified.
-			 */
-			flags = 0;
-			memcpy(tmp, data, dsize);
-			data = tmp;
-			mtype_data_reset_flags(data, &flags);
-#endif
-			key = HKEY(data, h->initval, htable_bits);
-			m = __ipset_dereference_protected(hbucket(t, key), 1);
-			if (!m) {
-				m = kzalloc(sizeof(*m) +
-					    AHASH_INIT_SIZE * dsize,
-					    GFP_ATOMIC);
-				if (!m) {
-					ret = -ENOMEM;
-					goto cleanup;
-				}
-				m->size = AHASH_INIT_SIZE;
-				extsize = ext_size(AHASH_INIT_SIZE, dsize);
-				RCU_INIT_POINTER(hbucket(t, key), m);
-			} else if (m->pos >= m->size) {
-				struct hbucket *ht;
-
-				if (m->size >= AHASH_MAX(h)) {
-					ret = -EAGAIN;
-				} else {
-					ht = kzalloc(sizeof(*ht) +
-						(m->size + AHASH_INIT_SIZE)
-						* dsize,
-						GFP_ATOMIC);
-					if (!ht)
-						ret = -ENOMEM;
-				}
-				if (ret < 0)
-					goto cleanup;
-				memcpy(ht, m, sizeof(struct hbucket) +
-					      m->size * dsize);
-				ht->size = m->size + AHASH_INIT_SIZE;
-				extsize += ext_size(AHASH_INIT_SIZE, dsize);
-				kfree(m);
-				m = ht;
-				RCU_INIT_POINTER(hbucket(t, key), ht);
-			}
-			d = ahash_data(m, m->pos, dsize);
-			memcpy(d, data, dsize);
-			set_bit(m->pos++, m->used);
-#ifdef IP_SET_HASH_WITH_NETS
-			mtype_data_reset_flags(d, &flags);
-#endif
+	for (i = 0; i < hsize; i++) {
+		ret = mtype_resize_copy(set, orig, t, i, tmp, &extsize);
+		if (ret < 0)
+			goto cleanup;
+		h->resize_pos = i + 1;
+		if (h->resize_pos % AHASH_RESIZE_CHUNK == 0) {
+			spin_unlock_bh(&set->lock);
+			cond_resched();
+			spin_lock_bh(&set->lock);
+		}
+	}
+	/* Catch up with the buckets modified meanwhile: first still in
+	 * chunks, then the few modified during that pass with the lock held
+	 * until the new table is published.
+	 */
+	for (i = find_first_bit(dirty, hsize), n = 0; i < hsize;
+	     i = find_next_bit(dirty, hsize, i + 1)) {
+		__clear_bit(i, dirty);
+		mtype_resize_clear(set, orig, t, i, &extsize);
+		ret = mtype_resize_copy(set, orig, t, i, tmp, &extsize);
+		if (ret < 0)
+			goto cleanup;
+		if (++n % AHASH_RESIZE_CHUNK == 0) {
+			spin_unlock_bh(&set->lock);
+			cond_resched();
+			spin_lock_bh(&set->lock);
 		}
 	}
+	for_each_set_bit(i, dirty, hsize) {
+		mtype_resize_clear(set, orig, t, i, &extsize);
+		ret = mtype_resize_copy(set, orig, t, i, tmp, &extsize);
+		if (ret < 0)
+			goto cleanup;
+	}
+	h->resize_dirty = NULL;
 	rcu_assign_pointer(h->table, t);
 	set->ext_size = extsize;
 
@@ -674,18 +780,20 @@ mtype_resize(struct ip_set *set, bool retried)
 	}
 
 out:
-#ifdef IP_SET_HASH_WITH_NETS
+	kvfree(dirty);
 	kfree(tmp);
-#endif
 	return ret;
 
 cleanup:
+	h->resize_dirty = NULL;
 	atomic_set(&orig->ref, 0);
 	atomic_dec(&orig->uref);
 	spin_unlock_bh(&set->lock);
 	mtype_ahash_destroy(set, t, false);
-	if (ret == -EAGAIN)
+	if (ret == -EAGAIN) {
+		bitmap_zero(dirty, hsize);
 		goto retry;
+	}
 	goto out;
 }
 
@@ -716,6 +824,7 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 
 	t = ipset_dereference_protected(h->table, set);
 	key = HKEY(value, h->initval, t->htable_bits);
+	mtype_resize_mark(h, key);
 	n = __ipset_dereference_protected(hbucket(t, key), 1);
 	if (!n) {
 		if (forceadd || set->elements >= h->maxelem)
@@ -849,6 +958,7 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 
 	t = ipset_dereference_protected(h->table, set);
 	key = HKEY(value, h->initval, t->htable_bits);
+	mtype_resize_mark(h, key);
 	n = __ipset_dereference_protected(hbucket(t, key), 1);
 	if (!n)
 		goto out;
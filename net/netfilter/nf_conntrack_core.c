@@ -74,12 +74,19 @@ EXPORT_SYMBOL_GPL(nf_conntrack_expect_lock);
 struct hlist_nulls_head *nf_conntrack_hash __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 
+/* number of buckets remembered by gc as holding early-drop candidates */
+#define NF_CT_EVICT_HINTS	64u
+
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
 	u32			last_bucket;
 	bool			exiting;
 	bool			early_drop;
 	long			next_gc_run;
+	unsigned int		scan_scale;
+	unsigned int		hint_next;
+	/* bucket + 1 of chains with unassured entries, 0 if unused */
+	unsigned int		evict_hint[NF_CT_EVICT_HINTS];
 };
 
 static __read_mostly struct kmem_cache *nf_conntrack_cachep;
@@ -93,6 +100,8 @@ static __read_mostly bool nf_conntrack_locks_all;
 #define GC_MAX_SCAN_JIFFIES	(16u * HZ)
 /* desired ratio of entries found to be expired */
 #define GC_EVICT_RATIO	50u
+/* at most 1/(GC_MAX_BUCKETS_DIV / GC_MAX_SCAN_SCALE) of table per cycle */
+#define GC_MAX_SCAN_SCALE	16u
 
 static struct conntrack_gc_work conntrack_gc_work;
 
@@ -719,6 +728,18 @@ static int nf_ct_resolve_clash(struct net *net, struct sk_buff *skb,
 	return NF_DROP;
 }
 
+/* Fold one confirmation time into the per-cpu moving average, 1/8 weight.
+ * Called with BHs disabled.
+ */
+static void nf_ct_insert_lat_update(struct net *net, u64 delta)
+{
+	unsigned int lat = __this_cpu_read(net->ct.stat->insert_lat);
+	unsigned int sample = min_t(u64, delta, UINT_MAX);
+
+	lat = lat - (lat >> 3) + (sample >> 3);
+	__this_cpu_write(net->ct.stat->insert_lat, lat);
+}
+
 /* Confirm a connection given skb; places it in hash table */
 int
 __nf_conntrack_confirm(struct sk_buff *skb)
@@ -734,6 +755,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	struct net *net;
 	unsigned int sequence;
 	int ret = NF_DROP;
+	u64 start;
 
 	ct = nf_ct_get(skb, &ctinfo);
 	net = nf_ct_net(ct);
@@ -747,6 +769,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 
 	zone = nf_ct_zone(ct);
 	local_bh_disable();
+	start = local_clock();
 
 	do {
 		sequence = read_seqcount_begin(&nf_conntrack_generation);
@@ -815,6 +838,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	 */
 	__nf_conntrack_hash_insert(ct, hash, reply_hash);
 	nf_conntrack_double_unlock(hash, reply_hash);
+	nf_ct_insert_lat_update(net, local_clock() - start);
 	local_bh_enable();
 
 	help = nfct_help(ct);
@@ -932,10 +956,43 @@ static unsigned int early_drop_list(struct net *net,
 	return drops;
 }
 
+/* Try a chain the gc worker saw holding unassured entries.  The hint slot
+ * is picked by the (random) hash of the new entry, so cpus racing for hints
+ * mostly use different slots and each hint is consumed at most once.
+ */
+static bool early_drop_hint(struct net *net, unsigned int hash)
+{
+	unsigned int *slot, hint, hsize, drops;
+	struct hlist_nulls_head *ct_hash;
+
+	slot = &conntrack_gc_work.evict_hint[hash % NF_CT_EVICT_HINTS];
+	if (!READ_ONCE(*slot))
+		return false;
+
+	hint = xchg(slot, 0);
+	if (!hint)
+		return false;
+
+	rcu_read_lock();
+	nf_conntrack_get_ht(&ct_hash, &hsize);
+	drops = early_drop_list(net, &ct_hash[(hint - 1) % hsize]);
+	rcu_read_unlock();
+
+	if (!drops)
+		return false;
+
+	NF_CT_STAT_ADD_ATOMIC(net, early_drop, drops);
+	NF_CT_STAT_INC_ATOMIC(net, early_drop_hint);
+	return true;
+}
+
 static noinline int early_drop(struct net *net, unsigned int hash)
 {
 	unsigned int i, bucket;
 
+	if (early_drop_hint(net, hash))
+		return true;
+
 	for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
 		struct hlist_nulls_head *ct_hash;
 		unsigned int hsize, drops;
@@ -978,6 +1035,14 @@ static bool gc_worker_can_early_drop(const struct nf_conn *ct)
 	return false;
 }
 
+static void gc_worker_add_hint(struct conntrack_gc_work *gc_work,
+			       unsigned int bucket)
+{
+	unsigned int i = gc_work->hint_next++ % NF_CT_EVICT_HINTS;
+
+	WRITE_ONCE(gc_work->evict_hint[i], bucket + 1);
+}
+
 static void gc_worker(struct work_struct *work)
 {
 	unsigned int min_interval = max(HZ / GC_MAX_BUCKETS_DIV, 1u);
@@ -989,7 +1054,8 @@ static void gc_worker(struct work_struct *work)
 
 	gc_work = container_of(work, struct conntrack_gc_work, dwork.work);
 
-	goal = nf_conntrack_htable_size / GC_MAX_BUCKETS_DIV;
+	goal = nf_conntrack_htable_size / GC_MAX_BUCKETS_DIV *
+	       gc_work->scan_scale;
 	i = gc_work->last_bucket;
 	if (gc_work->early_drop)
 		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
@@ -1000,6 +1066,7 @@ static void gc_worker(struct work_struct *work)
 		struct hlist_nulls_node *n;
 		unsigned int hashsz;
 		struct nf_conn *tmp;
+		bool hinted = false;
 
 		i++;
 		rcu_read_lock();
@@ -1012,19 +1079,32 @@ static void gc_worker(struct work_struct *work)
 			struct net *net;
 
 			tmp = nf_ct_tuplehash_to_ctrack(h);
+			net = nf_ct_net(tmp);
 
 			scanned++;
+			NF_CT_STAT_INC_ATOMIC(net, gc_scanned);
+			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
+				nf_ct_offload_timeout(tmp);
+				continue;
+			}
+
 			if (nf_ct_is_expired(tmp)) {
 				nf_ct_gc_expired(tmp);
+				NF_CT_STAT_INC_ATOMIC(net, gc_expired);
 				expired_count++;
 				continue;
 			}
 
-			if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
+			if (gc_worker_skip_ct(tmp))
 				continue;
 
-			net = nf_ct_net(tmp);
-			if (atomic_read(&net->ct.count) < nf_conntrack_max95)
+			if (!hinted && !test_bit(IPS_ASSURED_BIT, &tmp->status)) {
+				gc_worker_add_hint(gc_work, i);
+				hinted = true;
+			}
+
+			if (nf_conntrack_max95 == 0 ||
+			    atomic_read(&net->ct.count) < nf_conntrack_max95)
 				continue;
 
 			/* need to take reference to avoid possible races */
@@ -1036,8 +1116,8 @@ static void gc_worker(struct work_struct *work)
 				continue;
 			}
 
-			if (gc_worker_can_early_drop(tmp))
-				nf_ct_kill(tmp);
+			if (gc_worker_can_early_drop(tmp) && nf_ct_kill(tmp))
+				NF_CT_STAT_INC_ATOMIC(net, gc_early_drop);
 
 			nf_ct_put(tmp);
 		}
@@ -1068,19 +1148,29 @@ static void gc_worker(struct work_struct *work)
 	 * Normally, expire ratio will be close to 0.
 	 *
 	 * As soon as a sizeable fraction of the entries have expired
-	 * increase scan frequency.
+	 * increase scan frequency, and scan a larger part of the table
+	 * per cycle for as long as that keeps being the case.  Below the
+	 * desired ratio, back off in proportion to how few entries were
+	 * found to be stale.
 	 */
 	ratio = scanned ? expired_count * 100 / scanned : 0;
 	if (ratio > GC_EVICT_RATIO) {
 		gc_work->next_gc_run = min_interval;
+		gc_work->scan_scale = min(gc_work->scan_scale * 2,
+					  GC_MAX_SCAN_SCALE);
 	} else {
 		unsigned int max = GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV;
+		unsigned int step;
 
 		BUILD_BUG_ON((GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV) == 0);
 
-		gc_work->next_gc_run += min_interval;
+		step = min_interval * (GC_EVICT_RATIO - ratio) / GC_EVICT_RATIO;
+		gc_work->next_gc_run += max(step, 1u);
 		if (gc_work->next_gc_run > max)
 			gc_work->next_gc_run = max;
+
+		if (gc_work->scan_scale > 1)
+			gc_work->scan_scale /= 2;
 	}
 
 	next_run = gc_work->next_gc_run;
@@ -1094,6 +1184,7 @@ static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work)
 	INIT_DEFERRABLE_WORK(&gc_work->dwork, gc_worker);
 	gc_work->next_gc_run = HZ;
 	gc_work->exiting = false;
+	gc_work->scan_scale = 1;
 }
 
 static struct nf_conn *
@@ -0,0 +1,1205 @@
+/*
+ * PIPAPO: PIle PAcket POlicies, set type for ranges over concatenated fields
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Problem
+ * -------
+ *
+ * Match packet bytes against a set of entries, each made of a concatenation
+ * of fields, where each field can be a single value, a prefix or an arbitrary
+ * range, e.g. (source prefix, destination port range). The hash, bitmap and
+ * rbtree set types can only express exact matches or a single interval over
+ * the whole key, so such policies have to be spelt out as linear rules.
+ *
+ * Algorithm
+ * ---------
+ *
+ * Each field is split into groups of 4 bits. For each group, a lookup table
+ * holds one bucket per possible group value (16 buckets), and each bucket is
+ * a bitmap of rules matching that value:
+ *
+ *   - inserting a single value sets the rule bit in exactly one bucket per
+ *     group;
+ *   - a prefix sets the rule bit in every bucket of the groups beyond the
+ *     prefix length, and in the matching buckets of a partially masked group;
+ *   - a range is first expanded into the minimal set of prefixes covering it,
+ *     each of which becomes a rule.
+ *
+ * Matching a field is then a matter of selecting one bucket per group from
+ * the packet bytes and intersecting (AND) the bucket bitmaps: bits left set
+ * are rules matching the whole field.
+ *
+ * Rules of a field are linked to rules of the next field by a mapping table:
+ * rule i of field n maps to the range of rules, in field n + 1, derived from
+ * the same set element. The matching bits of a field are translated through
+ * the mapping table into the initial bitmap for the next field, so each
+ * field only considers rules whose previous fields matched. Rules of the last
+ * field map to set elements.
+ *
+ * Lookup cost is thus bounded by the number of groups times the length of the
+ * bitmaps, independently of the shape of the ranges, and the inner loop is a
+ * straight sequence of word-sized AND operations.
+ *
+ * Updates
+ * -------
+ *
+ * The lookup tables are not updated in place: insertions and removals are
+ * applied to a working copy of the matching data, created on demand, which
+ * is published via RCU by the set commit operation at the end of the
+ * transaction.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <net/ipv6.h>
+#include <net/netfilter/nf_tables.h>
+
+#define NFT_PIPAPO_MIN_FIELDS		2
+#define NFT_PIPAPO_MAX_FIELDS		NFT_REG32_COUNT
+#define NFT_PIPAPO_MAX_BYTES		(sizeof(struct in6_addr))
+#define NFT_PIPAPO_MAX_BITS		(NFT_PIPAPO_MAX_BYTES * BITS_PER_BYTE)
+
+/* Bits to be grouped together in lookup table buckets */
+#define NFT_PIPAPO_GROUP_BITS		4
+#define NFT_PIPAPO_GROUPS_PER_BYTE	(BITS_PER_BYTE / NFT_PIPAPO_GROUP_BITS)
+#define NFT_PIPAPO_BUCKETS		BIT(NFT_PIPAPO_GROUP_BITS)
+
+/* A range expands to at most two rules per bit, keep the rule count well
+ * within the range of the mapping table and of bitmap sizes.
+ */
+#define NFT_PIPAPO_RULES_MAX		(INT_MAX / BITS_PER_LONG)
+
+/**
+ * union nft_pipapo_map_bucket - mapping table bucket
+ * @to:		first rule number in the next field this rule maps to
+ * @n:		number of rules in the next field this rule maps to
+ * @e:		in the last field, set element this rule maps to
+ */
+union nft_pipapo_map_bucket {
+	struct {
+		u32 to;
+		u32 n;
+	};
+	struct nft_pipapo_elem *e;
+};
+
+/**
+ * struct nft_pipapo_field - lookup, mapping tables and related data for a field
+ * @groups:	number of 4-bit groups
+ * @len:	length of the field, bytes
+ * @rules:	number of inserted rules
+ * @bsize:	size of each bucket in lookup table, in longs
+ * @lt:		lookup table: groups * NFT_PIPAPO_BUCKETS * bsize longs
+ * @mt:		mapping table: one bucket per rule
+ */
+struct nft_pipapo_field {
+	unsigned int groups;
+	unsigned int len;
+	unsigned int rules;
+	unsigned int bsize;
+	unsigned long *lt;
+	union nft_pipapo_map_bucket *mt;
+};
+
+/**
+ * struct nft_pipapo_match - data used for lookups on a given version
+ * @field_count:	number of fields in the set
+ * @scratch:		per-CPU matching bitmaps, two halves of @bsize_max longs
+ * @bsize_max:		maximum lookup table bucket size of all fields, longs
+ * @rcu:		used to free matching data after a grace period
+ * @f:			fields, with lookup and mapping tables
+ */
+struct nft_pipapo_match {
+	int field_count;
+	unsigned long * __percpu *scratch;
+	unsigned int bsize_max;
+	struct rcu_head rcu;
+	struct nft_pipapo_field f[0];
+};
+
+/**
+ * struct nft_pipapo - representation of a set
+ * @match:	currently in-use matching data
+ * @clone:	working copy of matching data with pending updates, if any
+ */
+struct nft_pipapo {
+	struct nft_pipapo_match __rcu *match;
+	struct nft_pipapo_match *clone;
+};
+
+struct nft_pipapo_elem {
+	struct nft_set_ext ext;
+};
+
+/* Selects which half of the scratch map is the initial matching bitmap, the
+ * other half is guaranteed to be all zeroes between lookups.
+ */
+static DEFINE_PER_CPU(bool, nft_pipapo_scratch_index);
+
+#define nft_pipapo_for_each_field(field, index, match)		\
+	for ((field) = (match)->f, (index) = 0;			\
+	     (index) < (match)->field_count;			\
+	     (index)++, (field)++)
+
+/* Fields are stored in 32-bit registers, each one starts at a new register */
+static unsigned int pipapo_field_padded(const struct nft_pipapo_field *f)
+{
+	return round_up(f->len, sizeof(u32));
+}
+
+static unsigned long *pipapo_bucket(const struct nft_pipapo_field *f,
+				    unsigned int group, unsigned int v)
+{
+	return f->lt + (group * NFT_PIPAPO_BUCKETS + v) * f->bsize;
+}
+
+/**
+ * pipapo_and_field_buckets() - intersect buckets selected by packet data
+ * @f:		field, with lookup table
+ * @dst:	matching bitmap, ANDed in place
+ * @data:	packet bytes for this field
+ *
+ * This is the per-packet hot path: one AND over @f->bsize longs per group.
+ */
+static void pipapo_and_field_buckets(const struct nft_pipapo_field *f,
+				     unsigned long *dst, const u8 *data)
+{
+	unsigned int nbits = f->bsize * BITS_PER_LONG;
+	unsigned int group;
+
+	for (group = 0; group < f->groups; group += 2, data++) {
+		__bitmap_and(dst, dst, pipapo_bucket(f, group, *data >> 4),
+			     nbits);
+		__bitmap_and(dst, dst, pipapo_bucket(f, group + 1, *data & 0xf),
+			     nbits);
+	}
+}
+
+/**
+ * pipapo_refill() - map matching rules of a field to rules in the next one
+ * @map:	bitmap of matching rules for the current field, cleared here
+ * @len:	length of @map, longs
+ * @rules:	number of rules in the current field
+ * @dst:	initial bitmap for the next field
+ * @mt:		mapping table of the current field
+ * @match_only:	return index of first matching rule instead of mapping it
+ *
+ * Return: -1 if no rule matches, index of the first matching rule if
+ * @match_only is set, 0 otherwise.
+ */
+static int pipapo_refill(unsigned long *map, unsigned int len,
+			 unsigned int rules, unsigned long *dst,
+			 const union nft_pipapo_map_bucket *mt,
+			 bool match_only)
+{
+	unsigned long bitset;
+	unsigned int k, i;
+	int ret = -1;
+
+	for (k = 0; k < len; k++) {
+		bitset = map[k];
+		while (bitset) {
+			i = k * BITS_PER_LONG + __ffs(bitset);
+
+			if (unlikely(i >= rules)) {
+				map[k] = 0;
+				return -1;
+			}
+
+			if (match_only) {
+				__clear_bit(i, map);
+				return i;
+			}
+
+			ret = 0;
+			bitmap_set(dst, mt[i].to, mt[i].n);
+
+			bitset &= bitset - 1;
+		}
+		map[k] = 0;
+	}
+
+	return ret;
+}
+
+static bool nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned long *res_map, *fill_map, *scratch;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool map_index;
+	int i, b;
+
+	local_bh_disable();
+
+	m = rcu_dereference(priv->match);
+	if (unlikely(!m))
+		goto out;
+
+	scratch = *raw_cpu_ptr(m->scratch);
+	if (unlikely(!scratch))
+		goto out;
+
+	map_index = raw_cpu_read(nft_pipapo_scratch_index);
+	res_map  = scratch + (map_index ? m->bsize_max : 0);
+	fill_map = scratch + (map_index ? 0 : m->bsize_max);
+
+	/* Only the buckets of the first field are considered at first, the
+	 * rest of the bitmap stays clear for the next fields.
+	 */
+	memset(res_map, 0xff, m->f[0].bsize * sizeof(*res_map));
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+
+		pipapo_and_field_buckets(f, res_map, rp);
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0) {
+			raw_cpu_write(nft_pipapo_scratch_index, map_index);
+			goto out;
+		}
+
+		if (last) {
+			if (unlikely(!nft_set_elem_active(&f->mt[b].e->ext,
+							  genmask)))
+				goto next_match;
+
+			/* No refill for the last field: fill_map is still
+			 * clean and can stay where it is for the next packet.
+			 * Further matches (nested entries) are left in res_map
+			 * though, and past the buckets of the first field they
+			 * would end up in the fill bitmap of the next packet.
+			 */
+			memset(res_map, 0, f->bsize * sizeof(*res_map));
+			*ext = &f->mt[b].e->ext;
+			raw_cpu_write(nft_pipapo_scratch_index, map_index);
+			local_bh_enable();
+			return true;
+		}
+
+		/* res_map was cleared by pipapo_refill(), swap halves: the
+		 * filled bitmap is the starting point for the next field.
+		 */
+		map_index = !map_index;
+		swap(res_map, fill_map);
+
+		rp += pipapo_field_padded(f);
+	}
+out:
+	local_bh_enable();
+	return false;
+}
+
+/**
+ * pipapo_get() - get matching element from working copy, control plane only
+ * @m:		matching data, usually the working copy
+ * @data:	key data, padded to 32-bit registers
+ * @genmask:	generation mask the element has to be active in
+ *
+ * Return: matching element, ERR_PTR(-ENOENT) if none, or ERR_PTR(-ENOMEM).
+ */
+static struct nft_pipapo_elem *pipapo_get(const struct nft_pipapo_match *m,
+					  const u8 *data, u8 genmask)
+{
+	struct nft_pipapo_elem *ret = ERR_PTR(-ENOENT);
+	unsigned long *res_map, *fill_map = NULL;
+	const struct nft_pipapo_field *f;
+	int i, b;
+
+	res_map = kcalloc(m->bsize_max, sizeof(*res_map), GFP_KERNEL);
+	fill_map = kcalloc(m->bsize_max, sizeof(*fill_map), GFP_KERNEL);
+	if (!res_map || !fill_map) {
+		ret = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	memset(res_map, 0xff, m->f[0].bsize * sizeof(*res_map));
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+
+		pipapo_and_field_buckets(f, res_map, data);
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0)
+			goto out;
+
+		if (last) {
+			if (!nft_set_elem_active(&f->mt[b].e->ext, genmask))
+				goto next_match;
+
+			ret = f->mt[b].e;
+			goto out;
+		}
+
+		swap(res_map, fill_map);
+		data += pipapo_field_padded(f);
+	}
+out:
+	kfree(fill_map);
+	kfree(res_map);
+	return ret;
+}
+
+/**
+ * pipapo_resize() - resize lookup and mapping tables of a field
+ * @f:		field
+ * @old_rules:	previous number of rules
+ * @rules:	new number of rules
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure, in which case the
+ * field is left untouched.
+ */
+static int pipapo_resize(struct nft_pipapo_field *f, unsigned int old_rules,
+			 unsigned int rules)
+{
+	unsigned long *new_lt = NULL, *new_p, *old_p;
+	union nft_pipapo_map_bucket *new_mt;
+	unsigned int new_bsize, copy, bucket;
+
+	new_bsize = DIV_ROUND_UP(rules, BITS_PER_LONG);
+	if (new_bsize == f->bsize)
+		goto mt;
+
+	copy = min(new_bsize, f->bsize);
+
+	new_lt = kvzalloc(f->groups * NFT_PIPAPO_BUCKETS * new_bsize *
+			  sizeof(*new_lt), GFP_KERNEL);
+	if (!new_lt)
+		return -ENOMEM;
+
+	new_p = new_lt;
+	old_p = f->lt;
+	for (bucket = 0; bucket < f->groups * NFT_PIPAPO_BUCKETS; bucket++) {
+		memcpy(new_p, old_p, copy * sizeof(*new_p));
+		new_p += new_bsize;
+		old_p += f->bsize;
+	}
+
+mt:
+	new_mt = kvmalloc_array(rules, sizeof(*new_mt), GFP_KERNEL);
+	if (!new_mt) {
+		kvfree(new_lt);
+		return -ENOMEM;
+	}
+
+	memcpy(new_mt, f->mt, min(old_rules, rules) * sizeof(*new_mt));
+	if (rules > old_rules)
+		memset(new_mt + old_rules, 0,
+		       (rules - old_rules) * sizeof(*new_mt));
+
+	if (new_lt) {
+		kvfree(f->lt);
+		f->lt = new_lt;
+		f->bsize = new_bsize;
+	}
+
+	kvfree(f->mt);
+	f->mt = new_mt;
+
+	return 0;
+}
+
+/**
+ * pipapo_insert() - insert a single rule, matching a prefix, into a field
+ * @f:		field
+ * @k:		key data for this field, in network order
+ * @mask_bits:	prefix length, bits
+ *
+ * Return: number of inserted rules (1), negative error code on failure.
+ */
+static int pipapo_insert(struct nft_pipapo_field *f, const u8 *k,
+			 int mask_bits)
+{
+	unsigned int rule = f->rules, group, b;
+	int err;
+
+	err = pipapo_resize(f, f->rules, f->rules + 1);
+	if (err)
+		return err;
+
+	f->rules++;
+
+	for (group = 0; group < f->groups; group++) {
+		int bits = mask_bits - group * NFT_PIPAPO_GROUP_BITS;
+		u8 v, mask;
+
+		v = k[group / NFT_PIPAPO_GROUPS_PER_BYTE];
+		v = group % 2 ? v & 0xf : v >> 4;
+
+		if (bits >= NFT_PIPAPO_GROUP_BITS) {
+			__set_bit(rule, pipapo_bucket(f, group, v));
+			continue;
+		}
+
+		/* Prefix ends within, or before, this group: set the rule bit
+		 * in every bucket matching the significant bits.
+		 */
+		bits = max(bits, 0);
+		mask = (0xf << (NFT_PIPAPO_GROUP_BITS - bits)) & 0xf;
+		for (b = 0; b < NFT_PIPAPO_BUCKETS; b++) {
+			if ((b & mask) == (v & mask))
+				__set_bit(rule, pipapo_bucket(f, group, b));
+		}
+	}
+
+	return 1;
+}
+
+/* Bit @step of a big-endian number @len bytes long, counting from the LSB */
+static bool pipapo_bit(const u8 *base, unsigned int step, unsigned int len)
+{
+	return base[len - 1 - step / BITS_PER_BYTE] & BIT(step % BITS_PER_BYTE);
+}
+
+/* Fill bits up to @step, inclusive, of @base into @tmp */
+static void pipapo_step_fill(u8 *tmp, const u8 *base, int step,
+			     unsigned int len)
+{
+	int i;
+
+	memcpy(tmp, base, len);
+	for (i = 0; i <= step; i++)
+		tmp[len - 1 - i / BITS_PER_BYTE] |= BIT(i % BITS_PER_BYTE);
+}
+
+/* Add 2^step to @base, which can't overflow as @base stays below the end */
+static void pipapo_base_sum(u8 *base, unsigned int step, unsigned int len)
+{
+	bool carry = false;
+	int i;
+
+	for (i = len - 1 - step / BITS_PER_BYTE; i >= 0; i--) {
+		if (carry)
+			base[i]++;
+		else
+			base[i] += 1 << (step % BITS_PER_BYTE);
+
+		if (base[i])
+			break;
+
+		carry = true;
+	}
+}
+
+/**
+ * pipapo_expand() - expand range into the minimal set of covering prefixes
+ * @f:		field
+ * @start:	start of the range, in network order
+ * @end:	end of the range, inclusive, not lower than @start
+ *
+ * Starting from @start, repeatedly insert the largest aligned block which
+ * doesn't go beyond @end, until the end of a block matches @end.
+ *
+ * Return: number of inserted rules, negative error code on failure.
+ */
+static int pipapo_expand(struct nft_pipapo_field *f,
+			 const u8 *start, const u8 *end)
+{
+	unsigned int len = f->len * BITS_PER_BYTE, step;
+	u8 base[NFT_PIPAPO_MAX_BYTES], tmp[NFT_PIPAPO_MAX_BYTES];
+	int err, masks = 0;
+
+	memcpy(base, start, f->len);
+	for (;;) {
+		for (step = 0; step < len; step++) {
+			if (pipapo_bit(base, step, f->len))
+				break;
+
+			pipapo_step_fill(tmp, base, step, f->len);
+			if (memcmp(tmp, end, f->len) > 0)
+				break;
+		}
+
+		err = pipapo_insert(f, base, len - step);
+		if (err < 0)
+			return err;
+		masks++;
+
+		pipapo_step_fill(tmp, base, (int)step - 1, f->len);
+		if (!memcmp(tmp, end, f->len))
+			break;
+
+		pipapo_base_sum(base, step, f->len);
+	}
+
+	return masks;
+}
+
+/**
+ * pipapo_map() - link rules of a new element across fields
+ * @m:		matching data
+ * @map:	first rule and number of rules added to each field
+ * @e:		new element, mapped from rules of the last field
+ */
+static void pipapo_map(struct nft_pipapo_match *m,
+		       const union nft_pipapo_map_bucket map[],
+		       struct nft_pipapo_elem *e)
+{
+	struct nft_pipapo_field *f;
+	int i, j;
+
+	for (i = 0, f = m->f; i < m->field_count - 1; i++, f++) {
+		for (j = 0; j < map[i].n; j++) {
+			f->mt[map[i].to + j].to = map[i + 1].to;
+			f->mt[map[i].to + j].n = map[i + 1].n;
+		}
+	}
+
+	for (j = 0; j < map[i].n; j++)
+		f->mt[map[i].to + j].e = e;
+}
+
+/**
+ * pipapo_truncate() - drop rules from the end of a field
+ * @f:		field
+ * @rules:	number of rules to keep
+ *
+ * Used to undo a partial insertion: new rules are always appended, and not
+ * referenced by any mapping table yet.
+ */
+static void pipapo_truncate(struct nft_pipapo_field *f, unsigned int rules)
+{
+	unsigned int bucket;
+
+	if (rules >= f->rules)
+		return;
+
+	for (bucket = 0; bucket < f->groups * NFT_PIPAPO_BUCKETS; bucket++)
+		bitmap_clear(f->lt + bucket * f->bsize, rules,
+			     f->rules - rules);
+
+	/* Shrinking can fail, oversized tables are still valid */
+	pipapo_resize(f, f->rules, rules);
+	f->rules = rules;
+}
+
+static void pipapo_free_scratch(const struct nft_pipapo_match *m)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree(*per_cpu_ptr(m->scratch, cpu));
+}
+
+/**
+ * pipapo_realloc_scratch() - resize per-CPU matching bitmaps of a copy
+ * @m:		matching data, not in use by the packet path
+ * @bsize_max:	new maximum bucket size, longs
+ *
+ * Return: 0 on success, -ENOMEM on failure. Already replaced areas are larger
+ * than needed in that case, which is harmless.
+ */
+static int pipapo_realloc_scratch(struct nft_pipapo_match *m,
+				  unsigned int bsize_max)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		unsigned long *scratch;
+
+		scratch = kzalloc_node(bsize_max * sizeof(*scratch) * 2,
+				       GFP_KERNEL, cpu_to_node(cpu));
+		if (!scratch)
+			return -ENOMEM;
+
+		kfree(*per_cpu_ptr(m->scratch, cpu));
+		*per_cpu_ptr(m->scratch, cpu) = scratch;
+	}
+
+	return 0;
+}
+
+static void pipapo_free_match(struct nft_pipapo_match *m)
+{
+	struct nft_pipapo_field *f;
+	int i;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		kvfree(f->lt);
+		kvfree(f->mt);
+	}
+
+	pipapo_free_scratch(m);
+	free_percpu(m->scratch);
+	kfree(m);
+}
+
+static void pipapo_reclaim_match(struct rcu_head *rcu)
+{
+	pipapo_free_match(container_of(rcu, struct nft_pipapo_match, rcu));
+}
+
+static struct nft_pipapo_match *pipapo_alloc_match(int field_count)
+{
+	struct nft_pipapo_match *m;
+
+	m = kzalloc(sizeof(*m) + sizeof(m->f[0]) * field_count, GFP_KERNEL);
+	if (!m)
+		return NULL;
+
+	m->scratch = alloc_percpu(unsigned long *);
+	if (!m->scratch) {
+		kfree(m);
+		return NULL;
+	}
+
+	m->field_count = field_count;
+
+	return m;
+}
+
+/**
+ * pipapo_clone() - create a working copy of matching data
+ * @old:	matching data to copy
+ *
+ * Return: copy, with its own scratch maps, or ERR_PTR(-ENOMEM).
+ */
+static struct nft_pipapo_match *pipapo_clone(const struct nft_pipapo_match *old)
+{
+	const struct nft_pipapo_field *src;
+	struct nft_pipapo_field *dst;
+	struct nft_pipapo_match *new;
+	int i;
+
+	new = pipapo_alloc_match(old->field_count);
+	if (!new)
+		return ERR_PTR(-ENOMEM);
+
+	new->bsize_max = old->bsize_max;
+	if (old->bsize_max && pipapo_realloc_scratch(new, old->bsize_max))
+		goto err;
+
+	src = old->f;
+	nft_pipapo_for_each_field(dst, i, new) {
+		size_t lt_size = src->groups * NFT_PIPAPO_BUCKETS *
+				 src->bsize * sizeof(*src->lt);
+
+		*dst = *src;
+		dst->lt = NULL;
+		dst->mt = NULL;
+
+		dst->lt = kvmalloc(lt_size, GFP_KERNEL);
+		dst->mt = kvmalloc_array(src->rules, sizeof(*src->mt),
+					 GFP_KERNEL);
+		if (!dst->lt || !dst->mt) {
+			/* Fields past this one are still zeroed */
+			new->field_count = i + 1;
+			goto err;
+		}
+
+		memcpy(dst->lt, src->lt, lt_size);
+		memcpy(dst->mt, src->mt, src->rules * sizeof(*src->mt));
+		src++;
+	}
+
+	return new;
+
+err:
+	pipapo_free_match(new);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* Get working copy, creating it on the first update in a transaction */
+static struct nft_pipapo_match *pipapo_maybe_clone(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+
+	if (priv->clone)
+		return priv->clone;
+
+	m = pipapo_clone(nfnl_dereference(priv->match, NFNL_SUBSYS_NFTABLES));
+	if (IS_ERR(m))
+		return m;
+
+	priv->clone = m;
+
+	return m;
+}
+
+static const u8 *pipapo_elem_end(const struct nft_set_ext *ext)
+{
+	if (nft_set_ext_exists(ext, NFT_SET_EXT_KEY_END))
+		return (const u8 *)nft_set_ext_key_end(ext)->data;
+
+	return (const u8 *)nft_set_ext_key(ext)->data;
+}
+
+static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
+			     const struct nft_set_elem *elem,
+			     struct nft_set_ext **ext2)
+{
+	const struct nft_set_ext *ext = nft_set_elem_ext(set, elem->priv);
+	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
+	const u8 *start = (const u8 *)elem->key.val.data, *end;
+	struct nft_pipapo_elem *e = elem->priv, *dup;
+	u8 genmask = nft_genmask_next(net);
+	unsigned int bsize_max;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	const u8 *start_p, *end_p;
+	int i, ret = 0;
+
+	m = pipapo_maybe_clone(set);
+	if (IS_ERR(m))
+		return PTR_ERR(m);
+
+	end = pipapo_elem_end(ext);
+
+	dup = pipapo_get(m, start, genmask);
+	if (PTR_ERR(dup) == -ENOENT)
+		dup = pipapo_get(m, end, genmask);
+
+	if (!IS_ERR(dup)) {
+		*ext2 = &dup->ext;
+
+		/* Same start and end: report the existing element, any other
+		 * overlap with a live element is not allowed.
+		 */
+		if (!memcmp(start, nft_set_ext_key(&dup->ext)->data,
+			    set->klen) &&
+		    !memcmp(end, pipapo_elem_end(&dup->ext), set->klen))
+			return -EEXIST;
+
+		return -ENOTEMPTY;
+	}
+	if (PTR_ERR(dup) != -ENOENT)
+		return PTR_ERR(dup);
+
+	/* Validate */
+	start_p = start;
+	end_p = end;
+	nft_pipapo_for_each_field(f, i, m) {
+		if (f->rules >= NFT_PIPAPO_RULES_MAX - 2 * NFT_PIPAPO_MAX_BITS)
+			return -ENOSPC;
+
+		if (memcmp(start_p, end_p, f->len) > 0)
+			return -EINVAL;
+
+		start_p += pipapo_field_padded(f);
+		end_p += pipapo_field_padded(f);
+	}
+
+	/* Insert */
+	bsize_max = m->bsize_max;
+	nft_pipapo_for_each_field(f, i, m) {
+		rulemap[i].to = f->rules;
+
+		if (!memcmp(start, end, f->len))
+			ret = pipapo_insert(f, start, f->len * BITS_PER_BYTE);
+		else
+			ret = pipapo_expand(f, start, end);
+		if (ret < 0)
+			goto err;
+
+		rulemap[i].n = ret;
+		bsize_max = max(bsize_max, f->bsize);
+
+		start += pipapo_field_padded(f);
+		end += pipapo_field_padded(f);
+	}
+
+	if (bsize_max > m->bsize_max) {
+		ret = pipapo_realloc_scratch(m, bsize_max);
+		if (ret < 0)
+			goto err;
+
+		m->bsize_max = bsize_max;
+	}
+
+	pipapo_map(m, rulemap, e);
+	*ext2 = &e->ext;
+
+	return 0;
+
+err:
+	/* i is the field that failed, or past the last one */
+	for (i = min(i, m->field_count - 1); i >= 0; i--)
+		pipapo_truncate(&m->f[i], rulemap[i].to);
+
+	return ret;
+}
+
+/**
+ * pipapo_rulemap() - find rules derived from an element in each field
+ * @m:		matching data
+ * @e:		element
+ * @rulemap:	first rule and number of rules in each field, filled here
+ *
+ * Rules of the last field map directly to @e, rules of any other field map
+ * to the first rule of the element in the next field.
+ *
+ * Return: 0 on success, -ENOENT if @e is not found.
+ */
+static int pipapo_rulemap(const struct nft_pipapo_match *m,
+			  const struct nft_pipapo_elem *e,
+			  union nft_pipapo_map_bucket rulemap[])
+{
+	int i = m->field_count - 1;
+	const struct nft_pipapo_field *f = &m->f[i];
+	unsigned int r, to;
+
+	for (r = 0; r < f->rules && f->mt[r].e != e; r++)
+		;
+	if (r == f->rules)
+		return -ENOENT;
+
+	rulemap[i].to = r;
+	for (rulemap[i].n = 0; r < f->rules && f->mt[r].e == e; r++)
+		rulemap[i].n++;
+
+	for (i--, f--; i >= 0; i--, f--) {
+		to = rulemap[i + 1].to;
+
+		for (r = 0; r < f->rules && f->mt[r].to != to; r++)
+			;
+		if (r == f->rules)
+			return -ENOENT;
+
+		rulemap[i].to = r;
+		for (rulemap[i].n = 0; r < f->rules && f->mt[r].to == to; r++)
+			rulemap[i].n++;
+	}
+
+	return 0;
+}
+
+/**
+ * pipapo_drop() - delete rules of an element from all fields
+ * @m:		matching data
+ * @rulemap:	first rule and number of rules in each field
+ *
+ * Rules after the deleted ones are shifted down, and so are the mapping table
+ * entries referring to rules in the next field.
+ */
+static void pipapo_drop(struct nft_pipapo_match *m,
+			const union nft_pipapo_map_bucket rulemap[])
+{
+	struct nft_pipapo_field *f;
+	int i;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		unsigned int to = rulemap[i].to, n = rulemap[i].n;
+		unsigned int bucket, r;
+
+		for (bucket = 0; bucket < f->groups * NFT_PIPAPO_BUCKETS;
+		     bucket++) {
+			unsigned long *pos = f->lt + bucket * f->bsize;
+
+			bitmap_cut(pos, pos, to, n, f->rules);
+		}
+
+		memmove(f->mt + to, f->mt + to + n,
+			(f->rules - to - n) * sizeof(*f->mt));
+
+		if (i != m->field_count - 1) {
+			for (r = to; r < f->rules - n; r++)
+				f->mt[r].to -= rulemap[i + 1].n;
+		}
+
+		/* Shrinking can fail, oversized tables are still valid */
+		pipapo_resize(f, f->rules, f->rules - n);
+		f->rules -= n;
+	}
+}
+
+static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m = priv->clone;
+
+	/* Deactivation or insertion created the working copy already */
+	if (WARN_ON_ONCE(!m))
+		return;
+
+	if (pipapo_rulemap(m, elem->priv, rulemap))
+		return;
+
+	pipapo_drop(m, rulemap);
+}
+
+static void nft_pipapo_commit(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *old;
+
+	if (!priv->clone)
+		return;
+
+	old = nfnl_dereference(priv->match, NFNL_SUBSYS_NFTABLES);
+	rcu_assign_pointer(priv->match, priv->clone);
+	priv->clone = NULL;
+
+	call_rcu(&old->rcu, pipapo_reclaim_match);
+}
+
+static void nft_pipapo_activate(const struct net *net,
+				const struct nft_set *set,
+				const struct nft_set_elem *elem)
+{
+	struct nft_pipapo_elem *e = elem->priv;
+
+	nft_set_elem_change_active(net, set, &e->ext);
+	nft_set_elem_clear_busy(&e->ext);
+}
+
+static bool nft_pipapo_flush(const struct net *net, const struct nft_set *set,
+			     void *priv)
+{
+	struct nft_pipapo_elem *e = priv;
+
+	/* Removal at commit time needs a working copy */
+	if (IS_ERR(pipapo_maybe_clone(set)))
+		return false;
+
+	nft_set_elem_change_active(net, set, &e->ext);
+	return true;
+}
+
+static void *nft_pipapo_deactivate(const struct net *net,
+				   const struct nft_set *set,
+				   const struct nft_set_elem *elem)
+{
+	const struct nft_set_ext *ext = nft_set_elem_ext(set, elem->priv);
+	const u8 *key = (const u8 *)elem->key.val.data;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_elem *e;
+
+	m = pipapo_maybe_clone(set);
+	if (IS_ERR(m))
+		return NULL;
+
+	e = pipapo_get(m, key, nft_genmask_next(net));
+	if (IS_ERR(e))
+		return NULL;
+
+	/* Only exact matches of both ends can be deleted */
+	if (memcmp(nft_set_ext_key(&e->ext)->data, key, set->klen) ||
+	    memcmp(pipapo_elem_end(&e->ext), pipapo_elem_end(ext), set->klen))
+		return NULL;
+
+	nft_set_elem_change_active(net, set, &e->ext);
+	return e;
+}
+
+static void nft_pipapo_walk(const struct nft_ctx *ctx, struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_field *f;
+	struct nft_pipapo_match *m;
+	bool dump;
+	int r;
+
+	/* Walks over the next generation come from the control plane, under
+	 * the nfnetlink mutex, and need to see pending insertions. Dumps of
+	 * the current generation can run concurrently with updates and use
+	 * the published matching data instead.
+	 */
+	dump = iter->genmask != nft_genmask_next(ctx->net);
+	if (dump) {
+		rcu_read_lock();
+		m = rcu_dereference(priv->match);
+	} else {
+		m = priv->clone ? :
+		    nfnl_dereference(priv->match, NFNL_SUBSYS_NFTABLES);
+	}
+
+	f = &m->f[m->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		struct nft_pipapo_elem *e = f->mt[r].e;
+		struct nft_set_elem elem;
+
+		/* Rules of the same element are adjacent */
+		if (r < f->rules - 1 && f->mt[r + 1].e == e)
+			continue;
+
+		if (iter->count < iter->skip)
+			goto cont;
+		if (!nft_set_elem_active(&e->ext, iter->genmask))
+			goto cont;
+
+		elem.priv = e;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			break;
+cont:
+		iter->count++;
+	}
+
+	if (dump)
+		rcu_read_unlock();
+}
+
+static unsigned int nft_pipapo_privsize(const struct nlattr * const nla[],
+					const struct nft_set_desc *desc)
+{
+	return sizeof(struct nft_pipapo);
+}
+
+/* Worst case for a field n bits wide: a range expands to 2 * n prefixes, each
+ * one taking a bit in every bucket of every group, plus a mapping bucket.
+ */
+static u64 pipapo_estimate_size(const struct nft_set_desc *desc)
+{
+	u64 entry_size = 0, size;
+	int i;
+
+	for (i = 0; i < desc->field_count; i++) {
+		u64 rules = desc->field_len[i] * BITS_PER_BYTE * 2;
+
+		entry_size += rules * desc->field_len[i] *
+			      NFT_PIPAPO_GROUPS_PER_BYTE *
+			      NFT_PIPAPO_BUCKETS / BITS_PER_BYTE;
+		entry_size += rules * sizeof(union nft_pipapo_map_bucket);
+	}
+
+	size = sizeof(struct nft_pipapo) + sizeof(struct nft_pipapo_match) * 2 +
+	       sizeof(struct nft_pipapo_field) * desc->field_count;
+
+	return size + (u64)desc->size * entry_size;
+}
+
+static bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	u64 size;
+	int i;
+
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	for (i = 0; i < desc->field_count; i++) {
+		if (desc->field_len[i] > NFT_PIPAPO_MAX_BYTES)
+			return false;
+	}
+
+	size = pipapo_estimate_size(desc);
+	if (!desc->size || size > UINT_MAX)
+		est->size = ~0;
+	else
+		est->size = size;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+	est->space  = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+static int nft_pipapo_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	int i;
+
+	if (desc->field_count < NFT_PIPAPO_MIN_FIELDS ||
+	    desc->field_count > NFT_PIPAPO_MAX_FIELDS)
+		return -EINVAL;
+
+	m = pipapo_alloc_match(desc->field_count);
+	if (!m)
+		return -ENOMEM;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		f->len = desc->field_len[i];
+		f->groups = f->len * NFT_PIPAPO_GROUPS_PER_BYTE;
+	}
+
+	priv->clone = NULL;
+	rcu_assign_pointer(priv->match, m);
+
+	return 0;
+}
+
+static void nft_pipapo_destroy(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_field *f;
+	struct nft_pipapo_match *m;
+	int r;
+
+	m = rcu_dereference_protected(priv->match, true);
+
+	/* The working copy, if any, has the most recent view of elements */
+	f = priv->clone ? &priv->clone->f[priv->clone->field_count - 1] :
+			  &m->f[m->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		if (r < f->rules - 1 && f->mt[r + 1].e == f->mt[r].e)
+			continue;
+
+		nft_set_elem_destroy(set, f->mt[r].e, true);
+	}
+
+	if (priv->clone)
+		pipapo_free_match(priv->clone);
+
+	pipapo_free_match(m);
+}
+
+static struct nft_set_ops nft_pipapo_ops __read_mostly = {
+	.privsize	= nft_pipapo_privsize,
+	.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	.estimate	= nft_pipapo_estimate,
+	.init		= nft_pipapo_init,
+	.destroy	= nft_pipapo_destroy,
+	.insert		= nft_pipapo_insert,
+	.remove		= nft_pipapo_remove,
+	.commit		= nft_pipapo_commit,
+	.deactivate	= nft_pipapo_deactivate,
+	.flush		= nft_pipapo_flush,
+	.activate	= nft_pipapo_activate,
+	.lookup		= nft_pipapo_lookup,
+	.walk		= nft_pipapo_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_OBJECT,
+};
+
+static struct nft_set_type nft_pipapo_type __read_mostly = {
+	.ops		= &nft_pipapo_ops,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_pipapo_module_init(void)
+{
+	return nft_register_set(&nft_pipapo_type);
+}
+
+static void __exit nft_pipapo_module_exit(void)
+{
+	nft_unregister_set(&nft_pipapo_type);
+	/* Wait for matching data replaced by commits to be freed */
+	rcu_barrier();
+}
+
+module_init(nft_pipapo_module_init);
+module_exit(nft_pipapo_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
+MODULE_DESCRIPTION("nftables set type for ranges over concatenated fields");
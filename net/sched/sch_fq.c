@@ -22,6 +22,11 @@
  *  bunch of packets, and this packet scheduler adds delay between
  *  packets to respect rate limitation.
  *
+ *  Transport can instead stamp each packet with its Earliest Departure
+ *  Time in skb->tstamp (CLOCK_MONOTONIC). The flow is then held in the
+ *  delayed rb tree until that time, and no per packet rate computation
+ *  is needed : one qdisc watchdog covers all throttled flows.
+ *
  *  enqueue() :
  *   - lookup one RB tree (out of 1024 or more) to find the flow.
  *     If non existent flow, create it, add it to the tree.
@@ -111,6 +116,7 @@ struct fq_sched_data {
 	u64		stat_flows_plimit;
 	u64		stat_pkts_too_long;
 	u64		stat_allocation_errors;
+	u64		stat_horizon_caps;
 	struct qdisc_watchdog watchdog;
 };
 
@@ -457,6 +463,24 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 	}
 }
 
+/* Departure time requested by the transport in skb->tstamp.
+ * Anything more than one second away (the horizon) is not an EDT
+ * stamp (eg a receive timestamp), it is ignored and counted apart.
+ */
+static u64 fq_skb_departure(struct fq_sched_data *q,
+			    const struct sk_buff *skb, u64 now)
+{
+	u64 tstamp = ktime_to_ns(skb->tstamp);
+
+	if (likely(tstamp <= now))
+		return 0;
+	if (unlikely(tstamp - now > NSEC_PER_SEC)) {
+		q->stat_horizon_caps++;
+		return 0;
+	}
+	return tstamp;
+}
+
 static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
@@ -491,11 +515,16 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 	}
 
 	skb = f->head;
-	if (unlikely(skb && now < f->time_next_packet &&
-		     !skb_is_tcp_pure_ack(skb))) {
-		head->first = f->next;
-		fq_flow_set_throttled(q, f);
-		goto begin;
+	if (skb && !skb_is_tcp_pure_ack(skb)) {
+		u64 time_next_packet = fq_skb_departure(q, skb, now);
+
+		time_next_packet = max(time_next_packet, f->time_next_packet);
+		if (now < time_next_packet) {
+			head->first = f->next;
+			f->time_next_packet = time_next_packet;
+			fq_flow_set_throttled(q, f);
+			goto begin;
+		}
 	}
 
 	skb = fq_dequeue_head(sch, f);
@@ -521,7 +550,8 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 		goto out;
 
 	rate = q->flow_max_rate;
-	if (skb->sk)
+	/* A departure time means the sender already paced at its own rate */
+	if (skb->sk && !skb->tstamp)
 		rate = min(skb->sk->sk_pacing_rate, rate);
 
 	if (rate <= q->low_rate_threshold) {
@@ -876,6 +906,7 @@ static int fq_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 	st.flows_plimit		  = q->stat_flows_plimit;
 	st.pkts_too_long	  = q->stat_pkts_too_long;
 	st.allocation_errors	  = q->stat_allocation_errors;
+	st.horizon_caps		  = q->stat_horizon_caps;
 	st.time_next_delayed_flow = q->time_next_delayed_flow - ktime_get_ns();
 	st.flows		  = q->flows;
 	st.inactive_flows	  = q->inactive_flows;
@@ -522,6 +522,8 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 		.bc_xprt = args->bc_xprt,
 	};
 	char servername[48];
+	struct rpc_clnt *clnt;
+	int i;
 
 	if (args->bc_xprt) {
 		WARN_ON_ONCE(!(args->protocol & XPRT_TRANSPORT_BC));
@@ -584,7 +586,21 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt) || args->nconnect <= 1)
+		return clnt;
+
+	/*
+	 * Open the remaining connections to the same server. They join
+	 * the client's transport switch, which then spreads tasks over
+	 * all of them. Failing to add one is not fatal: the client
+	 * simply runs with fewer connections.
+	 */
+	for (i = 0; i < args->nconnect - 1; i++) {
+		if (rpc_clnt_add_xprt(clnt, &xprtargs, NULL, NULL) < 0)
+			break;
+	}
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -971,6 +987,7 @@ void rpc_task_release_transport(struct rpc_task *task)
 
 	if (xprt) {
 		task->tk_xprt = NULL;
+		atomic_long_dec(&xprt->queuelen);
 		xprt_put(xprt);
 	}
 }
@@ -995,8 +1012,14 @@ void rpc_task_release_client(struct rpc_task *task)
 static
 void rpc_task_set_transport(struct rpc_task *task, struct rpc_clnt *clnt)
 {
-	if (!task->tk_xprt)
-		task->tk_xprt = xprt_iter_get_next(&clnt->cl_xpi);
+	struct rpc_xprt *xprt;
+
+	if (task->tk_xprt)
+		return;
+	xprt = xprt_iter_get_next(&clnt->cl_xpi);
+	if (xprt)
+		atomic_long_inc(&xprt->queuelen);
+	task->tk_xprt = xprt;
 }
 
 static
@@ -2591,6 +2614,10 @@ int rpc_clnt_test_and_add_xprt(struct rpc_clnt *clnt,
 	struct rpc_cred *cred;
 	struct rpc_task *task;
 
+	/* an alias for an address we already have adds nothing */
+	if (rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
+		return 1;
+
 	data = kmalloc(sizeof(*data), GFP_NOFS);
 	if (!data)
 		return -ENOMEM;
@@ -938,6 +938,8 @@ static void rpc_init_task(struct rpc_task *task, const struct rpc_task_setup *ta
 	task->tk_workqueue = task_setup_data->workqueue;
 
 	task->tk_xprt = xprt_get(task_setup_data->rpc_xprt);
+	if (task->tk_xprt)
+		atomic_long_inc(&task->tk_xprt->queuelen);
 
 	if (task->tk_ops->rpc_call_prepare != NULL)
 		task->tk_action = rpc_prepare_task;
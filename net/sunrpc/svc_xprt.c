@@ -9,6 +9,7 @@
 #include <linux/freezer.h>
 #include <linux/kthread.h>
 #include <linux/slab.h>
+#include <linux/log2.h>
 #include <net/sock.h>
 #include <linux/sunrpc/addr.h>
 #include <linux/sunrpc/stats.h>
@@ -45,6 +46,9 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	svc_pool->sp_xprts is a lock-less list: transports are pushed
+ *	onto it without sp_lock and moved to sp_sockets, in arrival
+ *	order, by whichever thread next takes sp_lock to dequeue.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	The "service mutex" protects svc_serv->sv_nrthread.
@@ -400,6 +404,7 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
 
 	atomic_long_inc(&pool->sp_stats.packets);
+	xprt->xpt_qtime = ktime_get();
 
 redo_search:
 	/* find a thread for this xprt */
@@ -446,10 +451,8 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 	if (!queued) {
 		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
-		spin_lock_bh(&pool->sp_lock);
-		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-		pool->sp_stats.sockets_queued++;
-		spin_unlock_bh(&pool->sp_lock);
+		llist_add(&xprt->xpt_qnode, &pool->sp_xprts);
+		atomic_long_inc(&pool->sp_stats.sockets_queued);
 		goto redo_search;
 	}
 	rqstp = NULL;
@@ -472,6 +475,30 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+/*
+ * Move everything queued since the last dequeue onto sp_sockets. The
+ * lock-less list is LIFO, so reverse it to keep transports in the order
+ * they were enqueued. Called with sp_lock held.
+ */
+static void svc_pool_splice_xprts(struct svc_pool *pool)
+{
+	struct llist_node *first;
+	struct svc_xprt *xprt, *tmp;
+
+	first = llist_del_all(&pool->sp_xprts);
+	if (!first)
+		return;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(xprt, tmp, first, xpt_qnode)
+		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
+}
+
+static bool svc_pool_has_xprts(struct svc_pool *pool)
+{
+	return !list_empty(&pool->sp_sockets) || !llist_empty(&pool->sp_xprts);
+}
+
 /*
  * Dequeue the first transport, if there is one.
  */
@@ -479,10 +506,11 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_pool_has_xprts(pool))
 		goto out;
 
 	spin_lock_bh(&pool->sp_lock);
+	svc_pool_splice_xprts(pool);
 	if (likely(!list_empty(&pool->sp_sockets))) {
 		xprt = list_first_entry(&pool->sp_sockets,
 					struct svc_xprt, xpt_ready);
@@ -652,6 +680,54 @@ static void svc_check_conn_limits(struct svc_serv *serv)
 	}
 }
 
+/* Largest block svc_alloc_pages_bulk asks for before splitting it up */
+#define SVC_BULK_ALLOC_ORDER	3
+
+/*
+ * Fill the empty slots among the first @npages entries of @pages. When
+ * several pages are missing, take a higher order block in one call to
+ * the page allocator and split it, falling back to single pages when
+ * memory is fragmented. Returns the number of slots still empty.
+ */
+static unsigned int svc_alloc_pages_bulk(struct page **pages,
+					 unsigned int npages)
+{
+	unsigned int missing = 0;
+	unsigned int i, n;
+
+	for (i = 0; i < npages; i++)
+		if (!pages[i])
+			missing++;
+
+	i = 0;
+	while (missing) {
+		unsigned int order = min_t(unsigned int, ilog2(missing),
+					   SVC_BULK_ALLOC_ORDER);
+		struct page *p = NULL;
+
+		if (order)
+			p = alloc_pages(GFP_KERNEL | __GFP_NORETRY |
+					__GFP_NOWARN, order);
+		if (p) {
+			split_page(p, order);
+		} else {
+			order = 0;
+			p = alloc_page(GFP_KERNEL);
+			if (!p)
+				break;
+		}
+
+		for (n = 0; n < (1U << order); n++) {
+			while (pages[i])
+				i++;
+			pages[i] = p + n;
+		}
+		missing -= 1U << order;
+	}
+
+	return missing;
+}
+
 static int svc_alloc_arg(struct svc_rqst *rqstp)
 {
 	struct svc_serv *serv = rqstp->rq_server;
@@ -667,19 +743,15 @@ static int svc_alloc_arg(struct svc_rqst *rqstp)
 		/* use as many pages as possible */
 		pages = RPCSVC_MAXPAGES;
 	}
-	for (i = 0; i < pages ; i++)
-		while (rqstp->rq_pages[i] == NULL) {
-			struct page *p = alloc_page(GFP_KERNEL);
-			if (!p) {
-				set_current_state(TASK_INTERRUPTIBLE);
-				if (signalled() || kthread_should_stop()) {
-					set_current_state(TASK_RUNNING);
-					return -EINTR;
-				}
-				schedule_timeout(msecs_to_jiffies(500));
-			}
-			rqstp->rq_pages[i] = p;
+	while (svc_alloc_pages_bulk(rqstp->rq_pages, pages)) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (signalled() || kthread_should_stop()) {
+			set_current_state(TASK_RUNNING);
+			return -EINTR;
 		}
+		schedule_timeout(msecs_to_jiffies(500));
+	}
+	i = pages;
 	rqstp->rq_page_end = &rqstp->rq_pages[i];
 	rqstp->rq_pages[i++] = NULL; /* this might be seen in nfs_read_actor */
 
@@ -706,7 +778,7 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 		return false;
 
 	/* was a socket queued? */
-	if (!list_empty(&pool->sp_sockets))
+	if (svc_pool_has_xprts(pool))
 		return false;
 
 	/* are we shutting down? */
@@ -720,6 +792,18 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 	return true;
 }
 
+static void svc_pool_account_qtime(struct svc_pool *pool,
+				   struct svc_xprt *xprt)
+{
+	s64 us = ktime_us_delta(ktime_get(), xprt->xpt_qtime);
+	unsigned int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(unsigned int, fls64(us),
+			       SVC_POOL_QLAT_BUCKETS - 1);
+	atomic_long_inc(&pool->sp_stats.qlat[bucket]);
+}
+
 static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 {
 	struct svc_xprt *xprt;
@@ -744,6 +828,7 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 		 */
 		rqstp->rq_chandle.thread_wait = 1*HZ;
 		clear_bit(SP_TASK_PENDING, &pool->sp_flags);
+		svc_pool_account_qtime(pool, xprt);
 		return xprt;
 	}
 
@@ -767,8 +852,10 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	spin_unlock_bh(&rqstp->rq_lock);
 
 	xprt = rqstp->rq_xprt;
-	if (xprt != NULL)
+	if (xprt != NULL) {
+		svc_pool_account_qtime(pool, xprt);
 		return xprt;
+	}
 
 	if (!time_left)
 		atomic_long_inc(&pool->sp_stats.threads_timedout);
@@ -1120,6 +1207,7 @@ static struct svc_xprt *svc_dequeue_net(struct svc_serv *serv, struct net *net)
 		pool = &serv->sv_pools[i];
 
 		spin_lock_bh(&pool->sp_lock);
+		svc_pool_splice_xprts(pool);
 		list_for_each_entry_safe(xprt, tmp, &pool->sp_sockets, xpt_ready) {
 			if (xprt->xpt_net != net)
 				continue;
@@ -1433,18 +1521,27 @@ static void svc_pool_stats_stop(struct seq_file *m, void *p)
 static int svc_pool_stats_show(struct seq_file *m, void *p)
 {
 	struct svc_pool *pool = p;
+	int i;
 
 	if (p == SEQ_START_TOKEN) {
-		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout\n");
+		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout");
+		/* queueing latency buckets, named by their upper bound */
+		for (i = 0; i < SVC_POOL_QLAT_BUCKETS - 1; i++)
+			seq_printf(m, " qlat-%luus", 1UL << i);
+		seq_puts(m, " qlat-max\n");
 		return 0;
 	}
 
-	seq_printf(m, "%u %lu %lu %lu %lu\n",
+	seq_printf(m, "%u %lu %lu %lu %lu",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
-		pool->sp_stats.sockets_queued,
+		(unsigned long)atomic_long_read(&pool->sp_stats.sockets_queued),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
+	for (i = 0; i < SVC_POOL_QLAT_BUCKETS; i++)
+		seq_printf(m, " %lu",
+			   (unsigned long)atomic_long_read(&pool->sp_stats.qlat[i]));
+	seq_putc(m, '\n');
 
 	return 0;
 }
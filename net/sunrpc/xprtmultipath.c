@@ -43,7 +43,9 @@ static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
  * @xps: pointer to struct rpc_xprt_switch
  * @xprt: pointer to struct rpc_xprt
  *
- * Adds xprt to the end of the list of struct rpc_xprt in xps.
+ * Adds xprt to the end of the list of struct rpc_xprt in xps. Several
+ * transports may share an address (nconnect); callers that add aliases
+ * check rpc_xprt_switch_has_addr() first.
  */
 void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 		struct rpc_xprt *xprt)
@@ -51,8 +53,7 @@ void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 	if (xprt == NULL)
 		return;
 	spin_lock(&xps->xps_lock);
-	if ((xps->xps_net == xprt->xprt_net || xps->xps_net == NULL) &&
-	    !rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
+	if (xps->xps_net == xprt->xprt_net || xps->xps_net == NULL)
 		xprt_switch_add_xprt_locked(xps, xprt);
 	spin_unlock(&xps->xps_lock);
 }
@@ -314,11 +315,47 @@ struct rpc_xprt *xprt_switch_find_next_entry_roundrobin(struct list_head *head,
 	return xprt_switch_find_first_entry(head);
 }
 
+static
+unsigned long xprt_switch_avg_queuelen(struct rpc_xprt_switch *xps)
+{
+	unsigned long sum = 0, n = 0;
+	struct rpc_xprt *pos;
+
+	list_for_each_entry_rcu(pos, &xps->xps_xprt_list, xprt_switch) {
+		sum += atomic_long_read(&pos->queuelen);
+		n++;
+	}
+	return n ? DIV_ROUND_UP(sum, n) : 0;
+}
+
+/*
+ * Round robin, but pass over a transport that already has more tasks
+ * queued than the average, so that one slow connection does not keep
+ * receiving its share of new work. Gives up after one lap.
+ */
 static
 struct rpc_xprt *xprt_iter_next_entry_roundrobin(struct rpc_xprt_iter *xpi)
 {
-	return xprt_iter_next_entry_multiple(xpi,
+	struct rpc_xprt_switch *xps = rcu_dereference(xpi->xpi_xpswitch);
+	struct rpc_xprt *xprt;
+	unsigned long avg;
+	unsigned int tries;
+
+	xprt = xprt_iter_next_entry_multiple(xpi,
 			xprt_switch_find_next_entry_roundrobin);
+	if (xprt == NULL || xps == NULL || xps->xps_nxprts <= 1)
+		return xprt;
+
+	avg = xprt_switch_avg_queuelen(xps);
+	for (tries = 1; tries < xps->xps_nxprts; tries++) {
+		if (atomic_long_read(&xprt->queuelen) <= avg)
+			break;
+		xprt = xprt_iter_next_entry_multiple(xpi,
+				xprt_switch_find_next_entry_roundrobin);
+		if (xprt == NULL)
+			break;
+	}
+	return xprt;
 }
 
 static
@@ -486,6 +486,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
@@ -1828,6 +1829,44 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* MSG_ZEROCOPY sends below this size are copied: pinning the pages and
+ * queueing a completion costs more than copying a few pages.
+ */
+#define UNIX_ZEROCOPY_MIN	(4 * UNIX_SKB_FRAGS_SZ)
+
+extern int __zerocopy_sg_from_iter(struct sock *sk, struct sk_buff *skb,
+				   struct iov_iter *from, size_t length);
+
+/* Build an skb whose frags point at the sender's pages. The pages are
+ * charged to the sender's sk_wmem_alloc through skb->sk and stay pinned
+ * until the reader consumes the skb, which completes @uarg.
+ */
+static struct sk_buff *unix_stream_zerocopy_skb(struct sock *sk,
+						struct msghdr *msg, int size,
+						struct ubuf_info *uarg,
+						int *err)
+{
+	struct sk_buff *skb;
+
+	skb = sock_alloc_send_pskb(sk, 0, 0, msg->msg_flags & MSG_DONTWAIT,
+				   err, 0);
+	if (!skb)
+		return NULL;
+
+	*err = __zerocopy_sg_from_iter(NULL, skb, &msg->msg_iter, size);
+	if (*err == -EFAULT || !skb->len) {
+		kfree_skb(skb);
+		if (!*err)
+			*err = -EFAULT;
+		return NULL;
+	}
+	/* -EMSGSIZE only means the frags are full: send what fit */
+	*err = 0;
+
+	skb_zcopy_set(skb, uarg);
+	return skb;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
@@ -1837,6 +1876,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	struct sk_buff *skb;
 	int sent = 0;
 	struct scm_cookie scm;
+	struct ubuf_info *uarg = NULL;
 	bool fds_sent = false;
 	int data_len;
 
@@ -1862,12 +1902,42 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		err = -ENOBUFS;
+		uarg = sock_zerocopy_alloc(sk, len);
+		if (!uarg)
+			goto out_err;
+		/* still notify, but report the data as copied */
+		if (len < UNIX_ZEROCOPY_MIN)
+			uarg->zerocopy = 0;
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		/* Keep two messages in the pipe so it schedules better */
 		size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
 
+		if (uarg && uarg->zerocopy) {
+			/* worst case the first page is only partly used */
+			size = min_t(int, size,
+				     (MAX_SKB_FRAGS - 1) * PAGE_SIZE);
+			skb = unix_stream_zerocopy_skb(sk, msg, size, uarg,
+						       &err);
+			if (!skb)
+				goto out_err;
+			size = skb->len;
+
+			err = unix_scm_to_skb(&scm, skb, !fds_sent);
+			if (err < 0) {
+				kfree_skb(skb);
+				goto out_err;
+			}
+			fds_sent = true;
+			goto queue;
+		}
+
 		/* allow fallback to order-0 allocations */
 		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
@@ -1898,6 +1968,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			goto out_err;
 		}
 
+queue:
 		unix_state_lock(other);
 
 		if (sock_flag(other, SOCK_DEAD) ||
@@ -1911,6 +1982,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		sent += size;
 	}
 
+	sock_zerocopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -1923,6 +1995,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		sock_zerocopy_put(uarg);
+	else
+		sock_zerocopy_put_abort(uarg);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -1988,7 +2064,7 @@ static ssize_t unix_stream_sendpage(struct socket *socket, struct page *page,
 	skb = skb_peek_tail(&other->sk_receive_queue);
 	if (tail && tail == skb) {
 		skb = newskb;
-	} else if (!skb || !unix_skb_scm_eq(skb, &scm)) {
+	} else if (!skb || !unix_skb_scm_eq(skb, &scm) || skb_zcopy(skb)) {
 		if (newskb) {
 			skb = newskb;
 		} else {
@@ -2367,6 +2443,15 @@ static int unix_stream_read_generic(struct unix_stream_read_state *state,
 			sunaddr = NULL;
 		}
 
+		/* A pipe may hold on to the pages long after the skb is
+		 * consumed, so never hand it pages still owned by a sender.
+		 */
+		if (state->pipe && skb_orphan_frags_rx(skb, GFP_KERNEL)) {
+			if (copied == 0)
+				copied = -ENOMEM;
+			break;
+		}
+
 		chunk = min_t(unsigned int, unix_skb_len(skb) - skip, size);
 		skb_get(skb);
 		chunk = state->recv_actor(skb, skip, chunk, state);
@@ -2464,6 +2549,10 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.flags = flags
 	};
 
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sock->sk, msg, size, SOL_SOCKET,
+					  SO_ZEROCOPY);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -2648,7 +2737,7 @@ static unsigned int unix_poll(struct file *file, struct socket *sock, poll_table
 	mask = 0;
 
 	/* exceptional events? */
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty(&sk->sk_error_queue))
 		mask |= POLLERR;
 	if (sk->sk_shutdown == SHUTDOWN_MASK)
 		mask |= POLLHUP;
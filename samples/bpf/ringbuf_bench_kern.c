@@ -0,0 +1,110 @@
+/* Producer side of ringbuf_bench: every run of a program emits one
+ * fixed size record, through the BPF ring buffer or the perf buffer.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+#define KBUILD_MODNAME "foo"
+#include <uapi/linux/bpf.h>
+#include "bpf_helpers.h"
+
+#define MAX_CPUS 128
+
+/* Sizes are set by userspace before the maps are created */
+struct bpf_map_def SEC("maps") ringbuf = {
+	.type = BPF_MAP_TYPE_RINGBUF,
+	.max_entries = 1 << 20,
+};
+
+struct bpf_map_def SEC("maps") perfbuf = {
+	.type = BPF_MAP_TYPE_PERF_EVENT_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(u32),
+	.max_entries = MAX_CPUS,
+};
+
+/* Records that didn't fit, per cpu */
+struct bpf_map_def SEC("maps") dropped = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = 1,
+};
+
+/* 64 bytes, the consumer only counts records */
+struct sample {
+	u64 seq;
+	u64 ts;
+	u32 cpu;
+	u32 len;
+	u8 payload[40];
+};
+
+static __always_inline void count_drop(void)
+{
+	u32 key = 0;
+	u64 *cnt;
+
+	cnt = bpf_map_lookup_elem(&dropped, &key);
+	if (cnt)
+		*cnt += 1;
+}
+
+/* Build the record in place, no copy */
+SEC("xdp_ringbuf_reserve")
+int xdp_prognum0_reserve(struct xdp_md *ctx)
+{
+	struct sample *s;
+
+	s = bpf_ringbuf_reserve(&ringbuf, sizeof(*s), 0);
+	if (!s) {
+		count_drop();
+		return XDP_DROP;
+	}
+
+	s->seq = 0;
+	s->ts = bpf_ktime_get_ns();
+	s->cpu = bpf_get_smp_processor_id();
+	s->len = ctx->data_end - ctx->data;
+	bpf_ringbuf_submit(s, 0);
+
+	return XDP_DROP;
+}
+
+/* Build the record on the stack and copy it, like perf buffer users do */
+SEC("xdp_ringbuf_output")
+int xdp_prognum1_output(struct xdp_md *ctx)
+{
+	struct sample s = {};
+
+	s.ts = bpf_ktime_get_ns();
+	s.cpu = bpf_get_smp_processor_id();
+	s.len = ctx->data_end - ctx->data;
+	if (bpf_ringbuf_output(&ringbuf, &s, sizeof(s), 0))
+		count_drop();
+
+	return XDP_DROP;
+}
+
+SEC("xdp_perfbuf_output")
+int xdp_prognum2_perfbuf(struct xdp_md *ctx)
+{
+	struct sample s = {};
+
+	s.ts = bpf_ktime_get_ns();
+	s.cpu = bpf_get_smp_processor_id();
+	s.len = ctx->data_end - ctx->data;
+	if (bpf_perf_event_output(ctx, &perfbuf, BPF_F_CURRENT_CPU,
+				  &s, sizeof(s)))
+		count_drop();
+
+	return XDP_DROP;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,427 @@
+/* Compare the BPF ring buffer with the perf buffer for streaming events
+ * to userspace.
+ *
+ * Producer threads, one per cpu, run an XDP program with
+ * BPF_PROG_TEST_RUN in a loop; each run emits one record.  A single
+ * consumer thread drains the buffer(s) through mmap() and only sleeps in
+ * epoll_wait() when there is nothing left, like a real event collector.
+ *
+ *   ringbuf_bench -m reserve   bpf_ringbuf_reserve() + bpf_ringbuf_submit()
+ *   ringbuf_bench -m output    bpf_ringbuf_output()
+ *   ringbuf_bench -m perfbuf   bpf_perf_event_output(), one ring per cpu
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+#define _GNU_SOURCE
+#include <linux/bpf.h>
+#include <linux/perf_event.h>
+#include <linux/limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "bpf_load.h"
+#include "bpf_util.h"
+#include "libbpf.h"
+#include "perf-sys.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
+
+#define MAX_CPUS 128 /* as in ringbuf_bench_kern.c */
+
+/* map_fd[] order is the order of the maps in the object file */
+enum {
+	RINGBUF,
+	PERFBUF,
+	DROPPED,
+};
+
+enum {
+	MODE_RESERVE,
+	MODE_OUTPUT,
+	MODE_PERFBUF,
+};
+
+static const char * const mode_names[] = {
+	[MODE_RESERVE]	= "reserve",
+	[MODE_OUTPUT]	= "output",
+	[MODE_PERFBUF]	= "perfbuf",
+};
+
+static int mode = MODE_RESERVE;
+static unsigned long ring_size = 1 << 20;
+static int nr_producers = 1;
+static int batch = 64;
+static int wakeup_events = 1;
+static int duration = 5;
+static int nr_cpus;
+static int page_size;
+
+static volatile bool stop;
+static __u64 produced[MAX_CPUS];
+static __u64 consumed, lost, wakeups;
+
+struct ringbuf {
+	unsigned long *consumer_pos;
+	unsigned long *producer_pos;
+	void *data;
+	unsigned long mask;
+};
+
+static struct ringbuf rb;
+
+struct perfbuf_cpu {
+	int fd;
+	struct perf_event_mmap_page *header;
+	void *data;
+	__u64 mask;
+};
+
+static struct perfbuf_cpu pb[MAX_CPUS];
+
+static __u64 time_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void fixup_map(struct bpf_map_data *map, int idx)
+{
+	if (idx == RINGBUF)
+		map->def.max_entries = ring_size;
+	else if (idx == PERFBUF)
+		map->def.max_entries = nr_cpus;
+}
+
+static int ringbuf_setup(int epfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	void *tmp;
+
+	/* Consumer position, the only page we may write to */
+	tmp = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   map_fd[RINGBUF], 0);
+	if (tmp == MAP_FAILED)
+		return -errno;
+	rb.consumer_pos = tmp;
+
+	/* Producer position, then the data pages twice so that records
+	 * wrapping around the end are contiguous
+	 */
+	tmp = mmap(NULL, page_size + 2 * ring_size, PROT_READ, MAP_SHARED,
+		   map_fd[RINGBUF], page_size);
+	if (tmp == MAP_FAILED)
+		return -errno;
+	rb.producer_pos = tmp;
+	rb.data = tmp + page_size;
+	rb.mask = ring_size - 1;
+
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, map_fd[RINGBUF], &ev);
+}
+
+static int ringbuf_consume(void)
+{
+	unsigned long cons_pos, prod_pos;
+	int cnt = 0;
+	__u32 len;
+
+	cons_pos = __atomic_load_n(rb.consumer_pos, __ATOMIC_ACQUIRE);
+	prod_pos = __atomic_load_n(rb.producer_pos, __ATOMIC_ACQUIRE);
+	while (cons_pos < prod_pos) {
+		__u32 *hdr = rb.data + (cons_pos & rb.mask);
+
+		len = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+		if (len & BPF_RINGBUF_BUSY_BIT)
+			break;
+
+		if (!(len & BPF_RINGBUF_DISCARD_BIT))
+			cnt++;
+
+		len &= ~BPF_RINGBUF_DISCARD_BIT;
+		cons_pos += (len + BPF_RINGBUF_HDR_SZ + 7) & ~7;
+		/* Hand the space back as we go, producers may be waiting */
+		__atomic_store_n(rb.consumer_pos, cons_pos, __ATOMIC_RELEASE);
+	}
+
+	return cnt;
+}
+
+static int perfbuf_setup(int epfd)
+{
+	struct perf_event_attr attr = {
+		.sample_type = PERF_SAMPLE_RAW,
+		.type = PERF_TYPE_SOFTWARE,
+		.config = PERF_COUNT_SW_BPF_OUTPUT,
+		.wakeup_events = wakeup_events,
+	};
+	/* Same total memory as the ring buffer, split across cpus */
+	unsigned long size = ring_size / nr_cpus;
+	int i;
+
+	if (size < page_size)
+		size = page_size;
+	while (size & (size - 1))
+		size &= size - 1;
+
+	for (i = 0; i < nr_cpus; i++) {
+		struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+		void *base;
+
+		pb[i].fd = sys_perf_event_open(&attr, -1, i, -1, 0);
+		if (pb[i].fd < 0)
+			return -errno;
+
+		base = mmap(NULL, page_size + size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, pb[i].fd, 0);
+		if (base == MAP_FAILED)
+			return -errno;
+		pb[i].header = base;
+		pb[i].data = base + page_size;
+		pb[i].mask = size - 1;
+
+		if (bpf_map_update_elem(map_fd[PERFBUF], &i, &pb[i].fd, BPF_ANY))
+			return -errno;
+		if (ioctl(pb[i].fd, PERF_EVENT_IOC_ENABLE, 0))
+			return -errno;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, pb[i].fd, &ev))
+			return -errno;
+	}
+
+	return 0;
+}
+
+static int perfbuf_consume_cpu(struct perfbuf_cpu *p)
+{
+	__u64 data_head, data_tail;
+	int cnt = 0;
+
+	data_head = __atomic_load_n(&p->header->data_head, __ATOMIC_ACQUIRE);
+	data_tail = p->header->data_tail;
+
+	/* Headers are 8 byte aligned, they never wrap around the end */
+	while (data_tail != data_head) {
+		struct perf_event_header *e = p->data + (data_tail & p->mask);
+
+		if (e->type == PERF_RECORD_SAMPLE) {
+			cnt++;
+		} else if (e->type == PERF_RECORD_LOST) {
+			/* { header, id, lost }, may wrap between the fields */
+			lost += *(__u64 *)(p->data + ((data_tail + 16) & p->mask));
+		}
+		data_tail += e->size;
+	}
+
+	__atomic_store_n(&p->header->data_tail, data_tail, __ATOMIC_RELEASE);
+	return cnt;
+}
+
+static int perfbuf_consume(void)
+{
+	int i, cnt = 0;
+
+	for (i = 0; i < nr_cpus; i++)
+		cnt += perfbuf_consume_cpu(&pb[i]);
+	return cnt;
+}
+
+static void *consumer(void *arg)
+{
+	struct epoll_event events[MAX_CPUS];
+	int epfd = *(int *)arg;
+	int cnt;
+
+	while (!stop) {
+		cnt = mode == MODE_PERFBUF ? perfbuf_consume() : ringbuf_consume();
+		consumed += cnt;
+		if (cnt)
+			continue;
+
+		/* Caught up, wait for the kernel to tell us there is more */
+		if (epoll_wait(epfd, events, MAX_CPUS, 100) > 0)
+			wakeups++;
+	}
+
+	/* Whatever was produced before the producers stopped */
+	consumed += mode == MODE_PERFBUF ? perfbuf_consume() : ringbuf_consume();
+	return NULL;
+}
+
+static void *producer(void *arg)
+{
+	long cpu = (long)arg;
+	char pkt[64] = {};
+	__u32 retval, dur;
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+
+	while (!stop) {
+		if (bpf_prog_test_run(prog_fd[mode], batch, pkt, sizeof(pkt),
+				      NULL, NULL, &retval, &dur)) {
+			fprintf(stderr, "ERROR: test run: %s\n", strerror(errno));
+			stop = true;
+			break;
+		}
+		produced[cpu] += batch;
+	}
+
+	return NULL;
+}
+
+static __u64 read_dropped(void)
+{
+	__u64 values[nr_cpus], sum = 0;
+	__u32 key = 0;
+	int i;
+
+	if (bpf_map_lookup_elem(map_fd[DROPPED], &key, values))
+		return 0;
+	for (i = 0; i < nr_cpus; i++)
+		sum += values[i];
+	return sum;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [OPTS]\n"
+		"\nOPTS:\n"
+		"    -m <mode> reserve, output or perfbuf (default reserve)\n"
+		"    -p <n>    producer threads, one per cpu (default 1)\n"
+		"    -s <n>    buffer size in bytes, power of 2 (default 1M),\n"
+		"              split across cpus for perfbuf\n"
+		"    -b <n>    records per test run syscall (default 64)\n"
+		"    -w <n>    perfbuf wakeup_events (default 1)\n"
+		"    -d <n>    duration in seconds (default 5)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct rlimit r = {RLIM_INFINITY, RLIM_INFINITY};
+	pthread_t consumer_thread, producers[MAX_CPUS];
+	__u64 start, elapsed, total = 0, dropped;
+	char filename[PATH_MAX];
+	int opt, epfd, err, i;
+
+	nr_cpus = bpf_num_possible_cpus();
+	page_size = getpagesize();
+
+	while ((opt = getopt(argc, argv, "m:p:s:b:w:d:")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (i = 0; i < ARRAY_SIZE(mode_names); i++)
+				if (!strcmp(optarg, mode_names[i]))
+					break;
+			if (i == ARRAY_SIZE(mode_names)) {
+				usage(basename(argv[0]));
+				return 1;
+			}
+			mode = i;
+			break;
+		case 'p':
+			nr_producers = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			ring_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			wakeup_events = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(basename(argv[0]));
+			return 1;
+		}
+	}
+
+	if (nr_producers <= 0 || nr_producers > nr_cpus ||
+	    nr_cpus > MAX_CPUS || batch <= 0 || duration <= 0 ||
+	    ring_size < page_size || (ring_size & (ring_size - 1))) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	if (setrlimit(RLIMIT_MEMLOCK, &r)) {
+		perror("setrlimit(RLIMIT_MEMLOCK)");
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+
+	if (load_bpf_file_fixup_map(filename, fixup_map)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	if (!prog_fd[mode]) {
+		printf("load_bpf_file: %s\n", strerror(errno));
+		return 1;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	err = mode == MODE_PERFBUF ? perfbuf_setup(epfd) : ringbuf_setup(epfd);
+	if (err) {
+		fprintf(stderr, "ERROR: setting up %s: %s\n",
+			mode_names[mode], strerror(-err));
+		return 1;
+	}
+
+	pthread_create(&consumer_thread, NULL, consumer, &epfd);
+
+	start = time_get_ns();
+	for (i = 0; i < nr_producers; i++)
+		pthread_create(&producers[i], NULL, producer, (void *)(long)i);
+
+	sleep(duration);
+	stop = true;
+
+	for (i = 0; i < nr_producers; i++)
+		pthread_join(producers[i], NULL);
+	elapsed = time_get_ns() - start;
+	pthread_join(consumer_thread, NULL);
+
+	for (i = 0; i < nr_producers; i++)
+		total += produced[i];
+	dropped = read_dropped() + lost;
+
+	printf("%-8s producers %d: produced %7.3f M/s consumed %7.3f M/s "
+	       "dropped %llu wakeups %llu (%.1f records/wakeup)\n",
+	       mode_names[mode], nr_producers,
+	       total * 1000.0 / elapsed, consumed * 1000.0 / elapsed,
+	       dropped, wakeups, wakeups ? (double)consumed / wakeups : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Register a BPF_PROG_TYPE_TCP_CC program as a TCP congestion control
+ * algorithm, or unregister it.
+ *
+ * The algorithm stays registered once this program exits, sockets select
+ * it like any other one (sysctl net.ipv4.tcp_congestion_control,
+ * TCP_CONGESTION, "ip route ... congctl").
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include "libbpf.h"
+#include "bpf_load.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-e] [-n name] [prog_kern.o]\n"
+		"       %s -d [-n name]\n"
+		"  -n name  algorithm name (default bpf_cubic)\n"
+		"  -e       the algorithm needs ECN\n"
+		"  -d       unregister the algorithm\n"
+		"prog_kern.o defaults to tcp_cubic_kern.o\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = "tcp_cubic_kern.o";
+	const char *name = "bpf_cubic";
+	unsigned int flags = 0;
+	int detach = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "den:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			detach = 1;
+			break;
+		case 'e':
+			flags |= BPF_F_TCP_CC_NEEDS_ECN;
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		file = argv[optind];
+
+	if (detach) {
+		if (bpf_tcp_cc_detach(name)) {
+			fprintf(stderr, "ERROR: detaching %s: %s\n", name,
+				strerror(errno));
+			return 1;
+		}
+		return 0;
+	}
+
+	if (load_bpf_file((char *)file)) {
+		fprintf(stderr, "ERROR: loading %s\n%s", file, bpf_log_buf);
+		return 1;
+	}
+
+	if (bpf_tcp_cc_attach(prog_fd[0], name, flags)) {
+		fprintf(stderr, "ERROR: attaching %s as %s: %s\n", file, name,
+			strerror(errno));
+		return 1;
+	}
+
+	printf("%s registered from %s\n", name, file);
+	return 0;
+}
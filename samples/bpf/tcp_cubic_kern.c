@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* CUBIC congestion control (net/ipv4/tcp_cubic.c) as a BPF_PROG_TYPE_TCP_CC
+ * program, to be compared against the native module with test_tcp_cc.sh.
+ *
+ * Differences with tcp_cubic:
+ *  - no HyStart, run the module with hystart=0 for a like for like test,
+ *  - time is kept in usec (from now_us) instead of jiffies,
+ *  - the cube root is computed by Newton-Raphson instead of a lookup table,
+ *    since the program cannot index arrays on its stack.
+ *
+ * Use tcp_cc_user to attach it, then select it as "bpf_cubic".
+ */
+#include <uapi/linux/bpf.h>
+#include <linux/version.h>
+#include "bpf_helpers.h"
+
+#define TCP_CA_Loss		4
+#define CA_EVENT_TX_START	0
+
+#define USEC_PER_SEC		1000000ULL
+
+#define BICTCP_BETA_SCALE	1024	/* Scale factor beta calculation
+					 * max_cwnd = snd_cwnd * beta
+					 */
+#define BICTCP_HZ		10	/* BIC HZ 2^10 = 1024 */
+
+#define FAST_CONVERGENCE	1
+#define BETA			717	/* = 717/1024 (BICTCP_BETA_SCALE) */
+#define BIC_SCALE		41
+#define TCP_FRIENDLINESS	1
+
+#define CUBE_RTT_SCALE		(BIC_SCALE * 10)
+#define BETA_SCALE		(8 * (BICTCP_BETA_SCALE + BETA) / 3 / \
+				 (BICTCP_BETA_SCALE - BETA))
+/* 1/c * 2^2*bictcp_HZ * srtt, c = bic_scale >> 10 */
+#define CUBE_FACTOR		((1ULL << (10 + 3 * BICTCP_HZ)) / \
+				 (BIC_SCALE * 10))
+
+/* Per connection state, kept in ctx->priv[] */
+enum {
+	BIC_CNT,		/* increase cwnd by 1 after ACKs */
+	BIC_LAST_MAX_CWND,	/* last maximum snd_cwnd */
+	BIC_LAST_CWND,		/* the last snd_cwnd */
+	BIC_LAST_TIME,		/* time when updated last_cwnd */
+	BIC_ORIGIN_POINT,	/* origin point of bic function */
+	BIC_K,			/* time to origin point from the beginning
+				 * of the current epoch
+				 */
+	BIC_DELAY_MIN,		/* min delay (usec) */
+	BIC_EPOCH_START,	/* beginning of an epoch */
+	BIC_ACK_CNT,		/* number of acks */
+	BIC_TCP_CWND,		/* estimated tcp cwnd */
+	__BIC_MAX,
+};
+
+#define CA(field)		(ctx->priv[BIC_##field])
+
+static __always_inline void bictcp_reset(struct bpf_tcp_cc *ctx)
+{
+	int i;
+
+#pragma unroll
+	for (i = 0; i < __BIC_MAX; i++)
+		ctx->priv[i] = 0;
+}
+
+static __always_inline __u32 fls64(__u64 x)
+{
+	__u32 num = 64;
+
+	if (!x)
+		return 0;
+	if (!(x & (~0ULL << 32))) {
+		num -= 32;
+		x <<= 32;
+	}
+	if (!(x & (~0ULL << 48))) {
+		num -= 16;
+		x <<= 16;
+	}
+	if (!(x & (~0ULL << 56))) {
+		num -= 8;
+		x <<= 8;
+	}
+	if (!(x & (~0ULL << 60))) {
+		num -= 4;
+		x <<= 4;
+	}
+	if (!(x & (~0ULL << 62))) {
+		num -= 2;
+		x <<= 2;
+	}
+	if (!(x & (~0ULL << 63)))
+		num -= 1;
+	return num;
+}
+
+/* Newton-Raphson step towards the cube root of a, from above */
+#define CBRT_STEP(x, a)	((2 * (x) + (__u32)((a) / ((__u64)(x) * (x)))) / 3)
+
+/* calculate the cubic root of a, starting from 2^ceil(fls64(a) / 3)
+ * which is within a factor of 2 above the root
+ */
+static __always_inline __u32 cubic_root(__u64 a)
+{
+	__u32 x;
+
+	if (!a)
+		return 0;
+
+	x = 1U << ((fls64(a) + 2) / 3);
+	x = CBRT_STEP(x, a);
+	x = CBRT_STEP(x, a);
+	x = CBRT_STEP(x, a);
+	x = CBRT_STEP(x, a);
+	x = CBRT_STEP(x, a);
+	return x;
+}
+
+/* Compute congestion window to use. */
+static __always_inline void bictcp_update(struct bpf_tcp_cc *ctx, __u32 cwnd,
+					  __u32 acked)
+{
+	__u32 now = (__u32)ctx->now_us;
+	__u32 delta, bic_target, max_cnt;
+	__u64 offs, t;
+
+	CA(ACK_CNT) += acked;	/* count the number of ACKed packets */
+
+	if (CA(LAST_CWND) == cwnd &&
+	    (__s32)(now - CA(LAST_TIME)) <= USEC_PER_SEC / 32)
+		return;
+
+	/* The CUBIC function can update ca->cnt at most once per usec.
+	 * On all cwnd reduction events, ca->epoch_start is set to 0,
+	 * which will force a recalculation of ca->cnt.
+	 */
+	if (CA(EPOCH_START) && now == CA(LAST_TIME))
+		goto tcp_friendliness;
+
+	CA(LAST_CWND) = cwnd;
+	CA(LAST_TIME) = now;
+
+	if (CA(EPOCH_START) == 0) {
+		CA(EPOCH_START) = now | 1;	/* record beginning, never 0 */
+		CA(ACK_CNT) = acked;		/* start counting */
+		CA(TCP_CWND) = cwnd;		/* syn with cubic */
+
+		if (CA(LAST_MAX_CWND) <= cwnd) {
+			CA(K) = 0;
+			CA(ORIGIN_POINT) = cwnd;
+		} else {
+			/* Compute new K based on
+			 * (wmax-cwnd) * (srtt>>3 / HZ) / c * 2^(3*bictcp_HZ)
+			 */
+			CA(K) = cubic_root(CUBE_FACTOR *
+					   (CA(LAST_MAX_CWND) - cwnd));
+			CA(ORIGIN_POINT) = CA(LAST_MAX_CWND);
+		}
+	}
+
+	/* cubic function - calc*/
+	/* calculate c * time^3 / rtt, time^3 being done in 64 bit
+	 *  NOTE the unit of those variables
+	 *	  time  = (t - K) / 2^bictcp_HZ
+	 *	  c = bic_scale >> 10
+	 * !!! The following code does not have overflow problems,
+	 * if the cwnd < 1 million packets !!!
+	 */
+
+	t = (__s32)(now - CA(EPOCH_START));
+	t += CA(DELAY_MIN);
+	/* change the unit from usec to bictcp_HZ */
+	t = (t << BICTCP_HZ) / USEC_PER_SEC;
+
+	if (t < CA(K))		/* t - K */
+		offs = CA(K) - t;
+	else
+		offs = t - CA(K);
+
+	/* c/rtt * (t-K)^3 */
+	delta = (CUBE_RTT_SCALE * offs * offs * offs) >> (10 + 3 * BICTCP_HZ);
+	if (t < CA(K))		/* below origin*/
+		bic_target = CA(ORIGIN_POINT) - delta;
+	else			/* above origin*/
+		bic_target = CA(ORIGIN_POINT) + delta;
+
+	/* cubic function - calc bictcp_cnt*/
+	if (bic_target > cwnd)
+		CA(CNT) = cwnd / (bic_target - cwnd);
+	else
+		CA(CNT) = 100 * cwnd;	/* very small increment*/
+
+	/*
+	 * The initial growth of cubic function may be too conservative
+	 * when the available bandwidth is still unknown.
+	 */
+	if (CA(LAST_MAX_CWND) == 0 && CA(CNT) > 20)
+		CA(CNT) = 20;	/* increase cwnd 5% per RTT */
+
+tcp_friendliness:
+	/* TCP Friendly */
+	if (TCP_FRIENDLINESS) {
+		delta = (cwnd * BETA_SCALE) >> 3;
+		/* delta >= 1 for cwnd >= 1, this is the ack_cnt loop of
+		 * tcp_cubic done in one step
+		 */
+		if (CA(ACK_CNT) > delta) {
+			__u32 n = (CA(ACK_CNT) - 1) / delta;
+
+			CA(ACK_CNT) -= n * delta;
+			CA(TCP_CWND) += n;
+		}
+
+		if (CA(TCP_CWND) > cwnd) {	/* if bic is slower than tcp */
+			delta = CA(TCP_CWND) - cwnd;
+			max_cnt = cwnd / delta;
+			if (CA(CNT) > max_cnt)
+				CA(CNT) = max_cnt;
+		}
+	}
+
+	/* The maximum rate of cwnd increase CUBIC allows is 1 packet per
+	 * 2 packets ACKed, meaning cwnd grows at 1.5x per RTT.
+	 */
+	if (CA(CNT) < 2)
+		CA(CNT) = 2;
+}
+
+/* tcp_slow_start() */
+static __always_inline __u32 tcp_slow_start(struct bpf_tcp_cc *ctx,
+					    __u32 acked)
+{
+	__u32 cwnd = ctx->snd_cwnd + acked;
+
+	if (cwnd > ctx->snd_ssthresh)
+		cwnd = ctx->snd_ssthresh;
+	acked -= cwnd - ctx->snd_cwnd;
+	ctx->snd_cwnd = cwnd < ctx->snd_cwnd_clamp ? cwnd : ctx->snd_cwnd_clamp;
+
+	return acked;
+}
+
+/* tcp_cong_avoid_ai(), w is at least 2 */
+static __always_inline void tcp_cong_avoid_ai(struct bpf_tcp_cc *ctx, __u32 w,
+					      __u32 acked)
+{
+	/* If credits accumulated at a higher w, apply them gently now. */
+	if (ctx->snd_cwnd_cnt >= w) {
+		ctx->snd_cwnd_cnt = 0;
+		ctx->snd_cwnd++;
+	}
+
+	ctx->snd_cwnd_cnt += acked;
+	if (ctx->snd_cwnd_cnt >= w) {
+		__u32 delta = ctx->snd_cwnd_cnt / w;
+
+		ctx->snd_cwnd_cnt -= delta * w;
+		ctx->snd_cwnd += delta;
+	}
+	if (ctx->snd_cwnd > ctx->snd_cwnd_clamp)
+		ctx->snd_cwnd = ctx->snd_cwnd_clamp;
+}
+
+static __always_inline void bictcp_cong_avoid(struct bpf_tcp_cc *ctx,
+					      __u32 acked)
+{
+	if (!ctx->is_cwnd_limited)
+		return;
+
+	if (ctx->snd_cwnd < ctx->snd_ssthresh) {
+		acked = tcp_slow_start(ctx, acked);
+		if (!acked)
+			return;
+	}
+	bictcp_update(ctx, ctx->snd_cwnd, acked);
+	tcp_cong_avoid_ai(ctx, CA(CNT), acked);
+}
+
+static __always_inline __u32 bictcp_recalc_ssthresh(struct bpf_tcp_cc *ctx)
+{
+	__u32 ssthresh;
+
+	CA(EPOCH_START) = 0;	/* end of epoch */
+
+	/* Wmax and fast convergence */
+	if (ctx->snd_cwnd < CA(LAST_MAX_CWND) && FAST_CONVERGENCE)
+		CA(LAST_MAX_CWND) = (ctx->snd_cwnd *
+				     (BICTCP_BETA_SCALE + BETA)) /
+				    (2 * BICTCP_BETA_SCALE);
+	else
+		CA(LAST_MAX_CWND) = ctx->snd_cwnd;
+
+	ssthresh = (ctx->snd_cwnd * BETA) / BICTCP_BETA_SCALE;
+	return ssthresh > 2 ? ssthresh : 2;
+}
+
+static __always_inline void bictcp_cwnd_event(struct bpf_tcp_cc *ctx,
+					      __u32 event)
+{
+	if (event == CA_EVENT_TX_START) {
+		__u32 now = (__u32)ctx->now_us;
+
+		/* We were application limited (idle) for a while.
+		 * Shift epoch_start to keep cwnd growth to cubic curve.
+		 */
+		if (CA(EPOCH_START) && ctx->idle_us) {
+			CA(EPOCH_START) += ctx->idle_us;
+			if ((__s32)(CA(EPOCH_START) - now) > 0)
+				CA(EPOCH_START) = now | 1;
+		}
+	}
+}
+
+/* Keep the minimum RTT seen outside of recovery */
+static __always_inline void bictcp_acked(struct bpf_tcp_cc *ctx, __s32 rtt_us)
+{
+	__u32 delay;
+
+	/* Some calls are for duplicates without timetamps */
+	if (rtt_us < 0)
+		return;
+
+	/* Discard delay samples right after fast recovery */
+	if (CA(EPOCH_START) &&
+	    (__s32)((__u32)ctx->now_us - CA(EPOCH_START)) < USEC_PER_SEC)
+		return;
+
+	delay = rtt_us;
+	if (delay == 0)
+		delay = 1;
+
+	/* first time call or link delay decreases */
+	if (CA(DELAY_MIN) == 0 || CA(DELAY_MIN) > delay)
+		CA(DELAY_MIN) = delay;
+}
+
+SEC("tcp_cc")
+int bpf_cubic(struct bpf_tcp_cc *ctx)
+{
+	switch (ctx->op) {
+	case BPF_TCP_CC_INIT:
+		bictcp_reset(ctx);
+		break;
+	case BPF_TCP_CC_SSTHRESH:
+		return bictcp_recalc_ssthresh(ctx);
+	case BPF_TCP_CC_CONG_AVOID:
+		bictcp_cong_avoid(ctx, ctx->args[1]);
+		break;
+	case BPF_TCP_CC_SET_STATE:
+		if (ctx->args[0] == TCP_CA_Loss)
+			bictcp_reset(ctx);
+		break;
+	case BPF_TCP_CC_CWND_EVENT:
+		bictcp_cwnd_event(ctx, ctx->args[0]);
+		break;
+	case BPF_TCP_CC_PKTS_ACKED:
+		bictcp_acked(ctx, ctx->args[1]);
+		break;
+	}
+
+	/* Reno undo_cwnd */
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+__u32 _version SEC("version") = LINUX_VERSION_CODE;
@@ -0,0 +1,73 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Throughput of the BPF CUBIC of tcp_cubic_kern.c against the native
+# tcp_cubic module, with iperf3 over a veth pair shaped by netem.
+#
+# usage: test_tcp_cc.sh [delay] [rate] [loss] [seconds] [runs]
+
+DELAY=${1:-20ms}
+RATE=${2:-200mbit}
+LOSS=${3:-0.05%}
+TIME=${4:-20}
+RUNS=${5:-3}
+
+NS1=tcc_ns1
+NS2=tcc_ns2
+VETH1=tcc_veth1
+VETH2=tcc_veth2
+IP1=192.168.254.1
+IP2=192.168.254.2
+
+HYSTART=/sys/module/tcp_cubic/parameters/hystart
+OLD_HYSTART=
+
+function cleanup {
+	ip netns exec $NS2 killall iperf3 2> /dev/null
+	ip netns delete $NS1 2> /dev/null
+	ip netns delete $NS2 2> /dev/null
+	./tcp_cc_user -d -n bpf_cubic 2> /dev/null
+	if [ -n "$OLD_HYSTART" ]; then
+		echo $OLD_HYSTART > $HYSTART
+	fi
+}
+
+function run {
+	local cc=$1
+	local i
+
+	for i in $(seq $RUNS); do
+		printf "%-10s run %d: " $cc $i
+		ip netns exec $NS1 iperf3 -c $IP2 -t $TIME -C $cc -f m | \
+			awk '/sender/ { print $7, $8, "retr", $9 }'
+	done
+}
+
+trap cleanup EXIT
+cleanup
+
+modprobe tcp_cubic 2> /dev/null
+if [ -w $HYSTART ]; then
+	# the BPF version has no HyStart
+	OLD_HYSTART=$(cat $HYSTART)
+	echo 0 > $HYSTART
+fi
+
+./tcp_cc_user -n bpf_cubic tcp_cubic_kern.o || exit 1
+
+ip netns add $NS1
+ip netns add $NS2
+ip link add $VETH1 netns $NS1 type veth peer name $VETH2 netns $NS2
+ip netns exec $NS1 ip addr add $IP1/24 dev $VETH1
+ip netns exec $NS2 ip addr add $IP2/24 dev $VETH2
+ip netns exec $NS1 ip link set dev $VETH1 up
+ip netns exec $NS2 ip link set dev $VETH2 up
+ip netns exec $NS1 tc qdisc add dev $VETH1 root netem \
+	delay $DELAY rate $RATE loss $LOSS limit 10000
+ip netns exec $NS2 iperf3 -s -D
+
+echo "netem: delay $DELAY rate $RATE loss $LOSS, $TIME s per run"
+run cubic
+run bpf_cubic
+
+exit 0
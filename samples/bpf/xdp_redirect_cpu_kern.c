@@ -0,0 +1,166 @@
+/* Spread packets over a set of CPUs with a cpumap, doing RSS in software:
+ * the remote CPUs build the skbs and run the network stack.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+#define KBUILD_MODNAME "foo"
+#include <uapi/linux/bpf.h>
+#include <linux/in.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_vlan.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include "bpf_helpers.h"
+
+#define MAX_CPUS 64
+
+/* Destination CPUs, the value is the queue size towards each of them */
+struct bpf_map_def SEC("maps") cpu_map = {
+	.type = BPF_MAP_TYPE_CPUMAP,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = MAX_CPUS,
+};
+
+/* CPUs to spread over, filled by userspace, cpus_count of them */
+struct bpf_map_def SEC("maps") cpus_available = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = MAX_CPUS,
+};
+
+struct bpf_map_def SEC("maps") cpus_count = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = 1,
+};
+
+/* Packets seen and redirected per CPU, drops on the remote CPUs are
+ * reported by the xdp:xdp_cpumap_* tracepoints.
+ */
+struct datarec {
+	u64 processed;
+	u64 dropped;
+};
+
+struct bpf_map_def SEC("maps") rx_cnt = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(struct datarec),
+	.max_entries = 1,
+};
+
+static __always_inline u32 hash_words(u32 a, u32 b)
+{
+	u32 h = a ^ (b * 0x9e3779b9);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+/* Flows must stay on one CPU, hash on the addresses only so that
+ * fragments follow the rest of their datagram.
+ */
+static __always_inline u32 flow_hash(void *data, void *data_end)
+{
+	struct ethhdr *eth = data;
+	u64 nh_off = sizeof(*eth);
+	u16 h_proto;
+
+	if (data + nh_off > data_end)
+		return 0;
+
+	h_proto = eth->h_proto;
+	if (h_proto == htons(ETH_P_8021Q) || h_proto == htons(ETH_P_8021AD)) {
+		struct vlan_hdr *vhdr = data + nh_off;
+
+		nh_off += sizeof(*vhdr);
+		if (data + nh_off > data_end)
+			return 0;
+		h_proto = vhdr->h_vlan_encapsulated_proto;
+	}
+
+	if (h_proto == htons(ETH_P_IP)) {
+		struct iphdr *iph = data + nh_off;
+
+		if ((void *)(iph + 1) > data_end)
+			return 0;
+		return hash_words(iph->saddr, iph->daddr);
+	} else if (h_proto == htons(ETH_P_IPV6)) {
+		struct ipv6hdr *ip6h = data + nh_off;
+
+		if ((void *)(ip6h + 1) > data_end)
+			return 0;
+		return hash_words(ip6h->saddr.s6_addr32[0] ^
+				  ip6h->saddr.s6_addr32[3],
+				  ip6h->daddr.s6_addr32[0] ^
+				  ip6h->daddr.s6_addr32[3]);
+	}
+
+	return 0;
+}
+
+SEC("xdp_cpu_map_hash")
+int xdp_prognum0_hash(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct datarec *rec;
+	u32 key = 0, idx;
+	u32 *count;
+	u32 *cpu;
+
+	rec = bpf_map_lookup_elem(&rx_cnt, &key);
+	if (!rec)
+		return XDP_ABORTED;
+	rec->processed++;
+
+	count = bpf_map_lookup_elem(&cpus_count, &key);
+	if (!count || !*count)
+		return XDP_PASS;
+
+	idx = flow_hash(data, data_end) % *count;
+	cpu = bpf_map_lookup_elem(&cpus_available, &idx);
+	if (!cpu) {
+		rec->dropped++;
+		return XDP_ABORTED;
+	}
+
+	return bpf_redirect_map(&cpu_map, *cpu, 0);
+}
+
+/* Everything to the first CPU, to measure a single remote CPU */
+SEC("xdp_cpu_map_single")
+int xdp_prognum1_single(struct xdp_md *ctx)
+{
+	struct datarec *rec;
+	u32 key = 0;
+	u32 *cpu;
+
+	rec = bpf_map_lookup_elem(&rx_cnt, &key);
+	if (!rec)
+		return XDP_ABORTED;
+	rec->processed++;
+
+	cpu = bpf_map_lookup_elem(&cpus_available, &key);
+	if (!cpu) {
+		rec->dropped++;
+		return XDP_ABORTED;
+	}
+
+	return bpf_redirect_map(&cpu_map, *cpu, 0);
+}
+
+char _license[] SEC("license") = "GPL";
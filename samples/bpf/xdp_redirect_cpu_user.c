@@ -0,0 +1,190 @@
+/* Attach xdp_redirect_cpu_kern.o to a device, and spread the packets
+ * received on it over a set of CPUs through a cpumap.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/limits.h>
+#include <net/if.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "bpf_load.h"
+#include "bpf_util.h"
+#include "libbpf.h"
+
+#define MAX_CPUS 64 /* as in xdp_redirect_cpu_kern.c */
+
+static int ifindex = -1;
+static __u32 xdp_flags;
+
+/* map_fd[] order is the order of the maps in the object file */
+enum {
+	CPU_MAP,
+	CPUS_AVAILABLE,
+	CPUS_COUNT,
+	RX_CNT,
+};
+
+struct datarec {
+	__u64 processed;
+	__u64 dropped;
+};
+
+static void int_exit(int sig)
+{
+	if (ifindex > -1)
+		set_link_xdp_fd(ifindex, -1, xdp_flags);
+	exit(0);
+}
+
+static void poll_stats(int interval)
+{
+	unsigned int nr_cpus = bpf_num_possible_cpus();
+	struct datarec values[nr_cpus], prev[nr_cpus];
+
+	memset(prev, 0, sizeof(prev));
+
+	while (1) {
+		__u64 pkts = 0, drops = 0;
+		__u32 key = 0;
+		int i;
+
+		sleep(interval);
+		if (bpf_map_lookup_elem(map_fd[RX_CNT], &key, values))
+			continue;
+		for (i = 0; i < nr_cpus; i++) {
+			pkts += values[i].processed - prev[i].processed;
+			drops += values[i].dropped - prev[i].dropped;
+		}
+		printf("XDP-RX %10llu pkt/s %10llu drop/s\n",
+		       pkts / interval, drops / interval);
+		memcpy(prev, values, sizeof(values));
+	}
+}
+
+static int add_cpu(__u32 cpu, __u32 qsize, __u32 avail_idx)
+{
+	__u32 count = avail_idx + 1, key = 0;
+
+	/* Starts the kthread on the remote CPU */
+	if (bpf_map_update_elem(map_fd[CPU_MAP], &cpu, &qsize, 0)) {
+		fprintf(stderr, "ERROR: adding CPU %u to cpumap: %s\n",
+			cpu, strerror(errno));
+		return -1;
+	}
+	if (bpf_map_update_elem(map_fd[CPUS_AVAILABLE], &avail_idx, &cpu, 0) ||
+	    bpf_map_update_elem(map_fd[CPUS_COUNT], &key, &count, 0)) {
+		fprintf(stderr, "ERROR: updating available CPUs: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [OPTS] -d <ifname|ifindex> -c <cpu> [-c <cpu> ...]\n"
+		"\nOPTS:\n"
+		"    -q <n>  queue size per CPU (default 192)\n"
+		"    -s <n>  stats interval in seconds (default 2)\n"
+		"    -1      redirect everything to the first CPU\n"
+		"    -S      use skb-mode (generic XDP)\n"
+		"    -N      enforce native mode\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	__u32 cpus[MAX_CPUS], ncpus = 0, qsize = 192;
+	char filename[PATH_MAX];
+	int interval = 2;
+	int prog_id = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "d:c:q:s:1SN")) != -1) {
+		switch (opt) {
+		case 'd':
+			ifindex = if_nametoindex(optarg);
+			if (!ifindex)
+				ifindex = strtoul(optarg, NULL, 0);
+			if (!ifindex) {
+				fprintf(stderr, "Invalid device %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'c':
+			if (ncpus == MAX_CPUS) {
+				fprintf(stderr, "At most %d CPUs\n", MAX_CPUS);
+				return 1;
+			}
+			cpus[ncpus++] = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			qsize = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case '1':
+			prog_id = 1;
+			break;
+		case 'S':
+			xdp_flags |= XDP_FLAGS_SKB_MODE;
+			break;
+		case 'N':
+			xdp_flags |= XDP_FLAGS_DRV_MODE;
+			break;
+		default:
+			usage(basename(argv[0]));
+			return 1;
+		}
+	}
+
+	if (ifindex < 0 || !ncpus || interval <= 0) {
+		usage(basename(argv[0]));
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+
+	if (load_bpf_file(filename)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	if (!prog_fd[prog_id]) {
+		printf("load_bpf_file: %s\n", strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < ncpus; i++)
+		if (add_cpu(cpus[i], qsize, i))
+			return 1;
+
+	signal(SIGINT, int_exit);
+	signal(SIGTERM, int_exit);
+
+	if (set_link_xdp_fd(ifindex, prog_fd[prog_id], xdp_flags) < 0) {
+		printf("ERROR: link set xdp fd failed on %d\n", ifindex);
+		return 1;
+	}
+
+	poll_stats(interval);
+	return 0;
+}
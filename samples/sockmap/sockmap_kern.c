@@ -27,6 +27,10 @@
  *
  * The bpf_printk is verbose and prints information as connections
  * are established and verdicts are decided.
+ *
+ * The sk_msg programs give a verdict on what the sockets in
+ * sock_map_txmsg send. User space fills the map and the sock_* arrays
+ * below to pick the apply/cork sizes and the redirect target.
  */
 
 #define bpf_printk(fmt, ...)					\
@@ -43,6 +47,35 @@ struct bpf_map_def SEC("maps") sock_map = {
 	.max_entries = 20,
 };
 
+struct bpf_map_def SEC("maps") sock_map_txmsg = {
+	.type = BPF_MAP_TYPE_SOCKMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 20,
+};
+
+struct bpf_map_def SEC("maps") sock_apply_bytes = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 1,
+};
+
+struct bpf_map_def SEC("maps") sock_cork_bytes = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 1,
+};
+
+/* [0] redirect flags, [1] sock_map_txmsg key of the redirect target */
+struct bpf_map_def SEC("maps") sock_redir_flags = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 2,
+};
+
 SEC("sk_skb1")
 int bpf_prog1(struct __sk_buff *skb)
 {
@@ -105,4 +138,44 @@ int bpf_sockmap(struct bpf_sock_ops *skops)
 
 	return 0;
 }
+
+static inline void bpf_msg_policy(struct sk_msg_md *msg)
+{
+	int *bytes, zero = 0;
+
+	bytes = bpf_map_lookup_elem(&sock_apply_bytes, &zero);
+	if (bytes && *bytes)
+		bpf_msg_apply_bytes(msg, *bytes);
+	bytes = bpf_map_lookup_elem(&sock_cork_bytes, &zero);
+	if (bytes && *bytes)
+		bpf_msg_cork_bytes(msg, *bytes);
+}
+
+SEC("sk_msg1")
+int bpf_prog_msg_pass(struct sk_msg_md *msg)
+{
+	bpf_msg_policy(msg);
+	return SK_PASS;
+}
+
+SEC("sk_msg2")
+int bpf_prog_msg_redir(struct sk_msg_md *msg)
+{
+	int *flags, *key, zero = 0, one = 1;
+
+	bpf_msg_policy(msg);
+	flags = bpf_map_lookup_elem(&sock_redir_flags, &zero);
+	key = bpf_map_lookup_elem(&sock_redir_flags, &one);
+	if (!flags || !key)
+		return SK_DROP;
+	return bpf_msg_redirect_map(msg, &sock_map_txmsg, *key, *flags);
+}
+
+SEC("sk_msg3")
+int bpf_prog_msg_drop(struct sk_msg_md *msg)
+{
+	bpf_msg_policy(msg);
+	return SK_DROP;
+}
+
 char _license[] SEC("license") = "GPL";
@@ -23,6 +23,11 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
 
 #include <sys/time.h>
 #include <sys/types.h>
@@ -46,15 +51,53 @@ void running_handler(int a);
 #define S1_PORT 10000
 #define S2_PORT 10001
 
-static int sockmap_test_sockets(int rate, int dot)
+/* map_fd[] and prog_fd[] follow the order in sockmap_kern.c */
+enum {
+	MAP_SOCK,
+	MAP_TXMSG,
+	MAP_APPLY_BYTES,
+	MAP_CORK_BYTES,
+	MAP_REDIR_FLAGS,
+};
+
+enum {
+	PROG_PARSE,
+	PROG_VERDICT,
+	PROG_SOCKOPS,
+	PROG_MSG_PASS,
+	PROG_MSG_REDIR,
+	PROG_MSG_DROP,
+};
+
+/* sock_map_txmsg keys */
+#define TXMSG_KEY_TARGET 0
+#define TXMSG_KEY_SENDER 1
+
+enum txmsg_mode {
+	TXMSG_NONE,
+	TXMSG_PASS,
+	TXMSG_REDIR,
+	TXMSG_DROP,
+};
+
+struct sockmap_options {
+	int iov_count;
+	int iov_length;
+	int cnt;
+	int apply;
+	int cork;
+	bool ingress;
+	bool sendpage;
+	enum txmsg_mode txmsg;
+};
+
+static int s1, s2, c1, c2, p1, p2;
+
+static int sockmap_init_sockets(void)
 {
-	int i, sc, err, max_fd, one = 1;
-	int s1, s2, c1, c2, p1, p2;
+	int i, err, one = 1;
 	struct sockaddr_in addr;
-	struct timeval timeout;
-	char buf[1024] = {0};
 	int *fds[4] = {&s1, &s2, &c1, &c2};
-	fd_set w;
 
 	s1 = s2 = p1 = p2 = c1 = c2 = 0;
 
@@ -63,8 +106,7 @@ static int sockmap_test_sockets(int rate, int dot)
 		*fds[i] = socket(AF_INET, SOCK_STREAM, 0);
 		if (*fds[i] < 0) {
 			perror("socket s1 failed()");
-			err = *fds[i];
-			goto out;
+			return errno;
 		}
 	}
 
@@ -74,7 +116,7 @@ static int sockmap_test_sockets(int rate, int dot)
 				 (char *)&one, sizeof(one));
 		if (err) {
 			perror("setsockopt failed()");
-			goto out;
+			return errno;
 		}
 	}
 
@@ -83,7 +125,7 @@ static int sockmap_test_sockets(int rate, int dot)
 		err = ioctl(*fds[i], FIONBIO, (char *)&one);
 		if (err < 0) {
 			perror("ioctl s1 failed()");
-			goto out;
+			return errno;
 		}
 	}
 
@@ -96,14 +138,14 @@ static int sockmap_test_sockets(int rate, int dot)
 	err = bind(s1, (struct sockaddr *)&addr, sizeof(addr));
 	if (err < 0) {
 		perror("bind s1 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	addr.sin_port = htons(S2_PORT);
 	err = bind(s2, (struct sockaddr *)&addr, sizeof(addr));
 	if (err < 0) {
 		perror("bind s2 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	/* Listen server sockets */
@@ -111,14 +153,14 @@ static int sockmap_test_sockets(int rate, int dot)
 	err = listen(s1, 32);
 	if (err < 0) {
 		perror("listen s1 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	addr.sin_port = htons(S2_PORT);
 	err = listen(s2, 32);
 	if (err < 0) {
 		perror("listen s1 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	/* Initiate Connect */
@@ -126,36 +168,59 @@ static int sockmap_test_sockets(int rate, int dot)
 	err = connect(c1, (struct sockaddr *)&addr, sizeof(addr));
 	if (err < 0 && errno != EINPROGRESS) {
 		perror("connect c1 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	addr.sin_port = htons(S2_PORT);
 	err = connect(c2, (struct sockaddr *)&addr, sizeof(addr));
 	if (err < 0 && errno != EINPROGRESS) {
 		perror("connect c2 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	/* Accept Connecrtions */
 	p1 = accept(s1, NULL, NULL);
 	if (p1 < 0) {
 		perror("accept s1 failed()\n");
-		goto out;
+		return errno;
 	}
 
 	p2 = accept(s2, NULL, NULL);
 	if (p2 < 0) {
 		perror("accept s1 failed()\n");
-		goto out;
+		return errno;
 	}
 
-	max_fd = p2;
-	timeout.tv_sec = 10;
-	timeout.tv_usec = 0;
-
 	printf("connected sockets: c1 <-> p1, c2 <-> p2\n");
 	printf("cgroups binding: c1(%i) <-> s1(%i) - - - c2(%i) <-> s2(%i)\n",
 		c1, s1, c2, s2);
+	return 0;
+}
+
+static void sockmap_close_sockets(void)
+{
+	close(s1);
+	close(s2);
+	close(p1);
+	close(p2);
+	close(c1);
+	close(c2);
+}
+
+static int sockmap_test_sockets(int rate, int dot)
+{
+	struct timeval timeout;
+	char buf[1024] = {0};
+	int err, sc, max_fd;
+	fd_set w;
+
+	err = sockmap_init_sockets();
+	if (err)
+		goto out;
+
+	max_fd = p2;
+	timeout.tv_sec = 10;
+	timeout.tv_usec = 0;
 
 	/* Ping/Pong data from client to server */
 	sc = send(c1, buf, sizeof(buf), 0);
@@ -217,23 +282,344 @@ static int sockmap_test_sockets(int rate, int dot)
 	} while (running);
 
 out:
-	close(s1);
-	close(s2);
-	close(p1);
-	close(p2);
-	close(c1);
-	close(c2);
+	sockmap_close_sockets();
+	return err;
+}
+
+static double elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_rate(const char *who, size_t bytes, double secs)
+{
+	printf("%s: %zu bytes in %.3fs, %.2f MB/s, %.3f Gbps\n", who, bytes,
+	       secs, bytes / secs / 1e6, bytes * 8 / secs / 1e9);
+}
+
+static int msg_send(int fd, struct sockmap_options *opt, size_t *sent)
+{
+	struct msghdr msg = {0};
+	struct iovec *iov;
+	int i, err = 0;
+	char *buf;
+
+	iov = calloc(opt->iov_count, sizeof(struct iovec));
+	buf = calloc(opt->iov_count, opt->iov_length);
+	if (!iov || !buf) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < opt->iov_count; i++) {
+		iov[i].iov_base = buf + i * opt->iov_length;
+		iov[i].iov_len = opt->iov_length;
+	}
+	msg.msg_iov = iov;
+	msg.msg_iovlen = opt->iov_count;
+
+	*sent = 0;
+	for (i = 0; i < opt->cnt; i++) {
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+		if (n < 0) {
+			/* A dropped message is an expected outcome */
+			if (errno == EACCES && opt->txmsg == TXMSG_DROP)
+				continue;
+			perror("sendmsg");
+			err = -errno;
+			break;
+		}
+		*sent += n;
+	}
+out:
+	free(buf);
+	free(iov);
+	return err;
+}
+
+static int page_send(int fd, struct sockmap_options *opt, size_t *sent)
+{
+	size_t len = (size_t)opt->iov_count * opt->iov_length;
+	char tmpl[] = "/tmp/sockmap_XXXXXX";
+	int i, err = 0, file;
+	char *buf;
+
+	file = mkstemp(tmpl);
+	if (file < 0)
+		return -errno;
+	unlink(tmpl);
+
+	buf = calloc(1, len);
+	if (!buf || write(file, buf, len) != (ssize_t)len) {
+		err = -EIO;
+		goto out;
+	}
+
+	*sent = 0;
+	for (i = 0; i < opt->cnt; i++) {
+		off_t off = 0;
+		ssize_t n = sendfile(fd, file, &off, len);
+
+		if (n < 0) {
+			if (errno == EACCES && opt->txmsg == TXMSG_DROP)
+				continue;
+			perror("sendfile");
+			err = -errno;
+			break;
+		}
+		*sent += n;
+	}
+out:
+	free(buf);
+	close(file);
 	return err;
 }
 
+/* Read until total bytes arrived or the stream stalled for a second */
+static int msg_recv(int fd, size_t total, size_t *received)
+{
+	struct timeval timeout = { .tv_sec = 1 };
+	char buf[64 * 1024];
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(timeout)))
+		return -errno;
+
+	*received = 0;
+	while (*received < total) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -errno;
+		}
+		if (!n)
+			break;
+		*received += n;
+	}
+	return 0;
+}
+
+static int sockmap_setup_txmsg(struct sockmap_options *opt)
+{
+	int prog, zero = 0, one = 1, key, flags, target, err;
+
+	switch (opt->txmsg) {
+	case TXMSG_PASS:
+		prog = prog_fd[PROG_MSG_PASS];
+		break;
+	case TXMSG_REDIR:
+		prog = prog_fd[PROG_MSG_REDIR];
+		break;
+	case TXMSG_DROP:
+		prog = prog_fd[PROG_MSG_DROP];
+		break;
+	default:
+		return 0;
+	}
+
+	err = bpf_prog_attach(prog, map_fd[MAP_TXMSG], BPF_SK_MSG_VERDICT, 0);
+	if (err) {
+		fprintf(stderr, "ERROR: bpf_prog_attach (txmsg): %d (%s)\n",
+			err, strerror(errno));
+		return err;
+	}
+
+	bpf_map_update_elem(map_fd[MAP_APPLY_BYTES], &zero, &opt->apply,
+			    BPF_ANY);
+	bpf_map_update_elem(map_fd[MAP_CORK_BYTES], &zero, &opt->cork,
+			    BPF_ANY);
+
+	/* Redirects to the ingress of p1 skip the TCP stack entirely, egress
+	 * redirects go out on c2 and are read on p2.
+	 */
+	flags = opt->ingress ? BPF_F_INGRESS : 0;
+	target = opt->ingress ? p1 : c2;
+	key = TXMSG_KEY_TARGET;
+	bpf_map_update_elem(map_fd[MAP_REDIR_FLAGS], &zero, &flags, BPF_ANY);
+	bpf_map_update_elem(map_fd[MAP_REDIR_FLAGS], &one, &key, BPF_ANY);
+
+	if (opt->txmsg == TXMSG_REDIR) {
+		err = bpf_map_update_elem(map_fd[MAP_TXMSG], &key, &target,
+					  BPF_ANY);
+		if (err) {
+			fprintf(stderr, "ERROR: txmsg target update: %s\n",
+				strerror(errno));
+			return err;
+		}
+	}
+
+	key = TXMSG_KEY_SENDER;
+	err = bpf_map_update_elem(map_fd[MAP_TXMSG], &key, &c1, BPF_ANY);
+	if (err)
+		fprintf(stderr, "ERROR: txmsg sender update: %s\n",
+			strerror(errno));
+	return err;
+}
+
+/* Stream cnt messages from c1 and read them where the verdict sends them,
+ * reporting the throughput seen by both ends.
+ */
+static int sockmap_bench(struct sockmap_options *opt)
+{
+	size_t total = (size_t)opt->cnt * opt->iov_count * opt->iov_length;
+	struct timespec start, end;
+	size_t sent = 0, received;
+	int err, status, rx;
+	pid_t pid;
+
+	err = sockmap_init_sockets();
+	if (err)
+		goto out;
+
+	err = sockmap_setup_txmsg(opt);
+	if (err)
+		goto out;
+
+	/* Blocking sockets from here on */
+	err = 0;
+	ioctl(c1, FIONBIO, &err);
+	ioctl(p1, FIONBIO, &err);
+	ioctl(p2, FIONBIO, &err);
+
+	rx = (opt->txmsg == TXMSG_REDIR && !opt->ingress) ? p2 : p1;
+
+	pid = fork();
+	if (pid < 0) {
+		err = -errno;
+		goto out;
+	}
+	if (!pid) {
+		if (opt->txmsg == TXMSG_DROP)
+			exit(0);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		err = msg_recv(rx, total, &received);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (err) {
+			fprintf(stderr, "recv failed: %s\n", strerror(-err));
+			exit(1);
+		}
+		print_rate("rx", received, elapsed(&start, &end));
+		exit(received == total ? 0 : 1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (opt->sendpage)
+		err = page_send(c1, opt, &sent);
+	else
+		err = msg_send(c1, opt, &sent);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print_rate("tx", sent, elapsed(&start, &end));
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "receiver did not get %zu bytes\n", total);
+		if (!err)
+			err = -EIO;
+	}
+out:
+	sockmap_close_sockets();
+	return err;
+}
+
+static const struct option long_options[] = {
+	{"help",	no_argument,		NULL, 'h' },
+	{"cgroup",	required_argument,	NULL, 'c' },
+	{"test",	required_argument,	NULL, 't' },
+	{"txmsg",	required_argument,	NULL, 'm' },
+	{"ingress",	no_argument,		NULL, 'i' },
+	{"apply",	required_argument,	NULL, 'a' },
+	{"cork",	required_argument,	NULL, 'k' },
+	{"iov_count",	required_argument,	NULL, 'n' },
+	{"length",	required_argument,	NULL, 'l' },
+	{"cnt",		required_argument,	NULL, 'r' },
+	{"sendpage",	no_argument,		NULL, 'p' },
+	{0, 0, NULL, 0 }
+};
+
+static void usage(char *argv[])
+{
+	printf(" Usage: %s --cgroup <cgroup_path> [options]\n", argv[0]);
+	printf(" --test ping            sk_skb redirect ping/pong (default)\n");
+	printf(" --test bench           stream c1 -> p1 over loopback TCP\n");
+	printf(" --txmsg pass|redir|drop  sk_msg verdict for bench\n");
+	printf(" --ingress              redirect to the receive side of p1\n");
+	printf(" --apply <bytes>        apply each verdict to <bytes>\n");
+	printf(" --cork <bytes>         cork until <bytes> are queued\n");
+	printf(" --iov_count <n>        iovecs per sendmsg (default 1)\n");
+	printf(" --length <bytes>       bytes per iovec (default 1024)\n");
+	printf(" --cnt <n>              number of sendmsg calls (default 1000)\n");
+	printf(" --sendpage             send with sendfile instead\n");
+}
+
 int main(int argc, char **argv)
 {
+	struct sockmap_options opt = {
+		.iov_count = 1,
+		.iov_length = 1024,
+		.cnt = 1000,
+	};
 	int rate = 1, dot = 1;
+	char *cg_path = NULL;
+	bool bench = false;
 	char filename[256];
-	int err, cg_fd;
-	char *cg_path;
+	int err, cg_fd, c;
+
+	while ((c = getopt_long(argc, argv, "hc:t:m:ia:k:n:l:r:p",
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'c':
+			cg_path = optarg;
+			break;
+		case 't':
+			bench = !strcmp(optarg, "bench");
+			break;
+		case 'm':
+			if (!strcmp(optarg, "pass"))
+				opt.txmsg = TXMSG_PASS;
+			else if (!strcmp(optarg, "redir"))
+				opt.txmsg = TXMSG_REDIR;
+			else if (!strcmp(optarg, "drop"))
+				opt.txmsg = TXMSG_DROP;
+			else {
+				usage(argv);
+				return -EINVAL;
+			}
+			break;
+		case 'i':
+			opt.ingress = true;
+			break;
+		case 'a':
+			opt.apply = atoi(optarg);
+			break;
+		case 'k':
+			opt.cork = atoi(optarg);
+			break;
+		case 'n':
+			opt.iov_count = atoi(optarg);
+			break;
+		case 'l':
+			opt.iov_length = atoi(optarg);
+			break;
+		case 'r':
+			opt.cnt = atoi(optarg);
+			break;
+		case 'p':
+			opt.sendpage = true;
+			break;
+		case 'h':
+		default:
+			usage(argv);
+			return -1;
+		}
+	}
+
+	/* Old style: the cgroup is the last argument */
+	if (!cg_path && optind < argc)
+		cg_path = argv[optind];
 
-	cg_path = argv[argc - 1];
 	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
 
 	running = 1;
@@ -247,6 +633,18 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (bench) {
+		err = sockmap_bench(&opt);
+		if (err)
+			fprintf(stderr, "ERROR: bench failed: %d\n", err);
+		return err;
+	}
+
+	if (!cg_path) {
+		usage(argv);
+		return -EINVAL;
+	}
+
 	/* Cgroup configuration */
 	cg_fd = open(cg_path, O_DIRECTORY, O_RDONLY);
 	if (cg_fd < 0) {
@@ -256,7 +654,7 @@ int main(int argc, char **argv)
 	}
 
 	/* Attach programs to sockmap */
-	err = bpf_prog_attach(prog_fd[0], map_fd[0],
+	err = bpf_prog_attach(prog_fd[PROG_PARSE], map_fd[MAP_SOCK],
 				BPF_SK_SKB_STREAM_PARSER, 0);
 	if (err) {
 		fprintf(stderr, "ERROR: bpf_prog_attach (sockmap): %d (%s)\n",
@@ -264,7 +662,7 @@ int main(int argc, char **argv)
 		return err;
 	}
 
-	err = bpf_prog_attach(prog_fd[1], map_fd[0],
+	err = bpf_prog_attach(prog_fd[PROG_VERDICT], map_fd[MAP_SOCK],
 				BPF_SK_SKB_STREAM_VERDICT, 0);
 	if (err) {
 		fprintf(stderr, "ERROR: bpf_prog_attach (sockmap): %d (%s)\n",
@@ -273,7 +671,8 @@ int main(int argc, char **argv)
 	}
 
 	/* Attach to cgroups */
-	err = bpf_prog_attach(prog_fd[2], cg_fd, BPF_CGROUP_SOCK_OPS, 0);
+	err = bpf_prog_attach(prog_fd[PROG_SOCKOPS], cg_fd,
+			      BPF_CGROUP_SOCK_OPS, 0);
 	if (err) {
 		fprintf(stderr, "ERROR: bpf_prog_attach (groups): %d (%s)\n",
 			err, strerror(errno));
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * epoll-wait: Stress the epoll ready list with many producers signalling
+ * a single epoll instance.
+ *
+ * Every producer thread owns a set of eventfds, all registered in the same
+ * epoll instance, and keeps writing to them. The waiter threads drain the
+ * instance with epoll_wait() and read the eventfds back. This mostly
+ * measures the cost of ep_poll_callback() contending on the epoll instance,
+ * so use as many producers as there are CPUs.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+static unsigned int nproducers = 0;
+static unsigned int nwaiters   = 1;
+static unsigned int nsecs      = 8;
+/* amount of eventfds per producer */
+static unsigned int nfds       = 16;
+static bool edge = false, done = false, silent = false;
+
+struct timeval start, end, runtime;
+static int epollfd;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	int *fds;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nproducers, "Specify amount of producer threads"),
+	OPT_UINTEGER('w', "waiters", &nwaiters, "Specify amount of epoll_wait() threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,     "Specify amount of eventfds per producer"),
+	OPT_BOOLEAN( 'E', "edge",    &edge,     "Use edge-triggered events"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void *producerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = 0; /* avoid cacheline bouncing */
+	uint64_t val = 1;
+	unsigned int i;
+
+	wait_for_start();
+
+	do {
+		for (i = 0; i < nfds; i++, ops++) {
+			/* EAGAIN only means the counter is saturated */
+			if (write(w->fds[i], &val, sizeof(val)) < 0 &&
+			    errno != EAGAIN)
+				err(EXIT_FAILURE, "write");
+		}
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void *waiterfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct epoll_event events[64];
+	unsigned long ops = 0;
+	uint64_t val;
+	int i, n;
+
+	wait_for_start();
+
+	do {
+		/* time out so that we notice when the run is over */
+		n = epoll_wait(epollfd, events, ARRAY_SIZE(events), 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "epoll_wait");
+		}
+
+		for (i = 0; i < n; i++, ops++) {
+			if (read(events[i].data.fd, &val, sizeof(val)) < 0 &&
+			    errno != EAGAIN)
+				err(EXIT_FAILURE, "read");
+		}
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void start_threads(struct worker *worker, unsigned int nthreads,
+			  unsigned int ncpus, unsigned int cpu_base,
+			  void *(*fn)(void *))
+{
+	pthread_attr_t thread_attr;
+	unsigned int i;
+	cpu_set_t cpu;
+	int ret;
+
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+
+		CPU_ZERO(&cpu);
+		CPU_SET((cpu_base + i) % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, fn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+}
+
+static void join_threads(struct worker *worker, unsigned int nthreads)
+{
+	unsigned int i;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+}
+
+static void print_summary(unsigned long events)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld writes/sec per producer (+- %.2f%%), %ld events/sec reaped, total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       events / runtime.tv_sec, (int) runtime.tv_sec);
+}
+
+int bench_epoll_wait(int argc, const char **argv)
+{
+	struct worker *producer = NULL, *waiter = NULL;
+	struct epoll_event ev;
+	unsigned long events = 0;
+	struct sigaction act;
+	unsigned int i, j, ncpus;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || !nwaiters || !nfds || !nsecs) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nproducers) /* default to the number of CPUs */
+		nproducers = ncpus;
+
+	producer = calloc(nproducers, sizeof(*producer));
+	waiter = calloc(nwaiters, sizeof(*waiter));
+	if (!producer || !waiter)
+		goto errmem;
+
+	epollfd = epoll_create1(0);
+	if (epollfd < 0)
+		err(EXIT_FAILURE, "epoll_create1");
+
+	ev.events = EPOLLIN | (edge ? EPOLLET : 0);
+	for (i = 0; i < nproducers; i++) {
+		producer[i].fds = calloc(nfds, sizeof(*producer[i].fds));
+		if (!producer[i].fds)
+			goto errmem;
+
+		for (j = 0; j < nfds; j++) {
+			int fd = eventfd(0, EFD_NONBLOCK);
+
+			if (fd < 0)
+				err(EXIT_FAILURE, "eventfd");
+			ev.data.fd = fd;
+			if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev))
+				err(EXIT_FAILURE, "epoll_ctl");
+			producer[i].fds[j] = fd;
+		}
+	}
+
+	printf("Run summary [PID %d]: %d producers, each signalling %d [%s] eventfds, %d waiters for %d secs.\n\n",
+	       getpid(), nproducers, nfds, edge ? "edge" : "level", nwaiters, nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nproducers + nwaiters;
+	gettimeofday(&start, NULL);
+	/* waiters go on the CPUs the last producers would use */
+	start_threads(waiter, nwaiters, ncpus, ncpus - nwaiters % ncpus,
+		      waiterfn);
+	start_threads(producer, nproducers, ncpus, 0, producerfn);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	join_threads(producer, nproducers);
+	join_threads(waiter, nwaiters);
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nproducers; i++) {
+		unsigned long t = producer[i].ops / runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[producer %2d] eventfds: %d ... %d [ %ld writes/sec ]\n",
+			       producer[i].tid, producer[i].fds[0],
+			       producer[i].fds[nfds - 1], t);
+
+		for (j = 0; j < nfds; j++)
+			close(producer[i].fds[j]);
+		free(producer[i].fds);
+	}
+
+	for (i = 0; i < nwaiters; i++) {
+		if (!silent)
+			printf("[waiter   %2d] [ %ld events/sec ]\n",
+			       waiter[i].tid, waiter[i].ops / runtime.tv_sec);
+		events += waiter[i].ops;
+	}
+
+	print_summary(events);
+
+	close(epollfd);
+	free(producer);
+	free(waiter);
+	return 0;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * path-walk: Resolve the same set of paths from many threads at once.
+ *
+ * A small tree of nested directories is created under a scratch directory,
+ * with a symlink next to every leaf file. Each thread then keeps stat()ing
+ * the leaves, either directly or through the symlinks, so that all of them
+ * walk the same hot directories. With -m the RCU-walk fallback counters of
+ * the mount are read from /proc/self/mountstats before and after the run.
+ *
+ * With -n every thread instead stats names that do not exist, cycling over
+ * that many of them, which is the stat storm that fills the dcache with
+ * negative dentries. /proc/sys/fs/dentry-state is shown before and after.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int depth    = 6;
+/* amount of leaf files per thread */
+static unsigned int nfiles   = 64;
+/* amount of missing names per thread, 0 for none */
+static unsigned int nmissing = 0;
+static const char *basedir   = "/tmp";
+static bool symlinks = false, mountstats = false, done = false, silent = false;
+
+struct timeval start, end, runtime;
+static char *rootdir, *leafdir;
+static char **paths;
+static unsigned int npaths;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,   "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,      "Specify runtime (in seconds)"),
+	OPT_UINTEGER('d', "depth",   &depth,      "Specify directory nesting depth"),
+	OPT_UINTEGER('f', "files",   &nfiles,     "Specify amount of leaf files"),
+	OPT_STRING(  'D', "dir",     &basedir,    "dir", "Create the tree below this directory"),
+	OPT_BOOLEAN( 'l', "symlink", &symlinks,   "Resolve the leaves through symlinks"),
+	OPT_UINTEGER('n', "negative", &nmissing,  "Stat this many missing names per thread instead"),
+	OPT_BOOLEAN( 'm', "mountstats", &mountstats, "Show RCU-walk fallbacks of the mount"),
+	OPT_BOOLEAN( 's', "silent",  &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_path_walk_usage[] = {
+	"perf bench fs path-walk <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = 0; /* avoid cacheline bouncing */
+	unsigned int i = w->tid;
+	char missing[PATH_MAX];
+	struct stat st;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		if (nmissing) {
+			snprintf(missing, sizeof(missing), "%s/m%d-%lu",
+				 leafdir, w->tid, ops % nmissing);
+			if (!stat(missing, &st) || errno != ENOENT)
+				err(EXIT_FAILURE, "stat %s", missing);
+		} else {
+			/* spread the threads over the leaves */
+			if (stat(paths[i % npaths], &st))
+				err(EXIT_FAILURE, "stat");
+			i += 7;
+		}
+		ops++;
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void create_tree(void)
+{
+	char dir[PATH_MAX], file[PATH_MAX], link[PATH_MAX];
+	unsigned int i;
+	int fd, len;
+
+	len = snprintf(dir, sizeof(dir), "%s/perf-path-walk-XXXXXX", basedir);
+	if (len >= (int)sizeof(dir))
+		errx(EXIT_FAILURE, "directory name too long");
+	if (!mkdtemp(dir))
+		err(EXIT_FAILURE, "mkdtemp");
+	rootdir = strdup(dir);
+	if (!rootdir)
+		err(EXIT_FAILURE, "strdup");
+
+	for (i = 0; i < depth; i++) {
+		len += snprintf(dir + len, sizeof(dir) - len, "/d%u", i);
+		if (len >= (int)sizeof(dir))
+			errx(EXIT_FAILURE, "directory name too long");
+		if (mkdir(dir, 0755))
+			err(EXIT_FAILURE, "mkdir");
+	}
+	leafdir = strdup(dir);
+	if (!leafdir)
+		err(EXIT_FAILURE, "strdup");
+
+	npaths = nfiles;
+	paths = calloc(npaths, sizeof(*paths));
+	if (!paths)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nfiles; i++) {
+		snprintf(file, sizeof(file), "%s/f%u", dir, i);
+		fd = open(file, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			err(EXIT_FAILURE, "open");
+		close(fd);
+
+		if (symlinks) {
+			/* relative, so the link body is walked in this tree */
+			snprintf(link, sizeof(link), "%s/l%u", dir, i);
+			snprintf(file, sizeof(file), "f%u", i);
+			if (symlink(file, link))
+				err(EXIT_FAILURE, "symlink");
+			paths[i] = strdup(link);
+		} else {
+			paths[i] = strdup(file);
+		}
+		if (!paths[i])
+			err(EXIT_FAILURE, "strdup");
+	}
+}
+
+static void remove_tree(void)
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	unsigned int i;
+	int len;
+
+	len = snprintf(dir, sizeof(dir), "%s", rootdir);
+	for (i = 0; i < depth; i++)
+		len += snprintf(dir + len, sizeof(dir) - len, "/d%u", i);
+
+	for (i = 0; i < nfiles; i++) {
+		snprintf(path, sizeof(path), "%s/f%u", dir, i);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/l%u", dir, i);
+		unlink(path);
+		free(paths[i]);
+	}
+	free(paths);
+
+	for (i = depth; i > 0; i--) {
+		rmdir(dir);
+		*strrchr(dir, '/') = '\0';
+	}
+	rmdir(rootdir);
+	free(rootdir);
+	free(leafdir);
+}
+
+static void show_dentry_state(const char *when)
+{
+	long nr_dentry, nr_unused, age, want, nr_negative;
+	FILE *f;
+
+	f = fopen("/proc/sys/fs/dentry-state", "r");
+	if (!f)
+		return;
+	if (fscanf(f, "%ld %ld %ld %ld %ld", &nr_dentry, &nr_unused,
+		   &age, &want, &nr_negative) == 5)
+		printf("dentry-state %s: %ld dentries, %ld unused, %ld unused negative\n",
+		       when, nr_dentry, nr_unused, nr_negative);
+	fclose(f);
+}
+
+/*
+ * Find the "rcuwalk:" line of the mount holding the tree. Mounts are
+ * matched on the longest mount point that prefixes the tree, which is
+ * good enough for a scratch directory. The line only shows up once a walk
+ * on that mount has fallen back.
+ */
+static bool read_rcuwalk(char *buf, size_t size)
+{
+	char line[1024], mnt[PATH_MAX];
+	size_t best = 0, len;
+	bool in_mnt = false;
+	FILE *f;
+
+	f = fopen("/proc/self/mountstats", "r");
+	if (!f)
+		return false;
+	buf[0] = '\0';
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p;
+
+		if (sscanf(line, "device %*s mounted on %4095s", mnt) == 1) {
+			len = strlen(mnt);
+			in_mnt = !strncmp(rootdir, mnt, len) && len >= best &&
+				 (rootdir[len] == '/' || len == 1);
+			if (in_mnt)
+				best = len;
+			continue;
+		}
+
+		p = strstr(line, "rcuwalk:");
+		if (in_mnt && p) {
+			snprintf(buf, size, "%s", p + strlen("rcuwalk:"));
+			buf[strcspn(buf, "\n")] = '\0';
+		}
+	}
+	fclose(f);
+
+	if (best && !buf[0])
+		snprintf(buf, size, "none");
+	return best;
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld lookups/sec (+- %.2f%%), %.3f usecs/lookup, total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       avg ? 1000000.0 / avg : 0.0, (int) runtime.tv_sec);
+}
+
+int bench_path_walk(int argc, const char **argv)
+{
+	char before[256] = "", after[256] = "";
+	struct worker *worker = NULL;
+	struct sigaction act;
+	unsigned int i, ncpus;
+	pthread_attr_t thread_attr;
+	cpu_set_t cpu;
+	int ret;
+
+	argc = parse_options(argc, argv, options, bench_path_walk_usage, 0);
+	if (argc || !nfiles || !nsecs) {
+		usage_with_options(bench_path_walk_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	create_tree();
+
+	if (nmissing) {
+		printf("Run summary [PID %d]: %d threads each missing %d names at depth %d for %d secs.\n\n",
+		       getpid(), nthreads, nmissing, depth, nsecs);
+		show_dentry_state("before");
+	} else {
+		printf("Run summary [PID %d]: %d threads resolving %d %s at depth %d for %d secs.\n\n",
+		       getpid(), nthreads, nfiles,
+		       symlinks ? "symlinks" : "files", depth, nsecs);
+	}
+
+	if (mountstats && !read_rcuwalk(before, sizeof(before))) {
+		fprintf(stderr, "mount not found in /proc/self/mountstats\n");
+		mountstats = false;
+	}
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops / runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] [ %ld lookups/sec ]\n",
+			       worker[i].tid, t);
+	}
+
+	print_summary();
+
+	if (mountstats && read_rcuwalk(after, sizeof(after)))
+		printf("RCU-walk fallbacks before: %s\n"
+		       "RCU-walk fallbacks after:  %s\n", before, after);
+	if (nmissing)
+		show_dentry_state("after");
+
+	remove_tree();
+	free(worker);
+	return 0;
+}
@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *
+ * sched-unix-zerocopy.c
+ *
+ * unix-zerocopy: Benchmark for large transfers over AF_UNIX stream sockets,
+ * comparing plain copies against MSG_ZEROCOPY sends.
+ *
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <linux/errqueue.h>
+#include <linux/time64.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+static unsigned int	loops = 1000;
+static unsigned int	msg_kb = 256;
+static const char	*mode_str = "both";
+
+static const struct option options[] = {
+	OPT_UINTEGER('l', "loop",	&loops,		"Specify number of messages"),
+	OPT_UINTEGER('s', "size",	&msg_kb,	"Specify message size in KB"),
+	OPT_STRING('m', "mode",		&mode_str,	"copy|zerocopy|both",
+		   "Specify send mode"),
+	OPT_END()
+};
+
+static const char * const bench_sched_unix_zerocopy_usage[] = {
+	"perf bench sched unix-zerocopy <options>",
+	NULL
+};
+
+struct zc_stats {
+	unsigned int	completions;
+	unsigned int	copied;
+	unsigned int	next_id;
+};
+
+/* Reap completion notifications; returns false once the queue is empty */
+static bool zc_reap(int fd, struct zc_stats *st)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct sock_extended_err *serr;
+	struct msghdr msg = {
+		.msg_control	= control,
+		.msg_controllen	= sizeof(control),
+	};
+	struct cmsghdr *cm;
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+		if (errno != EAGAIN)
+			err(EXIT_FAILURE, "recvmsg errqueue");
+		return false;
+	}
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SO_ZEROCOPY)
+		errx(EXIT_FAILURE, "unexpected cmsg");
+
+	serr = (void *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		errx(EXIT_FAILURE, "unexpected origin %u", serr->ee_origin);
+	if (serr->ee_info != st->next_id)
+		errx(EXIT_FAILURE, "completion %u, expected %u",
+		     serr->ee_info, st->next_id);
+
+	st->completions += serr->ee_data - serr->ee_info + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		st->copied += serr->ee_data - serr->ee_info + 1;
+	st->next_id = serr->ee_data + 1;
+
+	return true;
+}
+
+static void reader(int fd, size_t total)
+{
+	size_t len = msg_kb * 1024;
+	char *buf;
+
+	buf = malloc(len);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+
+	while (total) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret <= 0)
+			err(EXIT_FAILURE, "read");
+		total -= ret;
+	}
+
+	free(buf);
+}
+
+static void writer(int fd, bool zerocopy, struct zc_stats *st)
+{
+	size_t len = msg_kb * 1024;
+	int flags = zerocopy ? MSG_ZEROCOPY : 0;
+	unsigned int i;
+	char *buf;
+
+	buf = malloc(len);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+	memset(buf, 'z', len);
+
+	for (i = 0; i < loops; i++) {
+		size_t off = 0;
+
+		while (off < len) {
+			ssize_t ret = send(fd, buf + off, len - off, flags);
+
+			if (ret < 0 && errno == ENOBUFS && zerocopy) {
+				/* too many pinned pages: let completions drain */
+				struct pollfd pfd = { .fd = fd, .events = 0 };
+
+				poll(&pfd, 1, 100);
+				while (zc_reap(fd, st))
+					;
+				continue;
+			}
+			if (ret <= 0)
+				err(EXIT_FAILURE, "send");
+			off += ret;
+		}
+
+		if (zerocopy)
+			while (zc_reap(fd, st))
+				;
+	}
+
+	free(buf);
+}
+
+static int run_one(bool zerocopy)
+{
+	unsigned long long result_usec;
+	struct timeval start, stop, diff;
+	struct zc_stats st = { 0 };
+	size_t total = (size_t)loops * msg_kb * 1024;
+	int sv[2], wait_stat;
+	pid_t pid;
+	int one = 1;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		err(EXIT_FAILURE, "socketpair");
+
+	if (zerocopy && setsockopt(sv[0], SOL_SOCKET, SO_ZEROCOPY,
+				   &one, sizeof(one))) {
+		fprintf(stderr, "SO_ZEROCOPY not supported on AF_UNIX: %s\n",
+			strerror(errno));
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+
+	if (!pid) {
+		close(sv[0]);
+		reader(sv[1], total);
+		exit(0);
+	}
+
+	close(sv[1]);
+	writer(sv[0], zerocopy, &st);
+
+	if (waitpid(pid, &wait_stat, 0) != pid || !WIFEXITED(wait_stat) ||
+	    WEXITSTATUS(wait_stat))
+		errx(EXIT_FAILURE, "reader failed");
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	/* the reader has consumed every skb, so all completions are queued */
+	if (zerocopy)
+		while (zc_reap(sv[0], &st))
+			;
+	close(sv[0]);
+
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %10s: %lu.%03lu [sec] %12.2lf MB/sec",
+		       zerocopy ? "zerocopy" : "copy",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC),
+		       (double)total / (double)result_usec);
+		if (zerocopy)
+			printf("  (%u completions, %u copied)",
+			       st.completions, st.copied);
+		printf("\n");
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lu.%03lu\n", zerocopy ? "zerocopy" : "copy",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
+
+int bench_sched_unix_zerocopy(int argc, const char **argv)
+{
+	bool do_copy, do_zerocopy;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_unix_zerocopy_usage, 0);
+
+	do_copy = !strcmp(mode_str, "copy") || !strcmp(mode_str, "both");
+	do_zerocopy = !strcmp(mode_str, "zerocopy") || !strcmp(mode_str, "both");
+	if ((!do_copy && !do_zerocopy) || !msg_kb || !loops)
+		usage_with_options(bench_sched_unix_zerocopy_usage, options);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Sending %u messages of %u KB over an AF_UNIX stream socket\n\n",
+		       loops, msg_kb);
+
+	if (do_copy)
+		run_one(false);
+	if (do_zerocopy && run_one(true))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+
+int _version SEC("version") = 1;
+
+#define SOCKOPS_PASSIVE_PORT	50205
+
+struct bpf_map_def SEC("maps") sock_map_passive = {
+	.type = BPF_MAP_TYPE_SOCKMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 2,
+};
+
+struct bpf_map_def SEC("maps") sock_map_passive_err = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 1,
+};
+
+/* Add the accepted side of connections to SOCKOPS_PASSIVE_PORT to the
+ * sockmap from the passive established callback, where the child socket
+ * is still in SYN_RECV, and report the result.
+ */
+SEC("sockops")
+int bpf_sockmap_passive(struct bpf_sock_ops *skops)
+{
+	int key = 0, err;
+
+	if (skops->op != BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB ||
+	    skops->local_port != SOCKOPS_PASSIVE_PORT)
+		return 1;
+
+	err = bpf_sock_map_update(skops, &sock_map_passive, &key, BPF_ANY);
+	bpf_map_update_elem(&sock_map_passive_err, &key, &err, BPF_ANY);
+	return 1;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,43 @@
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+#include "bpf_util.h"
+#include "bpf_endian.h"
+
+int _version SEC("version") = 1;
+
+#define bpf_printk(fmt, ...)					\
+({								\
+	       char ____fmt[] = fmt;				\
+	       bpf_trace_printk(____fmt, sizeof(____fmt),	\
+				##__VA_ARGS__);			\
+})
+
+struct bpf_map_def SEC("maps") sock_map_msg = {
+	.type = BPF_MAP_TYPE_SOCKMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 20,
+};
+
+/* data[2] == 1 queues the message on the receive side of the sock at
+ * key data[3], anything else is passed as is.
+ */
+SEC("sk_msg1")
+int bpf_prog1(struct sk_msg_md *msg)
+{
+	void *data_end = (void *)(long) msg->data_end;
+	void *data = (void *)(long) msg->data;
+	__u8 *d = data;
+
+	if (data + 8 > data_end)
+		return SK_DROP;
+
+	bpf_printk("msg: data[2] = %u redir(%u)\n", d[2], d[3]);
+
+	if (d[2] == 1)
+		return bpf_msg_redirect_map(msg, &sock_map_msg, d[3],
+					    BPF_F_INGRESS);
+	return SK_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
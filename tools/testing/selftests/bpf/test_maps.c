@@ -16,8 +16,11 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include <poll.h>
+
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
 
 #include <linux/bpf.h>
 
@@ -290,6 +293,116 @@ static void test_hashmap_walk(int task, void *data)
 	close(fd);
 }
 
+static void __test_hashmap_batch(enum bpf_map_type type, int nr_cpus)
+{
+	int fd, i, j, max_entries = 10000;
+	long long *keys, *values, pair[2];
+	__u32 batch, count, step, total = 0;
+	bool seen[max_entries];
+	int err;
+
+	fd = bpf_create_map(type, sizeof(long long), sizeof(long long),
+			    max_entries, map_flags);
+	if (fd < 0) {
+		printf("Failed to create hashmap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	keys = calloc(max_entries, sizeof(*keys));
+	values = calloc(max_entries * nr_cpus, sizeof(*values));
+	assert(keys && values);
+
+	/* Empty map, nothing to return and no cursor to resume from. */
+	count = max_entries;
+	assert(bpf_map_lookup_batch(fd, NULL, &batch, keys, values,
+				    &count, 0) == -1 && errno == ENOENT);
+	assert(count == 0);
+
+	for (i = 0; i < max_entries; i++) {
+		keys[i] = i;
+		for (j = 0; j < nr_cpus; j++)
+			values[i * nr_cpus + j] = i + j;
+	}
+
+	count = max_entries;
+	assert(bpf_map_update_batch(fd, keys, values, &count, 0) == 0);
+	assert(count == max_entries);
+
+	/* Unknown element and command flags are rejected. */
+	count = max_entries;
+	assert(bpf_map_lookup_batch(fd, NULL, &batch, keys, values,
+				    &count, 1) == -1 && errno == EINVAL);
+
+	/* Walk the whole map in small batches. A bucket that does not fit
+	 * into the batch fails with ENOSPC when nothing was copied yet,
+	 * retry it with a bigger one.
+	 */
+	memset(keys, 0, max_entries * sizeof(*keys));
+	memset(values, 0, max_entries * nr_cpus * sizeof(*values));
+	memset(seen, 0, sizeof(seen));
+	step = 1;
+	for (;;) {
+		count = step;
+		err = bpf_map_lookup_batch(fd, total ? &batch : NULL, &batch,
+					   keys + total,
+					   values + total * nr_cpus,
+					   &count, 0);
+		if (err && errno == ENOSPC) {
+			assert(count == 0);
+			step++;
+			continue;
+		}
+		assert(!err || errno == ENOENT);
+		total += count;
+		if (err)
+			break;
+		assert(count);
+		assert(total <= max_entries);
+	}
+	assert(total == max_entries);
+
+	for (i = 0; i < max_entries; i++) {
+		assert(keys[i] >= 0 && keys[i] < max_entries);
+		assert(!seen[keys[i]]);
+		seen[keys[i]] = true;
+		for (j = 0; j < nr_cpus; j++)
+			assert(values[i * nr_cpus + j] == keys[i] + j);
+	}
+
+	/* Drain half of it by key, then the rest with lookup_and_delete. */
+	count = max_entries / 2;
+	assert(bpf_map_delete_batch(fd, keys, &count, 0) == 0);
+	assert(count == max_entries / 2);
+	assert(bpf_map_lookup_elem(fd, &keys[0], values) == -1 &&
+	       errno == ENOENT);
+
+	/* Deleting a key that is gone stops the batch at that key. */
+	pair[0] = keys[max_entries - 1];
+	pair[1] = keys[0];
+	count = 2;
+	assert(bpf_map_delete_batch(fd, pair, &count, 0) == -1 &&
+	       errno == ENOENT);
+	assert(count == 1);
+
+	count = max_entries;
+	assert(bpf_map_lookup_and_delete_batch(fd, NULL, &batch, keys, values,
+					       &count, 0) == -1 &&
+	       errno == ENOENT);
+	assert(count == max_entries - max_entries / 2 - 1);
+	assert(bpf_map_get_next_key(fd, NULL, keys) == -1 && errno == ENOENT);
+
+	free(keys);
+	free(values);
+	close(fd);
+}
+
+static void test_hashmap_batch(int task, void *data)
+{
+	__test_hashmap_batch(BPF_MAP_TYPE_HASH, 1);
+	__test_hashmap_batch(BPF_MAP_TYPE_PERCPU_HASH,
+			     bpf_num_possible_cpus());
+}
+
 static void test_arraymap(int task, void *data)
 {
 	int key, next_key, fd;
@@ -404,6 +517,60 @@ static void test_arraymap_percpu(int task, void *data)
 	close(fd);
 }
 
+static void test_arraymap_batch(int task, void *data)
+{
+	int fd, i, max_entries = 100;
+	int keys[max_entries], key;
+	long long values[max_entries], value;
+	__u32 count;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(key), sizeof(value),
+			    max_entries, 0);
+	if (fd < 0) {
+		printf("Failed to create arraymap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < max_entries; i++) {
+		keys[i] = i;
+		values[i] = i + 1000;
+	}
+
+	/* Out of range key stops the update at that element. */
+	keys[max_entries - 1] = max_entries;
+	count = max_entries;
+	assert(bpf_map_update_batch(fd, keys, values, &count, 0) == -1 &&
+	       errno == E2BIG);
+	assert(count == max_entries - 1);
+	keys[max_entries - 1] = max_entries - 1;
+	count = max_entries;
+	assert(bpf_map_update_batch(fd, keys, values, &count, 0) == 0);
+
+	/* Array keys are the cursor, resume after the last one returned. */
+	memset(values, 0, sizeof(values));
+	count = max_entries / 2;
+	assert(bpf_map_lookup_batch(fd, NULL, &key, keys, values,
+				    &count, 0) == 0);
+	assert(count == max_entries / 2 && key == max_entries / 2 - 1);
+	count = max_entries;
+	assert(bpf_map_lookup_batch(fd, &key, &key, keys + max_entries / 2,
+				    values + max_entries / 2, &count, 0) == -1 &&
+	       errno == ENOENT);
+	assert(count == max_entries / 2);
+
+	for (i = 0; i < max_entries; i++)
+		assert(keys[i] == i && values[i] == i + 1000);
+
+	/* Arrays have no delete. */
+	count = 1;
+	assert(bpf_map_delete_batch(fd, keys, &count, 0) == -1);
+	count = 1;
+	assert(bpf_map_lookup_and_delete_batch(fd, NULL, &key, keys, values,
+					       &count, 0) == -1);
+
+	close(fd);
+}
+
 static void test_arraymap_percpu_many_keys(void)
 {
 	unsigned int nr_cpus = bpf_num_possible_cpus();
@@ -456,21 +623,128 @@ static void test_devmap(int task, void *data)
 	close(fd);
 }
 
+static void test_cpumap(int task, void *data)
+{
+	unsigned int nr_cpus = bpf_num_possible_cpus();
+	__u32 key, next_key, value;
+	int fd;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_CPUMAP, sizeof(key), sizeof(value),
+			    nr_cpus, 0);
+	if (fd < 0) {
+		printf("Failed to create cpumap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	/* Value is the queue size, zero is the same as a delete */
+	key = 0;
+	value = 192;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == 0);
+	value = 0;
+	assert(bpf_map_lookup_elem(fd, &key, &value) == 0 && value == 192);
+
+	/* Resize the queue */
+	value = 512;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_EXIST) == 0);
+	assert(bpf_map_lookup_elem(fd, &key, &value) == 0 && value == 512);
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+
+	/* Out of range index and queue size */
+	key = nr_cpus;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == E2BIG);
+	key = 0;
+	value = 1 << 20;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == EOVERFLOW);
+
+	assert(bpf_map_get_next_key(fd, NULL, &next_key) == 0 &&
+	       next_key == 0);
+
+	assert(bpf_map_delete_elem(fd, &key) == 0);
+	assert(bpf_map_lookup_elem(fd, &key, &value) == -1 && errno == ENOENT);
+
+	close(fd);
+}
+
+static void test_ringbuf(int task, void *data)
+{
+	long page_size = sysconf(_SC_PAGE_SIZE);
+	struct pollfd pfd = { .events = POLLIN };
+	unsigned long *cons, *prod;
+	__u32 key = 0, value = 0;
+	int fd;
+
+	/* Size must be a power of 2 multiple of the page size, no key/value */
+	assert(bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, 3 * page_size, 0) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_create_map(BPF_MAP_TYPE_RINGBUF, 4, 0, page_size, 0) == -1 &&
+	       errno == EINVAL);
+
+	fd = bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, 4 * page_size, 0);
+	if (fd < 0) {
+		printf("Failed to create ringbuf '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	/* Records are only produced by programs */
+	assert(bpf_map_lookup_elem(fd, &key, &value) == -1 && errno == ENOENT);
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1);
+
+	/* Only the consumer page can be mapped writable */
+	cons = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	assert(cons != MAP_FAILED);
+	assert(mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0) == MAP_FAILED);
+	assert(mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, page_size) == MAP_FAILED);
+
+	/* Producer page and data pages twice, nothing past them */
+	prod = mmap(NULL, page_size + 8 * page_size, PROT_READ, MAP_SHARED,
+		    fd, page_size);
+	assert(prod != MAP_FAILED);
+	assert(mprotect(prod, page_size, PROT_READ | PROT_WRITE) == -1);
+	assert(mmap(NULL, 2 * page_size, PROT_READ, MAP_SHARED,
+		    fd, 9 * page_size) == MAP_FAILED);
+	assert(*cons == 0 && *prod == 0);
+
+	/* Nothing to read yet */
+	pfd.fd = fd;
+	assert(poll(&pfd, 1, 0) == 0);
+
+	/* The mappings keep the ring alive */
+	close(fd);
+	assert(*cons == 0 && *prod == 0);
+
+	munmap(cons, page_size);
+	munmap(prod, page_size + 8 * page_size);
+}
+
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <linux/err.h>
 #define SOCKMAP_PARSE_PROG "./sockmap_parse_prog.o"
 #define SOCKMAP_VERDICT_PROG "./sockmap_verdict_prog.o"
+#define SOCKMAP_TCP_MSG_PROG "./sockmap_tcp_msg_prog.o"
 static void test_sockmap(int tasks, void *data)
 {
 	int one = 1, map_fd_rx = 0, map_fd_tx = 0, map_fd_break, s, sc, rc;
 	struct bpf_map *bpf_map_rx, *bpf_map_tx, *bpf_map_break;
+	struct bpf_map *bpf_map_msg;
+	struct bpf_object *obj_msg;
+	int map_fd_msg = 0;
 	int ports[] = {50200, 50201, 50202, 50204};
-	int err, i, fd, udp, sfd[6] = {0xdeadbeef};
+	int err, i, fd, udp, cfd, afd, sfd[6] = {0xdeadbeef};
 	u8 buf[20] = {0x0, 0x5, 0x3, 0x2, 0x1, 0x0};
-	int parse_prog, verdict_prog;
+	int parse_prog, verdict_prog, msg_prog;
 	struct sockaddr_in addr;
 	struct bpf_object *obj;
 	struct timeval to;
@@ -560,16 +834,54 @@ static void test_sockmap(int tasks, void *data)
 		goto out_sockmap;
 	}
 
-	/* Test update without programs */
+	/* Test update without programs, listeners are not ESTABLISHED */
 	for (i = 0; i < 6; i++) {
 		err = bpf_map_update_elem(fd, &i, &sfd[i], BPF_ANY);
-		if (err) {
+		if (i < 2 && !err) {
+			printf("Allowed update sockmap '%i:%i' not in ESTABLISHED\n",
+			       i, sfd[i]);
+			goto out_sockmap;
+		} else if (i >= 2 && err) {
 			printf("Failed noprog update sockmap '%i:%i'\n",
 			       i, sfd[i]);
 			goto out_sockmap;
 		}
 	}
 
+	/* Test a child accepted from a listener that was offered to the
+	 * map comes up as a plain socket and can be added on its own.
+	 */
+	cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (cfd < 0)
+		goto out_sockmap;
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(ports[0]);
+	err = connect(cfd, (struct sockaddr *)&addr, sizeof(addr));
+	if (err) {
+		printf("Failed listener child connect\n");
+		goto out_sockmap;
+	}
+	afd = accept(sfd[0], NULL, NULL);
+	if (afd < 0) {
+		printf("Failed listener child accept\n");
+		goto out_sockmap;
+	}
+	i = 0;
+	err = bpf_map_update_elem(fd, &i, &afd, BPF_NOEXIST);
+	if (err) {
+		printf("Failed listener child update sockmap %i\n", err);
+		goto out_sockmap;
+	}
+	err = bpf_map_delete_elem(fd, &i);
+	if (err) {
+		printf("Failed listener child delete sockmap %i\n", err);
+		goto out_sockmap;
+	}
+	close(afd);
+	close(cfd);
+
 	/* Test attaching/detaching bad fds */
 	err = bpf_prog_attach(-1, fd, BPF_SK_SKB_STREAM_PARSER, 0);
 	if (!err) {
@@ -658,6 +970,37 @@ static void test_sockmap(int tasks, void *data)
 		goto out_sockmap;
 	}
 
+	err = bpf_prog_load(SOCKMAP_TCP_MSG_PROG,
+			    BPF_PROG_TYPE_SK_MSG, &obj_msg, &msg_prog);
+	if (err) {
+		printf("Failed to load SK_MSG prog\n");
+		goto out_sockmap;
+	}
+
+	bpf_map_msg = bpf_object__find_map_by_name(obj_msg, "sock_map_msg");
+	if (IS_ERR(bpf_map_msg)) {
+		printf("Failed to load map msg from msg prog\n");
+		goto out_sockmap;
+	}
+
+	map_fd_msg = bpf_map__fd(bpf_map_msg);
+	if (map_fd_msg < 0) {
+		printf("Failed to get map msg fd\n");
+		goto out_sockmap;
+	}
+
+	err = bpf_prog_attach(msg_prog, map_fd_msg, BPF_SK_SKB_STREAM_VERDICT, 0);
+	if (!err) {
+		printf("Allowed attaching SK_MSG program as stream verdict\n");
+		goto out_sockmap;
+	}
+
+	err = bpf_prog_attach(msg_prog, map_fd_msg, BPF_SK_MSG_VERDICT, 0);
+	if (err) {
+		printf("Failed msg verdict bpf prog attach\n");
+		goto out_sockmap;
+	}
+
 	err = bpf_prog_attach(parse_prog, map_fd_break,
 			      BPF_SK_SKB_STREAM_PARSER, 0);
 	if (!err) {
@@ -687,7 +1030,7 @@ static void test_sockmap(int tasks, void *data)
 	}
 
 	/* Test map update elem afterwards fd lives in fd and map_fd */
-	for (i = 0; i < 6; i++) {
+	for (i = 2; i < 6; i++) {
 		err = bpf_map_update_elem(map_fd_rx, &i, &sfd[i], BPF_ANY);
 		if (err) {
 			printf("Failed map_fd_rx update sockmap %i '%i:%i'\n",
@@ -753,6 +1096,46 @@ static void test_sockmap(int tasks, void *data)
 		}
 	}
 
+	/* Test msg verdict, sfd[2] sends to its own receive side */
+	i = 0;
+	err = bpf_map_update_elem(map_fd_msg, &i, &sfd[2], BPF_ANY);
+	if (err) {
+		printf("Failed map_fd_msg update sockmap %i\n", err);
+		goto out_sockmap;
+	}
+
+	buf[2] = 1;
+	buf[3] = 0;
+	sc = send(sfd[2], buf, 20, 0);
+	if (sc != 20) {
+		printf("Failed sockmap msg ingress send %i\n", sc);
+		goto out_sockmap;
+	}
+
+	FD_ZERO(&w);
+	FD_SET(sfd[2], &w);
+	to.tv_sec = 1;
+	to.tv_usec = 0;
+	s = select(sfd[2] + 1, &w, NULL, NULL, &to);
+	if (s != 1 || !FD_ISSET(sfd[2], &w)) {
+		printf("Failed sockmap msg ingress select %i\n", s);
+		goto out_sockmap;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	rc = recv(sfd[2], buf, sizeof(buf), 0);
+	if (rc != 20 || buf[2] != 1) {
+		printf("Failed sockmap msg ingress recv %i\n", rc);
+		goto out_sockmap;
+	}
+
+	err = bpf_map_delete_elem(map_fd_msg, &i);
+	if (err) {
+		printf("Failed delete sockmap msg %i\n", err);
+		goto out_sockmap;
+	}
+	buf[2] = 0;
+
 	/* Negative null entry lookup from datapath should be dropped */
 	buf[0] = 1;
 	buf[1] = 12;
@@ -783,7 +1166,7 @@ static void test_sockmap(int tasks, void *data)
 	}
 
 	/* Delete the elems without programs */
-	for (i = 0; i < 6; i++) {
+	for (i = 2; i < 6; i++) {
 		err = bpf_map_delete_elem(fd, &i);
 		if (err) {
 			printf("Failed delete sockmap %i '%i:%i'\n",
@@ -870,6 +1253,12 @@ static void test_sockmap(int tasks, void *data)
 		goto out_sockmap;
 	}
 
+	err = bpf_prog_detach(map_fd_msg, BPF_SK_MSG_VERDICT);
+	if (err) {
+		printf("Failed msg verdict prog detach\n");
+		goto out_sockmap;
+	}
+
 	/* Test map close sockets and empty maps */
 	for (i = 0; i < 6; i++) {
 		bpf_map_delete_elem(map_fd_tx, &i);
@@ -879,6 +1268,7 @@ static void test_sockmap(int tasks, void *data)
 	close(fd);
 	close(map_fd_rx);
 	bpf_object__close(obj);
+	bpf_object__close(obj_msg);
 	return;
 out:
 	for (i = 0; i < 6; i++)
@@ -897,6 +1287,123 @@ static void test_sockmap(int tasks, void *data)
 	exit(1);
 }
 
+#define SOCKMAP_SOCKOPS_PROG "./sockmap_sockops_prog.o"
+#define SOCKOPS_PASSIVE_PORT 50205
+#define SOCKOPS_CGROUP "/tmp/test_maps_cgroup"
+
+static int join_cgroup(const char *path)
+{
+	char procs[PATH_MAX];
+	int fd, ret;
+
+	snprintf(procs, sizeof(procs), "%s/cgroup.procs", path);
+	fd = open(procs, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = dprintf(fd, "%d\n", getpid()) < 0 ? -1 : 0;
+	close(fd);
+	return ret;
+}
+
+/* Passive children are added from BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB,
+ * while they are still in SYN_RECV.
+ */
+static void test_sockmap_passive(int tasks, void *data)
+{
+	int cg_fd = -1, lfd = -1, cfd = -1, afd = -1;
+	int prog_fd, map_fd_err, err, key = 0, value = -1;
+	struct sockaddr_in addr;
+	struct bpf_object *obj;
+	struct bpf_map *map;
+	bool mounted = false;
+
+	err = bpf_prog_load(SOCKMAP_SOCKOPS_PROG, BPF_PROG_TYPE_SOCK_OPS,
+			    &obj, &prog_fd);
+	if (err) {
+		printf("Failed to load SOCK_OPS prog\n");
+		exit(1);
+	}
+
+	map = bpf_object__find_map_by_name(obj, "sock_map_passive_err");
+	if (IS_ERR(map)) {
+		printf("Failed to find passive err map\n");
+		exit(1);
+	}
+	map_fd_err = bpf_map__fd(map);
+
+	if (mkdir(SOCKOPS_CGROUP, 0755) && errno != EEXIST)
+		goto out_skip;
+	mounted = !mount("none", SOCKOPS_CGROUP, "cgroup2", 0, NULL);
+	if (!mounted)
+		goto out_skip;
+	if (mkdir(SOCKOPS_CGROUP "/sockmap", 0755) && errno != EEXIST)
+		goto out_skip;
+	cg_fd = open(SOCKOPS_CGROUP "/sockmap", O_RDONLY);
+	if (cg_fd < 0 || join_cgroup(SOCKOPS_CGROUP "/sockmap"))
+		goto out_skip;
+
+	err = bpf_prog_attach(prog_fd, cg_fd, BPF_CGROUP_SOCK_OPS, 0);
+	if (err) {
+		printf("Failed to attach SOCK_OPS prog\n");
+		goto out_fail;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(SOCKOPS_PASSIVE_PORT);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0 || cfd < 0 ||
+	    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &(int){ 1 }, sizeof(int)) ||
+	    bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1) ||
+	    connect(cfd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("Failed to set up passive connection\n");
+		goto out_fail;
+	}
+	afd = accept(lfd, NULL, NULL);
+	if (afd < 0) {
+		printf("Failed passive accept\n");
+		goto out_fail;
+	}
+
+	if (bpf_map_lookup_elem(map_fd_err, &key, &value) || value) {
+		printf("Failed sockmap update from passive callback %i\n",
+		       value);
+		goto out_fail;
+	}
+
+	bpf_prog_detach(cg_fd, BPF_CGROUP_SOCK_OPS);
+	close(afd);
+	close(cfd);
+	close(lfd);
+	join_cgroup(SOCKOPS_CGROUP);
+	close(cg_fd);
+	rmdir(SOCKOPS_CGROUP "/sockmap");
+	umount(SOCKOPS_CGROUP);
+	rmdir(SOCKOPS_CGROUP);
+	bpf_object__close(obj);
+	return;
+
+out_fail:
+	bpf_prog_detach(cg_fd, BPF_CGROUP_SOCK_OPS);
+	join_cgroup(SOCKOPS_CGROUP);
+	umount(SOCKOPS_CGROUP);
+	exit(1);
+out_skip:
+	printf("test_sockmap_passive: SKIP, no cgroup2\n");
+	if (cg_fd >= 0)
+		close(cg_fd);
+	if (mounted) {
+		rmdir(SOCKOPS_CGROUP "/sockmap");
+		umount(SOCKOPS_CGROUP);
+	}
+	rmdir(SOCKOPS_CGROUP);
+	bpf_object__close(obj);
+}
+
 #define MAP_SIZE (32 * 1024)
 
 static void test_map_large(void)
@@ -1058,14 +1565,19 @@ static void run_all_tests(void)
 	test_hashmap(0, NULL);
 	test_hashmap_percpu(0, NULL);
 	test_hashmap_walk(0, NULL);
+	test_hashmap_batch(0, NULL);
 
 	test_arraymap(0, NULL);
 	test_arraymap_percpu(0, NULL);
+	test_arraymap_batch(0, NULL);
 
 	test_arraymap_percpu_many_keys();
 
 	test_devmap(0, NULL);
+	test_cpumap(0, NULL);
+	test_ringbuf(0, NULL);
 	test_sockmap(0, NULL);
+	test_sockmap_passive(0, NULL);
 
 	test_map_large();
 	test_map_parallel();
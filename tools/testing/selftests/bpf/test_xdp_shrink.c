@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Shrink every frame to its last SHRINK_TO bytes with
+ * bpf_xdp_adjust_head() and pass it up. Used by test_xdp_shrink.sh to
+ * hand the stack frames that filled a receive page but now fit entirely
+ * in the linear part of an skb.
+ */
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+
+#define SHRINK_TO	64
+
+int _version SEC("version") = 1;
+
+SEC("xdp_shrink")
+int xdp_shrink_prog(struct xdp_md *xdp)
+{
+	void *data_end = (void *)(long)xdp->data_end;
+	void *data = (void *)(long)xdp->data;
+	int len = data_end - data;
+
+	if (len <= SHRINK_TO)
+		return XDP_PASS;
+	if (bpf_xdp_adjust_head(xdp, len - SHRINK_TO))
+		return XDP_ABORTED;
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
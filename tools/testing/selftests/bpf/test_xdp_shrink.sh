@@ -0,0 +1,58 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Attach a native XDP program that shrinks every received frame to 64
+# bytes to a virtio_net device in big-packet mode (no mergeable buffers,
+# guest offloads off), then make the peer send frames that fill the first
+# receive page exactly. Those used to leave nothing for skb frags and hit
+# a BUG_ON in page_to_skb().
+#
+# Needs a virtio_net device and a peer on it:
+#   VIRTIO_IF=eth1 VIRTIO_PEER=192.168.122.1 ./test_xdp_shrink.sh
+# The peer must accept the larger MTU, the replies themselves are
+# mangled by the program and dropped by the stack.
+
+# Ethernet frame of PAGE_SIZE minus the padded virtio header (16 bytes)
+FRAME=$(($(getconf PAGESIZE) - 16))
+MTU=$((FRAME - 14))
+PAYLOAD=$((MTU - 28))
+
+if [ -z "$VIRTIO_IF" ] || [ -z "$VIRTIO_PEER" ]; then
+	echo "selftests: test_xdp_shrink [SKIP] VIRTIO_IF and VIRTIO_PEER not set"
+	exit 0
+fi
+if [ "$(basename "$(readlink /sys/class/net/$VIRTIO_IF/device/driver)")" != \
+     "virtio_net" ]; then
+	echo "selftests: test_xdp_shrink [SKIP] $VIRTIO_IF is not a virtio_net device"
+	exit 0
+fi
+
+old_mtu=$(cat /sys/class/net/$VIRTIO_IF/mtu)
+
+cleanup()
+{
+	if [ "$?" = "0" ]; then
+		echo "selftests: test_xdp_shrink [PASS]";
+	else
+		echo "selftests: test_xdp_shrink [FAILED]";
+	fi
+
+	set +e
+	ip link set dev $VIRTIO_IF xdp off 2> /dev/null
+	ip link set dev $VIRTIO_IF mtu $old_mtu 2> /dev/null
+}
+
+set -e
+trap cleanup 0 2 3 6 9
+
+ip link set dev $VIRTIO_IF mtu $MTU
+ip link set dev $VIRTIO_IF xdp obj test_xdp_shrink.o sec xdp_shrink
+
+# The echo replies are shrunk to garbage, only the kernel has to survive
+ping -c 10 -i 0.2 -W 1 -M do -s $PAYLOAD $VIRTIO_PEER > /dev/null || true
+
+ip link set dev $VIRTIO_IF xdp off
+ip link set dev $VIRTIO_IF mtu $old_mtu
+ping -c 1 -W 1 $VIRTIO_PEER > /dev/null
+
+exit 0
@@ -0,0 +1,200 @@
+/*
+ * Test batched writes to a tap device (IFF_BATCH), with and without NAPI.
+ *
+ * A single write() carries several frames, each prefixed by its length.
+ * The frames must show up in order on a packet socket bound to the tap,
+ * and a malformed tail must not hold back the frames in front of it.
+ *
+ * Runs in its own network namespace.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_tun.h>
+#include <net/ethernet.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef IFF_NAPI
+#define IFF_NAPI	0x0010
+#endif
+
+#ifndef IFF_BATCH
+#define IFF_BATCH	0x0040
+#endif
+
+#define ETH_P_TEST	0x88b5
+#define NUM_FRAMES	16
+#define FRAME_LEN	64
+
+static int tap_open(const char *name, int flags)
+{
+	struct ifreq ifr;
+	int fd, features;
+
+	fd = open("/dev/net/tun", O_RDWR);
+	if (fd < 0)
+		error(1, errno, "open /dev/net/tun");
+
+	if (ioctl(fd, TUNGETFEATURES, &features))
+		error(1, errno, "TUNGETFEATURES");
+	if ((features & flags) != flags) {
+		fprintf(stderr, "tap does not support flags 0x%x, skip\n",
+			flags);
+		exit(4);
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI | flags;
+	if (ioctl(fd, TUNSETIFF, &ifr))
+		error(1, errno, "TUNSETIFF");
+
+	return fd;
+}
+
+static int link_up(const char *name)
+{
+	struct ifreq ifr;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+	if (ioctl(fd, SIOCGIFFLAGS, &ifr))
+		error(1, errno, "SIOCGIFFLAGS");
+	ifr.ifr_flags |= IFF_UP;
+	if (ioctl(fd, SIOCSIFFLAGS, &ifr))
+		error(1, errno, "SIOCSIFFLAGS");
+	if (ioctl(fd, SIOCGIFINDEX, &ifr))
+		error(1, errno, "SIOCGIFINDEX");
+
+	close(fd);
+	return ifr.ifr_ifindex;
+}
+
+static int packet_open(int ifindex)
+{
+	struct sockaddr_ll sll = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_TEST),
+		.sll_ifindex = ifindex,
+	};
+	int fd;
+
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_TEST));
+	if (fd < 0)
+		error(1, errno, "socket packet");
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)))
+		error(1, errno, "bind packet");
+
+	return fd;
+}
+
+/* Build n frames, each prefixed by its 32 bit length, numbered from seq */
+static size_t build_batch(char *buf, int n, int seq)
+{
+	size_t off = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		struct ether_header *eth;
+		uint32_t len = FRAME_LEN;
+
+		memcpy(buf + off, &len, sizeof(len));
+		off += sizeof(len);
+
+		memset(buf + off, 0, FRAME_LEN);
+		eth = (struct ether_header *)(buf + off);
+		memset(eth->ether_dhost, 0xff, ETH_ALEN);
+		eth->ether_shost[0] = 0x02;
+		eth->ether_shost[5] = 0x01;
+		eth->ether_type = htons(ETH_P_TEST);
+		buf[off + sizeof(*eth)] = seq + i;
+		off += FRAME_LEN;
+	}
+
+	return off;
+}
+
+static void expect_frames(int fd, int n, int seq)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char frame[FRAME_LEN];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ssize_t ret;
+
+		if (poll(&pfd, 1, 1000) != 1)
+			error(1, 0, "frame %d of %d did not arrive", i, n);
+
+		ret = recv(fd, frame, sizeof(frame), 0);
+		if (ret != FRAME_LEN)
+			error(1, errno, "recv: %zd", ret);
+		if (frame[sizeof(struct ether_header)] != (char)(seq + i))
+			error(1, 0, "frame %d out of order", i);
+	}
+}
+
+static void test_batch(const char *name, int flags)
+{
+	char buf[NUM_FRAMES * (FRAME_LEN + sizeof(uint32_t)) + 8];
+	int tap, pkt, ifindex;
+	size_t len;
+	ssize_t ret;
+	uint32_t bad;
+
+	tap = tap_open(name, IFF_BATCH | flags);
+	ifindex = link_up(name);
+	pkt = packet_open(ifindex);
+
+	/* A full batch */
+	len = build_batch(buf, NUM_FRAMES, 0);
+	ret = write(tap, buf, len);
+	if (ret != len)
+		error(1, errno, "write batch: %zd != %zu", ret, len);
+	expect_frames(pkt, NUM_FRAMES, 0);
+
+	/* A batch whose last header runs past the end of the write */
+	len = build_batch(buf, 4, 32);
+	bad = FRAME_LEN;
+	memcpy(buf + len, &bad, sizeof(bad));
+	ret = write(tap, buf, len + sizeof(bad) + 1);
+	if (ret != len)
+		error(1, errno, "write short batch: %zd != %zu", ret, len);
+	expect_frames(pkt, 4, 32);
+
+	close(pkt);
+	close(tap);
+	fprintf(stderr, "%s: ok\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	if (unshare(CLONE_NEWNET)) {
+		fprintf(stderr, "unshare: %s, skip\n", strerror(errno));
+		return 4;
+	}
+
+	test_batch("tapbatch0", 0);
+	test_batch("tapbatch1", IFF_NAPI);
+
+	fprintf(stderr, "OK. All tests passed\n");
+	return 0;
+}
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Create many short-lived UDP flows as fast as possible, to put the
+ * conntrack insert, early drop and gc paths under pressure.
+ *
+ * Each thread sends one datagram per flow from its own socket, cycling
+ * through a range of destination ports, so that every (thread, port)
+ * pair is a separate conntrack entry on the receiver.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct sockaddr_in cfg_dst;
+static unsigned int cfg_flows = 65536;
+static unsigned int cfg_threads = 1;
+static unsigned int cfg_seconds = 5;
+static unsigned int cfg_port_min = 1024;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t	thread;
+	unsigned int	id;
+	unsigned long	sent;
+	unsigned long	errors;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct sockaddr_in dst = cfg_dst;
+	unsigned int per_thread, i = 0;
+	char byte = 0;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	per_thread = cfg_flows / cfg_threads;
+	if (!per_thread)
+		per_thread = 1;
+
+	while (!stop) {
+		dst.sin_port = htons(cfg_port_min + (i++ % per_thread));
+		if (sendto(fd, &byte, sizeof(byte), MSG_DONTWAIT,
+			   (struct sockaddr *)&dst, sizeof(dst)) < 0) {
+			if (errno != EAGAIN && errno != ENOBUFS &&
+			    errno != ECONNREFUSED && errno != EPERM) {
+				perror("sendto");
+				exit(1);
+			}
+			w->errors++;
+			continue;
+		}
+		w->sent++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -d <ipv4 address> [-n flows] [-t threads] [-s seconds] [-p first port]\n",
+		prog);
+	exit(1);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	bool have_dst = false;
+	int c;
+
+	cfg_dst.sin_family = AF_INET;
+
+	while ((c = getopt(argc, argv, "d:n:t:s:p:")) != -1) {
+		switch (c) {
+		case 'd':
+			if (inet_pton(AF_INET, optarg, &cfg_dst.sin_addr) != 1)
+				usage(argv[0]);
+			have_dst = true;
+			break;
+		case 'n':
+			cfg_flows = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port_min = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!have_dst || !cfg_threads || !cfg_flows ||
+	    cfg_port_min + cfg_flows / cfg_threads > 65536)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long sent = 0, errors = 0;
+	struct worker *workers;
+	unsigned int i;
+
+	parse_opts(argc, argv);
+
+	workers = calloc(cfg_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < cfg_threads; i++) {
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(cfg_seconds);
+	stop = true;
+
+	for (i = 0; i < cfg_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		sent += workers[i].sent;
+		errors += workers[i].errors;
+	}
+
+	printf("sent %lu packets (%lu pps), %lu send errors\n",
+	       sent, sent / cfg_seconds, errors);
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,185 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Stress conntrack with many short-lived UDP flows, from ns1 to ns2:
+#
+# ns1 <-----------> ns2
+#     veth0     veth0
+#
+# ns2 tracks connections with a table limit well below the number of
+# flows sent, so that inserts have to make room by early drop of
+# unassured entries.  Checks that:
+#   - the table stays within nf_conntrack_max,
+#   - new flows are not dropped for lack of space,
+#   - gc reaps all entries once they time out.
+#
+# Per-cpu statistics from /proc/net/stat/nf_conntrack (insert latency,
+# gc and early drop counters) are reported at the end.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+flows=65536
+threads=$(nproc)
+duration=5
+max=8192
+
+while getopts "n:t:d:m:" o; do
+	case $o in
+	n) flows=$OPTARG ;;
+	t) threads=$OPTARG ;;
+	d) duration=$OPTARG ;;
+	m) max=$OPTARG ;;
+	*) echo "Usage: $0 [-n flows] [-t threads] [-d seconds] [-m max]"; exit 1 ;;
+	esac
+done
+
+stress=$(dirname $0)/conntrack_stress
+if [ ! -x "$stress" ]; then
+	echo "SKIP: conntrack_stress not built"
+	exit $ksft_skip
+fi
+
+nft --version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without nft tool"
+	exit $ksft_skip
+fi
+
+ip -Version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+ip netns add ns1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+ip netns add ns2
+
+old_max=$(cat /proc/sys/net/netfilter/nf_conntrack_max 2>/dev/null)
+
+cleanup() {
+	ip netns del ns1
+	ip netns del ns2
+	[ -n "$old_max" ] && echo $old_max > /proc/sys/net/netfilter/nf_conntrack_max
+}
+
+trap cleanup EXIT
+
+ip link add veth0 netns ns1 type veth peer name veth0 netns ns2
+for ns in ns1 ns2; do
+	ip -net $ns link set lo up
+	ip -net $ns link set veth0 up
+done
+ip -net ns1 addr add 10.0.1.1/24 dev veth0
+ip -net ns2 addr add 10.0.1.2/24 dev veth0
+
+ip netns exec ns2 nft -f - <<EOF
+table ip filter {
+	chain input {
+		type filter hook input priority 0; policy accept;
+		ct state new counter
+	}
+
+	# nobody listens, keep the flows one-way
+	chain output {
+		type filter hook output priority 0; policy accept;
+		icmp type destination-unreachable drop
+	}
+}
+EOF
+if [ $? -ne 0 ]; then
+	echo "SKIP: Could not load ruleset"
+	exit $ksft_skip
+fi
+
+# nf_conntrack_max is global, the udp timeout is per namespace.
+echo $max > /proc/sys/net/netfilter/nf_conntrack_max
+ip netns exec ns2 sysctl -q net.netfilter.nf_conntrack_udp_timeout=5
+
+ct_count() {
+	ip netns exec ns2 cat /proc/sys/net/netfilter/nf_conntrack_count
+}
+
+# Sum a column of /proc/net/stat/nf_conntrack in ns2 over all cpus, the
+# insert latency is averaged instead.
+ct_stat() {
+	local i c=0 n=0 sum=0 fields
+
+	while read -a fields; do
+		if [ $c -eq 0 ]; then
+			for i in ${!fields[@]}; do
+				[ "${fields[$i]}" = "$1" ] && c=$((i + 1))
+			done
+			[ $c -eq 0 ] && break
+			continue
+		fi
+		sum=$((sum + 0x${fields[$((c - 1))]}))
+		n=$((n + 1))
+	done < <(ip netns exec ns2 cat /proc/net/stat/nf_conntrack)
+
+	[ "$1" = "insert_lat" ] && [ $n -gt 0 ] && sum=$((sum / n))
+	echo $sum
+}
+
+if ! ip netns exec ns2 head -1 /proc/net/stat/nf_conntrack | grep -q gc_scanned; then
+	echo "SKIP: kernel lacks conntrack gc statistics"
+	exit $ksft_skip
+fi
+
+# Watch the table size while the flood runs
+peak=0
+ip netns exec ns1 $stress -d 10.0.1.2 -n $flows -t $threads -s $duration &
+pid=$!
+while kill -0 $pid 2>/dev/null; do
+	count=$(ct_count)
+	[ $count -gt $peak ] && peak=$count
+	sleep 0.2
+done
+wait $pid || ret=1
+
+# The limit is checked before early drop, allow one in-flight insert per cpu
+if [ $peak -gt $((max + $(nproc))) ]; then
+	echo "FAIL: table grew to $peak entries, limit is $max"
+	ret=1
+fi
+
+drop=$(ct_stat drop)
+early_drop=$(ct_stat early_drop)
+insert_failed=$(ct_stat insert_failed)
+
+# Unassured udp entries can always be evicted, packets should not be
+# dropped for lack of space.
+if [ $early_drop -eq 0 ]; then
+	echo "FAIL: no early drops with $flows flows and a limit of $max"
+	ret=1
+fi
+if [ $drop -gt 0 ]; then
+	echo "FAIL: $drop packets dropped, table full"
+	ret=1
+fi
+
+# Everything times out after 5 seconds, gc must notice within a few more
+# as it speeds up while most of what it scans has expired.
+for i in $(seq 1 30); do
+	count=$(ct_count)
+	[ $count -eq 0 ] && break
+	sleep 1
+done
+if [ $count -ne 0 ]; then
+	echo "FAIL: $count entries left after timeout"
+	ret=1
+fi
+
+echo "peak $peak/$max entries, early_drop $early_drop (hinted $(ct_stat early_drop_hint)), drop $drop, insert_failed $insert_failed"
+echo "gc scanned $(ct_stat gc_scanned) expired $(ct_stat gc_expired) early_drop $(ct_stat gc_early_drop), avg insert latency $(ct_stat insert_lat) ns"
+
+if [ $ret -eq 0 ]; then
+	echo "PASS: conntrack stress, $flows flows, $threads threads"
+fi
+
+exit $ret
@@ -0,0 +1,290 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check and benchmark sets matching ranges over concatenated fields
+# (nft_set_pipapo), e.g. destination address range . destination port range.
+#
+# Packets are sent from ns1 to ns2 over a veth pair, classification happens
+# in the prerouting chain of ns2:
+#
+# ns1 <-----------> ns2
+#     veth0     veth0
+#
+# The correctness part sends packets inside and outside of the inserted
+# ranges, also after deleting some elements, and checks the rule counter.
+#
+# With -p, pktgen is used to measure packet rate with the same N entries
+# (10000 by default) as:
+#   - a concatenated range set (pipapo),
+#   - an interval set on the address alone (rbtree), for reference,
+#   - N linear rules, as policies would be written without such sets.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+perf=0
+entries=10000
+duration=5
+
+while getopts "pn:d:" o; do
+	case $o in
+	p) perf=1 ;;
+	n) entries=$OPTARG ;;
+	d) duration=$OPTARG ;;
+	*) echo "Usage: $0 [-p] [-n entries] [-d seconds]"; exit 1 ;;
+	esac
+done
+
+nft --version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without nft tool"
+	exit $ksft_skip
+fi
+
+ip -Version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+ip netns add ns1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+ip netns add ns2
+
+tmp=$(mktemp)
+
+cleanup() {
+	ip netns del ns1
+	ip netns del ns2
+	rm -f "$tmp"
+}
+
+trap cleanup EXIT
+
+ip link add veth0 netns ns1 type veth peer name veth0 netns ns2
+for ns in ns1 ns2; do
+	ip -net $ns link set lo up
+	ip -net $ns link set veth0 up
+done
+ip -net ns1 addr add 192.168.1.1/24 dev veth0
+ip -net ns2 addr add 192.168.1.2/24 dev veth0
+
+# Everything goes to ns2, addresses in the ranges are not local there.
+ip -net ns1 route add 10.0.0.0/8 via 192.168.1.2
+
+nft_ns2() {
+	ip netns exec ns2 nft "$@"
+}
+
+# Element i: 10.(i / 256).(i % 256).0-127 . ((i % 60) * 1000 + 1)-+999
+elem_addr() {
+	echo "10.$(($1 / 256)).$(($1 % 256))"
+}
+
+elem_port() {
+	echo $((($1 % 60) * 1000 + 1))
+}
+
+setup_set() {
+	nft_ns2 -f - <<EOF
+table ip filter {
+	set test {
+		type ipv4_addr . inet_service
+		flags interval
+	}
+
+	chain prerouting {
+		type filter hook prerouting priority 0; policy accept;
+		ip protocol udp counter
+		ip daddr . udp dport @test counter drop
+	}
+}
+EOF
+}
+
+matched() {
+	nft_ns2 list chain ip filter prerouting | \
+		grep '@test' | sed 's/.*packets \([0-9]*\).*/\1/'
+}
+
+send_udp() {
+	ip netns exec ns1 bash -c "echo -n x > /dev/udp/$1/$2" 2>/dev/null
+}
+
+check_send() {
+	local addr=$1 port=$2 expect=$3 before after
+
+	before=$(matched)
+	send_udp $addr $port
+	sleep 0.1
+	after=$(matched)
+
+	if [ $((after - before)) -ne $expect ]; then
+		echo "FAIL: $addr . $port: matched $((after - before)), expected $expect"
+		ret=1
+	fi
+}
+
+test_correctness() {
+	local i a p n=64
+
+	setup_set
+	if [ $? -ne 0 ]; then
+		echo "SKIP: nft or kernel lack support for concatenated ranges"
+		exit $ksft_skip
+	fi
+
+	for ((i = 0; i < n; i++)); do
+		echo "add element ip filter test { $(elem_addr $i).0-$(elem_addr $i).127 . $(elem_port $i)-$(($(elem_port $i) + 999)) }"
+	done > "$tmp"
+	nft_ns2 -f "$tmp" || { echo "FAIL: insertion"; exit 1; }
+
+	# Overlapping element must be rejected
+	nft_ns2 add element ip filter test { 10.0.0.64-10.0.0.200 . 1-2000 } 2>/dev/null
+	if [ $? -eq 0 ]; then
+		echo "FAIL: overlapping element accepted"
+		ret=1
+	fi
+
+	for i in 0 1 17 63; do
+		a=$(elem_addr $i); p=$(elem_port $i)
+		check_send $a.0 $p 1
+		check_send $a.127 $((p + 999)) 1
+		check_send $a.42 $((p + 500)) 1
+		check_send $a.128 $p 0
+		check_send $a.0 $((p + 1000)) 0
+	done
+	check_send 10.1.0.1 1 0
+
+	nft_ns2 delete element ip filter test { $(elem_addr 17).0-$(elem_addr 17).127 . $(elem_port 17)-$(($(elem_port 17) + 999)) }
+	check_send $(elem_addr 17).42 $(($(elem_port 17) + 500)) 0
+	check_send $(elem_addr 16).42 $(($(elem_port 16) + 500)) 1
+	check_send $(elem_addr 18).42 $(($(elem_port 18) + 500)) 1
+
+	# Nested entries: a packet in the inner one matches both, and the
+	# leftover match must not leak into the lookup of the next packets
+	nft_ns2 add element ip filter test { 10.1.1.16-10.1.1.31 . 500-600 }
+	nft_ns2 add element ip filter test { 10.1.1.0-10.1.1.255 . 1-1000 }
+	for i in 1 2 3; do
+		check_send 10.1.1.20 550 1
+		check_send 10.1.2.20 550 0
+		check_send 10.1.1.20 2000 0
+		check_send $(elem_addr 16).200 $(elem_port 16) 0
+	done
+	check_send 10.1.1.200 900 1
+
+	nft_ns2 flush set ip filter test
+	check_send $(elem_addr 0).0 $(elem_port 0) 0
+
+	nft_ns2 flush ruleset
+
+	if [ $ret -eq 0 ]; then
+		echo "PASS: concatenated ranges, $n entries"
+	fi
+}
+
+# Fill $tmp with the ruleset for a given setup, with $entries entries
+gen_ruleset() {
+	local i
+
+	echo "table ip filter {"
+	case $1 in
+	pipapo)
+		echo "set test { type ipv4_addr . inet_service; flags interval; elements = {"
+		for ((i = 0; i < entries; i++)); do
+			echo "$(elem_addr $i).0-$(elem_addr $i).127 . $(elem_port $i)-$(($(elem_port $i) + 999)),"
+		done
+		echo "} }"
+		;;
+	rbtree)
+		echo "set test { type ipv4_addr; flags interval; elements = {"
+		for ((i = 0; i < entries; i++)); do
+			echo "$(elem_addr $i).0-$(elem_addr $i).127,"
+		done
+		echo "} }"
+		;;
+	esac
+
+	echo "chain prerouting { type filter hook prerouting priority 0; policy accept;"
+	echo "ip protocol udp counter"
+	case $1 in
+	pipapo)
+		echo "ip daddr . udp dport @test counter drop"
+		;;
+	rbtree)
+		echo "ip daddr @test counter drop"
+		;;
+	linear)
+		for ((i = 0; i < entries; i++)); do
+			echo "ip daddr $(elem_addr $i).0-$(elem_addr $i).127 udp dport $(elem_port $i)-$(($(elem_port $i) + 999)) counter drop"
+		done
+		;;
+	esac
+	echo "} }"
+}
+
+pgset() {
+	ip netns exec ns1 bash -c "echo '$1' > $2"
+}
+
+perf_run() {
+	local total mac pg=/proc/net/pktgen
+
+	gen_ruleset $1 > "$tmp"
+	nft_ns2 -f "$tmp"
+	if [ $? -ne 0 ]; then
+		echo "SKIP: $1 setup failed"
+		return
+	fi
+
+	mac=$(ip -net ns2 link show veth0 | awk '/ether/ { print $2 }')
+
+	pgset "rem_device_all" $pg/kpktgend_0
+	pgset "add_device veth0" $pg/kpktgend_0
+	pgset "count 0" $pg/veth0
+	pgset "pkt_size 64" $pg/veth0
+	pgset "dst_mac $mac" $pg/veth0
+	pgset "src_min 192.168.1.1" $pg/veth0
+	pgset "src_max 192.168.1.1" $pg/veth0
+	pgset "dst_min 10.0.0.0" $pg/veth0
+	pgset "dst_max 10.$((entries / 256)).255.255" $pg/veth0
+	pgset "udp_dst_min 1" $pg/veth0
+	pgset "udp_dst_max 60000" $pg/veth0
+	pgset "flag IPDST_RND" $pg/veth0
+	pgset "flag UDPDST_RND" $pg/veth0
+
+	ip netns exec ns1 bash -c "echo start > $pg/pgctrl" &
+	sleep $duration
+	pgset "stop" $pg/pgctrl
+	wait
+
+	total=$(nft_ns2 list chain ip filter prerouting | \
+		grep -m1 'ip protocol udp counter' | \
+		sed 's/.*packets \([0-9]*\).*/\1/')
+
+	printf "%-8s %8d entries: %10d pps\n" $1 $entries \
+		$((total / duration))
+
+	nft_ns2 flush ruleset
+}
+
+test_perf() {
+	ip netns exec ns1 test -d /proc/net/pktgen || modprobe pktgen
+	if ! ip netns exec ns1 test -d /proc/net/pktgen; then
+		echo "SKIP: pktgen not available"
+		return
+	fi
+
+	for t in pipapo rbtree linear; do
+		perf_run $t
+	done
+}
+
+test_correctness
+[ $perf -eq 1 ] && test_perf
+
+exit $ret
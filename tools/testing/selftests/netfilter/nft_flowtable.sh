@@ -0,0 +1,169 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# This tests basic flowtable functionality.
+# Creates following topology:
+#
+# originator         forwarder          responder
+# ns1 <-----------> nsr1 <-----------> ns2
+#     veth0     veth0      veth1     veth0
+#
+# Established connections are pushed into the flowtable by the
+# "flow offload" rule in the forward chain of nsr1, so that the
+# remaining packets bypass the classic forwarding path.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+nft --version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without nft tool"
+	exit $ksft_skip
+fi
+
+ip -Version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+which nc > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without nc (netcat)"
+	exit $ksft_skip
+fi
+
+ip netns add nsr1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+
+ip netns add ns1
+ip netns add ns2
+
+cleanup() {
+	ip netns del ns1
+	ip netns del ns2
+	ip netns del nsr1
+	rm -f "$ns1in" "$ns2out"
+}
+
+trap cleanup EXIT
+
+ip link add veth0 netns nsr1 type veth peer name eth0 netns ns1
+ip link add veth1 netns nsr1 type veth peer name eth0 netns ns2
+
+for dev in lo veth0 veth1; do
+	ip -net nsr1 link set $dev up
+done
+
+ip -net nsr1 addr add 10.0.1.1/24 dev veth0
+ip -net nsr1 addr add dead:1::1/64 dev veth0
+ip -net nsr1 addr add 10.0.2.1/24 dev veth1
+ip -net nsr1 addr add dead:2::1/64 dev veth1
+
+ip netns exec nsr1 sysctl net.ipv4.conf.all.forwarding=1 > /dev/null
+ip netns exec nsr1 sysctl net.ipv6.conf.all.forwarding=1 > /dev/null
+
+for i in 1 2; do
+	ip -net ns$i link set lo up
+	ip -net ns$i link set eth0 up
+
+	ip -net ns$i addr add 10.0.$i.99/24 dev eth0
+	ip -net ns$i route add default via 10.0.$i.1
+	ip -net ns$i addr add dead:$i::99/64 dev eth0
+	ip -net ns$i route add default via dead:$i::1
+done
+
+ip netns exec nsr1 nft -f - <<EOF2
+table inet filter {
+	flowtable f1 {
+		hook ingress priority 0
+		devices = { veth0, veth1 }
+	}
+
+	chain forward {
+		type filter hook forward priority 0; policy drop;
+
+		meta oif "veth1" tcp dport 12345 flow offload @f1 counter
+
+		# flows that leave the flowtable again are seen here.
+		ct state established,related accept
+
+		meta nfproto ipv4 meta l4proto icmp accept
+		meta nfproto ipv6 meta l4proto icmpv6 accept
+	}
+}
+EOF2
+if [ $? -ne 0 ]; then
+	echo "SKIP: Could not load nft ruleset with flowtable"
+	exit $ksft_skip
+fi
+
+# the ruleset must be listed back with its flowtable.
+ip netns exec nsr1 nft list flowtables inet > /dev/null
+if [ $? -ne 0 ]; then
+	echo "FAIL: cannot list flowtables"
+	ret=1
+fi
+
+# a device can only be part of one flowtable.
+ip netns exec nsr1 nft add flowtable inet filter f2 \
+	{ hook ingress priority 10\; devices = { veth0 }\; } 2>/dev/null
+if [ $? -eq 0 ]; then
+	echo "FAIL: veth0 was added to a second flowtable"
+	ret=1
+fi
+
+# the flowtable is in use by the offload rule.
+ip netns exec nsr1 nft delete flowtable inet filter f1 2>/dev/null
+if [ $? -eq 0 ]; then
+	echo "FAIL: flowtable in use could be deleted"
+	ret=1
+fi
+
+ns1in=$(mktemp)
+ns2out=$(mktemp)
+
+dd if=/dev/urandom of="$ns1in" bs=1M count=4 2> /dev/null
+
+test_tcp_forwarding()
+{
+	local daddr=$1
+
+	ip netns exec ns2 nc -w 5 -l -p 12345 > "$ns2out" &
+	local lpid=$!
+
+	sleep 1
+	ip netns exec ns1 nc -w 5 $daddr 12345 < "$ns1in"
+	wait $lpid
+
+	cmp "$ns1in" "$ns2out" > /dev/null 2>&1
+	if [ $? -ne 0 ]; then
+		echo "FAIL: file mismatch for $daddr"
+		return 1
+	fi
+
+	echo "PASS: flow offloaded for $daddr"
+	return 0
+}
+
+test_tcp_forwarding 10.0.2.99 || ret=1
+test_tcp_forwarding dead:2::99 || ret=1
+
+# offloaded flows stop hitting the counter after the first packets, a
+# fully forwarded 4MB transfer would need several thousand packets.
+packets=$(ip netns exec nsr1 nft list chain inet filter forward | \
+	  awk '/flow offload/ { for (i = 1; i < NF; i++) if ($i == "packets") print $(i + 1) }')
+if [ -n "$packets" ] && [ "$packets" -gt 1000 ]; then
+	echo "FAIL: $packets packets took the slow path"
+	ret=1
+fi
+
+# removing a flowtable device must not leave a stale hook behind.
+ip -net nsr1 link del veth1
+ip netns exec nsr1 nft list flowtables inet > /dev/null || ret=1
+
+exit $ret
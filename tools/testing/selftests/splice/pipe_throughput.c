@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Pipe throughput for the ways data gets in and out of a pipe:
+ *
+ *   write    - write() into the pipe, read() out of it
+ *   vmsplice - vmsplice() page-aligned buffers with SPLICE_F_GIFT,
+ *              splice() them out to /dev/null
+ *   sendfile - sendfile() a file to /dev/null, through the internal pipe
+ *
+ * Usage: pipe_throughput [-m mode] [-s total MB] [-c chunk KB] [-p pipe KB]
+ */
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+static size_t total_mb = 1024;
+static size_t chunk_kb = 256;
+static size_t pipe_kb;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *mode, size_t bytes, double secs)
+{
+	printf("%-8s %6zu MB in %.3f s: %9.1f MB/s (chunk %zu KB, pipe %zu KB)\n",
+	       mode, bytes >> 20, secs, (bytes >> 20) / secs, chunk_kb,
+	       pipe_kb);
+}
+
+static char *alloc_chunk(size_t len)
+{
+	char *buf;
+
+	if (posix_memalign((void **)&buf, sysconf(_SC_PAGESIZE), len))
+		errx(1, "posix_memalign");
+	memset(buf, 'p', len);
+	return buf;
+}
+
+static void set_pipe_size(int fd)
+{
+	int size;
+
+	if (pipe_kb && fcntl(fd, F_SETPIPE_SZ, pipe_kb << 10) < 0)
+		err(1, "F_SETPIPE_SZ");
+	size = fcntl(fd, F_GETPIPE_SZ);
+	if (size < 0)
+		err(1, "F_GETPIPE_SZ");
+	pipe_kb = size >> 10;
+}
+
+static void reader(int fd, int splice_out)
+{
+	size_t len = chunk_kb << 10;
+	char *buf = NULL;
+	int null = -1;
+	ssize_t ret;
+
+	if (splice_out) {
+		null = open("/dev/null", O_WRONLY);
+		if (null < 0)
+			err(1, "open /dev/null");
+	} else {
+		buf = alloc_chunk(len);
+	}
+
+	for (;;) {
+		if (splice_out)
+			ret = splice(fd, NULL, null, NULL, len, SPLICE_F_MOVE);
+		else
+			ret = read(fd, buf, len);
+		if (ret < 0)
+			err(1, splice_out ? "splice" : "read");
+		if (!ret)
+			break;
+	}
+	_exit(0);
+}
+
+static void writer(int fd, int gift)
+{
+	size_t len = chunk_kb << 10, left = total_mb << 20;
+	unsigned int i, nbufs = 1, next = 0;
+	char **bufs;
+	ssize_t ret;
+
+	/*
+	 * Gifted pages are never written again. Once a pipe's worth of
+	 * data has followed a buffer, the reader is done with it and the
+	 * buffer can be gifted once more, as is.
+	 */
+	if (gift)
+		nbufs = (pipe_kb + chunk_kb - 1) / chunk_kb + 2;
+	bufs = calloc(nbufs, sizeof(*bufs));
+	if (!bufs)
+		err(1, "calloc");
+	for (i = 0; i < nbufs; i++)
+		bufs[i] = alloc_chunk(len);
+
+	while (left) {
+		size_t n = left < len ? left : len;
+		char *buf = bufs[next];
+
+		next = (next + 1) % nbufs;
+		if (gift) {
+			struct iovec iov = {
+				.iov_base = buf,
+				.iov_len = n,
+			};
+
+			while (iov.iov_len) {
+				ret = vmsplice(fd, &iov, 1, SPLICE_F_GIFT);
+				if (ret < 0)
+					err(1, "vmsplice");
+				iov.iov_base = (char *)iov.iov_base + ret;
+				iov.iov_len -= ret;
+			}
+			ret = n;
+		} else {
+			ret = write(fd, buf, n);
+			if (ret < 0)
+				err(1, "write");
+		}
+		left -= ret;
+	}
+
+	for (i = 0; i < nbufs; i++)
+		free(bufs[i]);
+	free(bufs);
+}
+
+static void run_pipe(const char *mode, int gift)
+{
+	int fds[2], status;
+	double start;
+	pid_t pid;
+
+	if (pipe(fds))
+		err(1, "pipe");
+	set_pipe_size(fds[1]);
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (!pid) {
+		close(fds[1]);
+		reader(fds[0], gift);
+	}
+	close(fds[0]);
+
+	start = now();
+	writer(fds[1], gift);
+	close(fds[1]);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		errx(1, "reader failed");
+	report(mode, total_mb << 20, now() - start);
+}
+
+static void run_sendfile(void)
+{
+	char path[] = "/tmp/pipe_throughput.XXXXXX";
+	size_t len = chunk_kb << 10, left;
+	int fd, null;
+	double start;
+	char *buf;
+	ssize_t ret;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		err(1, "mkstemp");
+	unlink(path);
+
+	buf = alloc_chunk(len);
+	for (left = total_mb << 20; left; left -= ret) {
+		ret = write(fd, buf, left < len ? left : len);
+		if (ret <= 0)
+			err(1, "write");
+	}
+	free(buf);
+
+	null = open("/dev/null", O_WRONLY);
+	if (null < 0)
+		err(1, "open /dev/null");
+
+	/* the page cache is warm, this only measures the splice path */
+	start = now();
+	if (lseek(fd, 0, SEEK_SET))
+		err(1, "lseek");
+	for (left = total_mb << 20; left; left -= ret) {
+		ret = sendfile(null, fd, NULL, left < len ? left : len);
+		if (ret <= 0)
+			err(1, "sendfile");
+	}
+	report("sendfile", total_mb << 20, now() - start);
+
+	close(null);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:s:c:p:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mode = optarg;
+			break;
+		case 's':
+			total_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			chunk_kb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pipe_kb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-m write|vmsplice|sendfile] [-s MB] [-c KB] [-p KB]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (!total_mb || !chunk_kb)
+		errx(1, "size and chunk must not be zero");
+
+	if (!mode || !strcmp(mode, "write"))
+		run_pipe("write", 0);
+	if (!mode || !strcmp(mode, "vmsplice"))
+		run_pipe("vmsplice", 1);
+	if (!mode || !strcmp(mode, "sendfile"))
+		run_sendfile();
+
+	return 0;
+}